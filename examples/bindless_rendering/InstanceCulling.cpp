@@ -0,0 +1,312 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "InstanceCulling.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace donut::math;
+
+#include "bindless_rendering_cb.h"
+
+FrustumPlanes GetFrustumPlanes(const float4x4& m)
+{
+    // Row-vector convention: clip = float4(p, 1) * m, so every clip coordinate is a dot product with a column.
+    // The D3D clip volume is -w <= x <= w, -w <= y <= w, 0 <= z <= w.
+    auto column = [&m](int j) { return float4(m[0][j], m[1][j], m[2][j], m[3][j]); };
+
+    const float4 x = column(0);
+    const float4 y = column(1);
+    const float4 z = column(2);
+    const float4 w = column(3);
+
+    FrustumPlanes planes = { w + x, w - x, w + y, w - y, z, w - z };
+
+    for (float4& plane : planes)
+    {
+        float normalLength = length(plane.xyz());
+        if (normalLength > 1e-6f)
+            plane /= normalLength;
+        else
+            plane = float4(0.f, 0.f, 0.f, 1.f);
+    }
+
+    return planes;
+}
+
+static float3 TransformPoint(const float transform[12], const float3& p)
+{
+    return float3(
+        transform[0] * p.x + transform[1] * p.y + transform[2] * p.z + transform[3],
+        transform[4] * p.x + transform[5] * p.y + transform[6] * p.z + transform[7],
+        transform[8] * p.x + transform[9] * p.y + transform[10] * p.z + transform[11]);
+}
+
+// World space center and half size of the transformed bounds of a draw, like cs_cull
+static void GetWorldBox(const DrawRecord& record, const float transform[12], float3& worldCenter, float3& worldExtent)
+{
+    const float3 objectCenter = (record.boundsMin + record.boundsMax) * 0.5f;
+    const float3 objectExtent = (record.boundsMax - record.boundsMin) * 0.5f;
+
+    float extent[3];
+    for (int row = 0; row < 3; row++)
+    {
+        const float* r = transform + row * 4;
+        extent[row] = std::abs(r[0]) * objectExtent.x + std::abs(r[1]) * objectExtent.y + std::abs(r[2]) * objectExtent.z;
+    }
+
+    worldCenter = TransformPoint(transform, objectCenter);
+    worldExtent = float3(extent[0], extent[1], extent[2]);
+}
+
+DrawVisibility TestDrawVisibility(const DrawRecord& record, const float transform[12], const FrustumPlanes& planes, float tolerance)
+{
+    float3 worldCenter, worldExtent;
+    GetWorldBox(record, transform, worldCenter, worldExtent);
+
+    DrawVisibility result = DrawVisibility::Visible;
+
+    for (const float4& plane : planes)
+    {
+        const float3 normal = plane.xyz();
+        const float distance = dot(normal, worldCenter) + plane.w + dot(abs(normal), worldExtent);
+
+        if (distance < -tolerance)
+            return DrawVisibility::Culled;
+
+        if (distance < tolerance)
+            result = DrawVisibility::Borderline;
+    }
+
+    return result;
+}
+
+uint32_t DepthPyramid::GetNumLevels(uint32_t width, uint32_t height)
+{
+    uint32_t numLevels = 1;
+    while ((std::max(width, height) >> numLevels) != 0)
+        numLevels++;
+    return numLevels;
+}
+
+void DepthPyramid::Build(const float* depth, uint32_t width, uint32_t height, size_t rowPitch)
+{
+    m_Levels.resize(GetNumLevels(width, height));
+
+    Level& base = m_Levels[0];
+    base.width = width;
+    base.height = height;
+    base.texels.resize(size_t(width) * height);
+    for (uint32_t y = 0; y < height; y++)
+        std::copy(depth + y * rowPitch, depth + y * rowPitch + width, base.texels.begin() + size_t(y) * width);
+
+    for (uint32_t levelIndex = 1; levelIndex < uint32_t(m_Levels.size()); levelIndex++)
+    {
+        const Level& source = m_Levels[levelIndex - 1];
+        Level& dest = m_Levels[levelIndex];
+        dest.width = std::max(width >> levelIndex, 1u);
+        dest.height = std::max(height >> levelIndex, 1u);
+        dest.texels.resize(size_t(dest.width) * dest.height);
+
+        for (uint32_t y = 0; y < dest.height; y++)
+        {
+            // The last row and column also cover the odd texels of the source level
+            const uint32_t firstY = std::min(y * 2, source.height - 1);
+            const uint32_t lastY = (y == dest.height - 1) ? source.height - 1 : std::min(y * 2 + 1, source.height - 1);
+
+            for (uint32_t x = 0; x < dest.width; x++)
+            {
+                const uint32_t firstX = std::min(x * 2, source.width - 1);
+                const uint32_t lastX = (x == dest.width - 1) ? source.width - 1 : std::min(x * 2 + 1, source.width - 1);
+
+                float result = 1.f;
+                for (uint32_t sy = firstY; sy <= lastY; sy++)
+                {
+                    for (uint32_t sx = firstX; sx <= lastX; sx++)
+                        result = std::min(result, source.texels[size_t(sy) * source.width + sx]);
+                }
+
+                dest.texels[size_t(y) * dest.width + x] = result;
+            }
+        }
+    }
+}
+
+float DepthPyramid::Load(uint32_t level, uint32_t x, uint32_t y) const
+{
+    const Level& source = m_Levels[level];
+    return source.texels[size_t(y) * source.width + x];
+}
+
+// The part of IsBoxOccluded after the projection, with the screen rectangle in pixels of level 0
+static bool IsRectOccluded(const DepthPyramid& pyramid, float2 minPixelPos, float2 maxPixelPos, float maxDepth)
+{
+    const uint32_t width = pyramid.GetWidth();
+    const uint32_t height = pyramid.GetHeight();
+
+    auto toPixel = [](float pos, uint32_t size) { return std::min(uint32_t(std::max(pos, 0.f)), size - 1); };
+    const uint32_t minX = toPixel(minPixelPos.x, width);
+    const uint32_t minY = toPixel(minPixelPos.y, height);
+    const uint32_t maxX = toPixel(maxPixelPos.x, width);
+    const uint32_t maxY = toPixel(maxPixelPos.y, height);
+
+    const uint32_t maxExtent = std::max(maxX - minX + 1, maxY - minY + 1);
+    uint32_t level = 0;
+    while ((1u << level) < maxExtent)
+        level++;
+    level = std::min(level, pyramid.GetNumLevels() - 1);
+
+    const uint32_t levelWidth = std::max(width >> level, 1u);
+    const uint32_t levelHeight = std::max(height >> level, 1u);
+
+    float pyramidDepth = 1.f;
+    for (uint32_t y = std::min(minY >> level, levelHeight - 1); y <= std::min(maxY >> level, levelHeight - 1); y++)
+    {
+        for (uint32_t x = std::min(minX >> level, levelWidth - 1); x <= std::min(maxX >> level, levelWidth - 1); x++)
+            pyramidDepth = std::min(pyramidDepth, pyramid.Load(level, x, y));
+    }
+
+    return maxDepth < pyramidDepth;
+}
+
+DrawVisibility TestDrawOcclusion(const DrawRecord& record, const float transform[12], const float4x4& worldToClip,
+    const DepthPyramid& pyramid, float depthTolerance, float pixelTolerance)
+{
+    float3 worldCenter, worldExtent;
+    GetWorldBox(record, transform, worldCenter, worldExtent);
+
+    float2 minUV = 1.f;
+    float2 maxUV = 0.f;
+    float maxDepth = 0.f;
+
+    for (uint32_t cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+    {
+        const float3 corner = worldCenter + worldExtent * float3(
+            (cornerIndex & 1) ? 1.f : -1.f,
+            (cornerIndex & 2) ? 1.f : -1.f,
+            (cornerIndex & 4) ? 1.f : -1.f);
+
+        const float4 clipPos = float4(corner, 1.f) * worldToClip;
+
+        if (clipPos.w <= 1e-5f)
+            return DrawVisibility::Visible;
+
+        const float3 ndc = clipPos.xyz() / clipPos.w;
+        const float2 uv = float2(ndc.x * 0.5f + 0.5f, ndc.y * -0.5f + 0.5f);
+        minUV = min(minUV, uv);
+        maxUV = max(maxUV, uv);
+        maxDepth = std::max(maxDepth, ndc.z);
+    }
+
+    const float2 size = float2(float(pyramid.GetWidth()), float(pyramid.GetHeight()));
+    const float2 minPixelPos = saturate(minUV) * size;
+    const float2 maxPixelPos = saturate(maxUV) * size;
+
+    // A larger rectangle and a nearer box can only make the draw visible, a smaller rectangle and a farther box occluded
+    const bool occludedWhenGrown = IsRectOccluded(pyramid, minPixelPos - pixelTolerance, maxPixelPos + pixelTolerance, maxDepth + depthTolerance);
+    const bool occludedWhenShrunk = IsRectOccluded(pyramid, min(minPixelPos + pixelTolerance, maxPixelPos), max(maxPixelPos - pixelTolerance, minPixelPos), maxDepth - depthTolerance);
+
+    if (occludedWhenGrown != occludedWhenShrunk)
+        return DrawVisibility::Borderline;
+
+    return occludedWhenGrown ? DrawVisibility::Culled : DrawVisibility::Visible;
+}
+
+void DepthRasterizer::Clear(uint32_t width, uint32_t height)
+{
+    m_Width = width;
+    m_Height = height;
+    m_Depth.assign(size_t(width) * height, 0.f);
+}
+
+void DepthRasterizer::DrawTriangles(const float transform[12], const float4x4& worldToClip,
+    const float3* positions, const uint32_t* indices, size_t numIndices)
+{
+    const float2 size = float2(float(m_Width), float(m_Height));
+
+    for (size_t index = 0; index + 2 < numIndices; index += 3)
+    {
+        float3 screen[3];
+        bool clipped = false;
+
+        for (int vertex = 0; vertex < 3; vertex++)
+        {
+            const float4 clipPos = float4(TransformPoint(transform, positions[indices[index + vertex]]), 1.f) * worldToClip;
+            if (clipPos.w <= 1e-5f)
+            {
+                clipped = true;
+                break;
+            }
+
+            const float3 ndc = clipPos.xyz() / clipPos.w;
+            screen[vertex] = float3((ndc.x * 0.5f + 0.5f) * size.x, (ndc.y * -0.5f + 0.5f) * size.y, ndc.z);
+        }
+
+        if (clipped)
+            continue;
+
+        // Both windings are rasterized, which gives the same depth as back face culling for closed meshes
+        float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+        if (std::abs(area) < 1e-8f)
+            continue;
+        if (area < 0.f)
+        {
+            std::swap(screen[1], screen[2]);
+            area = -area;
+        }
+
+        const int minX = std::max(int(std::floor(std::min({ screen[0].x, screen[1].x, screen[2].x }))), 0);
+        const int minY = std::max(int(std::floor(std::min({ screen[0].y, screen[1].y, screen[2].y }))), 0);
+        const int maxX = std::min(int(std::ceil(std::max({ screen[0].x, screen[1].x, screen[2].x }))), int(m_Width) - 1);
+        const int maxY = std::min(int(std::ceil(std::max({ screen[0].y, screen[1].y, screen[2].y }))), int(m_Height) - 1);
+
+        auto edge = [](const float3& a, const float3& b, float px, float py)
+        {
+            return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+        };
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            const float py = float(y) + 0.5f;
+
+            for (int x = minX; x <= maxX; x++)
+            {
+                const float px = float(x) + 0.5f;
+
+                const float w0 = edge(screen[1], screen[2], px, py);
+                const float w1 = edge(screen[2], screen[0], px, py);
+                const float w2 = edge(screen[0], screen[1], px, py);
+                if (w0 < 0.f || w1 < 0.f || w2 < 0.f)
+                    continue;
+
+                // NDC depth is linear in screen space
+                const float depth = (w0 * screen[0].z + w1 * screen[1].z + w2 * screen[2].z) / area;
+                if (depth < 0.f || depth > 1.f)
+                    continue;
+
+                float& stored = m_Depth[size_t(y) * m_Width + x];
+                stored = std::max(stored, depth);
+            }
+        }
+    }
+}
@@ -0,0 +1,101 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <array>
+#include <vector>
+
+struct DrawRecord;
+
+// CPU versions of the culling kernels in instance_culling.hlsl and depth_pyramid.hlsl, used to validate the GPU results.
+
+typedef std::array<donut::math::float4, 6> FrustumPlanes;
+
+// Extracts the normalized world space frustum planes from a view-projection matrix.
+// Planes that do not exist, like the far plane of an infinite projection, are set to always pass.
+FrustumPlanes GetFrustumPlanes(const donut::math::float4x4& viewProjMatrix);
+
+enum class DrawVisibility
+{
+    Culled,
+    Visible,
+    Borderline  // closer than the tolerance to one of the planes, the GPU may decide either way
+};
+
+// 'transform' is the 3x4 row-major object to world matrix, the same layout as InstanceData::transform
+DrawVisibility TestDrawVisibility(const DrawRecord& record, const float transform[12], const FrustumPlanes& planes, float tolerance);
+
+// CPU version of the depth pyramid built by depth_pyramid.hlsl, with the same level sizes and reduction.
+class DepthPyramid
+{
+public:
+    // 'rowPitch' is the distance between the rows of 'depth' in floats
+    void Build(const float* depth, uint32_t width, uint32_t height, size_t rowPitch);
+
+    uint32_t GetWidth() const { return m_Levels.empty() ? 0 : m_Levels[0].width; }
+    uint32_t GetHeight() const { return m_Levels.empty() ? 0 : m_Levels[0].height; }
+    uint32_t GetNumLevels() const { return uint32_t(m_Levels.size()); }
+    float Load(uint32_t level, uint32_t x, uint32_t y) const;
+
+    // Number of levels of a pyramid with the given base size, down to 1x1
+    static uint32_t GetNumLevels(uint32_t width, uint32_t height);
+
+private:
+    struct Level
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<float> texels;
+    };
+
+    std::vector<Level> m_Levels;
+};
+
+// CPU version of IsBoxOccluded in instance_culling.hlsl. Returns Culled when the draw is hidden behind the depth
+// in the pyramid. Borderline means that a depth difference below 'depthTolerance', or a shift of the screen
+// rectangle by less than 'pixelTolerance', changes the result.
+DrawVisibility TestDrawOcclusion(const DrawRecord& record, const float transform[12], const donut::math::float4x4& worldToClip,
+    const DepthPyramid& pyramid, float depthTolerance, float pixelTolerance);
+
+// Renders the depth of triangle meshes on the CPU with reverse Z, for a GPU independent depth pyramid.
+// Triangles that cross the near plane are skipped, which can only make the reference see less occlusion.
+class DepthRasterizer
+{
+public:
+    // Clears the depth to 0, the far plane
+    void Clear(uint32_t width, uint32_t height);
+
+    void DrawTriangles(const float transform[12], const donut::math::float4x4& worldToClip,
+        const donut::math::float3* positions, const uint32_t* indices, size_t numIndices);
+
+    uint32_t GetWidth() const { return m_Width; }
+    uint32_t GetHeight() const { return m_Height; }
+    const std::vector<float>& GetDepth() const { return m_Depth; }
+
+private:
+    uint32_t m_Width = 0;
+    uint32_t m_Height = 0;
+    std::vector<float> m_Depth;
+};
@@ -35,11 +35,17 @@
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/math/math.h>
 #include <nvrhi/utils.h>
+#include <algorithm>
+#include <chrono>
 
 using namespace donut;
 using namespace donut::math;
 
 #include <donut/shaders/view_cb.h>
+#include "bindless_rendering_cb.h"
+
+#include "Benchmark.h"
+#include "InstanceCulling.h"
 
 static const char* g_WindowTitle = "Donut Example: Bindless Rendering";
 
@@ -56,6 +62,52 @@ private:
     nvrhi::ShaderHandle m_PixelShader;
     nvrhi::GraphicsPipelineHandle m_GraphicsPipeline;
 
+    // Indirect draw path: one drawIndirect call with an argument record per geometry of every instance
+    nvrhi::ShaderHandle m_IndirectVertexShader;
+    nvrhi::InputLayoutHandle m_IndirectInputLayout;
+    nvrhi::GraphicsPipelineHandle m_IndirectPipeline;
+    nvrhi::BufferHandle m_DrawRecordBuffer;
+    nvrhi::BufferHandle m_DrawIdBuffer;
+    nvrhi::BufferHandle m_IndirectArgsBuffer;
+    uint32_t m_NumDraws = 0;
+    bool m_UseIndirectDraws = true;
+    // CPU copies for culling validation
+    std::vector<DrawRecord> m_DrawRecords;
+    std::vector<const engine::MeshGeometry*> m_DrawGeometries;
+    std::vector<const engine::MeshInfo*> m_DrawMeshes;
+    std::vector<const engine::SceneGraphNode*> m_InstanceNodes;
+
+    // GPU culling: a compute pass appends the arguments of the visible draws to m_CulledArgsBuffer
+    nvrhi::ShaderHandle m_CullingShader;
+    nvrhi::ComputePipelineHandle m_CullingPipeline;
+    nvrhi::BindingLayoutHandle m_CullingBindingLayout;
+    nvrhi::BindingSetHandle m_CullingBindingSet;
+    nvrhi::BufferHandle m_CullingConstants;
+    nvrhi::BufferHandle m_CulledArgsBuffer;
+    nvrhi::BufferHandle m_DrawCountBuffer;
+    bool m_UseGpuCulling = true;
+
+    // Occlusion culling against a depth pyramid of the draws that were visible in the previous frame
+    nvrhi::ShaderHandle m_DepthPyramidShader;
+    nvrhi::ComputePipelineHandle m_DepthPyramidPipeline;
+    nvrhi::BindingLayoutHandle m_DepthPyramidBindingLayout;
+    std::vector<nvrhi::BindingSetHandle> m_DepthPyramidBindingSets; // one per level
+    nvrhi::TextureHandle m_DepthPyramid;
+    nvrhi::BufferHandle m_DrawVisibilityBuffer;
+    nvrhi::BufferHandle m_CullingStatsBuffer;
+    bool m_UseOcclusionCulling = true;
+
+    // The statistics are read back a few frames later to avoid waiting for the GPU
+    static constexpr uint32_t c_NumStatsReadbacks = 3;
+    nvrhi::BufferHandle m_CullingStatsReadback[c_NumStatsReadbacks];
+    bool m_CullingStatsPending[c_NumStatsReadbacks] = {};
+    uint32_t m_CullingStatsIndex = 0;
+    uint32_t m_FrustumVisibleDraws = 0;
+    uint32_t m_OccludedDraws = 0;
+
+    // Number of command list calls made by Render, helper passes such as the blit count as one
+    uint32_t m_ApiCalls = 0;
+
     nvrhi::BufferHandle m_ViewConstants;
     
     nvrhi::TextureHandle m_DepthBuffer;
@@ -89,6 +141,16 @@ public:
 
         m_VertexShader = m_ShaderFactory->CreateShader("/shaders/app/bindless_rendering.hlsl", "vs_main", nullptr, nvrhi::ShaderType::Vertex);
         m_PixelShader = m_ShaderFactory->CreateShader("/shaders/app/bindless_rendering.hlsl", "ps_main", nullptr, nvrhi::ShaderType::Pixel);
+        m_IndirectVertexShader = m_ShaderFactory->CreateShader("/shaders/app/bindless_rendering.hlsl", "vs_main_indirect", nullptr, nvrhi::ShaderType::Vertex);
+
+        auto drawIdAttribute = nvrhi::VertexAttributeDesc()
+            .setName("DRAWID")
+            .setFormat(nvrhi::Format::R32_UINT)
+            .setBufferIndex(0)
+            .setOffset(0)
+            .setElementStride(sizeof(uint32_t))
+            .setIsInstanced(true);
+        m_IndirectInputLayout = GetDevice()->createInputLayout(&drawIdAttribute, 1, m_IndirectVertexShader);
 
         nvrhi::BindlessLayoutDesc bindlessLayoutDesc;
         bindlessLayoutDesc.visibility = nvrhi::ShaderType::All;
@@ -117,6 +179,9 @@ public:
 
         m_ViewConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(PlanarViewConstants), "ViewConstants", engine::c_MaxRenderPassConstantBufferVersions));
         
+        CreateIndirectDrawBuffers();
+        CreateCullingPass();
+
         GetDevice()->waitForIdle();
 
         nvrhi::BindingSetDesc bindingSetDesc;
@@ -126,6 +191,7 @@ public:
             nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene->GetInstanceBuffer()),
             nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_Scene->GetGeometryBuffer()),
             nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_Scene->GetMaterialBuffer()),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_DrawRecordBuffer),
             nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_AnisotropicWrapSampler)
         };
         nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDesc, m_BindingLayout, m_BindingSet);
@@ -133,6 +199,273 @@ public:
         return true;
     }
 
+    // Builds the draw records and indirect arguments for all geometries once, the scene is static
+    void CreateIndirectDrawBuffers()
+    {
+        std::vector<DrawRecord> drawRecords;
+        std::vector<nvrhi::DrawIndirectArguments> drawArguments;
+
+        m_DrawGeometries.clear();
+        m_DrawMeshes.clear();
+        m_InstanceNodes.clear();
+
+        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+        {
+            const size_t instanceIndex = size_t(instance->GetInstanceIndex());
+            if (m_InstanceNodes.size() <= instanceIndex)
+                m_InstanceNodes.resize(instanceIndex + 1);
+            m_InstanceNodes[instanceIndex] = instance->GetNode();
+
+            for (const auto& geometry : instance->GetMesh()->geometries)
+            {
+                DrawRecord record = {};
+                record.instanceIndex = uint(instance->GetInstanceIndex());
+                record.geometryIndex = uint(geometry->globalGeometryIndex);
+                record.vertexCount = geometry->numIndices;
+                record.boundsMin = geometry->objectSpaceBounds.m_mins;
+                record.boundsMax = geometry->objectSpaceBounds.m_maxs;
+
+                nvrhi::DrawIndirectArguments args;
+                args.vertexCount = geometry->numIndices;
+                args.instanceCount = 1;
+                args.startVertexLocation = 0;
+                args.startInstanceLocation = uint32_t(drawRecords.size()); // selects the draw ID, see vs_main_indirect
+
+                drawRecords.push_back(record);
+                drawArguments.push_back(args);
+                m_DrawGeometries.push_back(geometry.get());
+                m_DrawMeshes.push_back(instance->GetMesh().get());
+            }
+        }
+
+        m_NumDraws = uint32_t(drawRecords.size());
+        const uint32_t bufferEntries = std::max(m_NumDraws, 1u);
+
+        std::vector<uint32_t> drawIds(bufferEntries);
+        for (uint32_t index = 0; index < bufferEntries; index++)
+            drawIds[index] = index;
+
+        m_DrawRecordBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(DrawRecord) * bufferEntries)
+            .setStructStride(sizeof(DrawRecord))
+            .setInitialState(nvrhi::ResourceStates::ShaderResource)
+            .setKeepInitialState(true)
+            .setDebugName("DrawRecords"));
+
+        m_DrawIdBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(uint32_t) * bufferEntries)
+            .setIsVertexBuffer(true)
+            .setInitialState(nvrhi::ResourceStates::VertexBuffer)
+            .setKeepInitialState(true)
+            .setDebugName("DrawIds"));
+
+        m_IndirectArgsBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(nvrhi::DrawIndirectArguments) * bufferEntries)
+            .setIsDrawIndirectArgs(true)
+            .setInitialState(nvrhi::ResourceStates::IndirectArgument)
+            .setKeepInitialState(true)
+            .setDebugName("IndirectDrawArguments"));
+
+        m_CommandList->open();
+        m_CommandList->writeBuffer(m_DrawIdBuffer, drawIds.data(), drawIds.size() * sizeof(uint32_t));
+        if (m_NumDraws > 0)
+        {
+            m_CommandList->writeBuffer(m_DrawRecordBuffer, drawRecords.data(), drawRecords.size() * sizeof(DrawRecord));
+            m_CommandList->writeBuffer(m_IndirectArgsBuffer, drawArguments.data(), drawArguments.size() * sizeof(nvrhi::DrawIndirectArguments));
+        }
+        m_CommandList->close();
+        GetDevice()->executeCommandList(m_CommandList);
+
+        m_DrawRecords = std::move(drawRecords);
+    }
+
+    void CreateCullingPass()
+    {
+        m_CullingShader = m_ShaderFactory->CreateShader("/shaders/app/instance_culling.hlsl", "cs_cull", nullptr, nvrhi::ShaderType::Compute);
+
+        m_CullingConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(CullingConstants), "CullingConstants", engine::c_MaxRenderPassConstantBufferVersions));
+
+        // Written by the culling pass and consumed by drawIndirect, so it moves between the UAV and indirect argument states
+        m_CulledArgsBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(nvrhi::DrawIndirectArguments) * std::max(m_NumDraws, 1u))
+            .setIsDrawIndirectArgs(true)
+            .setCanHaveUAVs(true)
+            .setCanHaveRawViews(true)
+            .setInitialState(nvrhi::ResourceStates::IndirectArgument)
+            .setKeepInitialState(true)
+            .setDebugName("CulledDrawArguments"));
+
+        m_DrawCountBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(uint32_t))
+            .setCanHaveUAVs(true)
+            .setCanHaveRawViews(true)
+            .setInitialState(nvrhi::ResourceStates::UnorderedAccess)
+            .setKeepInitialState(true)
+            .setDebugName("CulledDrawCount"));
+
+        m_DrawVisibilityBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(uint32_t) * std::max(m_NumDraws, 1u))
+            .setCanHaveUAVs(true)
+            .setCanHaveRawViews(true)
+            .setInitialState(nvrhi::ResourceStates::UnorderedAccess)
+            .setKeepInitialState(true)
+            .setDebugName("DrawVisibility"));
+
+        m_CullingStatsBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(uint32_t) * 4)
+            .setCanHaveUAVs(true)
+            .setCanHaveRawViews(true)
+            .setInitialState(nvrhi::ResourceStates::UnorderedAccess)
+            .setKeepInitialState(true)
+            .setDebugName("CullingStats"));
+
+        for (auto& readback : m_CullingStatsReadback)
+        {
+            readback = GetDevice()->createBuffer(nvrhi::BufferDesc()
+                .setByteSize(sizeof(uint32_t) * 4)
+                .setCpuAccess(nvrhi::CpuAccessMode::Read)
+                .setInitialState(nvrhi::ResourceStates::CopyDest)
+                .setKeepInitialState(true)
+                .setDebugName("CullingStatsReadback"));
+        }
+
+        // Nothing was visible in the previous frame, so the first frame draws everything in the second phase
+        m_CommandList->open();
+        m_CommandList->clearBufferUInt(m_DrawVisibilityBuffer, 0);
+        m_CommandList->close();
+        GetDevice()->executeCommandList(m_CommandList);
+
+        m_DepthPyramidShader = m_ShaderFactory->CreateShader("/shaders/app/depth_pyramid.hlsl", "cs_build", nullptr, nvrhi::ShaderType::Compute);
+    }
+
+    // Creates the depth pyramid for the current depth buffer, and the binding sets that reference it
+    void CreateDepthPyramid()
+    {
+        const nvrhi::TextureDesc& depthDesc = m_DepthBuffer->getDesc();
+        const uint32_t numLevels = DepthPyramid::GetNumLevels(depthDesc.width, depthDesc.height);
+
+        m_DepthPyramid = GetDevice()->createTexture(nvrhi::TextureDesc()
+            .setDimension(nvrhi::TextureDimension::Texture2D)
+            .setWidth(depthDesc.width)
+            .setHeight(depthDesc.height)
+            .setMipLevels(numLevels)
+            .setFormat(nvrhi::Format::R32_FLOAT)
+            .setIsUAV(true)
+            .setInitialState(nvrhi::ResourceStates::ShaderResource)
+            .setKeepInitialState(true)
+            .setDebugName("DepthPyramid"));
+
+        m_DepthPyramidBindingSets.clear();
+        for (uint32_t level = 0; level < numLevels; level++)
+        {
+            nvrhi::BindingSetDesc bindingSetDesc;
+            bindingSetDesc.bindings = {
+                nvrhi::BindingSetItem::PushConstants(0, sizeof(DepthPyramidConstants)),
+                level == 0
+                    ? nvrhi::BindingSetItem::Texture_SRV(0, m_DepthBuffer)
+                    : nvrhi::BindingSetItem::Texture_SRV(0, m_DepthPyramid, nvrhi::Format::UNKNOWN, nvrhi::TextureSubresourceSet(level - 1, 1, 0, 1)),
+                nvrhi::BindingSetItem::Texture_UAV(0, m_DepthPyramid, nvrhi::Format::UNKNOWN, nvrhi::TextureSubresourceSet(level, 1, 0, 1))
+            };
+
+            nvrhi::BindingSetHandle bindingSet;
+            nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::Compute, 0, bindingSetDesc, m_DepthPyramidBindingLayout, bindingSet);
+            m_DepthPyramidBindingSets.push_back(bindingSet);
+        }
+
+        if (!m_DepthPyramidPipeline)
+        {
+            nvrhi::ComputePipelineDesc pipelineDesc;
+            pipelineDesc.CS = m_DepthPyramidShader;
+            pipelineDesc.bindingLayouts = { m_DepthPyramidBindingLayout };
+            m_DepthPyramidPipeline = GetDevice()->createComputePipeline(pipelineDesc);
+        }
+
+        nvrhi::BindingSetDesc bindingSetDesc;
+        bindingSetDesc.bindings = {
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_CullingConstants),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene->GetInstanceBuffer()),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_DrawRecordBuffer),
+            nvrhi::BindingSetItem::Texture_SRV(2, m_DepthPyramid),
+            nvrhi::BindingSetItem::RawBuffer_UAV(0, m_CulledArgsBuffer),
+            nvrhi::BindingSetItem::RawBuffer_UAV(1, m_DrawCountBuffer),
+            nvrhi::BindingSetItem::RawBuffer_UAV(2, m_DrawVisibilityBuffer),
+            nvrhi::BindingSetItem::RawBuffer_UAV(3, m_CullingStatsBuffer)
+        };
+        m_CullingBindingSet = nullptr;
+        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::Compute, 0, bindingSetDesc, m_CullingBindingLayout, m_CullingBindingSet);
+
+        if (!m_CullingPipeline)
+        {
+            nvrhi::ComputePipelineDesc pipelineDesc;
+            pipelineDesc.CS = m_CullingShader;
+            pipelineDesc.bindingLayouts = { m_CullingBindingLayout };
+            m_CullingPipeline = GetDevice()->createComputePipeline(pipelineDesc);
+        }
+    }
+
+    void BuildDepthPyramid()
+    {
+        const nvrhi::TextureDesc& pyramidDesc = m_DepthPyramid->getDesc();
+
+        for (uint32_t level = 0; level < pyramidDesc.mipLevels; level++)
+        {
+            DepthPyramidConstants constants;
+            constants.sourceSize = uint2(std::max(pyramidDesc.width >> (level ? level - 1 : 0), 1u), std::max(pyramidDesc.height >> (level ? level - 1 : 0), 1u));
+            constants.destSize = uint2(std::max(pyramidDesc.width >> level, 1u), std::max(pyramidDesc.height >> level, 1u));
+
+            nvrhi::ComputeState state;
+            state.pipeline = m_DepthPyramidPipeline;
+            state.bindings = { m_DepthPyramidBindingSets[level] };
+            m_CommandList->setComputeState(state);
+            m_CommandList->setPushConstants(&constants, sizeof(constants));
+            m_CommandList->dispatch(
+                (constants.destSize.x + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+                (constants.destSize.y + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE);
+            m_ApiCalls += 3;
+        }
+    }
+
+    void CullDraws(uint32_t cullingPhase)
+    {
+        CullingConstants cullingConstants = {};
+        const FrustumPlanes planes = GetFrustumPlanes(m_View.GetViewProjectionMatrix());
+        for (int planeIndex = 0; planeIndex < 6; planeIndex++)
+            cullingConstants.frustumPlanes[planeIndex] = planes[planeIndex];
+        cullingConstants.matWorldToClip = m_View.GetViewProjectionMatrix();
+        cullingConstants.numDraws = m_NumDraws;
+        cullingConstants.cullingPhase = cullingPhase;
+        cullingConstants.pyramidLevels = m_DepthPyramid->getDesc().mipLevels;
+        cullingConstants.pyramidSize = uint2(m_DepthPyramid->getDesc().width, m_DepthPyramid->getDesc().height);
+        m_CommandList->writeBuffer(m_CullingConstants, &cullingConstants, sizeof(cullingConstants));
+
+        m_CommandList->clearBufferUInt(m_CulledArgsBuffer, 0);
+        m_CommandList->clearBufferUInt(m_DrawCountBuffer, 0);
+
+        nvrhi::ComputeState computeState;
+        computeState.pipeline = m_CullingPipeline;
+        computeState.bindings = { m_CullingBindingSet };
+        m_CommandList->setComputeState(computeState);
+        m_CommandList->dispatch((m_NumDraws + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE);
+        m_ApiCalls += 5;
+    }
+
+    void ReadCullingStats()
+    {
+        nvrhi::IBuffer* readback = m_CullingStatsReadback[m_CullingStatsIndex];
+        if (!m_CullingStatsPending[m_CullingStatsIndex])
+            return;
+
+        const uint32_t* stats = static_cast<const uint32_t*>(GetDevice()->mapBuffer(readback, nvrhi::CpuAccessMode::Read));
+        if (stats)
+        {
+            m_FrustumVisibleDraws = stats[CULLING_STAT_FRUSTUM_VISIBLE / 4];
+            m_OccludedDraws = stats[CULLING_STAT_OCCLUDED / 4];
+            GetDevice()->unmapBuffer(readback);
+        }
+
+        m_CullingStatsPending[m_CullingStatsIndex] = false;
+    }
+
     bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override 
     {
         engine::Scene* scene = new engine::Scene(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, m_DescriptorTableManager, nullptr);
@@ -149,6 +482,22 @@ public:
     bool KeyboardUpdate(int key, int scancode, int action, int mods) override
     {
         m_Camera.KeyboardUpdate(key, scancode, action, mods);
+
+        if (key == GLFW_KEY_I && action == GLFW_PRESS)
+        {
+            m_UseIndirectDraws = !m_UseIndirectDraws;
+        }
+
+        if (key == GLFW_KEY_C && action == GLFW_PRESS)
+        {
+            m_UseGpuCulling = !m_UseGpuCulling;
+        }
+
+        if (key == GLFW_KEY_O && action == GLFW_PRESS)
+        {
+            m_UseOcclusionCulling = !m_UseOcclusionCulling;
+        }
+
         return true;
     }
 
@@ -164,10 +513,150 @@ public:
         return true;
     }
 
+    void SetCameraPose(const float3& position, const float3& target)
+    {
+        m_Camera.LookAt(position, target);
+    }
+
+    void SetIndirectDrawsEnabled(bool enabled)
+    {
+        m_UseIndirectDraws = enabled;
+    }
+
+    void SetGpuCullingEnabled(bool enabled)
+    {
+        m_UseGpuCulling = enabled;
+    }
+
+    void SetOcclusionCullingEnabled(bool enabled)
+    {
+        m_UseOcclusionCulling = enabled;
+    }
+
+    uint32_t GetApiCallsLastFrame() const
+    {
+        return m_ApiCalls;
+    }
+
+    uint32_t GetNumDraws() const
+    {
+        return m_NumDraws;
+    }
+
+    nvrhi::IBuffer* GetCulledArgsBuffer() const
+    {
+        return m_CulledArgsBuffer;
+    }
+
+    nvrhi::IBuffer* GetDrawCountBuffer() const
+    {
+        return m_DrawCountBuffer;
+    }
+
+    nvrhi::IBuffer* GetDrawVisibilityBuffer() const
+    {
+        return m_DrawVisibilityBuffer;
+    }
+
+    nvrhi::ITexture* GetDepthPyramid() const
+    {
+        return m_DepthPyramid;
+    }
+
+    // Same layout as InstanceData::transform
+    void GetDrawTransform(uint32_t drawIndex, float transform[12]) const
+    {
+        affineToColumnMajor(m_InstanceNodes[m_DrawRecords[drawIndex].instanceIndex]->GetLocalToWorldTransformFloat(), transform);
+    }
+
+    // Runs the CPU version of the culling kernel for the current view, with the same view matrices that Render used.
+    // Draws that are closer than 'tolerance' to a frustum plane are returned separately because
+    // floating point differences between the CPU and the GPU can put them on either side.
+    void CullDrawsOnCPU(float tolerance, std::vector<uint32_t>& visibleDraws, std::vector<uint32_t>& borderlineDraws) const
+    {
+        visibleDraws.clear();
+        borderlineDraws.clear();
+
+        const FrustumPlanes planes = GetFrustumPlanes(m_View.GetViewProjectionMatrix());
+
+        for (uint32_t drawIndex = 0; drawIndex < m_NumDraws; drawIndex++)
+        {
+            float transform[12];
+            GetDrawTransform(drawIndex, transform);
+
+            switch (TestDrawVisibility(m_DrawRecords[drawIndex], transform, planes, tolerance))
+            {
+            case DrawVisibility::Visible:
+                visibleDraws.push_back(drawIndex);
+                break;
+            case DrawVisibility::Borderline:
+                borderlineDraws.push_back(drawIndex);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // Runs the CPU version of the occlusion test for the given draws against a depth pyramid, with the view of the last frame
+    void TestOcclusionOnCPU(const DepthPyramid& pyramid, const std::vector<uint32_t>& draws, float depthTolerance, float pixelTolerance,
+        std::vector<DrawVisibility>& results) const
+    {
+        results.resize(draws.size());
+
+        for (size_t index = 0; index < draws.size(); index++)
+        {
+            float transform[12];
+            GetDrawTransform(draws[index], transform);
+            results[index] = TestDrawOcclusion(m_DrawRecords[draws[index]], transform, m_View.GetViewProjectionMatrix(), pyramid, depthTolerance, pixelTolerance);
+        }
+    }
+
+    // Renders the depth of the given draws with the software rasterizer, with the view of the last frame.
+    // Returns false when the scene does not keep the vertex data on the CPU.
+    bool RasterizeDepthOnCPU(const std::vector<uint32_t>& draws, DepthRasterizer& rasterizer) const
+    {
+        for (uint32_t drawIndex : draws)
+        {
+            const engine::MeshInfo* mesh = m_DrawMeshes[drawIndex];
+            const engine::MeshGeometry* geometry = m_DrawGeometries[drawIndex];
+            const engine::BufferGroup* buffers = mesh->buffers.get();
+
+            if (buffers->positionData.empty() || buffers->indexData.empty())
+                return false;
+
+            float transform[12];
+            GetDrawTransform(drawIndex, transform);
+
+            rasterizer.DrawTriangles(transform, m_View.GetViewProjectionMatrix(),
+                buffers->positionData.data() + mesh->vertexOffset + geometry->vertexOffsetInMesh,
+                buffers->indexData.data() + mesh->indexOffset + geometry->indexOffsetInMesh,
+                geometry->numIndices);
+        }
+
+        return true;
+    }
+
     void Animate(float fElapsedTimeSeconds) override
     {
         m_Camera.Animate(fElapsedTimeSeconds);
-        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
+
+        // The headless benchmark and the culling validation run without a window
+        if (!GetDeviceManager()->GetWindow())
+            return;
+
+        char cullingInfo[96] = "";
+        if (m_UseIndirectDraws && m_UseGpuCulling)
+        {
+            if (m_UseOcclusionCulling)
+                snprintf(cullingInfo, sizeof(cullingInfo), ", occlusion culling: %u visible, %u occluded", m_FrustumVisibleDraws - m_OccludedDraws, m_OccludedDraws);
+            else
+                snprintf(cullingInfo, sizeof(cullingInfo), ", frustum culling");
+        }
+
+        char extraInfo[160];
+        snprintf(extraInfo, sizeof(extraInfo), "(%s draws%s, %u API calls)", m_UseIndirectDraws ? "Indirect" : "Direct", cullingInfo, m_ApiCalls);
+        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfo);
     }
 
     void BackBufferResizing() override
@@ -176,6 +665,10 @@ public:
         m_ColorBuffer = nullptr;
         m_Framebuffer = nullptr;
         m_GraphicsPipeline = nullptr;
+        m_IndirectPipeline = nullptr;
+        m_DepthPyramid = nullptr;
+        m_DepthPyramidBindingSets.clear();
+        m_CullingBindingSet = nullptr;
         m_BindingCache->Clear();
     }
 
@@ -199,6 +692,7 @@ public:
             m_ColorBuffer = GetDevice()->createTexture(textureDesc);
 
             textureDesc.format = nvrhi::Format::D24S8;
+            textureDesc.isTypeless = true; // read by the depth pyramid pass
             textureDesc.debugName = "DepthBuffer";
             textureDesc.initialState = nvrhi::ResourceStates::DepthWrite;
             m_DepthBuffer = GetDevice()->createTexture(textureDesc);
@@ -218,6 +712,12 @@ public:
             pipelineDesc.renderState.rasterState.frontCounterClockwise = true;
             pipelineDesc.renderState.rasterState.setCullBack();
             m_GraphicsPipeline = GetDevice()->createGraphicsPipeline(pipelineDesc, m_Framebuffer);
+
+            pipelineDesc.VS = m_IndirectVertexShader;
+            pipelineDesc.inputLayout = m_IndirectInputLayout;
+            m_IndirectPipeline = GetDevice()->createGraphicsPipeline(pipelineDesc, m_Framebuffer);
+
+            CreateDepthPyramid();
         }
 
         nvrhi::Viewport windowViewport(float(fbinfo.width), float(fbinfo.height));
@@ -225,6 +725,13 @@ public:
         m_View.SetMatrices(m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(dm::PI_f * 0.25f, windowViewport.width() / windowViewport.height(), 0.1f));
         m_View.UpdateCache();
         
+        m_ApiCalls = 0;
+
+        ReadCullingStats();
+
+        const bool gpuCulling = m_UseIndirectDraws && m_UseGpuCulling;
+        const bool occlusionCulling = gpuCulling && m_UseOcclusionCulling;
+
         m_CommandList->open();
 
         m_CommandList->clearTextureFloat(m_ColorBuffer, nvrhi::AllSubresources, nvrhi::Color(0.f));
@@ -233,37 +740,402 @@ public:
         PlanarViewConstants viewConstants;
         m_View.FillPlanarViewConstants(viewConstants);
         m_CommandList->writeBuffer(m_ViewConstants, &viewConstants, sizeof(viewConstants));
+        m_ApiCalls += 3;
 
         nvrhi::GraphicsState state;
-        state.pipeline = m_GraphicsPipeline;
         state.framebuffer = m_Framebuffer;
         state.bindings = { m_BindingSet, m_DescriptorTableManager->GetDescriptorTable() };
         state.viewport = m_View.GetViewportState();
-        m_CommandList->setGraphicsState(state);
 
-        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+        if (gpuCulling)
+        {
+            // nvrhi has no indirect count draw, so the culled list is drawn with the full draw count
+            // and the entries after the visible draws are cleared to zero, which makes them empty draws.
+            if (occlusionCulling)
+            {
+                m_CommandList->clearBufferUInt(m_CullingStatsBuffer, 0);
+                m_ApiCalls++;
+            }
+
+            CullDraws(occlusionCulling ? CULLING_PHASE_PREVIOUS_VISIBLE : CULLING_PHASE_FRUSTUM);
+        }
+
+        if (m_UseIndirectDraws)
+        {
+            state.pipeline = m_IndirectPipeline;
+            state.vertexBuffers = { nvrhi::VertexBufferBinding().setBuffer(m_DrawIdBuffer).setSlot(0).setOffset(0) };
+            state.indirectParams = gpuCulling ? m_CulledArgsBuffer : m_IndirectArgsBuffer;
+            m_CommandList->setGraphicsState(state);
+
+            m_CommandList->drawIndirect(0, m_NumDraws);
+            m_ApiCalls += 2;
+        }
+
+        if (occlusionCulling)
+        {
+            // Draws that were hidden in the previous frame and are not hidden behind the first phase anymore
+            BuildDepthPyramid();
+            CullDraws(CULLING_PHASE_OCCLUSION);
+
+            m_CommandList->setGraphicsState(state);
+            m_CommandList->drawIndirect(0, m_NumDraws);
+
+            m_CommandList->copyBuffer(m_CullingStatsReadback[m_CullingStatsIndex], 0, m_CullingStatsBuffer, 0, sizeof(uint32_t) * 4);
+            m_CullingStatsPending[m_CullingStatsIndex] = true;
+            m_ApiCalls += 3;
+        }
+        else
         {
-            const auto& mesh = instance->GetMesh();
+            state.pipeline = m_GraphicsPipeline;
+            m_CommandList->setGraphicsState(state);
+            m_ApiCalls++;
 
-            for (size_t i = 0; i < mesh->geometries.size(); i++)
+            for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
             {
-                int2 constants = int2(instance->GetInstanceIndex(), int(i));
-                m_CommandList->setPushConstants(&constants, sizeof(constants));
+                const auto& mesh = instance->GetMesh();
 
-                nvrhi::DrawArguments args;
-                args.instanceCount = 1;
-                args.vertexCount = mesh->geometries[i]->numIndices;
-                m_CommandList->draw(args);
+                for (size_t i = 0; i < mesh->geometries.size(); i++)
+                {
+                    int2 constants = int2(instance->GetInstanceIndex(), int(i));
+                    m_CommandList->setPushConstants(&constants, sizeof(constants));
+
+                    nvrhi::DrawArguments args;
+                    args.instanceCount = 1;
+                    args.vertexCount = mesh->geometries[i]->numIndices;
+                    m_CommandList->draw(args);
+                    m_ApiCalls += 2;
+                }
             }
         }
         
         m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_ColorBuffer, m_BindingCache.get());
+        m_ApiCalls++;
 
         m_CommandList->close();
         GetDevice()->executeCommandList(m_CommandList);
+
+        m_CullingStatsIndex = (m_CullingStatsIndex + 1) % c_NumStatsReadbacks;
     }
 };
 
+struct BenchmarkParameters
+{
+    std::filesystem::path cameraPathFile;
+    std::filesystem::path csvFile = "bindless_rendering_benchmark.csv";
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    int frames = 600;
+    int warmupFrames = 10;
+};
+
+// Renders the scene into an offscreen target without presenting, following a scripted camera path,
+// and records how long each frame takes to record and to complete on the GPU.
+static bool RunHeadlessBenchmark(BindlessRendering& example, nvrhi::IDevice* device, const BenchmarkParameters& params)
+{
+    vfs::NativeFileSystem fs;
+    CameraPath cameraPath;
+    if (!cameraPath.Load(fs, params.cameraPathFile))
+        return false;
+
+    auto textureDesc = nvrhi::TextureDesc()
+        .setDimension(nvrhi::TextureDimension::Texture2D)
+        .setWidth(params.width)
+        .setHeight(params.height)
+        .setFormat(nvrhi::Format::SRGBA8_UNORM)
+        .setIsRenderTarget(true)
+        .setInitialState(nvrhi::ResourceStates::RenderTarget)
+        .setKeepInitialState(true)
+        .setDebugName("OffscreenLdrColor");
+    nvrhi::TextureHandle colorTarget = device->createTexture(textureDesc);
+
+    nvrhi::FramebufferHandle framebuffer = device->createFramebuffer(nvrhi::FramebufferDesc()
+        .addColorAttachment(colorTarget));
+
+    const float frameTime = cameraPath.GetDuration() / float(std::max(params.frames - 1, 1));
+
+    FrameTimeReport report;
+
+    for (int frame = -params.warmupFrames; frame < params.frames; frame++)
+    {
+        float3 position, target;
+        cameraPath.Evaluate(float(std::max(frame, 0)) * frameTime, position, target);
+        example.SetCameraPose(position, target);
+
+        auto frameStart = std::chrono::high_resolution_clock::now();
+
+        example.Animate(frameTime);
+        example.Render(framebuffer);
+
+        auto recordEnd = std::chrono::high_resolution_clock::now();
+
+        device->waitForIdle();
+        device->runGarbageCollection();
+
+        auto frameEnd = std::chrono::high_resolution_clock::now();
+
+        if (frame < 0)
+            continue;
+
+        FrameTimeReport::Sample sample;
+        sample.cpuMilliseconds = std::chrono::duration<double, std::milli>(recordEnd - frameStart).count();
+        sample.frameMilliseconds = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+        sample.apiCalls = example.GetApiCallsLastFrame();
+        report.AddSample(sample);
+    }
+
+    report.PrintSummary();
+
+    if (!report.WriteCSV(params.csvFile))
+        return false;
+
+    log::info("Frame times written to '%s'", params.csvFile.generic_string().c_str());
+
+    return true;
+}
+
+// Renders the scene with GPU culling at several poses along the camera path, reads back the results,
+// and compares them with the CPU versions of the culling kernels:
+// - the compacted draw list of frustum culling,
+// - the visibility flags of occlusion culling, tested on the CPU against the same depth pyramid,
+// - and, for information only, the occlusion decisions against the depth of the software rasterizer.
+static bool RunCullingValidation(BindlessRendering& example, nvrhi::IDevice* device, const BenchmarkParameters& params)
+{
+    constexpr int numPoses = 32;
+    constexpr float frustumTolerance = 1e-3f;
+    constexpr float depthTolerance = 1e-6f;
+    constexpr float pixelTolerance = 0.01f;
+
+    vfs::NativeFileSystem fs;
+    CameraPath cameraPath;
+    if (!cameraPath.Load(fs, params.cameraPathFile))
+        return false;
+
+    nvrhi::TextureHandle colorTarget = device->createTexture(nvrhi::TextureDesc()
+        .setDimension(nvrhi::TextureDimension::Texture2D)
+        .setWidth(params.width)
+        .setHeight(params.height)
+        .setFormat(nvrhi::Format::SRGBA8_UNORM)
+        .setIsRenderTarget(true)
+        .setInitialState(nvrhi::ResourceStates::RenderTarget)
+        .setKeepInitialState(true)
+        .setDebugName("OffscreenLdrColor"));
+
+    nvrhi::FramebufferHandle framebuffer = device->createFramebuffer(nvrhi::FramebufferDesc()
+        .addColorAttachment(colorTarget));
+
+    const uint32_t numDraws = example.GetNumDraws();
+    const size_t argsSize = sizeof(nvrhi::DrawIndirectArguments) * std::max(numDraws, 1u);
+    const size_t visibilitySize = sizeof(uint32_t) * std::max(numDraws, 1u);
+
+    auto createReadback = [device](size_t byteSize, const char* name)
+    {
+        return device->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(byteSize)
+            .setCpuAccess(nvrhi::CpuAccessMode::Read)
+            .setInitialState(nvrhi::ResourceStates::CopyDest)
+            .setKeepInitialState(true)
+            .setDebugName(name));
+    };
+
+    nvrhi::BufferHandle argsReadback = createReadback(argsSize, "CulledDrawArgumentsReadback");
+    nvrhi::BufferHandle countReadback = createReadback(sizeof(uint32_t), "CulledDrawCountReadback");
+    nvrhi::BufferHandle visibilityReadback = createReadback(visibilitySize, "DrawVisibilityReadback");
+    nvrhi::StagingTextureHandle pyramidReadback;
+
+    nvrhi::CommandListHandle commandList = device->createCommandList();
+
+    example.SetIndirectDrawsEnabled(true);
+    example.SetGpuCullingEnabled(true);
+
+    std::vector<uint32_t> cpuVisible, cpuBorderline, gpuVisible, occlusionCandidates;
+    std::vector<DrawVisibility> occlusionResults;
+    DepthPyramid pyramid;
+    DepthRasterizer rasterizer;
+    bool rasterizerAvailable = true;
+    int failedPoses = 0;
+
+    for (int pose = 0; pose < numPoses; pose++)
+    {
+        float3 position, target;
+        cameraPath.Evaluate(cameraPath.GetDuration() * float(pose) / float(numPoses - 1), position, target);
+        example.SetCameraPose(position, target);
+
+        // Frustum culling
+
+        example.SetOcclusionCullingEnabled(false);
+        example.Animate(0.f);
+        example.Render(framebuffer);
+
+        commandList->open();
+        commandList->copyBuffer(argsReadback, 0, example.GetCulledArgsBuffer(), 0, argsSize);
+        commandList->copyBuffer(countReadback, 0, example.GetDrawCountBuffer(), 0, sizeof(uint32_t));
+        commandList->close();
+        device->executeCommandList(commandList);
+        device->waitForIdle();
+
+        const uint32_t* count = static_cast<const uint32_t*>(device->mapBuffer(countReadback, nvrhi::CpuAccessMode::Read));
+        const uint32_t visibleCount = std::min(*count, numDraws);
+        device->unmapBuffer(countReadback);
+
+        gpuVisible.clear();
+        const auto* args = static_cast<const nvrhi::DrawIndirectArguments*>(device->mapBuffer(argsReadback, nvrhi::CpuAccessMode::Read));
+        for (uint32_t index = 0; index < visibleCount; index++)
+            gpuVisible.push_back(args[index].startInstanceLocation);
+        device->unmapBuffer(argsReadback);
+
+        // The order of the compacted list depends on the thread scheduling
+        std::sort(gpuVisible.begin(), gpuVisible.end());
+
+        example.CullDrawsOnCPU(frustumTolerance, cpuVisible, cpuBorderline);
+
+        // Every draw that the CPU finds visible must be on the GPU list, and every draw on the GPU list
+        // must be visible or borderline on the CPU
+        int missing = 0;
+        for (uint32_t drawIndex : cpuVisible)
+        {
+            if (!std::binary_search(gpuVisible.begin(), gpuVisible.end(), drawIndex))
+                missing++;
+        }
+
+        int extra = 0;
+        for (uint32_t drawIndex : gpuVisible)
+        {
+            if (!std::binary_search(cpuVisible.begin(), cpuVisible.end(), drawIndex) &&
+                !std::binary_search(cpuBorderline.begin(), cpuBorderline.end(), drawIndex))
+                extra++;
+        }
+
+        bool poseFailed = false;
+        if (missing || extra)
+        {
+            log::warning("Pose %d: %d draws visible on the CPU are missing on the GPU, %d draws culled on the CPU are drawn on the GPU",
+                pose, missing, extra);
+            poseFailed = true;
+        }
+
+        // Occlusion culling. The second frame draws the visible set of the first one in its first phase,
+        // so its depth pyramid holds the depth of the whole visible scene.
+
+        example.SetOcclusionCullingEnabled(true);
+        for (int frame = 0; frame < 2; frame++)
+        {
+            example.Animate(0.f);
+            example.Render(framebuffer);
+        }
+
+        nvrhi::ITexture* gpuPyramid = example.GetDepthPyramid();
+        if (!pyramidReadback)
+        {
+            nvrhi::TextureDesc readbackDesc = gpuPyramid->getDesc();
+            readbackDesc.mipLevels = 1;
+            readbackDesc.isUAV = false;
+            readbackDesc.initialState = nvrhi::ResourceStates::CopyDest;
+            readbackDesc.debugName = "DepthPyramidReadback";
+            pyramidReadback = device->createStagingTexture(readbackDesc, nvrhi::CpuAccessMode::Read);
+        }
+
+        commandList->open();
+        commandList->copyBuffer(visibilityReadback, 0, example.GetDrawVisibilityBuffer(), 0, visibilitySize);
+        commandList->copyTexture(pyramidReadback, nvrhi::TextureSlice(), gpuPyramid, nvrhi::TextureSlice());
+        commandList->close();
+        device->executeCommandList(commandList);
+        device->waitForIdle();
+
+        size_t rowPitch = 0;
+        const float* depth = static_cast<const float*>(device->mapStagingTexture(pyramidReadback, nvrhi::TextureSlice(), nvrhi::CpuAccessMode::Read, &rowPitch));
+        pyramid.Build(depth, gpuPyramid->getDesc().width, gpuPyramid->getDesc().height, rowPitch / sizeof(float));
+        device->unmapStagingTexture(pyramidReadback);
+
+        const uint32_t* visibility = static_cast<const uint32_t*>(device->mapBuffer(visibilityReadback, nvrhi::CpuAccessMode::Read));
+        std::vector<uint32_t> gpuVisibility(visibility, visibility + numDraws);
+        device->unmapBuffer(visibilityReadback);
+
+        // Draws culled by the frustum on the CPU must not be marked as visible
+        int occlusionMismatches = 0;
+        for (uint32_t drawIndex = 0; drawIndex < numDraws; drawIndex++)
+        {
+            if (gpuVisibility[drawIndex] &&
+                !std::binary_search(cpuVisible.begin(), cpuVisible.end(), drawIndex) &&
+                !std::binary_search(cpuBorderline.begin(), cpuBorderline.end(), drawIndex))
+                occlusionMismatches++;
+        }
+
+        example.TestOcclusionOnCPU(pyramid, cpuVisible, depthTolerance, pixelTolerance, occlusionResults);
+
+        int occludedOnCPU = 0;
+        for (size_t index = 0; index < cpuVisible.size(); index++)
+        {
+            const bool gpuVisibleFlag = gpuVisibility[cpuVisible[index]] != 0;
+            if (occlusionResults[index] == DrawVisibility::Culled)
+            {
+                occludedOnCPU++;
+                if (gpuVisibleFlag)
+                    occlusionMismatches++;
+            }
+            else if (occlusionResults[index] == DrawVisibility::Visible && !gpuVisibleFlag)
+            {
+                occlusionMismatches++;
+            }
+        }
+
+        if (occlusionMismatches)
+        {
+            log::warning("Pose %d: %d occlusion culling decisions differ between the CPU and the GPU", pose, occlusionMismatches);
+            poseFailed = true;
+        }
+
+        // Software rasterizer reference: only reported, because its rasterization rules differ from the GPU
+        char referenceInfo[96] = "";
+        if (rasterizerAvailable)
+        {
+            occlusionCandidates = cpuVisible;
+            occlusionCandidates.insert(occlusionCandidates.end(), cpuBorderline.begin(), cpuBorderline.end());
+
+            rasterizer.Clear(pyramid.GetWidth(), pyramid.GetHeight());
+            rasterizerAvailable = example.RasterizeDepthOnCPU(occlusionCandidates, rasterizer);
+
+            if (rasterizerAvailable)
+            {
+                DepthPyramid referencePyramid;
+                referencePyramid.Build(rasterizer.GetDepth().data(), rasterizer.GetWidth(), rasterizer.GetHeight(), rasterizer.GetWidth());
+                example.TestOcclusionOnCPU(referencePyramid, cpuVisible, depthTolerance, pixelTolerance, occlusionResults);
+
+                int agreements = 0;
+                for (size_t index = 0; index < cpuVisible.size(); index++)
+                {
+                    if ((occlusionResults[index] == DrawVisibility::Culled) == (gpuVisibility[cpuVisible[index]] == 0))
+                        agreements++;
+                }
+
+                snprintf(referenceInfo, sizeof(referenceInfo), ", software rasterizer agrees on %d of %d", agreements, int(cpuVisible.size()));
+            }
+            else
+            {
+                log::info("The scene does not keep vertex data on the CPU, skipping the software rasterizer reference");
+            }
+        }
+
+        if (poseFailed)
+        {
+            failedPoses++;
+        }
+        else
+        {
+            log::info("Pose %d: %u of %u draws in the frustum, %d borderline, %d occluded%s",
+                pose, visibleCount, numDraws, int(cpuBorderline.size()), occludedOnCPU, referenceInfo);
+        }
+    }
+
+    if (failedPoses)
+    {
+        log::error("Culling validation failed for %d of %d poses", failedPoses, numPoses);
+        return false;
+    }
+
+    log::info("Culling validation passed for %d poses", numPoses);
+    return true;
+}
+
 #ifdef WIN32
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 #else
@@ -277,6 +1149,58 @@ int main(int __argc, const char** __argv)
         return 1;
     }
 
+    bool headless = false;
+    bool validateCulling = false;
+    bool indirectDraws = true;
+    bool gpuCulling = true;
+    bool occlusionCulling = true;
+    BenchmarkParameters benchmarkParams;
+    benchmarkParams.cameraPathFile = app::GetDirectoryWithExecutable().parent_path() / "media/sponza-flythrough.camera.json";
+
+    for (int i = 1; i < __argc; i++)
+    {
+        if (strcmp(__argv[i], "-headless") == 0)
+        {
+            headless = true;
+        }
+        else if (strcmp(__argv[i], "-validateCulling") == 0)
+        {
+            validateCulling = true;
+        }
+        else if (strcmp(__argv[i], "-directDraws") == 0)
+        {
+            indirectDraws = false;
+        }
+        else if (strcmp(__argv[i], "-noGpuCulling") == 0)
+        {
+            gpuCulling = false;
+        }
+        else if (strcmp(__argv[i], "-noOcclusionCulling") == 0)
+        {
+            occlusionCulling = false;
+        }
+        else if (strcmp(__argv[i], "-cameraPath") == 0 && i + 1 < __argc)
+        {
+            benchmarkParams.cameraPathFile = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-csv") == 0 && i + 1 < __argc)
+        {
+            benchmarkParams.csvFile = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-frames") == 0 && i + 1 < __argc)
+        {
+            benchmarkParams.frames = std::max(atoi(__argv[++i]), 1);
+        }
+        else if (strcmp(__argv[i], "-width") == 0 && i + 1 < __argc)
+        {
+            benchmarkParams.width = uint32_t(std::max(atoi(__argv[++i]), 1));
+        }
+        else if (strcmp(__argv[i], "-height") == 0 && i + 1 < __argc)
+        {
+            benchmarkParams.height = uint32_t(std::max(atoi(__argv[++i]), 1));
+        }
+    }
+
     app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
 
     app::DeviceCreationParameters deviceParams;
@@ -285,19 +1209,42 @@ int main(int __argc, const char** __argv)
     deviceParams.enableNvrhiValidationLayer = true;
 #endif
 
-    if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
+    // The benchmark and the culling validation render offscreen and never present
+    bool deviceCreated = (headless || validateCulling)
+        ? deviceManager->CreateHeadlessDevice(deviceParams)
+        : deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle);
+
+    if (!deviceCreated)
     {
         log::fatal("Cannot initialize a graphics device with the requested parameters");
         return 1;
     }
     
+    int exitCode = 0;
     {
         BindlessRendering example(deviceManager);
         if (example.Init())
         {
-            deviceManager->AddRenderPassToBack(&example);
-            deviceManager->RunMessageLoop();
-            deviceManager->RemoveRenderPass(&example);
+            example.SetIndirectDrawsEnabled(indirectDraws);
+            example.SetGpuCullingEnabled(gpuCulling);
+            example.SetOcclusionCullingEnabled(occlusionCulling);
+
+            if (validateCulling)
+            {
+                if (!RunCullingValidation(example, deviceManager->GetDevice(), benchmarkParams))
+                    exitCode = 1;
+            }
+            else if (headless)
+            {
+                if (!RunHeadlessBenchmark(example, deviceManager->GetDevice(), benchmarkParams))
+                    exitCode = 1;
+            }
+            else
+            {
+                deviceManager->AddRenderPassToBack(&example);
+                deviceManager->RunMessageLoop();
+                deviceManager->RemoveRenderPass(&example);
+            }
         }
     }
     
@@ -305,5 +1252,5 @@ int main(int __argc, const char** __argv)
 
     delete deviceManager;
 
-    return 0;
+    return exitCode;
 }
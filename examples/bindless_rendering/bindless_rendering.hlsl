@@ -24,6 +24,7 @@
 
 #include <donut/shaders/bindless.h>
 #include <donut/shaders/view_cb.h>
+#include "bindless_rendering_cb.h"
 
 #ifdef SPIRV
 #define VK_PUSH_CONSTANT [[vk::push_constant]]
@@ -44,19 +45,22 @@ VK_PUSH_CONSTANT ConstantBuffer<InstanceConstants> g_Instance : register(b1);
 StructuredBuffer<InstanceData> t_InstanceData : register(t0);
 StructuredBuffer<GeometryData> t_GeometryData : register(t1);
 StructuredBuffer<MaterialConstants> t_MaterialConstants : register(t2);
+StructuredBuffer<DrawRecord> t_DrawRecords : register(t3);
 SamplerState s_MaterialSampler : register(s0);
 
 VK_BINDING(0, 1) ByteAddressBuffer t_BindlessBuffers[] : register(t0, space1);
 VK_BINDING(1, 1) Texture2D t_BindlessTextures[] : register(t0, space2);
 
-void vs_main(
-    in uint i_vertexID : SV_VertexID,
-    out float4 o_position : SV_Position,
-    out float2 o_uv : TEXCOORD,
-    out uint o_material : MATERIAL)
+void TransformVertex(
+    uint instanceIndex,
+    uint geometryIndex,
+    uint i_vertexID,
+    out float4 o_position,
+    out float2 o_uv,
+    out uint o_material)
 {
-    InstanceData instance = t_InstanceData[g_Instance.instance];
-    GeometryData geometry = t_GeometryData[instance.firstGeometryIndex + g_Instance.geometryInMesh];
+    InstanceData instance = t_InstanceData[instanceIndex];
+    GeometryData geometry = t_GeometryData[geometryIndex];
 
     ByteAddressBuffer indexBuffer = t_BindlessBuffers[geometry.indexBufferIndex];
     ByteAddressBuffer vertexBuffer = t_BindlessBuffers[geometry.vertexBufferIndex];
@@ -74,6 +78,34 @@ void vs_main(
     o_material = geometry.materialIndex;
 }
 
+void vs_main(
+    in uint i_vertexID : SV_VertexID,
+    out float4 o_position : SV_Position,
+    out float2 o_uv : TEXCOORD,
+    out uint o_material : MATERIAL)
+{
+    InstanceData instance = t_InstanceData[g_Instance.instance];
+
+    TransformVertex(g_Instance.instance, instance.firstGeometryIndex + g_Instance.geometryInMesh, i_vertexID,
+        o_position, o_uv, o_material);
+}
+
+// The draw ID comes from a per-instance vertex buffer holding 0, 1, 2...
+// Every indirect draw sets startInstanceLocation to its draw index, so the attribute fetch returns that index.
+// SV_InstanceID cannot be used for this because it does not include the start instance on all APIs.
+void vs_main_indirect(
+    in uint i_vertexID : SV_VertexID,
+    in uint i_drawID : DRAWID,
+    out float4 o_position : SV_Position,
+    out float2 o_uv : TEXCOORD,
+    out uint o_material : MATERIAL)
+{
+    DrawRecord record = t_DrawRecords[i_drawID];
+
+    TransformVertex(record.instanceIndex, record.geometryIndex, i_vertexID,
+        o_position, o_uv, o_material);
+}
+
 void ps_main(
     in float4 i_position : SV_Position,
     in float2 i_uv : TEXCOORD, 
@@ -0,0 +1,80 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef BINDLESS_RENDERING_CB_H
+#define BINDLESS_RENDERING_CB_H
+
+// One entry per geometry of every mesh instance, indexed by the draw ID in the indirect draw path
+struct DrawRecord
+{
+    uint instanceIndex;
+    uint geometryIndex; // global index into the geometry buffer
+    uint vertexCount;
+    uint padding0;
+
+    // object space bounds of the geometry, for culling
+    float3 boundsMin;
+    uint padding1;
+    float3 boundsMax;
+    uint padding2;
+};
+
+#define CULLING_GROUP_SIZE 64
+
+// Frustum culling only
+#define CULLING_PHASE_FRUSTUM 0
+// Occlusion culling, first phase: draws that were visible in the previous frame
+#define CULLING_PHASE_PREVIOUS_VISIBLE 1
+// Occlusion culling, second phase: tests all draws against the depth pyramid of the first phase
+// and draws the ones that became visible
+#define CULLING_PHASE_OCCLUSION 2
+
+// Offsets of the counters in the culling statistics buffer
+#define CULLING_STAT_FRUSTUM_VISIBLE 0
+#define CULLING_STAT_OCCLUDED 4
+#define CULLING_STAT_NEWLY_VISIBLE 8
+
+struct CullingConstants
+{
+    // normalized world space planes, a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+    float4 frustumPlanes[6];
+    float4x4 matWorldToClip;
+
+    uint numDraws;
+    uint cullingPhase;
+    uint pyramidLevels;
+    uint padding0;
+
+    uint2 pyramidSize;
+    uint2 padding1;
+};
+
+#define DEPTH_PYRAMID_GROUP_SIZE 8
+
+struct DepthPyramidConstants
+{
+    uint2 sourceSize;
+    uint2 destSize;
+};
+
+#endif // BINDLESS_RENDERING_CB_H
@@ -0,0 +1,68 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "bindless_rendering_cb.h"
+
+#ifdef SPIRV
+#define VK_PUSH_CONSTANT [[vk::push_constant]]
+#else
+#define VK_PUSH_CONSTANT
+#endif
+
+// Builds one level of the depth pyramid used for occlusion culling. Level 0 is a copy of the depth buffer,
+// every other level stores the minimum, which is the farthest depth with reverse Z, of the texels it covers
+// in the level above. Level sizes are rounded down, so the last column and row also cover the odd texels
+// that would otherwise be dropped.
+// Keep in sync with DepthPyramid::Build in InstanceCulling.cpp
+
+VK_PUSH_CONSTANT ConstantBuffer<DepthPyramidConstants> g_Pyramid : register(b0);
+Texture2D<float> t_Source : register(t0);
+RWTexture2D<float> u_Dest : register(u0);
+
+[numthreads(DEPTH_PYRAMID_GROUP_SIZE, DEPTH_PYRAMID_GROUP_SIZE, 1)]
+void cs_build(uint2 pixel : SV_DispatchThreadID)
+{
+    if (any(pixel >= g_Pyramid.destSize))
+        return;
+
+    if (all(g_Pyramid.sourceSize == g_Pyramid.destSize))
+    {
+        u_Dest[pixel] = t_Source[pixel];
+        return;
+    }
+
+    uint2 first = min(pixel * 2, g_Pyramid.sourceSize - 1);
+    uint2 last = min(pixel * 2 + 1, g_Pyramid.sourceSize - 1);
+    if (pixel.x == g_Pyramid.destSize.x - 1)
+        last.x = g_Pyramid.sourceSize.x - 1;
+    if (pixel.y == g_Pyramid.destSize.y - 1)
+        last.y = g_Pyramid.sourceSize.y - 1;
+
+    float result = 1.0;
+    for (uint y = first.y; y <= last.y; y++)
+    {
+        for (uint x = first.x; x <= last.x; x++)
+            result = min(result, t_Source[uint2(x, y)]);
+    }
+
+    u_Dest[pixel] = result;
+}
@@ -0,0 +1,170 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/bindless.h>
+#include "bindless_rendering_cb.h"
+
+// Frustum culls every draw record of the indirect draw path and appends the visible ones
+// to a compacted list of indirect arguments. The arguments buffer is cleared to zero before
+// the dispatch, so the unused entries after the visible draws do not draw anything.
+//
+// With occlusion culling, the pass runs twice per frame. The first phase draws what was visible
+// in the previous frame, according to u_DrawVisibility. The depth of that phase goes into a depth
+// pyramid, and the second phase tests all draws against it, stores the visibility for the next frame,
+// and appends the draws that were not drawn by the first phase.
+
+ConstantBuffer<CullingConstants> g_Culling : register(b0);
+StructuredBuffer<InstanceData> t_InstanceData : register(t0);
+StructuredBuffer<DrawRecord> t_DrawRecords : register(t1);
+RWByteAddressBuffer u_DrawArguments : register(u0);
+RWByteAddressBuffer u_DrawCount : register(u1);
+RWByteAddressBuffer u_DrawVisibility : register(u2);
+RWByteAddressBuffer u_CullingStats : register(u3);
+Texture2D<float> t_DepthPyramid : register(t2);
+
+// Keep in sync with TestDrawVisibility in InstanceCulling.cpp
+bool IsBoxVisible(float3 center, float3 extent)
+{
+    [unroll]
+    for (uint planeIndex = 0; planeIndex < 6; planeIndex++)
+    {
+        float4 plane = g_Culling.frustumPlanes[planeIndex];
+
+        float distance = dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extent);
+        if (distance < 0)
+            return false;
+    }
+
+    return true;
+}
+
+// Keep in sync with DepthPyramid::TestBox in InstanceCulling.cpp
+bool IsBoxOccluded(float3 center, float3 extent)
+{
+    float2 minUV = 1.0;
+    float2 maxUV = 0.0;
+    float maxDepth = 0.0;
+
+    [unroll]
+    for (uint cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+    {
+        float3 corner = center + extent * float3(
+            (cornerIndex & 1) ? 1.0 : -1.0,
+            (cornerIndex & 2) ? 1.0 : -1.0,
+            (cornerIndex & 4) ? 1.0 : -1.0);
+
+        float4 clipPos = mul(float4(corner, 1.0), g_Culling.matWorldToClip);
+
+        // The box crosses the near plane, its screen rectangle is unbounded
+        if (clipPos.w <= 1e-5)
+            return false;
+
+        float3 ndc = clipPos.xyz / clipPos.w;
+        float2 uv = ndc.xy * float2(0.5, -0.5) + 0.5;
+        minUV = min(minUV, uv);
+        maxUV = max(maxUV, uv);
+        maxDepth = max(maxDepth, ndc.z);
+    }
+
+    uint2 size = g_Culling.pyramidSize;
+    uint2 minPixel = min(uint2(saturate(minUV) * float2(size)), size - 1);
+    uint2 maxPixel = min(uint2(saturate(maxUV) * float2(size)), size - 1);
+
+    // Pick the level where the rectangle covers at most 2x2 texels
+    uint2 extentPixels = maxPixel - minPixel + 1;
+    uint maxExtent = max(extentPixels.x, extentPixels.y);
+    uint level = maxExtent <= 1 ? 0 : firstbithigh(maxExtent - 1) + 1;
+    level = min(level, g_Culling.pyramidLevels - 1);
+
+    uint2 levelSize = max(size >> level, 1);
+    uint2 first = min(minPixel >> level, levelSize - 1);
+    uint2 last = min(maxPixel >> level, levelSize - 1);
+
+    float pyramidDepth = 1.0;
+    for (uint y = first.y; y <= last.y; y++)
+    {
+        for (uint x = first.x; x <= last.x; x++)
+            pyramidDepth = min(pyramidDepth, t_DepthPyramid.Load(int3(x, y, level)));
+    }
+
+    // Reverse Z: the nearest point of the box is behind the farthest occluder in the rectangle
+    return maxDepth < pyramidDepth;
+}
+
+void AddToStatistic(uint offset, bool condition)
+{
+    uint count = WaveActiveCountBits(condition);
+    if (WaveIsFirstLane() && count != 0)
+        u_CullingStats.InterlockedAdd(offset, count);
+}
+
+[numthreads(CULLING_GROUP_SIZE, 1, 1)]
+void cs_cull(uint drawIndex : SV_DispatchThreadID)
+{
+    if (drawIndex >= g_Culling.numDraws)
+        return;
+
+    DrawRecord record = t_DrawRecords[drawIndex];
+    InstanceData instance = t_InstanceData[record.instanceIndex];
+
+    float3 objectCenter = (record.boundsMin + record.boundsMax) * 0.5;
+    float3 objectExtent = (record.boundsMax - record.boundsMin) * 0.5;
+
+    float3 worldCenter = mul(instance.transform, float4(objectCenter, 1.0)).xyz;
+    float3 worldExtent = mul(abs((float3x3)instance.transform), objectExtent);
+
+    bool visible = IsBoxVisible(worldCenter, worldExtent);
+
+    if (g_Culling.cullingPhase == CULLING_PHASE_PREVIOUS_VISIBLE)
+    {
+        visible = visible && u_DrawVisibility.Load(drawIndex * 4) != 0;
+    }
+    else if (g_Culling.cullingPhase == CULLING_PHASE_OCCLUSION)
+    {
+        bool drawnInFirstPhase = visible && u_DrawVisibility.Load(drawIndex * 4) != 0;
+        bool occluded = visible && IsBoxOccluded(worldCenter, worldExtent);
+
+        AddToStatistic(CULLING_STAT_FRUSTUM_VISIBLE, visible);
+        AddToStatistic(CULLING_STAT_OCCLUDED, occluded);
+
+        visible = visible && !occluded;
+        u_DrawVisibility.Store(drawIndex * 4, visible ? 1 : 0);
+
+        // Drawn in the first phase, it contributed to the depth pyramid and does not need another draw
+        if (drawnInFirstPhase)
+            visible = false;
+
+        AddToStatistic(CULLING_STAT_NEWLY_VISIBLE, visible);
+    }
+
+    if (!visible)
+        return;
+
+    uint slot;
+    u_DrawCount.InterlockedAdd(0, 1, slot);
+
+    // DrawIndirectArguments: vertexCount, instanceCount, startVertexLocation, startInstanceLocation (the draw ID)
+    u_DrawArguments.Store4(slot * 16, uint4(record.vertexCount, 1, 0, drawIndex));
+}
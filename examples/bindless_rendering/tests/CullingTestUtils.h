@@ -0,0 +1,56 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// Draw records and result names shared by the CPU-only culling and occlusion tests
+
+#include <donut/core/math/math.h>
+
+using namespace donut::math;
+
+#include "bindless_rendering_cb.h"
+#include "InstanceCulling.h"
+
+inline const char* ToString(DrawVisibility visibility)
+{
+    switch (visibility)
+    {
+    case DrawVisibility::Culled: return "Culled";
+    case DrawVisibility::Visible: return "Visible";
+    case DrawVisibility::Borderline: return "Borderline";
+    default: return "?";
+    }
+}
+
+inline DrawRecord MakeRecordFromBounds(const float3& boundsMin, const float3& boundsMax)
+{
+    DrawRecord record = {};
+    record.boundsMin = boundsMin;
+    record.boundsMax = boundsMax;
+    return record;
+}
+
+inline DrawRecord MakeRecordFromCenterExtent(const float3& center, const float3& extent)
+{
+    return MakeRecordFromBounds(center - extent, center + extent);
+}
@@ -0,0 +1,211 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// CPU-only test of the frustum culling kernel used to validate instance_culling.hlsl.
+// The expected results are worked out by hand for a 90 degree camera at the origin looking along +Z,
+// and a set of random draws is checked against a brute force test of the box corners.
+
+#include "CullingTestUtils.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+struct ReferenceCase
+{
+    const char* name;
+    float3 boundsMin;
+    float3 boundsMax;
+    float transform[12];
+    DrawVisibility expected;
+};
+
+// The frustum is x <= z, -x <= z, y <= z, -y <= z and z >= 0.1, with no far plane.
+// The side planes are at 45 degrees, so a box is on a plane when the distances along its normal cancel out.
+static const ReferenceCase c_ReferenceCases[] = {
+    { "inside",              float3(-1.f), float3(1.f), { 1, 0, 0, 0,    0, 1, 0, 0,    0, 0, 1, 5 },     DrawVisibility::Visible },
+    { "behind the camera",   float3(-1.f), float3(1.f), { 1, 0, 0, 0,    0, 1, 0, 0,    0, 0, 1, -5 },    DrawVisibility::Culled },
+    { "right of the view",   float3(-1.f), float3(1.f), { 1, 0, 0, 20,   0, 1, 0, 0,    0, 0, 1, 5 },     DrawVisibility::Culled },
+    { "above the view",      float3(-1.f), float3(1.f), { 1, 0, 0, 0,    0, 1, 0, 20,   0, 0, 1, 5 },     DrawVisibility::Culled },
+    { "crossing the right",  float3(-1.f), float3(1.f), { 1, 0, 0, 5,    0, 1, 0, 0,    0, 0, 1, 5 },     DrawVisibility::Visible },
+    // the corner (6, y, 6) is exactly on the plane x = z
+    { "touching the right",  float3(-1.f), float3(1.f), { 1, 0, 0, 7,    0, 1, 0, 0,    0, 0, 1, 5 },     DrawVisibility::Borderline },
+    { "touching the left",   float3(-1.f), float3(1.f), { 1, 0, 0, -7,   0, 1, 0, 0,    0, 0, 1, 5 },     DrawVisibility::Borderline },
+    // scaled by 2 around z = -1.5, reaches z = 0.5, in front of the near plane
+    { "scaled, near",        float3(-1.f), float3(1.f), { 2, 0, 0, 0,    0, 2, 0, 0,    0, 0, 2, -1.5f }, DrawVisibility::Visible },
+    // scaled by 2 around z = -2.5, reaches z = -0.5, behind the near plane
+    { "scaled, behind near", float3(-1.f), float3(1.f), { 2, 0, 0, 0,    0, 2, 0, 0,    0, 0, 2, -2.5f }, DrawVisibility::Culled },
+    // a vertical rod from y = 8 to 16 at z = 10 crosses the top plane y = z
+    { "vertical rod",        float3(-0.1f, -4.f, -0.1f), float3(0.1f, 4.f, 0.1f), { 1, 0, 0, 0,    0, 1, 0, 12,   0, 0, 1, 10 }, DrawVisibility::Visible },
+    // the same rod turned 90 degrees around Z lies flat at y = 12, above the view
+    { "rotated rod",         float3(-0.1f, -4.f, -0.1f), float3(0.1f, 4.f, 0.1f), { 0, -1, 0, 0,   1, 0, 0, 12,   0, 0, 1, 10 }, DrawVisibility::Culled },
+};
+
+static void TestReferenceCases(const FrustumPlanes& planes)
+{
+    for (const ReferenceCase& referenceCase : c_ReferenceCases)
+    {
+        const DrawRecord record = MakeRecordFromBounds(referenceCase.boundsMin, referenceCase.boundsMax);
+        const DrawVisibility result = TestDrawVisibility(record, referenceCase.transform, planes, 1e-3f);
+
+        CHECK(result == referenceCase.expected, "'%s' is %s, expected %s",
+            referenceCase.name, ToString(result), ToString(referenceCase.expected));
+    }
+}
+
+static void TestFrustumPlanes(const FrustumPlanes& planes)
+{
+    // points inside the frustum are in front of every plane, a point behind the near plane is not
+    const float3 inside[] = { float3(0.f, 0.f, 1.f), float3(0.9f, -0.9f, 1.f), float3(0.f, 0.f, 1e6f) };
+    for (const float3& point : inside)
+    {
+        for (const float4& plane : planes)
+            CHECK(dot(plane.xyz(), point) + plane.w > 0.f, "(%g, %g, %g) is outside a frustum plane", point.x, point.y, point.z);
+    }
+
+    const float3 beforeNearPlane = float3(0.f, 0.f, 0.05f);
+    bool beforeNearPlaneCulled = false;
+    for (const float4& plane : planes)
+        beforeNearPlaneCulled |= dot(plane.xyz(), beforeNearPlane) + plane.w < 0.f;
+    CHECK(beforeNearPlaneCulled, "a point between the camera and the near plane passes");
+
+    // the infinite projection has no far plane, it is replaced by one that always passes
+    int numDisabledPlanes = 0;
+    for (const float4& plane : planes)
+        numDisabledPlanes += (plane.x == 0.f && plane.y == 0.f && plane.z == 0.f && plane.w == 1.f) ? 1 : 0;
+    CHECK(numDisabledPlanes == 1, "%d planes are disabled, expected only the far plane", numDisabledPlanes);
+}
+
+static float3 TransformPoint(const float transform[12], const float3& p)
+{
+    return float3(
+        transform[0] * p.x + transform[1] * p.y + transform[2] * p.z + transform[3],
+        transform[4] * p.x + transform[5] * p.y + transform[6] * p.z + transform[7],
+        transform[8] * p.x + transform[9] * p.y + transform[10] * p.z + transform[11]);
+}
+
+static float3 GetCorner(const float3& boundsMin, const float3& boundsMax, uint32_t cornerIndex)
+{
+    return float3(
+        (cornerIndex & 1) ? boundsMax.x : boundsMin.x,
+        (cornerIndex & 2) ? boundsMax.y : boundsMin.y,
+        (cornerIndex & 4) ? boundsMax.z : boundsMin.z);
+}
+
+// A box is outside a plane when all its corners are
+static DrawVisibility TestCorners(const float3 corners[8], const FrustumPlanes& planes, float tolerance)
+{
+    DrawVisibility result = DrawVisibility::Visible;
+
+    for (const float4& plane : planes)
+    {
+        float maxDistance = -INFINITY;
+        for (uint32_t cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+            maxDistance = std::max(maxDistance, dot(plane.xyz(), corners[cornerIndex]) + plane.w);
+
+        if (maxDistance < -tolerance)
+            return DrawVisibility::Culled;
+
+        if (maxDistance < tolerance)
+            result = DrawVisibility::Borderline;
+    }
+
+    return result;
+}
+
+static void TestRandomDraws(const FrustumPlanes& planes)
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-30.f, 30.f);
+    std::uniform_real_distribution<float> size(0.05f, 4.f);
+    std::uniform_real_distribution<float> angle(0.f, 2.f * PI_f);
+
+    constexpr int numDraws = 10000;
+    constexpr float tolerance = 1e-3f;
+    int numCulled = 0;
+    int numVisible = 0;
+
+    for (int drawIndex = 0; drawIndex < numDraws; drawIndex++)
+    {
+        const float3 halfSize = float3(size(random), size(random), size(random));
+        const DrawRecord record = MakeRecordFromBounds(-halfSize, halfSize);
+
+        // a rotation around Y followed by one around X, and a translation
+        const float a = angle(random);
+        const float b = angle(random);
+        const float ca = cosf(a), sa = sinf(a), cb = cosf(b), sb = sinf(b);
+        const float transform[12] = {
+            ca,       0.f, sa,       position(random),
+            sa * sb,  cb,  -ca * sb, position(random),
+            -sa * cb, sb,  ca * cb,  position(random) };
+
+        // The kernel tests the world space bounding box of the transformed bounds, like cs_cull
+        float3 orientedCorners[8];
+        float3 worldMin = float3(INFINITY);
+        float3 worldMax = float3(-INFINITY);
+        for (uint32_t cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+        {
+            orientedCorners[cornerIndex] = TransformPoint(transform, GetCorner(record.boundsMin, record.boundsMax, cornerIndex));
+            worldMin = min(worldMin, orientedCorners[cornerIndex]);
+            worldMax = max(worldMax, orientedCorners[cornerIndex]);
+        }
+
+        float3 worldCorners[8];
+        for (uint32_t cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+            worldCorners[cornerIndex] = GetCorner(worldMin, worldMax, cornerIndex);
+
+        // the tests round differently, so only draws that are clearly on one side are compared
+        const DrawVisibility reference = TestCorners(worldCorners, planes, 10.f * tolerance);
+        const DrawVisibility tightReference = TestCorners(orientedCorners, planes, 10.f * tolerance);
+        const DrawVisibility result = TestDrawVisibility(record, transform, planes, tolerance);
+
+        if (reference != DrawVisibility::Borderline)
+        {
+            CHECK(result == reference, "random draw %d is %s, its world bounds are %s", drawIndex, ToString(result), ToString(reference));
+        }
+
+        // the world bounds contain the transformed bounds, so the kernel must never cull a draw that is in view
+        if (tightReference == DrawVisibility::Visible)
+        {
+            CHECK(result != DrawVisibility::Culled, "random draw %d is culled, but its transformed bounds are in view", drawIndex);
+        }
+
+        if (reference == DrawVisibility::Culled)
+            numCulled++;
+        else if (reference == DrawVisibility::Visible)
+            numVisible++;
+    }
+
+    // make sure that the random draws exercise both results
+    CHECK(numCulled > numDraws / 10 && numVisible > numDraws / 10, "%d culled and %d visible random draws", numCulled, numVisible);
+}
+
+int main()
+{
+    const FrustumPlanes planes = GetFrustumPlanes(perspProjD3DStyleReverse(PI_f * 0.5f, 1.f, 0.1f));
+
+    TestFrustumPlanes(planes);
+    TestReferenceCases(planes);
+    TestRandomDraws(planes);
+
+    return ReportTestResults("All culling checks passed");
+}
@@ -0,0 +1,267 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// CPU-only test of the depth pyramid and the occlusion test used to validate depth_pyramid.hlsl and instance_culling.hlsl.
+// The pyramid is compared with a brute force reduction, and the occlusion results with hand-computed results
+// for a wall that covers the left half of the screen and with a per-pixel test of random boxes.
+
+#include "CullingTestUtils.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+static const float c_Identity[12] = {
+    1.f, 0.f, 0.f, 0.f,
+    0.f, 1.f, 0.f, 0.f,
+    0.f, 0.f, 1.f, 0.f };
+
+static void TestNumLevels()
+{
+    struct { uint32_t width, height, levels; } const cases[] = {
+        { 1, 1, 1 }, { 2, 1, 2 }, { 5, 3, 3 }, { 64, 64, 7 }, { 100, 60, 7 }, { 1920, 1080, 11 } };
+
+    for (const auto& c : cases)
+    {
+        const uint32_t levels = DepthPyramid::GetNumLevels(c.width, c.height);
+        CHECK(levels == c.levels, "%ux%u has %u levels, expected %u", c.width, c.height, levels, c.levels);
+    }
+}
+
+// Every texel of the pyramid holds the farthest depth, the minimum with reverse Z, of the pixels it covers.
+// Texel x of level l covers the pixels from x << l to (x + 1) << l, and the last texel of a row or column
+// extends to the edge of the image, which covers the odd pixels of non power of two sizes.
+static void TestPyramidReduction(uint32_t width, uint32_t height, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> depthDistribution(0.f, 1.f);
+
+    // padded rows, to test the row pitch
+    const size_t rowPitch = width + 3;
+    std::vector<float> depth(rowPitch * height, -1.f);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+            depth[y * rowPitch + x] = depthDistribution(random);
+    }
+
+    DepthPyramid pyramid;
+    pyramid.Build(depth.data(), width, height, rowPitch);
+
+    CHECK(pyramid.GetWidth() == width && pyramid.GetHeight() == height, "the %ux%u pyramid is %ux%u", width, height, pyramid.GetWidth(), pyramid.GetHeight());
+    CHECK(pyramid.GetNumLevels() == DepthPyramid::GetNumLevels(width, height), "the %ux%u pyramid has %u levels", width, height, pyramid.GetNumLevels());
+
+    for (uint32_t level = 0; level < pyramid.GetNumLevels(); level++)
+    {
+        const uint32_t levelWidth = std::max(width >> level, 1u);
+        const uint32_t levelHeight = std::max(height >> level, 1u);
+
+        for (uint32_t y = 0; y < levelHeight; y++)
+        {
+            const uint32_t firstY = y << level;
+            const uint32_t endY = (y == levelHeight - 1) ? height : std::min((y + 1) << level, height);
+
+            for (uint32_t x = 0; x < levelWidth; x++)
+            {
+                const uint32_t firstX = x << level;
+                const uint32_t endX = (x == levelWidth - 1) ? width : std::min((x + 1) << level, width);
+
+                float expected = 1.f;
+                for (uint32_t py = firstY; py < endY; py++)
+                {
+                    for (uint32_t px = firstX; px < endX; px++)
+                        expected = std::min(expected, depth[py * rowPitch + px]);
+                }
+
+                const float result = pyramid.Load(level, x, y);
+                CHECK(result == expected, "%ux%u pyramid, level %u texel (%u, %u) is %g, expected %g", width, height, level, x, y, result, expected);
+            }
+        }
+    }
+}
+
+// Two triangles at depth z, from x0 to x1 and from y0 to y1 in world space
+static void DrawWall(DepthRasterizer& rasterizer, const float4x4& worldToClip, float x0, float x1, float y0, float y1, float z)
+{
+    const float3 positions[] = { float3(x0, y0, z), float3(x1, y0, z), float3(x1, y1, z), float3(x0, y1, z) };
+    const uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
+    rasterizer.DrawTriangles(c_Identity, worldToClip, positions, indices, std::size(indices));
+}
+
+static void TestRasterizer(const float4x4& worldToClip, uint32_t width, uint32_t height)
+{
+    DepthRasterizer rasterizer;
+    rasterizer.Clear(width, height);
+
+    // with an infinite reverse Z projection, the depth is zNear / z
+    DrawWall(rasterizer, worldToClip, -100.f, 100.f, -100.f, 100.f, 5.f);
+
+    const float expected = 0.1f / 5.f;
+    int wrongPixels = 0;
+    for (float depth : rasterizer.GetDepth())
+        wrongPixels += (std::abs(depth - expected) > 1e-6f) ? 1 : 0;
+
+    CHECK(wrongPixels == 0, "%d pixels of a full screen wall do not have the depth %g", wrongPixels, expected);
+
+    // a nearer wall over the left half replaces the depth there, and only there
+    DrawWall(rasterizer, worldToClip, -100.f, 0.f, -100.f, 100.f, 2.f);
+
+    const float nearExpected = 0.1f / 2.f;
+    const std::vector<float>& depth = rasterizer.GetDepth();
+    CHECK(std::abs(depth[10 * width + 1] - nearExpected) < 1e-6f, "the nearer wall is not drawn on the left");
+    CHECK(std::abs(depth[10 * width + width - 2] - expected) < 1e-6f, "the nearer wall is drawn on the right");
+}
+
+struct OcclusionCase
+{
+    const char* name;
+    float3 center;
+    float3 extent;
+    DrawVisibility expected;
+};
+
+// A wall at z = 5 covers the left half of the screen, and nothing is drawn on the right half
+static const OcclusionCase c_OcclusionCases[] = {
+    { "behind the wall",            float3(-4.f, 0.f, 10.f),  float3(0.5f), DrawVisibility::Culled },
+    { "far behind the wall",        float3(-20.f, 3.f, 50.f), float3(2.f),  DrawVisibility::Culled },
+    { "nothing in front",           float3(4.f, 0.f, 10.f),   float3(0.5f), DrawVisibility::Visible },
+    { "in front of the wall",       float3(-2.f, 0.f, 3.f),   float3(0.5f), DrawVisibility::Visible },
+    { "crossing the wall",          float3(-2.f, 0.f, 5.f),   float3(0.5f), DrawVisibility::Visible },
+    { "past the edge of the wall",  float3(-0.5f, 0.f, 10.f), float3(1.f),  DrawVisibility::Visible },
+    { "around the camera",          float3(0.f, 0.f, 0.f),    float3(1.f),  DrawVisibility::Visible },
+};
+
+static void TestOcclusionCases(const float4x4& worldToClip, uint32_t width, uint32_t height)
+{
+    DepthRasterizer rasterizer;
+    rasterizer.Clear(width, height);
+    DrawWall(rasterizer, worldToClip, -100.f, 0.f, -100.f, 100.f, 5.f);
+
+    DepthPyramid pyramid;
+    pyramid.Build(rasterizer.GetDepth().data(), width, height, width);
+
+    for (const OcclusionCase& occlusionCase : c_OcclusionCases)
+    {
+        const DrawRecord record = MakeRecordFromCenterExtent(occlusionCase.center, occlusionCase.extent);
+        const DrawVisibility result = TestDrawOcclusion(record, c_Identity, worldToClip, pyramid, 1e-6f, 0.01f);
+
+        CHECK(result == occlusionCase.expected, "'%s' is %s, expected %s",
+            occlusionCase.name, ToString(result), ToString(occlusionCase.expected));
+    }
+}
+
+// Random walls and boxes. A box that the pyramid culls must be behind the depth of every pixel
+// that its screen rectangle touches, and some of the boxes must be culled for the test to mean anything.
+static void TestRandomOcclusion(const float4x4& worldToClip, uint32_t width, uint32_t height)
+{
+    std::mt19937 random(5678);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    DepthRasterizer rasterizer;
+    rasterizer.Clear(width, height);
+
+    for (int wall = 0; wall < 8; wall++)
+    {
+        const float z = 2.f + 10.f * unit(random);
+        const float x = (unit(random) * 2.f - 1.f) * z;
+        const float y = (unit(random) * 2.f - 1.f) * z;
+        const float size = (0.5f + unit(random)) * z;
+        DrawWall(rasterizer, worldToClip, x - size, x + size, y - size, y + size, z);
+    }
+
+    const std::vector<float>& depth = rasterizer.GetDepth();
+
+    DepthPyramid pyramid;
+    pyramid.Build(depth.data(), width, height, width);
+
+    constexpr int numBoxes = 5000;
+    int numCulled = 0;
+
+    for (int boxIndex = 0; boxIndex < numBoxes; boxIndex++)
+    {
+        const float z = 1.f + 30.f * unit(random);
+        const float3 center = float3((unit(random) * 2.f - 1.f) * z, (unit(random) * 2.f - 1.f) * z, z);
+        const float3 extent = float3(0.05f + unit(random), 0.05f + unit(random), 0.05f + unit(random));
+        const DrawRecord record = MakeRecordFromCenterExtent(center, extent);
+
+        const DrawVisibility result = TestDrawOcclusion(record, c_Identity, worldToClip, pyramid, 1e-6f, 0.01f);
+        if (result != DrawVisibility::Culled)
+            continue;
+
+        numCulled++;
+
+        // the screen rectangle and the nearest depth of the box, from its corners
+        float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY, maxDepth = 0.f;
+        for (uint32_t cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+        {
+            const float3 corner = center + extent * float3(
+                (cornerIndex & 1) ? 1.f : -1.f,
+                (cornerIndex & 2) ? 1.f : -1.f,
+                (cornerIndex & 4) ? 1.f : -1.f);
+
+            const float4 clipPos = float4(corner, 1.f) * worldToClip;
+            const float3 ndc = clipPos.xyz() / clipPos.w;
+            minX = std::min(minX, (ndc.x * 0.5f + 0.5f) * float(width));
+            maxX = std::max(maxX, (ndc.x * 0.5f + 0.5f) * float(width));
+            minY = std::min(minY, (ndc.y * -0.5f + 0.5f) * float(height));
+            maxY = std::max(maxY, (ndc.y * -0.5f + 0.5f) * float(height));
+            maxDepth = std::max(maxDepth, ndc.z);
+        }
+
+        const int firstX = std::clamp(int(minX), 0, int(width) - 1);
+        const int lastX = std::clamp(int(maxX), 0, int(width) - 1);
+        const int firstY = std::clamp(int(minY), 0, int(height) - 1);
+        const int lastY = std::clamp(int(maxY), 0, int(height) - 1);
+
+        bool hidden = true;
+        for (int y = firstY; y <= lastY && hidden; y++)
+        {
+            for (int x = firstX; x <= lastX && hidden; x++)
+                hidden = maxDepth < depth[size_t(y) * width + x];
+        }
+
+        CHECK(hidden, "random box %d is culled, but it is in front of a pixel it covers", boxIndex);
+    }
+
+    CHECK(numCulled > numBoxes / 20, "only %d of %d random boxes are culled", numCulled, numBoxes);
+}
+
+int main()
+{
+    TestNumLevels();
+
+    // power of two, odd and single row sizes
+    TestPyramidReduction(64, 32, 1);
+    TestPyramidReduction(100, 60, 2);
+    TestPyramidReduction(37, 5, 3);
+    TestPyramidReduction(7, 1, 4);
+
+    constexpr uint32_t width = 100;
+    constexpr uint32_t height = 60;
+    const float4x4 worldToClip = perspProjD3DStyleReverse(PI_f * 0.5f, float(width) / float(height), 0.1f);
+
+    TestRasterizer(worldToClip, width, height);
+    TestOcclusionCases(worldToClip, width, height);
+    TestRandomOcclusion(worldToClip, width, height);
+
+    return ReportTestResults("All depth pyramid and occlusion checks passed");
+}
@@ -0,0 +1,220 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Benchmark.h"
+#include <donut/core/json.h>
+#include <donut/core/log.h>
+#include <json/value.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+using namespace donut;
+using namespace donut::math;
+
+static bool ReadFloat3(const Json::Value& node, float3& result)
+{
+    if (!node.isArray() || node.size() != 3)
+        return false;
+
+    result = float3(node[0].asFloat(), node[1].asFloat(), node[2].asFloat());
+    return true;
+}
+
+static float3 CatmullRom(const float3& p0, const float3& p1, const float3& p2, const float3& p3, float t)
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+
+    return 0.5f * ((2.f * p1)
+        + (p2 - p0) * t
+        + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t2
+        + (3.f * p1 - p0 - 3.f * p2 + p3) * t3);
+}
+
+bool CameraPath::Load(vfs::IFileSystem& fs, const std::filesystem::path& fileName)
+{
+    Json::Value root;
+    if (!json::LoadFromFile(fs, fileName, root))
+        return false;
+
+    const Json::Value& keys = root["keys"];
+    if (!keys.isArray())
+    {
+        log::error("Camera path '%s' doesn't contain a 'keys' array", fileName.generic_string().c_str());
+        return false;
+    }
+
+    m_Keys.clear();
+
+    for (const auto& node : keys)
+    {
+        Key key;
+        key.time = node["time"].asFloat();
+
+        if (!ReadFloat3(node["position"], key.position) || !ReadFloat3(node["target"], key.target))
+        {
+            log::error("Camera path '%s' contains a key with invalid position or target", fileName.generic_string().c_str());
+            return false;
+        }
+
+        AddKey(key);
+    }
+
+    if (m_Keys.empty())
+    {
+        log::error("Camera path '%s' is empty", fileName.generic_string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void CameraPath::AddKey(const Key& key)
+{
+    // keep the keys sorted by time so that Evaluate can do a binary search
+    auto it = std::upper_bound(m_Keys.begin(), m_Keys.end(), key.time,
+        [](float time, const Key& k) { return time < k.time; });
+
+    m_Keys.insert(it, key);
+}
+
+float CameraPath::GetDuration() const
+{
+    if (m_Keys.empty())
+        return 0.f;
+
+    return m_Keys.back().time - m_Keys.front().time;
+}
+
+void CameraPath::Evaluate(float time, float3& position, float3& target) const
+{
+    if (m_Keys.empty())
+        return;
+
+    if (m_Keys.size() == 1 || time <= m_Keys.front().time)
+    {
+        position = m_Keys.front().position;
+        target = m_Keys.front().target;
+        return;
+    }
+
+    if (time >= m_Keys.back().time)
+    {
+        position = m_Keys.back().position;
+        target = m_Keys.back().target;
+        return;
+    }
+
+    auto it = std::upper_bound(m_Keys.begin(), m_Keys.end(), time,
+        [](float t, const Key& k) { return t < k.time; });
+
+    size_t i2 = size_t(it - m_Keys.begin());
+    size_t i1 = i2 - 1;
+    size_t i0 = (i1 > 0) ? i1 - 1 : i1;
+    size_t i3 = std::min(i2 + 1, m_Keys.size() - 1);
+
+    const Key& k0 = m_Keys[i0];
+    const Key& k1 = m_Keys[i1];
+    const Key& k2 = m_Keys[i2];
+    const Key& k3 = m_Keys[i3];
+
+    float segment = k2.time - k1.time;
+    float t = (segment > 0.f) ? (time - k1.time) / segment : 0.f;
+
+    position = CatmullRom(k0.position, k1.position, k2.position, k3.position, t);
+    target = CatmullRom(k0.target, k1.target, k2.target, k3.target, t);
+}
+
+FrameTimeReport::Sample FrameTimeReport::GetPercentile(double percentile) const
+{
+    if (m_Samples.empty())
+        return Sample();
+
+    std::vector<double> cpuTimes;
+    std::vector<double> frameTimes;
+    std::vector<uint32_t> apiCalls;
+    cpuTimes.reserve(m_Samples.size());
+    frameTimes.reserve(m_Samples.size());
+    apiCalls.reserve(m_Samples.size());
+
+    for (const auto& sample : m_Samples)
+    {
+        cpuTimes.push_back(sample.cpuMilliseconds);
+        frameTimes.push_back(sample.frameMilliseconds);
+        apiCalls.push_back(sample.apiCalls);
+    }
+
+    std::sort(cpuTimes.begin(), cpuTimes.end());
+    std::sort(frameTimes.begin(), frameTimes.end());
+    std::sort(apiCalls.begin(), apiCalls.end());
+
+    size_t rank = size_t(std::ceil(percentile / 100.0 * double(m_Samples.size())));
+    size_t index = std::min(std::max(rank, size_t(1)), m_Samples.size()) - 1;
+
+    Sample result;
+    result.cpuMilliseconds = cpuTimes[index];
+    result.frameMilliseconds = frameTimes[index];
+    result.apiCalls = apiCalls[index];
+    return result;
+}
+
+bool FrameTimeReport::WriteCSV(const std::filesystem::path& fileName) const
+{
+    std::ofstream file(fileName);
+    if (!file.is_open())
+    {
+        log::error("Cannot open '%s' for writing", fileName.generic_string().c_str());
+        return false;
+    }
+
+    file << "frame,cpu_ms,frame_ms,api_calls\n";
+
+    for (size_t i = 0; i < m_Samples.size(); i++)
+    {
+        file << i << "," << m_Samples[i].cpuMilliseconds << "," << m_Samples[i].frameMilliseconds << "," << m_Samples[i].apiCalls << "\n";
+    }
+
+    const std::pair<const char*, double> percentiles[] = { { "p50", 50.0 }, { "p95", 95.0 }, { "p99", 99.0 } };
+    for (const auto& [name, value] : percentiles)
+    {
+        Sample sample = GetPercentile(value);
+        file << name << "," << sample.cpuMilliseconds << "," << sample.frameMilliseconds << "," << sample.apiCalls << "\n";
+    }
+
+    return true;
+}
+
+void FrameTimeReport::PrintSummary() const
+{
+    Sample p50 = GetPercentile(50.0);
+    Sample p95 = GetPercentile(95.0);
+    Sample p99 = GetPercentile(99.0);
+
+    log::info("Benchmark: %d frames", int(m_Samples.size()));
+    log::info("  CPU ms:   p50 %.3f  p95 %.3f  p99 %.3f", p50.cpuMilliseconds, p95.cpuMilliseconds, p99.cpuMilliseconds);
+    log::info("  Frame ms: p50 %.3f  p95 %.3f  p99 %.3f", p50.frameMilliseconds, p95.frameMilliseconds, p99.frameMilliseconds);
+
+    // only the examples that count their command list calls report them
+    if (p99.apiCalls != 0)
+        log::info("  API calls per frame: p50 %u  p99 %u", p50.apiCalls, p99.apiCalls);
+}
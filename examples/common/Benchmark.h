@@ -0,0 +1,86 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <donut/core/vfs/VFS.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// A camera path made of timed position/target keys, interpolated with a Catmull-Rom spline.
+// The file format is:
+// {
+//     "keys": [
+//         { "time": 0.0, "position": [x, y, z], "target": [x, y, z] },
+//         ...
+//     ]
+// }
+class CameraPath
+{
+public:
+    struct Key
+    {
+        float time = 0.f;
+        donut::math::float3 position = 0.f;
+        donut::math::float3 target = 0.f;
+    };
+
+    bool Load(donut::vfs::IFileSystem& fs, const std::filesystem::path& fileName);
+
+    void AddKey(const Key& key);
+
+    // Returns the camera position and target at the given time, clamped to the path duration.
+    void Evaluate(float time, donut::math::float3& position, donut::math::float3& target) const;
+
+    float GetDuration() const;
+    bool IsEmpty() const { return m_Keys.empty(); }
+
+private:
+    std::vector<Key> m_Keys;
+};
+
+// Collects per-frame timings of a benchmark run and writes them out as CSV,
+// followed by the 50th, 95th and 99th percentiles of each column.
+class FrameTimeReport
+{
+public:
+    struct Sample
+    {
+        double cpuMilliseconds = 0.0;   // recording and submission
+        double frameMilliseconds = 0.0; // including the wait for GPU completion
+        uint32_t apiCalls = 0;          // command list calls recorded by the example, if it counts them
+    };
+
+    void AddSample(const Sample& sample) { m_Samples.push_back(sample); }
+    size_t GetNumSamples() const { return m_Samples.size(); }
+
+    // Nearest-rank percentile, 'percentile' is in the [0, 100] range.
+    Sample GetPercentile(double percentile) const;
+
+    bool WriteCSV(const std::filesystem::path& fileName) const;
+    void PrintSummary() const;
+
+private:
+    std::vector<Sample> m_Samples;
+};
@@ -0,0 +1,76 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DrawListChangeTracker.h"
+
+using namespace donut;
+
+bool DrawListChangeTracker::Update(const engine::SceneGraph& sceneGraph)
+{
+    const auto& instances = sceneGraph.GetMeshInstances();
+    const auto& materials = sceneGraph.GetMaterials();
+
+    bool changed = !m_Valid
+        || sceneGraph.GetRootNode().get() != m_RootNode
+        || instances.size() != m_Instances.size()
+        || materials.size() != m_Materials.size();
+
+    for (size_t index = 0; !changed && index < instances.size(); index++)
+    {
+        const engine::MeshInstance* instance = instances[index].get();
+        const InstanceRecord& record = m_Instances[index];
+        changed = instance != record.instance || instance->GetMesh().get() != record.mesh || instance->GetMesh()->buffers.get() != record.buffers;
+    }
+
+    for (size_t index = 0; !changed && index < materials.size(); index++)
+    {
+        const engine::Material* material = materials[index].get();
+        const MaterialRecord& record = m_Materials[index];
+        changed = material != record.material || material->domain != record.domain || material->doubleSided != record.doubleSided;
+    }
+
+    if (!changed)
+        return false;
+
+    m_Valid = true;
+    m_RootNode = sceneGraph.GetRootNode().get();
+
+    m_Instances.clear();
+    m_Instances.reserve(instances.size());
+    for (const auto& instance : instances)
+        m_Instances.push_back({ instance.get(), instance->GetMesh().get(), instance->GetMesh()->buffers.get() });
+
+    m_Materials.clear();
+    m_Materials.reserve(materials.size());
+    for (const auto& material : materials)
+        m_Materials.push_back({ material.get(), material->domain, material->doubleSided });
+
+    return true;
+}
+
+void DrawListChangeTracker::Clear()
+{
+    m_Valid = false;
+    m_RootNode = nullptr;
+    m_Instances.clear();
+    m_Materials.clear();
+}
@@ -0,0 +1,62 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/SceneTypes.h>
+#include <vector>
+
+// Remembers what the draw items of a scene graph were built from, so that cached item lists can tell when
+// they are out of date without being invalidated by hand. It records the mesh instances in order with their
+// meshes and buffer groups, and the domain and double sided flag of every material. Assigning a different
+// material to a geometry of an existing mesh is not detected.
+// The records hold plain pointers, so Clear must be called before the scene they point into is released.
+class DrawListChangeTracker
+{
+public:
+    // Compares the scene graph with the last recorded state and records the current one.
+    // Returns true when they differ, including the first call after Clear.
+    bool Update(const donut::engine::SceneGraph& sceneGraph);
+
+    void Clear();
+
+private:
+    struct InstanceRecord
+    {
+        const donut::engine::MeshInstance* instance;
+        const donut::engine::MeshInfo* mesh;
+        const donut::engine::BufferGroup* buffers;
+    };
+
+    struct MaterialRecord
+    {
+        const donut::engine::Material* material;
+        donut::engine::MaterialDomain domain;
+        bool doubleSided;
+    };
+
+    bool m_Valid = false;
+    const donut::engine::SceneGraphNode* m_RootNode = nullptr;
+    std::vector<InstanceRecord> m_Instances;
+    std::vector<MaterialRecord> m_Materials;
+};
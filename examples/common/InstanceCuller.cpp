@@ -0,0 +1,361 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "InstanceCuller.h"
+#include "SimdFloat.h"
+#include "OcclusionRasterizer.h"
+#include <donut/engine/SceneTypes.h>
+#include <algorithm>
+#include <cassert>
+
+using namespace donut;
+using namespace donut::math;
+
+CullingFrustum CullingFrustum::FromViewProjection(const float4x4& m)
+{
+    // Row-vector convention: clip = float4(p, 1) * m, so every clip coordinate is a dot product with a column.
+    // The clip volume is -w <= x <= w, -w <= y <= w, 0 <= z <= w, which also holds for reverse and infinite depth.
+    auto column = [&m](int j) { return float4(m[0][j], m[1][j], m[2][j], m[3][j]); };
+
+    const float4 x = column(0);
+    const float4 y = column(1);
+    const float4 z = column(2);
+    const float4 w = column(3);
+
+    CullingFrustum frustum;
+    frustum.planes[0] = w + x;
+    frustum.planes[1] = w - x;
+    frustum.planes[2] = w + y;
+    frustum.planes[3] = w - y;
+    frustum.planes[4] = z;
+    frustum.planes[5] = w - z;
+    return frustum;
+}
+
+void InstanceCuller::Build(const engine::SceneGraph& sceneGraph)
+{
+    m_Instances = sceneGraph.GetMeshInstances();
+
+    const size_t paddedCount = (m_Instances.size() + c_SimdWidth - 1) / c_SimdWidth * c_SimdWidth;
+
+    // the padding lanes hold empty boxes, the SIMD loops skip them by index anyway
+    m_MinX.assign(paddedCount, 0.f);
+    m_MinY.assign(paddedCount, 0.f);
+    m_MinZ.assign(paddedCount, 0.f);
+    m_MaxX.assign(paddedCount, 0.f);
+    m_MaxY.assign(paddedCount, 0.f);
+    m_MaxZ.assign(paddedCount, 0.f);
+
+    UpdateBounds();
+}
+
+void InstanceCuller::UpdateBounds()
+{
+    for (size_t index = 0; index < m_Instances.size(); index++)
+    {
+        const box3 bounds = m_Instances[index]->GetNode()->GetGlobalBoundingBox();
+
+        m_MinX[index] = bounds.m_mins.x;
+        m_MinY[index] = bounds.m_mins.y;
+        m_MinZ[index] = bounds.m_mins.z;
+        m_MaxX[index] = bounds.m_maxs.x;
+        m_MaxY[index] = bounds.m_maxs.y;
+        m_MaxZ[index] = bounds.m_maxs.z;
+    }
+}
+
+const char* InstanceCuller::GetInstructionSetName()
+{
+    return GetSimdInstructionSetName();
+}
+
+// The bounds of c_SimdWidth consecutive instances, loaded once and tested against any number of frustums
+struct SimdBoxes
+{
+    SimdFloat minX, minY, minZ;
+    SimdFloat maxX, maxY, maxZ;
+};
+
+// Returns a bit mask of the boxes that intersect the frustum, one bit per SIMD lane.
+// For every plane, the corner of the box that lies furthest along the plane normal is tested.
+// If that corner is behind the plane, the whole box is outside.
+static inline int TestBoxes(const SimdBoxes& boxes, const CullingFrustum& frustum)
+{
+    SimdMask inside = SimdAllTrue();
+
+    for (const float4& plane : frustum.planes)
+    {
+        const SimdFloat px = plane.x > 0.f ? boxes.maxX : boxes.minX;
+        const SimdFloat py = plane.y > 0.f ? boxes.maxY : boxes.minY;
+        const SimdFloat pz = plane.z > 0.f ? boxes.maxZ : boxes.minZ;
+
+        SimdFloat distance = SimdMulAdd(SimdSet(plane.x), px,
+            SimdMulAdd(SimdSet(plane.y), py,
+            SimdMulAdd(SimdSet(plane.z), pz, SimdSet(plane.w))));
+
+        inside = SimdAnd(inside, SimdGreaterEqualZero(distance));
+    }
+
+    return SimdMoveMask(inside);
+}
+
+SimdBoxes InstanceCuller::LoadBoxes(size_t base) const
+{
+    SimdBoxes boxes;
+    boxes.minX = SimdLoad(m_MinX.data() + base);
+    boxes.minY = SimdLoad(m_MinY.data() + base);
+    boxes.minZ = SimdLoad(m_MinZ.data() + base);
+    boxes.maxX = SimdLoad(m_MaxX.data() + base);
+    boxes.maxY = SimdLoad(m_MaxY.data() + base);
+    boxes.maxZ = SimdLoad(m_MaxZ.data() + base);
+    return boxes;
+}
+
+void InstanceCuller::CullScalar(const CullingFrustum& frustum, std::vector<uint32_t>& visibleInstances) const
+{
+    visibleInstances.clear();
+
+    for (size_t index = 0; index < m_Instances.size(); index++)
+    {
+        bool inside = true;
+
+        for (const float4& plane : frustum.planes)
+        {
+            const float px = plane.x > 0.f ? m_MaxX[index] : m_MinX[index];
+            const float py = plane.y > 0.f ? m_MaxY[index] : m_MinY[index];
+            const float pz = plane.z > 0.f ? m_MaxZ[index] : m_MinZ[index];
+
+            if (plane.x * px + plane.y * py + plane.z * pz + plane.w < 0.f)
+            {
+                inside = false;
+                break;
+            }
+        }
+
+        if (inside)
+            visibleInstances.push_back(uint32_t(index));
+    }
+}
+
+void InstanceCuller::Cull(const CullingFrustum& frustum, std::vector<uint32_t>& visibleInstances) const
+{
+    visibleInstances.clear();
+
+    const size_t numInstances = m_Instances.size();
+
+    for (size_t base = 0; base < numInstances; base += c_SimdWidth)
+    {
+        int mask = TestBoxes(LoadBoxes(base), frustum);
+
+        for (size_t lane = 0; mask != 0; lane++, mask >>= 1)
+        {
+            if ((mask & 1) && base + lane < numInstances)
+                visibleInstances.push_back(uint32_t(base + lane));
+        }
+    }
+}
+
+void InstanceCuller::CullViews(const CullingFrustum* frustums, uint32_t numViews, std::vector<uint32_t>& viewMasks) const
+{
+    assert(numViews <= c_MaxCullingViews);
+
+    const size_t numInstances = m_Instances.size();
+    viewMasks.resize(numInstances);
+
+    for (size_t base = 0; base < numInstances; base += c_SimdWidth)
+    {
+        const SimdBoxes boxes = LoadBoxes(base);
+
+        uint32_t laneMasks[c_SimdWidth] = {};
+
+        for (uint32_t viewIndex = 0; viewIndex < numViews; viewIndex++)
+        {
+            int mask = TestBoxes(boxes, frustums[viewIndex]);
+
+            for (size_t lane = 0; mask != 0; lane++, mask >>= 1)
+            {
+                if (mask & 1)
+                    laneMasks[lane] |= 1u << viewIndex;
+            }
+        }
+
+        const size_t numLanes = std::min(c_SimdWidth, numInstances - base);
+        for (size_t lane = 0; lane < numLanes; lane++)
+            viewMasks[base + lane] = laneMasks[lane];
+    }
+}
+
+void InstanceCuller::GatherVisibleInstances(const std::vector<uint32_t>& viewMasks, uint32_t numViews, std::vector<std::vector<uint32_t>>& visibleInstances)
+{
+    visibleInstances.resize(numViews);
+    for (auto& list : visibleInstances)
+        list.clear();
+
+    for (size_t index = 0; index < viewMasks.size(); index++)
+    {
+        uint32_t mask = viewMasks[index];
+
+        for (uint32_t viewIndex = 0; mask != 0; viewIndex++, mask >>= 1)
+        {
+            if (mask & 1)
+                visibleInstances[viewIndex].push_back(uint32_t(index));
+        }
+    }
+}
+
+CulledOpaqueDrawStrategy::CulledOpaqueDrawStrategy(const InstanceCuller& culler, const std::vector<uint32_t>* visibleInstances,
+    OcclusionRasterizer* occlusion)
+    : m_Culler(culler)
+    , m_PrecomputedVisibleInstances(visibleInstances)
+    , m_Occlusion(occlusion)
+{
+}
+
+// Returns true if the node is the given root node or one of its descendants
+static bool IsInSubgraph(const engine::SceneGraphNode* node, const engine::SceneGraphNode* rootNode)
+{
+    for (; node; node = node->GetParent())
+    {
+        if (node == rootNode)
+            return true;
+    }
+
+    return false;
+}
+
+void CulledOpaqueDrawStrategy::SetView(const engine::IView* view, const std::vector<uint32_t>* visibleInstances, OcclusionRasterizer* occlusion)
+{
+    for (auto& entry : m_Views)
+    {
+        if (entry.view == view)
+        {
+            entry.visibleInstances = visibleInstances;
+            entry.occlusion = occlusion;
+            return;
+        }
+    }
+
+    m_Views.push_back({ view, visibleInstances, occlusion });
+}
+
+void CulledOpaqueDrawStrategy::ClearViews()
+{
+    m_Views.clear();
+}
+
+void CulledOpaqueDrawStrategy::PrepareForView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView& view)
+{
+    const std::vector<uint32_t>* precomputedVisibleInstances = m_PrecomputedVisibleInstances;
+    OcclusionRasterizer* occlusion = occlusion;
+
+    for (const auto& entry : m_Views)
+    {
+        if (entry.view == &view)
+        {
+            precomputedVisibleInstances = entry.visibleInstances;
+            occlusion = entry.occlusion;
+            break;
+        }
+    }
+
+    if (!precomputedVisibleInstances)
+        m_Culler.Cull(CullingFrustum::FromViewProjection(view.GetViewProjectionMatrix()), m_VisibleInstances);
+
+    const std::vector<uint32_t>& visibleInstances = precomputedVisibleInstances ? *precomputedVisibleInstances : m_VisibleInstances;
+
+    m_DrawItems.clear();
+    m_ReadPtr = 0;
+    m_NumOccludedGeometries = 0;
+
+    if (!rootNode)
+        return;
+
+    // The culler covers the whole scene, so rendering a subgraph skips the instances outside of it
+    const bool wholeGraph = rootNode->GetParent() == nullptr;
+
+    for (uint32_t instanceIndex : visibleInstances)
+    {
+        const engine::MeshInstance* instance = m_Culler.GetInstance(instanceIndex);
+        const engine::MeshInfo* mesh = instance->GetMesh().get();
+        const engine::SceneGraphNode* node = instance->GetNode();
+
+        if (!wholeGraph && !IsInSubgraph(node, rootNode.get()))
+            continue;
+
+        if (occlusion && !occlusion->IsBoxVisible(node->GetGlobalBoundingBox()))
+        {
+            m_NumOccludedGeometries += mesh->geometries.size();
+            continue;
+        }
+
+        // Meshes like Sponza are a single instance, so the geometries are tested separately when there are several
+        const bool testGeometries = occlusion && mesh->geometries.size() > 1;
+        const affine3 localToWorld = node->GetLocalToWorldTransformFloat();
+
+        for (const auto& geometry : mesh->geometries)
+        {
+            const engine::Material* material = geometry->material.get();
+            if (!material)
+                continue;
+
+            if (material->domain != engine::MaterialDomain::Opaque && material->domain != engine::MaterialDomain::AlphaTested)
+                continue;
+
+            if (testGeometries && !occlusion->IsBoxVisible(geometry->objectSpaceBounds * localToWorld))
+            {
+                m_NumOccludedGeometries++;
+                continue;
+            }
+
+            render::DrawItem item;
+            item.instance = instance;
+            item.mesh = mesh;
+            item.geometry = geometry.get();
+            item.material = material;
+            item.buffers = mesh->buffers.get();
+            item.distanceToCamera = 0.f;
+            item.cullMode = material->doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+            m_DrawItems.push_back(item);
+        }
+    }
+
+    std::sort(m_DrawItems.begin(), m_DrawItems.end(), [](const render::DrawItem& a, const render::DrawItem& b)
+    {
+        if (a.material != b.material)
+            return a.material < b.material;
+        if (a.buffers != b.buffers)
+            return a.buffers < b.buffers;
+        if (a.mesh != b.mesh)
+            return a.mesh < b.mesh;
+        if (a.geometry != b.geometry)
+            return a.geometry < b.geometry;
+        return a.instance->GetInstanceIndex() < b.instance->GetInstanceIndex();
+    });
+}
+
+const render::DrawItem* CulledOpaqueDrawStrategy::GetNextItem()
+{
+    if (m_ReadPtr < m_DrawItems.size())
+        return &m_DrawItems[m_ReadPtr++];
+
+    return nullptr;
+}
@@ -0,0 +1,124 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/render/DrawStrategy.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <donut/core/math/math.h>
+#include <array>
+#include <vector>
+
+// Six planes of a view frustum in world space. A point p is inside when dot(plane.xyz, p) + plane.w >= 0 for every plane.
+struct CullingFrustum
+{
+    std::array<donut::math::float4, 6> planes;
+
+    static CullingFrustum FromViewProjection(const donut::math::float4x4& viewProjMatrix);
+};
+
+// Maximum number of views that CullViews can handle, one bit per view in the visibility masks
+constexpr uint32_t c_MaxCullingViews = 32;
+
+struct SimdBoxes;
+class OcclusionRasterizer;
+
+// Keeps the world-space bounding boxes of all mesh instances of a scene graph in a structure-of-arrays layout
+// and tests them against view frustums with SSE or AVX, instead of walking the scene graph nodes for every view.
+class InstanceCuller
+{
+public:
+    // Collects the mesh instances and their bounds. Call again when instances are added or removed.
+    void Build(const donut::engine::SceneGraph& sceneGraph);
+
+    // Reads the bounds of the collected instances again, for when they move. Requires a refreshed scene graph.
+    void UpdateBounds();
+
+    // Writes the indices of the instances that intersect the frustum, in ascending order.
+    void Cull(const CullingFrustum& frustum, std::vector<uint32_t>& visibleInstances) const;
+    void CullScalar(const CullingFrustum& frustum, std::vector<uint32_t>& visibleInstances) const;
+
+    // Tests every instance against several frustums in one sweep, so that each box is loaded only once.
+    // Bit N of viewMasks[instance] is set when the instance intersects frustums[N].
+    void CullViews(const CullingFrustum* frustums, uint32_t numViews, std::vector<uint32_t>& viewMasks) const;
+
+    // Converts the masks produced by CullViews into a list of visible instances for each view
+    static void GatherVisibleInstances(const std::vector<uint32_t>& viewMasks, uint32_t numViews, std::vector<std::vector<uint32_t>>& visibleInstances);
+
+    size_t GetNumInstances() const { return m_Instances.size(); }
+    const donut::engine::MeshInstance* GetInstance(uint32_t index) const { return m_Instances[index].get(); }
+
+    // "AVX", "SSE" or "Scalar", depending on the instruction set the culler was compiled for
+    static const char* GetInstructionSetName();
+
+private:
+    std::vector<std::shared_ptr<donut::engine::MeshInstance>> m_Instances;
+
+    // padded to a multiple of the SIMD width
+    std::vector<float> m_MinX, m_MinY, m_MinZ;
+    std::vector<float> m_MaxX, m_MaxY, m_MaxZ;
+
+    SimdBoxes LoadBoxes(size_t base) const;
+};
+
+// Opaque draw strategy that takes the visible instances from an InstanceCuller instead of traversing the scene graph.
+// Items are sorted the same way as in InstancedOpaqueDrawStrategy so that RenderView can batch instances.
+// When a list of visible instances is provided, for example from InstanceCuller::CullViews, the view is not culled again.
+// With an occlusion rasterizer that has the occluders of the view drawn, the bounds of the visible instances
+// and of their geometries are tested against it, and hidden geometries produce no draw items.
+// The children of a composite view, such as the eyes of a stereo view, can have their own lists and rasterizers, see SetView.
+class CulledOpaqueDrawStrategy : public donut::render::IDrawStrategy
+{
+public:
+    explicit CulledOpaqueDrawStrategy(const InstanceCuller& culler, const std::vector<uint32_t>* visibleInstances = nullptr,
+        OcclusionRasterizer* occlusion = nullptr);
+
+    // Uses the given list and rasterizer when RenderCompositeView prepares this view, instead of the ones from the constructor.
+    // The view is matched by address, so the entries must be set again when the views are recreated.
+    void SetView(const donut::engine::IView* view, const std::vector<uint32_t>* visibleInstances, OcclusionRasterizer* occlusion = nullptr);
+    void ClearViews();
+
+    void PrepareForView(const std::shared_ptr<donut::engine::SceneGraphNode>& rootNode, const donut::engine::IView& view) override;
+    const donut::render::DrawItem* GetNextItem() override;
+
+    // Geometries of the visible instances that the occlusion test rejected in the last view, with or without their instance
+    size_t GetNumOccludedGeometries() const { return m_NumOccludedGeometries; }
+
+private:
+    const InstanceCuller& m_Culler;
+    const std::vector<uint32_t>* m_PrecomputedVisibleInstances;
+    OcclusionRasterizer* m_Occlusion;
+
+    struct ViewEntry
+    {
+        const donut::engine::IView* view;
+        const std::vector<uint32_t>* visibleInstances;
+        OcclusionRasterizer* occlusion;
+    };
+    std::vector<ViewEntry> m_Views;
+
+    size_t m_NumOccludedGeometries = 0;
+    std::vector<uint32_t> m_VisibleInstances;
+    std::vector<donut::render::DrawItem> m_DrawItems;
+    size_t m_ReadPtr = 0;
+};
@@ -0,0 +1,326 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "OcclusionRasterizer.h"
+#include "SimdFloat.h"
+#include <donut/engine/SceneTypes.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace donut;
+using namespace donut::math;
+
+static_assert(OcclusionRasterizer::c_Width % c_SimdWidth == 0, "The rows of the occlusion buffer must be a whole number of SIMD vectors");
+
+void OccluderMesh::Build(const engine::SceneGraph& sceneGraph, float minSize, size_t maxTriangles)
+{
+    struct Candidate
+    {
+        const engine::MeshInstance* instance;
+        const engine::MeshGeometry* geometry;
+        float area;
+    };
+
+    std::vector<Candidate> candidates;
+
+    for (const auto& instance : sceneGraph.GetMeshInstances())
+    {
+        const engine::MeshInfo* mesh = instance->GetMesh().get();
+        if (!mesh->buffers || mesh->buffers->positionData.empty() || mesh->buffers->indexData.empty())
+            continue;
+
+        const affine3 transform = instance->GetNode()->GetLocalToWorldTransformFloat();
+
+        for (const auto& geometry : mesh->geometries)
+        {
+            const engine::Material* material = geometry->material.get();
+            if (!material || material->domain != engine::MaterialDomain::Opaque)
+                continue;
+
+            const float3 size = (geometry->objectSpaceBounds * transform).diagonal();
+            const float largest = std::max({ size.x, size.y, size.z });
+            const float smallest = std::min({ size.x, size.y, size.z });
+            const float middle = size.x + size.y + size.z - largest - smallest;
+
+            if (middle < minSize)
+                continue;
+
+            candidates.push_back({ instance.get(), geometry.get(), largest * middle });
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.area > b.area; });
+
+    positions.clear();
+    indices.clear();
+
+    for (const Candidate& candidate : candidates)
+    {
+        const engine::MeshGeometry* geometry = candidate.geometry;
+        if (GetNumTriangles() + geometry->numIndices / 3 > maxTriangles)
+            continue;
+
+        const engine::MeshInfo* mesh = candidate.instance->GetMesh().get();
+        const engine::BufferGroup* buffers = mesh->buffers.get();
+        const affine3 transform = candidate.instance->GetNode()->GetLocalToWorldTransformFloat();
+
+        const uint32_t firstIndex = mesh->indexOffset + geometry->indexOffsetInMesh;
+        const uint32_t firstVertex = mesh->vertexOffset + geometry->vertexOffsetInMesh;
+        const uint32_t basePosition = uint32_t(positions.size());
+
+        for (uint32_t vertex = 0; vertex < geometry->numVertices; vertex++)
+            positions.push_back(transform.transformPoint(buffers->positionData[firstVertex + vertex]));
+
+        for (uint32_t index = 0; index < geometry->numIndices; index++)
+            indices.push_back(basePosition + buffers->indexData[firstIndex + index]);
+    }
+}
+
+OcclusionRasterizer::OcclusionRasterizer()
+    : m_Depth(c_Width * c_Height, 0.f)
+{
+}
+
+void OcclusionRasterizer::Begin(const float4x4& viewProjMatrix, bool reverseDepth)
+{
+    m_ViewProjMatrix = viewProjMatrix;
+    m_ReverseDepth = reverseDepth;
+    std::fill(m_Depth.begin(), m_Depth.end(), 0.f);
+    m_Statistics = Statistics();
+}
+
+float OcclusionRasterizer::GetNearPlaneDistance(const float4& clipPos) const
+{
+    // The near plane is z = w with reverse depth and z = 0 otherwise
+    return m_ReverseDepth ? clipPos.w - clipPos.z : clipPos.z;
+}
+
+float3 OcclusionRasterizer::ToScreen(const float4& clipPos) const
+{
+    const float invW = 1.f / clipPos.w;
+    const float depth = clipPos.z * invW;
+
+    return float3(
+        (clipPos.x * invW * 0.5f + 0.5f) * float(c_Width),
+        (clipPos.y * invW * -0.5f + 0.5f) * float(c_Height),
+        m_ReverseDepth ? depth : 1.f - depth);
+}
+
+void OcclusionRasterizer::DrawOccluders(const OccluderMesh& occluders)
+{
+    m_ClipPositions.resize(occluders.positions.size());
+    for (size_t index = 0; index < occluders.positions.size(); index++)
+        m_ClipPositions[index] = float4(occluders.positions[index], 1.f) * m_ViewProjMatrix;
+
+    for (size_t index = 0; index + 2 < occluders.indices.size(); index += 3)
+    {
+        const float4 triangle[3] = {
+            m_ClipPositions[occluders.indices[index]],
+            m_ClipPositions[occluders.indices[index + 1]],
+            m_ClipPositions[occluders.indices[index + 2]]
+        };
+
+        // Skip triangles that are completely outside one of the side planes
+        auto allOutside = [&triangle](auto distance)
+        {
+            return distance(triangle[0]) < 0.f && distance(triangle[1]) < 0.f && distance(triangle[2]) < 0.f;
+        };
+
+        if (allOutside([](const float4& p) { return p.w + p.x; }) || allOutside([](const float4& p) { return p.w - p.x; }) ||
+            allOutside([](const float4& p) { return p.w + p.y; }) || allOutside([](const float4& p) { return p.w - p.y; }))
+            continue;
+
+        // Clip against the near plane, which can turn the triangle into a quad
+        float4 polygon[4];
+        int numVertices = 0;
+        for (int vertex = 0; vertex < 3; vertex++)
+        {
+            const float4& current = triangle[vertex];
+            const float4& next = triangle[(vertex + 1) % 3];
+            const float currentDistance = GetNearPlaneDistance(current);
+            const float nextDistance = GetNearPlaneDistance(next);
+
+            if (currentDistance >= 0.f)
+                polygon[numVertices++] = current;
+
+            if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
+            {
+                const float t = currentDistance / (currentDistance - nextDistance);
+                polygon[numVertices++] = current + (next - current) * t;
+            }
+        }
+
+        if (numVertices >= 3)
+            DrawPolygon(polygon, numVertices);
+    }
+}
+
+void OcclusionRasterizer::DrawPolygon(const float4* vertices, int numVertices)
+{
+    for (const float4* vertex = vertices; vertex < vertices + numVertices; vertex++)
+    {
+        if (vertex->w <= 0.f)
+            return;
+    }
+
+    const float3 first = ToScreen(vertices[0]);
+    for (int vertex = 1; vertex + 1 < numVertices; vertex++)
+        DrawTriangle(first, ToScreen(vertices[vertex]), ToScreen(vertices[vertex + 1]));
+}
+
+void OcclusionRasterizer::DrawTriangle(float3 v0, float3 v1, float3 v2)
+{
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (std::abs(area) < 1e-6f)
+        return;
+
+    // Both windings are drawn, occluders can be seen from either side
+    if (area < 0.f)
+    {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    const int minX = std::max(int(std::floor(std::min({ v0.x, v1.x, v2.x }))), 0);
+    const int maxX = std::min(int(std::ceil(std::max({ v0.x, v1.x, v2.x }))), int(c_Width) - 1);
+    const int minY = std::max(int(std::floor(std::min({ v0.y, v1.y, v2.y }))), 0);
+    const int maxY = std::min(int(std::ceil(std::max({ v0.y, v1.y, v2.y }))), int(c_Height) - 1);
+
+    if (minX > maxX || minY > maxY)
+        return;
+
+    m_Statistics.numTriangles++;
+
+    // Edge functions a * x + b * y + c, positive inside
+    auto edge = [](const float3& from, const float3& to, float& a, float& b, float& c)
+    {
+        a = from.y - to.y;
+        b = to.x - from.x;
+        c = -(a * from.x + b * from.y);
+    };
+
+    float a0, b0, c0, a1, b1, c1, a2, b2, c2;
+    edge(v1, v2, a0, b0, c0);
+    edge(v2, v0, a1, b1, c1);
+    edge(v0, v1, a2, b2, c2);
+
+    // Depth is linear in screen space
+    const float depthDx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    const float depthDy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+    const float depthC = v0.z - depthDx * v0.x - depthDy * v0.y;
+
+    const int firstX = minX - minX % int(c_SimdWidth);
+    const SimdFloat ramp = SimdRamp();
+
+    for (int y = minY; y <= maxY; y++)
+    {
+        const float py = float(y) + 0.5f;
+        const SimdFloat row0 = SimdSet(b0 * py + c0);
+        const SimdFloat row1 = SimdSet(b1 * py + c1);
+        const SimdFloat row2 = SimdSet(b2 * py + c2);
+        const SimdFloat rowDepth = SimdSet(depthDy * py + depthC);
+        float* depthRow = m_Depth.data() + size_t(y) * c_Width;
+
+        for (int x = firstX; x <= maxX; x += int(c_SimdWidth))
+        {
+            const SimdFloat px = SimdAdd(SimdSet(float(x) + 0.5f), ramp);
+
+            SimdMask inside = SimdGreaterEqualZero(SimdMulAdd(SimdSet(a0), px, row0));
+            inside = SimdAnd(inside, SimdGreaterEqualZero(SimdMulAdd(SimdSet(a1), px, row1)));
+            inside = SimdAnd(inside, SimdGreaterEqualZero(SimdMulAdd(SimdSet(a2), px, row2)));
+
+            const SimdFloat depth = SimdMulAdd(SimdSet(depthDx), px, rowDepth);
+            inside = SimdAnd(inside, SimdGreaterEqualZero(depth));
+
+            if (!SimdMoveMask(inside))
+                continue;
+
+            const SimdFloat stored = SimdLoad(depthRow + x);
+            SimdStore(depthRow + x, SimdSelect(inside, SimdMax(stored, depth), stored));
+        }
+    }
+}
+
+bool OcclusionRasterizer::IsBoxVisible(const box3& bounds)
+{
+    m_Statistics.numTestedBoxes++;
+
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float maxX = -std::numeric_limits<float>::max();
+    float maxY = -std::numeric_limits<float>::max();
+    float nearest = 0.f;
+
+    for (uint32_t cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+    {
+        const float3 corner(
+            (cornerIndex & 1) ? bounds.m_maxs.x : bounds.m_mins.x,
+            (cornerIndex & 2) ? bounds.m_maxs.y : bounds.m_mins.y,
+            (cornerIndex & 4) ? bounds.m_maxs.z : bounds.m_mins.z);
+        const float4 clipPos = float4(corner, 1.f) * m_ViewProjMatrix;
+
+        // A box that crosses the near plane covers an unbounded part of the screen
+        if (GetNearPlaneDistance(clipPos) < 0.f || clipPos.w <= 0.f)
+            return true;
+
+        const float3 screen = ToScreen(clipPos);
+        minX = std::min(minX, screen.x);
+        minY = std::min(minY, screen.y);
+        maxX = std::max(maxX, screen.x);
+        maxY = std::max(maxY, screen.y);
+        nearest = std::max(nearest, screen.z);
+    }
+
+    const int firstPixelX = std::max(int(std::floor(minX)), 0);
+    const int lastPixelX = std::min(int(std::floor(maxX)), int(c_Width) - 1);
+    const int firstPixelY = std::max(int(std::floor(minY)), 0);
+    const int lastPixelY = std::min(int(std::floor(maxY)), int(c_Height) - 1);
+
+    // Outside of the view, frustum culling decides about it
+    if (firstPixelX > lastPixelX || firstPixelY > lastPixelY)
+        return true;
+
+    const int firstX = firstPixelX - firstPixelX % int(c_SimdWidth);
+    const SimdFloat ramp = SimdRamp();
+    const SimdFloat nearestVector = SimdSet(nearest);
+    const SimdFloat rangeMin = SimdSet(float(firstPixelX));
+    const SimdFloat rangeMax = SimdSet(float(lastPixelX));
+
+    for (int y = firstPixelY; y <= lastPixelY; y++)
+    {
+        const float* depthRow = m_Depth.data() + size_t(y) * c_Width;
+
+        for (int x = firstX; x <= lastPixelX; x += int(c_SimdWidth))
+        {
+            const SimdFloat px = SimdAdd(SimdSet(float(x)), ramp);
+            SimdMask inRange = SimdAnd(SimdLessEqual(rangeMin, px), SimdLessEqual(px, rangeMax));
+
+            // Some part of the box may be in front of the occluders at this pixel
+            if (SimdMoveMask(SimdAnd(inRange, SimdLessEqual(SimdLoad(depthRow + x), nearestVector))))
+                return true;
+        }
+    }
+
+    m_Statistics.numOccludedBoxes++;
+    return false;
+}
@@ -0,0 +1,85 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/core/math/math.h>
+#include <vector>
+
+// World space triangles of the large opaque geometries of a scene, used as occluders by OcclusionRasterizer
+struct OccluderMesh
+{
+    std::vector<donut::math::float3> positions;
+    std::vector<uint32_t> indices;
+
+    // Collects opaque geometries whose world space bounds are at least 'minSize' along two axes, largest first,
+    // until 'maxTriangles' is reached. Alpha tested and transparent geometries have holes and are skipped.
+    // Geometries of meshes without vertex data on the CPU are skipped as well.
+    void Build(const donut::engine::SceneGraph& sceneGraph, float minSize, size_t maxTriangles);
+
+    size_t GetNumTriangles() const { return indices.size() / 3; }
+};
+
+// Renders occluders into a small depth buffer on the CPU and tests bounding boxes against it,
+// so that hidden geometry can be skipped before any draw items are created for a view.
+// The buffer stores the nearness of the occluders, 1 at the near plane and 0 at the far plane or where nothing was drawn,
+// for both reverse and regular depth. Coverage is sampled at pixel centers, so occluders can hide objects
+// that are visible through gaps smaller than a pixel of the buffer.
+class OcclusionRasterizer
+{
+public:
+    static constexpr uint32_t c_Width = 256;
+    static constexpr uint32_t c_Height = 128;
+
+    struct Statistics
+    {
+        uint32_t numTriangles = 0; // drawn after clipping in the last view
+        uint32_t numTestedBoxes = 0;
+        uint32_t numOccludedBoxes = 0;
+    };
+
+    OcclusionRasterizer();
+
+    // Clears the buffer and sets the view for the following draws and tests
+    void Begin(const donut::math::float4x4& viewProjMatrix, bool reverseDepth);
+
+    void DrawOccluders(const OccluderMesh& occluders);
+
+    // Returns false when the box is completely behind the occluders drawn so far
+    bool IsBoxVisible(const donut::math::box3& bounds);
+
+    const std::vector<float>& GetDepth() const { return m_Depth; }
+    const Statistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    donut::math::float4x4 m_ViewProjMatrix;
+    bool m_ReverseDepth = true;
+    std::vector<float> m_Depth;
+    std::vector<donut::math::float4> m_ClipPositions;
+    Statistics m_Statistics;
+
+    void DrawPolygon(const donut::math::float4* vertices, int numVertices);
+    void DrawTriangle(donut::math::float3 v0, donut::math::float3 v1, donut::math::float3 v2);
+    donut::math::float3 ToScreen(const donut::math::float4& clipPos) const;
+    float GetNearPlaneDistance(const donut::math::float4& clipPos) const;
+};
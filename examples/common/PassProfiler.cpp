@@ -0,0 +1,273 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PassProfiler.h"
+#include <donut/core/log.h>
+#include <imgui.h>
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+using namespace donut;
+
+PassProfiler::PassProfiler(nvrhi::IDevice* device, uint32_t historyLength)
+    : m_Device(device)
+    // results for a frame arrive c_FramesInFlight frames later, the history must be longer than that
+    , m_HistoryLength(std::max(historyLength, c_FramesInFlight + 1))
+{
+}
+
+uint32_t PassProfiler::GetPassIndex(const char* name)
+{
+    for (uint32_t index = 0; index < uint32_t(m_Passes.size()); index++)
+    {
+        if (m_Passes[index].name == name)
+            return index;
+    }
+
+    PassHistory pass;
+    pass.name = name;
+    pass.cpuMs.resize(m_HistoryLength, 0.f);
+    pass.gpuMs.resize(m_HistoryLength, 0.f);
+    pass.frameNumbers.resize(m_HistoryLength, ~0ull);
+    m_Passes.push_back(std::move(pass));
+
+    return uint32_t(m_Passes.size() - 1);
+}
+
+nvrhi::TimerQueryHandle PassProfiler::AllocateQuery()
+{
+    if (m_FreeQueries.empty())
+        return m_Device->createTimerQuery();
+
+    nvrhi::TimerQueryHandle query = m_FreeQueries.back();
+    m_FreeQueries.pop_back();
+    return query;
+}
+
+void PassProfiler::BeginFrame()
+{
+    // The queries in this slot were issued c_FramesInFlight frames ago and have normally completed by now.
+    // If the GPU is further behind than that, getTimerQueryTime waits for the results.
+    auto& pendingQueries = m_PendingQueries[m_FrameNumber % c_FramesInFlight];
+
+    for (const auto& pending : pendingQueries)
+    {
+        float gpuMs = m_Device->getTimerQueryTime(pending.query) * 1000.f;
+        m_Device->resetTimerQuery(pending.query);
+        m_FreeQueries.push_back(pending.query);
+
+        // passes that are recorded several times per frame accumulate into one sample
+        PassHistory& pass = m_Passes[pending.passIndex];
+        uint32_t slot = uint32_t(pending.frameNumber % m_HistoryLength);
+        if (pass.frameNumbers[slot] != pending.frameNumber)
+        {
+            pass.frameNumbers[slot] = pending.frameNumber;
+            pass.cpuMs[slot] = 0.f;
+            pass.gpuMs[slot] = 0.f;
+        }
+        pass.cpuMs[slot] += pending.cpuMs;
+        pass.gpuMs[slot] += gpuMs;
+    }
+
+    pendingQueries.clear();
+}
+
+void PassProfiler::EndFrame()
+{
+    assert(m_OpenPasses.empty());
+    m_FrameNumber++;
+}
+
+void PassProfiler::BeginPass(nvrhi::ICommandList* commandList, const char* name)
+{
+    commandList->beginMarker(name);
+
+    if (!m_Enabled)
+        return;
+
+    OpenPass pass;
+    pass.commandList = commandList;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        pass.passIndex = GetPassIndex(name);
+        pass.query = AllocateQuery();
+    }
+
+    commandList->beginTimerQuery(pass.query);
+    pass.cpuStart = std::chrono::high_resolution_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_OpenPasses.push_back(pass);
+}
+
+void PassProfiler::EndPass(nvrhi::ICommandList* commandList)
+{
+    commandList->endMarker();
+
+    auto cpuEnd = std::chrono::high_resolution_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    // the innermost open pass on this command list
+    auto it = std::find_if(m_OpenPasses.rbegin(), m_OpenPasses.rend(),
+        [commandList](const OpenPass& open) { return open.commandList == commandList; });
+
+    if (it == m_OpenPasses.rend())
+        return;
+
+    OpenPass pass = *it;
+    m_OpenPasses.erase(std::next(it).base());
+
+    commandList->endTimerQuery(pass.query);
+
+    PendingQuery pending;
+    pending.passIndex = pass.passIndex;
+    pending.frameNumber = m_FrameNumber;
+    pending.cpuMs = std::chrono::duration<float, std::milli>(cpuEnd - pass.cpuStart).count();
+    pending.query = pass.query;
+    m_PendingQueries[m_FrameNumber % c_FramesInFlight].push_back(pending);
+}
+
+void PassProfiler::GetStats(std::vector<PassStats>& stats) const
+{
+    stats.clear();
+
+    for (const auto& pass : m_Passes)
+    {
+        PassStats result;
+        result.name = pass.name;
+
+        for (uint32_t slot = 0; slot < m_HistoryLength; slot++)
+        {
+            if (pass.frameNumbers[slot] == ~0ull)
+                continue;
+
+            result.cpuAverageMs += pass.cpuMs[slot];
+            result.gpuAverageMs += pass.gpuMs[slot];
+            result.cpuMaxMs = std::max(result.cpuMaxMs, pass.cpuMs[slot]);
+            result.gpuMaxMs = std::max(result.gpuMaxMs, pass.gpuMs[slot]);
+            result.numSamples++;
+        }
+
+        if (result.numSamples > 0)
+        {
+            result.cpuAverageMs /= float(result.numSamples);
+            result.gpuAverageMs /= float(result.numSamples);
+        }
+
+        stats.push_back(result);
+    }
+}
+
+bool PassProfiler::WriteJSON(const std::filesystem::path& fileName) const
+{
+    std::ofstream file(fileName);
+    if (!file.is_open())
+    {
+        log::error("Cannot open '%s' for writing", fileName.generic_string().c_str());
+        return false;
+    }
+
+    std::vector<PassStats> stats;
+    GetStats(stats);
+
+    file << "{\n  \"historyLength\": " << m_HistoryLength << ",\n  \"passes\": [";
+
+    for (size_t passIndex = 0; passIndex < m_Passes.size(); passIndex++)
+    {
+        const PassHistory& pass = m_Passes[passIndex];
+        const PassStats& passStats = stats[passIndex];
+
+        file << (passIndex > 0 ? "," : "") << "\n    {\n";
+        file << "      \"name\": \"" << pass.name << "\",\n";
+        file << "      \"cpuAverageMs\": " << passStats.cpuAverageMs << ",\n";
+        file << "      \"cpuMaxMs\": " << passStats.cpuMaxMs << ",\n";
+        file << "      \"gpuAverageMs\": " << passStats.gpuAverageMs << ",\n";
+        file << "      \"gpuMaxMs\": " << passStats.gpuMaxMs << ",\n";
+        file << "      \"frames\": [";
+
+        // write the samples from the oldest to the newest frame
+        std::vector<uint32_t> slots;
+        for (uint32_t slot = 0; slot < m_HistoryLength; slot++)
+        {
+            if (pass.frameNumbers[slot] != ~0ull)
+                slots.push_back(slot);
+        }
+        std::sort(slots.begin(), slots.end(), [&pass](uint32_t a, uint32_t b) { return pass.frameNumbers[a] < pass.frameNumbers[b]; });
+
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            uint32_t slot = slots[i];
+            file << (i > 0 ? ", " : "") << "{ \"frame\": " << pass.frameNumbers[slot]
+                << ", \"cpuMs\": " << pass.cpuMs[slot]
+                << ", \"gpuMs\": " << pass.gpuMs[slot] << " }";
+        }
+
+        file << "]\n    }";
+    }
+
+    file << "\n  ]\n}\n";
+
+    return true;
+}
+
+bool DrawPassProfilerTable(PassProfiler& profiler, std::vector<PassProfiler::PassStats>& stats)
+{
+    bool enabled = profiler.IsEnabled();
+    if (ImGui::Checkbox("Enable Profiling", &enabled))
+        profiler.SetEnabled(enabled);
+
+    ImGui::Text("Averages over the last %d frames", int(profiler.GetHistoryLength()));
+
+    profiler.GetStats(stats);
+
+    float sumCpu = 0.f;
+    float sumGpu = 0.f;
+
+    ImGui::Columns(3, "passes", false);
+    ImGui::Text("Pass"); ImGui::NextColumn();
+    ImGui::Text("CPU ms (max)"); ImGui::NextColumn();
+    ImGui::Text("GPU ms (max)"); ImGui::NextColumn();
+
+    for (const auto& pass : stats)
+    {
+        ImGui::Text("%s", pass.name.c_str()); ImGui::NextColumn();
+        ImGui::Text("%.3f (%.3f)", pass.cpuAverageMs, pass.cpuMaxMs); ImGui::NextColumn();
+        ImGui::Text("%.3f (%.3f)", pass.gpuAverageMs, pass.gpuMaxMs); ImGui::NextColumn();
+
+        sumCpu += pass.cpuAverageMs;
+        sumGpu += pass.gpuAverageMs;
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Sum of passes"); ImGui::NextColumn();
+    ImGui::Text("%.3f", sumCpu); ImGui::NextColumn();
+    ImGui::Text("%.3f", sumGpu); ImGui::NextColumn();
+    ImGui::Columns(1);
+
+    // Passes that are recorded on parallel command lists overlap in time
+    ImGui::TextDisabled("The CPU sum can exceed the frame time when passes record in parallel");
+
+    return ImGui::Button("Dump to JSON (P)");
+}
@@ -0,0 +1,137 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Measures the CPU recording time and the GPU execution time of named passes within a frame.
+// GPU times come from timer queries that are read back a few frames later, so the results
+// always lag behind the current frame. Both are kept in a ring buffer of the last N frames.
+// Passes can be recorded on several threads at once, as long as each thread uses its own command list;
+// nested passes are matched per command list.
+class PassProfiler
+{
+public:
+    struct PassStats
+    {
+        std::string name;
+        float cpuAverageMs = 0.f;
+        float cpuMaxMs = 0.f;
+        float gpuAverageMs = 0.f;
+        float gpuMaxMs = 0.f;
+        uint32_t numSamples = 0;
+    };
+
+    PassProfiler(nvrhi::IDevice* device, uint32_t historyLength = 128);
+
+    // Collects the GPU results of the oldest frame in flight, call before recording any passes.
+    void BeginFrame();
+    void EndFrame();
+
+    void BeginPass(nvrhi::ICommandList* commandList, const char* name);
+    void EndPass(nvrhi::ICommandList* commandList);
+
+    void SetEnabled(bool enabled) { m_Enabled = enabled; }
+    bool IsEnabled() const { return m_Enabled; }
+
+    uint32_t GetHistoryLength() const { return m_HistoryLength; }
+    void GetStats(std::vector<PassStats>& stats) const;
+
+    // Writes the averages and the full per-frame history of every pass as JSON.
+    bool WriteJSON(const std::filesystem::path& fileName) const;
+
+private:
+    static constexpr uint32_t c_FramesInFlight = 4;
+
+    struct PassHistory
+    {
+        std::string name;
+        std::vector<float> cpuMs;
+        std::vector<float> gpuMs;
+        std::vector<uint64_t> frameNumbers; // ~0 marks an empty slot
+    };
+
+    struct PendingQuery
+    {
+        uint32_t passIndex = 0;
+        uint64_t frameNumber = 0;
+        float cpuMs = 0.f;
+        nvrhi::TimerQueryHandle query;
+    };
+
+    struct OpenPass
+    {
+        nvrhi::ICommandList* commandList = nullptr;
+        uint32_t passIndex = 0;
+        std::chrono::high_resolution_clock::time_point cpuStart;
+        nvrhi::TimerQueryHandle query;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    uint32_t m_HistoryLength;
+    bool m_Enabled = true;
+    uint64_t m_FrameNumber = 0;
+
+    std::vector<PassHistory> m_Passes;
+    std::array<std::vector<PendingQuery>, c_FramesInFlight> m_PendingQueries;
+    std::vector<nvrhi::TimerQueryHandle> m_FreeQueries;
+    std::vector<OpenPass> m_OpenPasses;
+    std::mutex m_Mutex; // protects the pass, query and open pass lists while passes are recorded
+
+    uint32_t GetPassIndex(const char* name);
+    nvrhi::TimerQueryHandle AllocateQuery();
+};
+
+// Draws the profiling checkbox and a table of the average and maximum CPU and GPU times of every pass into the
+// current ImGui window. Returns true when the dump button is pressed. The stats vector is reused between frames.
+bool DrawPassProfilerTable(PassProfiler& profiler, std::vector<PassProfiler::PassStats>& stats);
+
+// Wraps a pass with PassProfiler::BeginPass and EndPass for the duration of a scope.
+class ProfilerScope
+{
+public:
+    ProfilerScope(PassProfiler& profiler, nvrhi::ICommandList* commandList, const char* name)
+        : m_Profiler(profiler)
+        , m_CommandList(commandList)
+    {
+        m_Profiler.BeginPass(m_CommandList, name);
+    }
+
+    ~ProfilerScope()
+    {
+        m_Profiler.EndPass(m_CommandList);
+    }
+
+    ProfilerScope(const ProfilerScope&) = delete;
+    ProfilerScope& operator=(const ProfilerScope&) = delete;
+
+private:
+    PassProfiler& m_Profiler;
+    nvrhi::ICommandList* m_CommandList;
+};
@@ -0,0 +1,175 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PersistentDrawStrategy.h"
+#include <donut/engine/View.h>
+#include <algorithm>
+#include <numeric>
+
+using namespace donut;
+using namespace donut::math;
+
+void PersistentDrawList::Rebuild(const engine::SceneGraph& sceneGraph)
+{
+    m_RootNode = sceneGraph.GetRootNode();
+    m_Instances = sceneGraph.GetMeshInstances();
+
+    std::vector<render::DrawItem> items;
+    std::vector<uint32_t> itemInstances;
+
+    for (uint32_t instanceIndex = 0; instanceIndex < uint32_t(m_Instances.size()); instanceIndex++)
+    {
+        const engine::MeshInstance* instance = m_Instances[instanceIndex].get();
+        const engine::MeshInfo* mesh = instance->GetMesh().get();
+
+        for (const auto& geometry : mesh->geometries)
+        {
+            const engine::Material* material = geometry->material.get();
+
+            if (!material || (material->domain != engine::MaterialDomain::Opaque && material->domain != engine::MaterialDomain::AlphaTested))
+                continue;
+
+            render::DrawItem item;
+            item.instance = instance;
+            item.mesh = mesh;
+            item.geometry = geometry.get();
+            item.material = material;
+            item.buffers = mesh->buffers.get();
+            item.distanceToCamera = 0.f;
+            item.cullMode = material->doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+            items.push_back(item);
+            itemInstances.push_back(instanceIndex);
+        }
+    }
+
+    // Same order as InstancedOpaqueDrawStrategy, so that RenderView can merge consecutive items into instanced draws
+    std::vector<uint32_t> order(items.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&items](uint32_t ia, uint32_t ib)
+    {
+        const render::DrawItem& a = items[ia];
+        const render::DrawItem& b = items[ib];
+        if (a.material != b.material)
+            return a.material < b.material;
+        if (a.buffers != b.buffers)
+            return a.buffers < b.buffers;
+        if (a.mesh != b.mesh)
+            return a.mesh < b.mesh;
+        if (a.geometry != b.geometry)
+            return a.geometry < b.geometry;
+        return a.instance->GetInstanceIndex() < b.instance->GetInstanceIndex();
+    });
+
+    m_SortedItems.resize(items.size());
+    m_ItemInstances.resize(items.size());
+    for (size_t index = 0; index < order.size(); index++)
+    {
+        m_SortedItems[index] = items[order[index]];
+        m_ItemInstances[index] = itemInstances[order[index]];
+    }
+
+    m_Statistics.numItems = uint32_t(m_SortedItems.size());
+}
+
+void PersistentDrawList::Update(const engine::SceneGraph& sceneGraph)
+{
+    // The tracker records the current state on every call, so it is updated even when the list is dirty anyway
+    const bool changed = m_ChangeTracker.Update(sceneGraph);
+
+    if (!m_Dirty && !changed && sceneGraph.GetRootNode() == m_RootNode)
+    {
+        m_Statistics.cacheHits++;
+        return;
+    }
+
+    Rebuild(sceneGraph);
+    m_Dirty = false;
+    m_Statistics.resorts++;
+}
+
+void PersistentDrawList::Clear()
+{
+    m_Dirty = true;
+    m_RootNode.reset();
+    m_Instances.clear();
+    m_SortedItems.clear();
+    m_ItemInstances.clear();
+    m_ChangeTracker.Clear();
+    m_Statistics.numItems = 0;
+}
+
+PersistentOpaqueDrawStrategy::PersistentOpaqueDrawStrategy(const PersistentDrawList& drawList)
+    : m_DrawList(drawList)
+{
+}
+
+// Returns true if the node is the given root node or one of its descendants
+static bool IsInSubgraph(const engine::SceneGraphNode* node, const engine::SceneGraphNode* rootNode)
+{
+    for (; node; node = node->GetParent())
+    {
+        if (node == rootNode)
+            return true;
+    }
+
+    return false;
+}
+
+void PersistentOpaqueDrawStrategy::PrepareForView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView& view)
+{
+    const auto& instances = m_DrawList.GetInstances();
+    const auto& sortedItems = m_DrawList.GetSortedItems();
+    const auto& itemInstances = m_DrawList.GetItemInstances();
+
+    m_VisibleItems.clear();
+    m_ReadPtr = 0;
+
+    if (!rootNode)
+        return;
+
+    // Rendering a subgraph only draws the instances below its root, like the traversing strategies
+    const bool wholeGraph = rootNode == m_DrawList.GetRootNode();
+    const frustum viewFrustum = view.GetViewFrustum();
+
+    m_InstanceVisible.resize(instances.size());
+    for (size_t instanceIndex = 0; instanceIndex < instances.size(); instanceIndex++)
+    {
+        const engine::SceneGraphNode* node = instances[instanceIndex]->GetNode();
+        bool visible = (wholeGraph || IsInSubgraph(node, rootNode.get())) && viewFrustum.intersectsWith(node->GetGlobalBoundingBox());
+        m_InstanceVisible[instanceIndex] = visible ? 1 : 0;
+    }
+
+    m_VisibleItems.reserve(sortedItems.size());
+    for (size_t itemIndex = 0; itemIndex < sortedItems.size(); itemIndex++)
+    {
+        if (m_InstanceVisible[itemInstances[itemIndex]])
+            m_VisibleItems.push_back(&sortedItems[itemIndex]);
+    }
+}
+
+const render::DrawItem* PersistentOpaqueDrawStrategy::GetNextItem()
+{
+    if (m_ReadPtr < m_VisibleItems.size())
+        return m_VisibleItems[m_ReadPtr++];
+
+    return nullptr;
+}
@@ -0,0 +1,97 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/render/DrawStrategy.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/SceneTypes.h>
+#include "DrawListChangeTracker.h"
+#include <vector>
+
+// The opaque draw items of all mesh instances of a scene graph, sorted once and kept between frames.
+// The list is sorted again when DrawListChangeTracker sees added, removed or replaced instances, a material
+// that changed its domain or double sided flag, or a new scene graph. Moving instances does not rebuild it
+// because culling reads the current bounds. The list is shared by any number of
+// PersistentOpaqueDrawStrategy objects, which can filter it for different views in parallel.
+class PersistentDrawList
+{
+public:
+    struct Statistics
+    {
+        uint32_t numItems = 0;
+        uint64_t cacheHits = 0;
+        uint64_t resorts = 0;
+    };
+
+    // Marks the list for a rebuild on the next Update, for changes that the tracker does not detect,
+    // such as a geometry of an existing mesh getting a different material.
+    void Invalidate() { m_Dirty = true; }
+
+    // Rebuilds the list if the scene graph changed or the list was invalidated.
+    // Call once per frame after the scene graph is refreshed, before any view is prepared.
+    void Update(const donut::engine::SceneGraph& sceneGraph);
+
+    // Releases the instances and the root node of the scene, call it when the scene is unloaded
+    void Clear();
+
+    const std::shared_ptr<donut::engine::SceneGraphNode>& GetRootNode() const { return m_RootNode; }
+    const std::vector<std::shared_ptr<donut::engine::MeshInstance>>& GetInstances() const { return m_Instances; }
+    const std::vector<donut::render::DrawItem>& GetSortedItems() const { return m_SortedItems; }
+    const std::vector<uint32_t>& GetItemInstances() const { return m_ItemInstances; }
+
+    const Statistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    bool m_Dirty = true;
+    std::shared_ptr<donut::engine::SceneGraphNode> m_RootNode; // of the scene graph the list was built from
+
+    std::vector<std::shared_ptr<donut::engine::MeshInstance>> m_Instances;
+    std::vector<donut::render::DrawItem> m_SortedItems;
+    std::vector<uint32_t> m_ItemInstances; // index into m_Instances for every sorted item
+
+    DrawListChangeTracker m_ChangeTracker;
+    Statistics m_Statistics;
+
+    void Rebuild(const donut::engine::SceneGraph& sceneGraph);
+};
+
+// Opaque draw strategy that filters a PersistentDrawList for one view, which keeps the sorted order.
+// Like the other strategies it keeps the items of the last prepared view, so views that are recorded
+// in parallel need one strategy each.
+class PersistentOpaqueDrawStrategy : public donut::render::IDrawStrategy
+{
+public:
+    explicit PersistentOpaqueDrawStrategy(const PersistentDrawList& drawList);
+
+    void PrepareForView(const std::shared_ptr<donut::engine::SceneGraphNode>& rootNode, const donut::engine::IView& view) override;
+    const donut::render::DrawItem* GetNextItem() override;
+
+    uint32_t GetNumVisibleItems() const { return uint32_t(m_VisibleItems.size()); }
+
+private:
+    const PersistentDrawList& m_DrawList;
+
+    std::vector<uint8_t> m_InstanceVisible;
+    std::vector<const donut::render::DrawItem*> m_VisibleItems;
+    size_t m_ReadPtr = 0;
+};
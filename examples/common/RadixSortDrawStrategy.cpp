@@ -0,0 +1,296 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "RadixSortDrawStrategy.h"
+#include <donut/engine/SceneTypes.h>
+#include <donut/engine/View.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+using namespace donut;
+using namespace donut::math;
+
+constexpr uint32_t c_DepthBits = 20;
+constexpr uint32_t c_MaterialBits = 8;
+constexpr uint32_t c_BufferBits = 4;
+
+// Folds a pointer into a few bits. Different objects may collide, which only affects grouping, not the depth order.
+static uint32_t HashPointer(const void* pointer, uint32_t bits)
+{
+    uint64_t value = uint64_t(reinterpret_cast<uintptr_t>(pointer));
+    value ^= value >> 17;
+    value *= 0x9E3779B97F4A7C15ull;
+    return uint32_t(value >> (64 - bits));
+}
+
+void TransparentItemSorter::Sort(const std::vector<render::DrawItem>& items, std::vector<uint32_t>& order)
+{
+    const size_t numItems = items.size();
+    order.resize(numItems);
+
+    if (numItems == 0)
+        return;
+
+    float maxDistance = 0.f;
+    for (const auto& item : items)
+        maxDistance = std::max(maxDistance, item.distanceToCamera);
+
+    // Ascending keys must give back to front order, so the farthest item gets the smallest depth value
+    const float depthScale = maxDistance > 0.f ? float((1u << c_DepthBits) - 1) / maxDistance : 0.f;
+
+    m_Keys.resize(numItems);
+    for (size_t index = 0; index < numItems; index++)
+    {
+        const render::DrawItem& item = items[index];
+        const uint32_t quantizedDistance = std::min(uint32_t(std::max(item.distanceToCamera, 0.f) * depthScale), (1u << c_DepthBits) - 1);
+        const uint32_t depth = ((1u << c_DepthBits) - 1) - quantizedDistance;
+        const uint32_t material = HashPointer(item.material, c_MaterialBits);
+        const uint32_t buffers = HashPointer(item.buffers, c_BufferBits);
+
+        m_Keys[index] = (depth << (c_MaterialBits + c_BufferBits)) | (material << c_BufferBits) | buffers;
+        order[index] = uint32_t(index);
+    }
+
+    // Histograms of all 4 key bytes in one pass
+    uint32_t histograms[4][256] = {};
+    for (uint32_t key : m_Keys)
+    {
+        histograms[0][key & 0xff]++;
+        histograms[1][(key >> 8) & 0xff]++;
+        histograms[2][(key >> 16) & 0xff]++;
+        histograms[3][key >> 24]++;
+    }
+
+    m_TempKeys.resize(numItems);
+    m_TempOrder.resize(numItems);
+
+    for (uint32_t pass = 0; pass < 4; pass++)
+    {
+        uint32_t* histogram = histograms[pass];
+        const uint32_t shift = pass * 8;
+
+        // All keys have the same byte here, the pass would not change the order
+        if (histogram[(m_Keys[0] >> shift) & 0xff] == numItems)
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < 256; bucket++)
+        {
+            const uint32_t count = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += count;
+        }
+
+        for (size_t index = 0; index < numItems; index++)
+        {
+            const uint32_t key = m_Keys[index];
+            const uint32_t destination = histogram[(key >> shift) & 0xff]++;
+            m_TempKeys[destination] = key;
+            m_TempOrder[destination] = order[index];
+        }
+
+        m_Keys.swap(m_TempKeys);
+        order.swap(m_TempOrder);
+    }
+}
+
+void RadixSortTransparentDrawStrategy::BeginFrame(const engine::SceneGraph& sceneGraph)
+{
+    m_OrderValid = false;
+
+    // The tracker records the current state on every call, so it is updated before the other checks
+    const bool changed = m_ChangeTracker.Update(sceneGraph);
+
+    if (!changed && sceneGraph.GetRootNode() == m_SceneRootNode && DrawDoubleSidedMaterialsSeparately == m_CandidatesDoubleSidedSeparately)
+    {
+        m_Statistics.cacheHits++;
+        return;
+    }
+
+    m_SceneRootNode = sceneGraph.GetRootNode();
+    m_CandidatesDoubleSidedSeparately = DrawDoubleSidedMaterialsSeparately;
+    m_Candidates.clear();
+    m_Statistics.rebuilds++;
+
+    for (const auto& instance : sceneGraph.GetMeshInstances())
+    {
+        const engine::MeshInfo* mesh = instance->GetMesh().get();
+
+        for (const auto& geometry : mesh->geometries)
+        {
+            const engine::Material* material = geometry->material.get();
+            if (!material || material->domain == engine::MaterialDomain::Opaque || material->domain == engine::MaterialDomain::AlphaTested)
+                continue;
+
+            render::DrawItem item;
+            item.instance = instance.get();
+            item.mesh = mesh;
+            item.geometry = geometry.get();
+            item.material = material;
+            item.buffers = mesh->buffers.get();
+            item.distanceToCamera = 0.f;
+
+            if (material->doubleSided && DrawDoubleSidedMaterialsSeparately)
+            {
+                item.cullMode = nvrhi::RasterCullMode::Front;
+                m_Candidates.push_back(item);
+                item.cullMode = nvrhi::RasterCullMode::Back;
+                m_Candidates.push_back(item);
+            }
+            else
+            {
+                item.cullMode = material->doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+                m_Candidates.push_back(item);
+            }
+        }
+    }
+}
+
+void RadixSortTransparentDrawStrategy::Clear()
+{
+    m_SceneRootNode.reset();
+    m_Candidates.clear();
+    m_VisibleItems.clear();
+    m_Order.clear();
+    m_ReadPtr = 0;
+    m_OrderValid = false;
+    m_SortedRootNode = nullptr;
+    m_ChangeTracker.Clear();
+}
+
+void RadixSortTransparentDrawStrategy::PrepareForView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView& view)
+{
+    m_ReadPtr = 0;
+
+    const float4x4 viewProjection = view.GetViewProjectionMatrix();
+    if (m_OrderValid && rootNode.get() == m_SortedRootNode && memcmp(&viewProjection, &m_SortedViewProjection, sizeof(float4x4)) == 0)
+    {
+        m_Statistics.reuses++;
+        return;
+    }
+
+    const frustum viewFrustum = view.GetViewFrustum();
+    const float3 viewOrigin = view.GetViewOrigin();
+
+    // Rendering a subgraph only draws the instances below its root, like the traversing strategies, and a null root draws nothing
+    const bool wholeGraph = rootNode == m_SceneRootNode;
+
+    m_VisibleItems.clear();
+    for (const render::DrawItem& candidate : m_Candidates)
+    {
+        const engine::SceneGraphNode* node = candidate.instance->GetNode();
+        if (!wholeGraph)
+        {
+            while (node && node != rootNode.get())
+                node = node->GetParent();
+
+            if (!node)
+                continue;
+        }
+
+        const box3 bounds = candidate.instance->GetNode()->GetGlobalBoundingBox();
+        if (!viewFrustum.intersectsWith(bounds))
+            continue;
+
+        render::DrawItem item = candidate;
+        item.distanceToCamera = length(bounds.center() - viewOrigin);
+        m_VisibleItems.push_back(item);
+    }
+
+    m_Sorter.Sort(m_VisibleItems, m_Order);
+
+    m_OrderValid = true;
+    m_SortedViewProjection = viewProjection;
+    m_SortedRootNode = rootNode.get();
+    m_Statistics.numItems = uint32_t(m_VisibleItems.size());
+    m_Statistics.sorts++;
+}
+
+const render::DrawItem* RadixSortTransparentDrawStrategy::GetNextItem()
+{
+    if (m_ReadPtr < m_Order.size())
+        return &m_VisibleItems[m_Order[m_ReadPtr++]];
+
+    return nullptr;
+}
+
+void RunTransparentSortBenchmark()
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    constexpr int numIterations = 20;
+
+    std::vector<engine::Material> materials(64);
+    std::vector<engine::BufferGroup> bufferGroups(8);
+    std::mt19937 randomGenerator(1);
+    std::uniform_real_distribution<float> distanceDistribution(0.f, 200.f);
+
+    TransparentItemSorter sorter;
+    std::vector<uint32_t> order;
+
+    for (size_t numItems : { size_t(10000), size_t(30000), size_t(100000) })
+    {
+        std::vector<render::DrawItem> items(numItems);
+        for (size_t index = 0; index < numItems; index++)
+        {
+            items[index].material = &materials[index % materials.size()];
+            items[index].buffers = &bufferGroups[index % bufferGroups.size()];
+            items[index].distanceToCamera = distanceDistribution(randomGenerator);
+        }
+
+        double comparisonMs = 0.0;
+        double radixMs = 0.0;
+        std::vector<render::DrawItem> sortedItems;
+
+        for (int iteration = 0; iteration < numIterations; iteration++)
+        {
+            sortedItems = items;
+
+            auto start = clock::now();
+            std::sort(sortedItems.begin(), sortedItems.end(), [](const render::DrawItem& a, const render::DrawItem& b)
+            {
+                return a.distanceToCamera > b.distanceToCamera;
+            });
+            auto comparisonEnd = clock::now();
+            sorter.Sort(items, order);
+            auto radixEnd = clock::now();
+
+            comparisonMs += std::chrono::duration<double, std::milli>(comparisonEnd - start).count();
+            radixMs += std::chrono::duration<double, std::milli>(radixEnd - comparisonEnd).count();
+        }
+
+        // The radix order may only differ from the exact order within one depth quantization step
+        const float tolerance = 200.f / float(1u << c_DepthBits) * 2.f;
+        bool ordered = true;
+        for (size_t index = 1; index < order.size(); index++)
+        {
+            if (items[order[index]].distanceToCamera > items[order[index - 1]].distanceToCamera + tolerance)
+                ordered = false;
+        }
+
+        log::info("%6d items: comparison sort %.3f ms, radix sort %.3f ms%s", int(numItems),
+            comparisonMs / numIterations, radixMs / numIterations, ordered ? "" : " (ORDER MISMATCH)");
+    }
+}
@@ -0,0 +1,96 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/render/DrawStrategy.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/core/math/math.h>
+#include "DrawListChangeTracker.h"
+#include <vector>
+
+// Sorts draw items back to front with an LSD radix sort over 32-bit keys.
+// The key holds the distance to the camera quantized to 20 bits, followed by 8 bits of the material
+// and 4 bits of the buffer group, so that items at the same depth are grouped by state.
+// The sort is stable, items with equal keys stay in their input order.
+class TransparentItemSorter
+{
+public:
+    // Writes the indices of the items in draw order
+    void Sort(const std::vector<donut::render::DrawItem>& items, std::vector<uint32_t>& order);
+
+private:
+    std::vector<uint32_t> m_Keys;
+    std::vector<uint32_t> m_TempKeys;
+    std::vector<uint32_t> m_TempOrder;
+};
+
+// Transparent draw strategy that sorts with TransparentItemSorter instead of a comparison sort.
+// The sorted order is kept for the rest of the frame, so several passes over the same view and root node share one sort.
+// The transparent geometries are collected again only when DrawListChangeTracker sees a change in the scene graph.
+class RadixSortTransparentDrawStrategy : public donut::render::IDrawStrategy
+{
+public:
+    struct Statistics
+    {
+        uint32_t numItems = 0; // visible in the last sorted view
+        uint64_t sorts = 0;
+        uint64_t reuses = 0;
+        uint64_t cacheHits = 0; // frames that kept the collected geometries
+        uint64_t rebuilds = 0;
+    };
+
+    // Collects the transparent geometries of the scene if it changed, and invalidates the order of the previous frame.
+    // Call once per frame after the scene graph is refreshed.
+    void BeginFrame(const donut::engine::SceneGraph& sceneGraph);
+
+    // Releases the geometries and the root node of the scene, call it when the scene is unloaded
+    void Clear();
+
+    void PrepareForView(const std::shared_ptr<donut::engine::SceneGraphNode>& rootNode, const donut::engine::IView& view) override;
+    const donut::render::DrawItem* GetNextItem() override;
+
+    // Renders double-sided materials as two items, back faces first, like TransparentDrawStrategy
+    bool DrawDoubleSidedMaterialsSeparately = true;
+
+    const Statistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    std::shared_ptr<donut::engine::SceneGraphNode> m_SceneRootNode;
+    std::vector<donut::render::DrawItem> m_Candidates;
+    bool m_CandidatesDoubleSidedSeparately = true;
+    DrawListChangeTracker m_ChangeTracker;
+    std::vector<donut::render::DrawItem> m_VisibleItems;
+    std::vector<uint32_t> m_Order;
+    size_t m_ReadPtr = 0;
+
+    TransparentItemSorter m_Sorter;
+
+    bool m_OrderValid = false;
+    donut::math::float4x4 m_SortedViewProjection;
+    const donut::engine::SceneGraphNode* m_SortedRootNode = nullptr;
+
+    Statistics m_Statistics;
+};
+
+// Compares the radix sort with a comparison sort by distance on synthetic item lists, prints the results to the log
+void RunTransparentSortBenchmark();
@@ -0,0 +1,124 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// Thin wrappers that let the culling, rasterization, block compression and ray casting loops
+// be written once for all instruction sets. The width is chosen at compile time from the flags of the source file,
+// which examples_simd_sources in CMakeLists.txt sets to AVX2 when DONUT_EXAMPLES_WITH_AVX2 is on.
+// The width can differ between files, so it must not leak into the types of any header.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE 1
+#endif
+
+#include <cstddef>
+
+#if SIMD_AVX
+constexpr size_t c_SimdWidth = 8;
+typedef __m256 SimdFloat;
+typedef __m256 SimdMask;
+static inline SimdFloat SimdLoad(const float* data) { return _mm256_loadu_ps(data); }
+static inline void SimdStore(float* data, SimdFloat a) { _mm256_storeu_ps(data, a); }
+static inline SimdFloat SimdSet(float value) { return _mm256_set1_ps(value); }
+static inline SimdFloat SimdRamp() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a, b); }
+static inline SimdFloat SimdSub(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a, b); }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a, b); }
+static inline SimdFloat SimdDiv(SimdFloat a, SimdFloat b) { return _mm256_div_ps(a, b); }
+static inline SimdFloat SimdMulAdd(SimdFloat a, SimdFloat b, SimdFloat c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+static inline SimdFloat SimdMin(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a, b); }
+static inline SimdFloat SimdMax(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a, b); }
+static inline SimdMask SimdGreaterEqualZero(SimdFloat a) { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ); }
+static inline SimdMask SimdLessEqual(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline SimdMask SimdLess(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline SimdMask SimdAnd(SimdMask a, SimdMask b) { return _mm256_and_ps(a, b); }
+static inline SimdMask SimdOr(SimdMask a, SimdMask b) { return _mm256_or_ps(a, b); }
+static inline SimdMask SimdAndNot(SimdMask a, SimdMask b) { return _mm256_andnot_ps(b, a); }
+static inline SimdMask SimdAllTrue() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+static inline SimdFloat SimdSelect(SimdMask mask, SimdFloat a, SimdFloat b) { return _mm256_blendv_ps(b, a, mask); }
+static inline int SimdMoveMask(SimdMask a) { return _mm256_movemask_ps(a); }
+#elif SIMD_SSE
+constexpr size_t c_SimdWidth = 4;
+typedef __m128 SimdFloat;
+typedef __m128 SimdMask;
+static inline SimdFloat SimdLoad(const float* data) { return _mm_loadu_ps(data); }
+static inline void SimdStore(float* data, SimdFloat a) { _mm_storeu_ps(data, a); }
+static inline SimdFloat SimdSet(float value) { return _mm_set1_ps(value); }
+static inline SimdFloat SimdRamp() { return _mm_setr_ps(0.f, 1.f, 2.f, 3.f); }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm_add_ps(a, b); }
+static inline SimdFloat SimdSub(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a, b); }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a, b); }
+static inline SimdFloat SimdDiv(SimdFloat a, SimdFloat b) { return _mm_div_ps(a, b); }
+static inline SimdFloat SimdMulAdd(SimdFloat a, SimdFloat b, SimdFloat c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline SimdFloat SimdMin(SimdFloat a, SimdFloat b) { return _mm_min_ps(a, b); }
+static inline SimdFloat SimdMax(SimdFloat a, SimdFloat b) { return _mm_max_ps(a, b); }
+static inline SimdMask SimdGreaterEqualZero(SimdFloat a) { return _mm_cmpge_ps(a, _mm_setzero_ps()); }
+static inline SimdMask SimdLessEqual(SimdFloat a, SimdFloat b) { return _mm_cmple_ps(a, b); }
+static inline SimdMask SimdLess(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a, b); }
+static inline SimdMask SimdAnd(SimdMask a, SimdMask b) { return _mm_and_ps(a, b); }
+static inline SimdMask SimdOr(SimdMask a, SimdMask b) { return _mm_or_ps(a, b); }
+static inline SimdMask SimdAndNot(SimdMask a, SimdMask b) { return _mm_andnot_ps(b, a); }
+static inline SimdMask SimdAllTrue() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+static inline SimdFloat SimdSelect(SimdMask mask, SimdFloat a, SimdFloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline int SimdMoveMask(SimdMask a) { return _mm_movemask_ps(a); }
+#else
+constexpr size_t c_SimdWidth = 1;
+typedef float SimdFloat;
+typedef bool SimdMask;
+static inline SimdFloat SimdLoad(const float* data) { return *data; }
+static inline void SimdStore(float* data, SimdFloat a) { *data = a; }
+static inline SimdFloat SimdSet(float value) { return value; }
+static inline SimdFloat SimdRamp() { return 0.f; }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return a + b; }
+static inline SimdFloat SimdSub(SimdFloat a, SimdFloat b) { return a - b; }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return a * b; }
+static inline SimdFloat SimdDiv(SimdFloat a, SimdFloat b) { return a / b; }
+static inline SimdFloat SimdMulAdd(SimdFloat a, SimdFloat b, SimdFloat c) { return a * b + c; }
+static inline SimdFloat SimdMin(SimdFloat a, SimdFloat b) { return a < b ? a : b; }
+static inline SimdFloat SimdMax(SimdFloat a, SimdFloat b) { return a > b ? a : b; }
+static inline SimdMask SimdGreaterEqualZero(SimdFloat a) { return a >= 0.f; }
+static inline SimdMask SimdLessEqual(SimdFloat a, SimdFloat b) { return a <= b; }
+static inline SimdMask SimdLess(SimdFloat a, SimdFloat b) { return a < b; }
+static inline SimdMask SimdAnd(SimdMask a, SimdMask b) { return a && b; }
+static inline SimdMask SimdOr(SimdMask a, SimdMask b) { return a || b; }
+static inline SimdMask SimdAndNot(SimdMask a, SimdMask b) { return a && !b; }
+static inline SimdMask SimdAllTrue() { return true; }
+static inline SimdFloat SimdSelect(SimdMask mask, SimdFloat a, SimdFloat b) { return mask ? a : b; }
+static inline int SimdMoveMask(SimdMask a) { return a ? 1 : 0; }
+#endif
+
+// "AVX", "SSE" or "Scalar"
+static inline const char* GetSimdInstructionSetName()
+{
+#if SIMD_AVX
+    return "AVX";
+#elif SIMD_SSE
+    return "SSE";
+#else
+    return "Scalar";
+#endif
+}
@@ -0,0 +1,46 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// Checks and result reporting shared by the CPU-only tests of the examples.
+// A failed CHECK prints its location and message and the test goes on, so that one run reports every failure.
+
+#include <cstdio>
+
+inline int g_Failures = 0;
+
+#define CHECK(condition, ...) \
+    do { if (!(condition)) { printf("FAILED %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); g_Failures++; } } while (0)
+
+// Prints the number of failed checks, or the given message when all passed, and returns the exit code of the test
+inline int ReportTestResults(const char* passedMessage)
+{
+    if (g_Failures != 0)
+    {
+        printf("%d checks failed\n", g_Failures);
+        return 1;
+    }
+
+    printf("%s\n", passedMessage);
+    return 0;
+}
@@ -38,6 +38,7 @@ using namespace donut;
 using namespace donut::math;
 
 #include "lighting_cb.h"
+#include "RayTracingScene.h"
 
 static const char* g_WindowTitle = "Donut Example: Bindless Ray Tracing";
 
@@ -56,7 +57,8 @@ private:
     nvrhi::BindingSetHandle m_BindingSet;
     nvrhi::BindingLayoutHandle m_BindlessLayout;
 
-    nvrhi::rt::AccelStructHandle m_TopLevelAS;
+    std::unique_ptr<RayTracingScene> m_RayTracingScene;
+    float m_CompactionBudgetMs = 0.f;
 
     nvrhi::BufferHandle m_ConstantBuffer;
 
@@ -75,8 +77,10 @@ private:
 public:
     using ApplicationBase::ApplicationBase;
 
-    bool Init(bool useRayQuery)
+    bool Init(bool useRayQuery, float compactionBudgetMs)
     {
+        m_CompactionBudgetMs = compactionBudgetMs;
+
         std::filesystem::path sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/sponza-plus.scene.json";
         std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
         std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/rt_bindless" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
@@ -146,7 +150,8 @@ public:
                 return false;
         }
 
-        m_CommandList = GetDevice()->createCommandList();
+        m_CommandList = GetDevice()->createCommandList(nvrhi::CommandListParameters()
+            .setScratchChunkSize(c_ScratchArenaChunkSize));
 
         m_CommandList->open();
 
@@ -223,7 +228,15 @@ public:
             }
         }
 
-        const char* extraInfo = (m_RayPipeline != nullptr) ? "- using RayPipeline" : "- using RayQuery";
+        RayTracingScene::Statistics stats;
+        if (m_RayTracingScene)
+            stats = m_RayTracingScene->GetStatistics();
+
+        char extraInfo[256];
+        snprintf(extraInfo, sizeof(extraInfo), "- using %s - %d instances, %d BLASes, %.1f MB - %d skinned BLAS refits - %.1f MB saved by compaction",
+            (m_RayPipeline != nullptr) ? "RayPipeline" : "RayQuery", int(stats.numInstances), int(stats.numAccelStructs),
+            double(stats.blasBytes + stats.tlasBytes) / double(1 << 20), int(stats.refitsLastFrame),
+            double(stats.compactionSavedBytes) / double(1 << 20));
         GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfo);
     }
 
@@ -291,122 +304,14 @@ public:
         return true;
     }
 
-    void GetMeshBlasDesc(engine::MeshInfo& mesh, nvrhi::rt::AccelStructDesc& blasDesc) const
-    {
-        blasDesc.isTopLevel = false;
-        blasDesc.debugName = mesh.name;
-
-        for (const auto& geometry : mesh.geometries)
-        {
-            nvrhi::rt::GeometryDesc geometryDesc;
-            auto & triangles = geometryDesc.geometryData.triangles;
-            triangles.indexBuffer = mesh.buffers->indexBuffer;
-            triangles.indexOffset = (mesh.indexOffset + geometry->indexOffsetInMesh) * sizeof(uint32_t);
-            triangles.indexFormat = nvrhi::Format::R32_UINT;
-            triangles.indexCount = geometry->numIndices;
-            triangles.vertexBuffer = mesh.buffers->vertexBuffer;
-            triangles.vertexOffset = (mesh.vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh.buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
-            triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
-            triangles.vertexStride = sizeof(float3);
-            triangles.vertexCount = geometry->numVertices;
-            geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
-            geometryDesc.flags = (geometry->material->domain == engine::MaterialDomain::AlphaTested)
-                ? nvrhi::rt::GeometryFlags::None
-                : nvrhi::rt::GeometryFlags::Opaque;
-            blasDesc.bottomLevelGeometries.push_back(geometryDesc);
-        }
-
-        // don't compact acceleration structures that are built per frame
-        if (mesh.skinPrototype != nullptr)
-        {
-            blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::PerferFastTrace;
-        }
-        else
-        {
-            blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::PerferFastTrace | nvrhi::rt::AccelStructBuildFlags::AllowCompaction;
-        }
-    }
-
     void CreateAccelStructs(nvrhi::ICommandList* commandList)
     {
-        for (const auto& mesh : m_Scene->GetSceneGraph()->GetMeshes())
-        {
-            if (mesh->buffers->hasAttribute(engine::VertexAttribute::JointWeights))
-                continue; // skip the skinning prototypes
-            
-            nvrhi::rt::AccelStructDesc blasDesc;
-
-            GetMeshBlasDesc(*mesh, blasDesc);
-
-            nvrhi::rt::AccelStructHandle as = GetDevice()->createAccelStruct(blasDesc);
-
-            if (!mesh->skinPrototype)
-                nvrhi::utils::BuildBottomLevelAccelStruct(commandList, as, blasDesc);
-
-            mesh->accelStruct = as;
-        }
-
-
-        nvrhi::rt::AccelStructDesc tlasDesc;
-        tlasDesc.isTopLevel = true;
-        tlasDesc.topLevelMaxInstances = m_Scene->GetSceneGraph()->GetMeshInstances().size();
-        m_TopLevelAS = GetDevice()->createAccelStruct(tlasDesc);
+        RayTracingScene::CreateParameters params;
+        params.compactionBudgetMs = m_CompactionBudgetMs;
+        m_RayTracingScene = std::make_unique<RayTracingScene>(GetDevice(), params);
+        m_RayTracingScene->CreateAccelStructs(*m_Scene->GetSceneGraph(), commandList);
     }
 
-    void BuildTLAS(nvrhi::ICommandList* commandList, uint32_t frameIndex) const
-    {
-        commandList->beginMarker("Skinned BLAS Updates");
-
-        // Transition all the buffers to their necessary states before building the BLAS'es to allow BLAS batching
-        for (const auto& skinnedInstance : m_Scene->GetSceneGraph()->GetSkinnedMeshInstances())
-        {
-            if (skinnedInstance->GetLastUpdateFrameIndex() < frameIndex)
-                continue;
-
-            commandList->setAccelStructState(skinnedInstance->GetMesh()->accelStruct, nvrhi::ResourceStates::AccelStructWrite);
-            commandList->setBufferState(skinnedInstance->GetMesh()->buffers->vertexBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
-        }
-        commandList->commitBarriers();
-
-        // Now build the BLAS'es
-        for (const auto& skinnedInstance : m_Scene->GetSceneGraph()->GetSkinnedMeshInstances())
-        {
-            if (skinnedInstance->GetLastUpdateFrameIndex() < frameIndex)
-                continue;
-            
-            nvrhi::rt::AccelStructDesc blasDesc;
-            GetMeshBlasDesc(*skinnedInstance->GetMesh(), blasDesc);
-            
-            nvrhi::utils::BuildBottomLevelAccelStruct(commandList, skinnedInstance->GetMesh()->accelStruct, blasDesc);
-        }
-        commandList->endMarker();
-
-        std::vector<nvrhi::rt::InstanceDesc> instances;
-
-        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
-        {
-            nvrhi::rt::InstanceDesc instanceDesc;
-            instanceDesc.bottomLevelAS = instance->GetMesh()->accelStruct;
-            assert(instanceDesc.bottomLevelAS);
-            instanceDesc.instanceMask = 1;
-            instanceDesc.instanceID = instance->GetInstanceIndex();
-
-            auto node = instance->GetNode();
-            assert(node);
-            dm::affineToColumnMajor(node->GetLocalToWorldTransformFloat(), instanceDesc.transform);
-
-            instances.push_back(instanceDesc);
-        }
-
-        // Compact acceleration structures that are tagged for compaction and have finished executing the original build
-        commandList->compactBottomLevelAccelStructs();
-
-        commandList->beginMarker("TLAS Update");
-        commandList->buildTopLevelAccelStruct(m_TopLevelAS, instances.data(), instances.size());
-        commandList->endMarker();
-    }
-
-
     void BackBufferResizing() override
     { 
         m_ColorBuffer = nullptr;
@@ -432,7 +337,7 @@ public:
             nvrhi::BindingSetDesc bindingSetDesc;
             bindingSetDesc.bindings = {
                 nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer),
-                nvrhi::BindingSetItem::RayTracingAccelStruct(0, m_TopLevelAS),
+                nvrhi::BindingSetItem::RayTracingAccelStruct(0, m_RayTracingScene->GetTopLevelAS()),
                 nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_Scene->GetInstanceBuffer()),
                 nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_Scene->GetGeometryBuffer()),
                 nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_Scene->GetMaterialBuffer()),
@@ -451,7 +356,7 @@ public:
         m_CommandList->open();
 
         m_Scene->Refresh(m_CommandList, GetFrameIndex());
-        BuildTLAS(m_CommandList, GetFrameIndex());
+        m_RayTracingScene->Update(*m_Scene->GetSceneGraph(), GetFrameIndex(), m_CommandList);
         
         LightingConstants constants = {};
         constants.ambientColor = float4(0.05f);
@@ -504,6 +409,7 @@ int main(int __argc, const char** __argv)
     deviceParams.enableRayTracingExtensions = true;
 
     bool useRayQuery = false;
+    float compactionBudgetMs = 0.5f;
     for (int i = 1; i < __argc; i++)
     {
         if (strcmp(__argv[i], "-rayQuery") == 0)
@@ -515,6 +421,10 @@ int main(int __argc, const char** __argv)
             deviceParams.enableDebugRuntime = true;
             deviceParams.enableNvrhiValidationLayer = true;
         }
+        else if (strcmp(__argv[i], "-compactionBudget") == 0 && i + 1 < __argc)
+        {
+            compactionBudgetMs = std::max(std::stof(__argv[++i]), 0.f);
+        }
     }
 
     if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
@@ -537,7 +447,7 @@ int main(int __argc, const char** __argv)
 
     {
         BindlessRayTracing example(deviceManager);
-        if (example.Init(useRayQuery))
+        if (example.Init(useRayQuery, compactionBudgetMs))
         {
             deviceManager->AddRenderPassToBack(&example);
             deviceManager->RunMessageLoop();
@@ -0,0 +1,174 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AccelStructCompactor.h"
+#include <donut/core/log.h>
+#include <algorithm>
+
+using namespace donut;
+
+// Conservative until the first batch is measured, about 100M triangles per second for the builds,
+// and ten times that for the compactions, which copy the built data
+static constexpr float c_InitialMsPerBuiltTriangle = 1e-5f;
+static constexpr float c_InitialMsPerCompactedTriangle = 1e-6f;
+
+AccelStructCompactor::AccelStructCompactor(nvrhi::IDevice* device, float frameBudgetMs)
+    : m_Device(device)
+    , m_FrameBudgetMs(frameBudgetMs)
+    , m_MsPerBuiltTriangle(c_InitialMsPerBuiltTriangle)
+    , m_MsPerCompactedTriangle(c_InitialMsPerCompactedTriangle)
+{
+    m_BuildTimerQuery = m_Device->createTimerQuery();
+    m_CompactionTimerQuery = m_Device->createTimerQuery();
+}
+
+void AccelStructCompactor::BeginScene(BlasBuilder& blasBuilder)
+{
+    m_BlasBuilder = &blasBuilder;
+    m_Entries.clear();
+    m_PendingEntries.clear();
+    m_NextEntry = 0;
+    m_Statistics = Statistics();
+
+    for (const auto& blas : blasBuilder.GetAccelStructs())
+    {
+        if (blas->skinned)
+            continue;
+
+        Entry entry;
+        entry.blas = blas.get();
+        m_Entries.push_back(entry);
+    }
+
+    // The largest BLASes save the most memory
+    std::stable_sort(m_Entries.begin(), m_Entries.end(), [](const Entry& a, const Entry& b)
+    {
+        return a.blas->triangles > b.blas->triangles;
+    });
+
+    m_Statistics.numMeshes = uint32_t(m_Entries.size());
+}
+
+void AccelStructCompactor::Update(nvrhi::ICommandList* commandList)
+{
+    if (m_TimerQueryPending && m_Device->pollTimerQuery(m_BuildTimerQuery) && m_Device->pollTimerQuery(m_CompactionTimerQuery))
+    {
+        const float buildMs = m_Device->getTimerQueryTime(m_BuildTimerQuery) * 1000.f;
+        const float compactionMs = m_Device->getTimerQueryTime(m_CompactionTimerQuery) * 1000.f;
+        m_Device->resetTimerQuery(m_BuildTimerQuery);
+        m_Device->resetTimerQuery(m_CompactionTimerQuery);
+        m_TimerQueryPending = false;
+
+        m_Statistics.lastBatchMs = buildMs + compactionMs;
+        m_Statistics.lastCompactionMs = compactionMs;
+
+        if (m_TimedBuiltTriangles > 0)
+            m_MsPerBuiltTriangle = 0.5f * (m_MsPerBuiltTriangle + buildMs / float(m_TimedBuiltTriangles));
+        if (m_TimedCompactedTriangles > 0)
+            m_MsPerCompactedTriangle = 0.5f * (m_MsPerCompactedTriangle + compactionMs / float(m_TimedCompactedTriangles));
+    }
+
+    // Nothing is recorded until the times of the previous frame are known, so that every build and compaction
+    // is measured. This also bounds the number of copies that exist next to their originals.
+    if (IsFinished() || m_TimerQueryPending)
+        return;
+
+    commandList->beginMarker("BLAS Compaction");
+
+    // Compacts the copies whose builds have finished on the GPU, which are at most the ones of the previous batch
+    commandList->beginTimerQuery(m_CompactionTimerQuery);
+    commandList->compactBottomLevelAccelStructs();
+    commandList->endTimerQuery(m_CompactionTimerQuery);
+
+    auto compacted = std::stable_partition(m_PendingEntries.begin(), m_PendingEntries.end(), [this](size_t index)
+    {
+        return !m_Entries[index].compactedAccelStruct->isCompacted();
+    });
+
+    m_TimedCompactedTriangles = 0;
+    for (auto it = compacted; it != m_PendingEntries.end(); ++it)
+    {
+        Entry& entry = m_Entries[*it];
+        entry.bytesBeforeCompaction = entry.blas->bytes;
+        m_BlasBuilder->ReplaceAccelStruct(*entry.blas, entry.compactedAccelStruct);
+        entry.bytesAfterCompaction = entry.blas->bytes;
+        entry.compactedAccelStruct = nullptr;
+        m_TimedCompactedTriangles += entry.blas->triangles;
+
+        m_Statistics.numCompacted++;
+        m_Statistics.bytesBeforeCompaction += entry.bytesBeforeCompaction;
+        m_Statistics.bytesAfterCompaction += entry.bytesAfterCompaction;
+    }
+
+    m_PendingEntries.erase(compacted, m_PendingEntries.end());
+
+    // The compactions of this frame take their part of the budget before the builds
+    float batchMs = float(m_TimedCompactedTriangles) * m_MsPerCompactedTriangle;
+
+    commandList->beginTimerQuery(m_BuildTimerQuery);
+    m_TimedBuiltTriangles = 0;
+
+    while (m_NextEntry < m_Entries.size())
+    {
+        Entry& entry = m_Entries[m_NextEntry];
+        const float entryMs = float(entry.blas->triangles) * m_MsPerBuiltTriangle;
+
+        // Always make progress, even if one BLAS does not fit into the budget
+        if ((m_TimedBuiltTriangles > 0 || m_TimedCompactedTriangles > 0) && batchMs + entryMs > m_FrameBudgetMs)
+            break;
+
+        nvrhi::rt::AccelStructDesc desc = entry.blas->desc;
+        desc.buildFlags = desc.buildFlags | nvrhi::rt::AccelStructBuildFlags::AllowCompaction;
+        entry.compactedAccelStruct = m_Device->createAccelStruct(desc);
+
+        commandList->buildBottomLevelAccelStruct(entry.compactedAccelStruct, desc.bottomLevelGeometries.data(),
+            desc.bottomLevelGeometries.size(), desc.buildFlags);
+
+        batchMs += entryMs;
+        m_TimedBuiltTriangles += entry.blas->triangles;
+        m_PendingEntries.push_back(m_NextEntry);
+        m_NextEntry++;
+    }
+
+    commandList->endTimerQuery(m_BuildTimerQuery);
+    commandList->endMarker();
+    m_TimerQueryPending = true;
+
+    m_Statistics.numPending = uint32_t(m_PendingEntries.size());
+
+    if (IsFinished())
+        ReportSavings();
+}
+
+void AccelStructCompactor::ReportSavings() const
+{
+    log::info("Compacted %d BLASes from %.2f MB to %.2f MB, saved %.2f MB", int(m_Statistics.numCompacted),
+        double(m_Statistics.bytesBeforeCompaction) / double(1 << 20),
+        double(m_Statistics.bytesAfterCompaction) / double(1 << 20),
+        double(m_Statistics.bytesBeforeCompaction - m_Statistics.bytesAfterCompaction) / double(1 << 20));
+
+    for (const Entry& entry : m_Entries)
+    {
+        log::debug("  %s: %.1f KB -> %.1f KB", entry.blas->desc.debugName.c_str(),
+            double(entry.bytesBeforeCompaction) / 1024.0, double(entry.bytesAfterCompaction) / 1024.0);
+    }
+}
@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "BlasBuilder.h"
+#include <nvrhi/nvrhi.h>
+#include <vector>
+
+// Compacts the static BLASes a few at a time after the scene is loaded. nvrhi compacts every acceleration structure
+// that was built with AllowCompaction at once, so the static BLASes are first built without it, and the compactor
+// builds compactable copies of some of them each frame. Once a copy is compacted, it replaces the original BLAS of
+// the meshes that share it. This builds every static BLAS twice, and the copies of one batch exist next to their
+// originals until they are compacted, in exchange for never compacting the whole scene in one frame.
+// Each frame first compacts the copies of the previous batch and then builds the next one, both timed, and the
+// number of copies is chosen so that the estimated time of both fits into a GPU time budget.
+class AccelStructCompactor
+{
+public:
+    struct Statistics
+    {
+        uint32_t numMeshes = 0;
+        uint32_t numCompacted = 0;
+        uint32_t numPending = 0;
+        uint64_t bytesBeforeCompaction = 0; // of the compacted BLASes
+        uint64_t bytesAfterCompaction = 0;
+        float lastBatchMs = 0.f;        // of the builds and the compactions of the last measured frame
+        float lastCompactionMs = 0.f;   // of the compactions alone
+    };
+
+    AccelStructCompactor(nvrhi::IDevice* device, float frameBudgetMs);
+
+    // Queues the static BLASes of the builder, largest first
+    void BeginScene(BlasBuilder& blasBuilder);
+
+    // Replaces the BLASes whose copies have been compacted, and records the builds and compactions of this frame.
+    // Must be called before the TLAS build so that the TLAS uses the compacted BLASes.
+    void Update(nvrhi::ICommandList* commandList);
+
+    bool IsFinished() const { return m_NextEntry == m_Entries.size() && m_Statistics.numPending == 0; }
+    const Statistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    struct Entry
+    {
+        BlasBuilder::Blas* blas = nullptr;
+        nvrhi::rt::AccelStructHandle compactedAccelStruct;
+        uint64_t bytesBeforeCompaction = 0;
+        uint64_t bytesAfterCompaction = 0;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    BlasBuilder* m_BlasBuilder = nullptr;
+    float m_FrameBudgetMs;
+    std::vector<Entry> m_Entries;
+    size_t m_NextEntry = 0;
+    std::vector<size_t> m_PendingEntries;
+    Statistics m_Statistics;
+
+    // Estimated GPU times to build a copy and to compact it, per triangle, refined with the timer queries of each batch
+    float m_MsPerBuiltTriangle;
+    float m_MsPerCompactedTriangle;
+    nvrhi::TimerQueryHandle m_BuildTimerQuery;
+    nvrhi::TimerQueryHandle m_CompactionTimerQuery;
+    uint64_t m_TimedBuiltTriangles = 0;
+    uint64_t m_TimedCompactedTriangles = 0;
+    bool m_TimerQueryPending = false;
+
+    void ReportSavings() const;
+};
@@ -0,0 +1,244 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "BlasBuilder.h"
+#include <donut/core/math/math.h>
+#include <nvrhi/utils.h>
+
+using namespace donut;
+using namespace donut::math;
+
+template <typename T>
+static void HashCombine(size_t& seed, const T& value)
+{
+    seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+static size_t HashGeometries(const std::vector<nvrhi::rt::GeometryDesc>& geometries)
+{
+    size_t hash = 0;
+    for (const auto& geometry : geometries)
+    {
+        const auto& triangles = geometry.geometryData.triangles;
+        HashCombine(hash, static_cast<const void*>(triangles.indexBuffer));
+        HashCombine(hash, static_cast<const void*>(triangles.vertexBuffer));
+        HashCombine(hash, triangles.indexOffset);
+        HashCombine(hash, triangles.vertexOffset);
+        HashCombine(hash, triangles.indexCount);
+        HashCombine(hash, triangles.vertexCount);
+        HashCombine(hash, uint32_t(geometry.flags));
+    }
+    return hash;
+}
+
+static bool SameGeometries(const std::vector<nvrhi::rt::GeometryDesc>& a, const std::vector<nvrhi::rt::GeometryDesc>& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t index = 0; index < a.size(); index++)
+    {
+        const auto& ta = a[index].geometryData.triangles;
+        const auto& tb = b[index].geometryData.triangles;
+        if (ta.indexBuffer != tb.indexBuffer || ta.vertexBuffer != tb.vertexBuffer ||
+            ta.indexOffset != tb.indexOffset || ta.vertexOffset != tb.vertexOffset ||
+            ta.indexCount != tb.indexCount || ta.vertexCount != tb.vertexCount ||
+            ta.indexFormat != tb.indexFormat || ta.vertexFormat != tb.vertexFormat ||
+            ta.vertexStride != tb.vertexStride || a[index].flags != b[index].flags)
+            return false;
+    }
+    return true;
+}
+
+BlasBuilder::BlasBuilder(nvrhi::IDevice* device, bool forceOpaque)
+    : m_Device(device)
+    , m_ForceOpaque(forceOpaque)
+{
+}
+
+void BlasBuilder::GetMeshBlasDesc(const engine::MeshInfo& mesh, nvrhi::rt::AccelStructDesc& blasDesc) const
+{
+    blasDesc.isTopLevel = false;
+    blasDesc.debugName = mesh.name;
+
+    for (const auto& geometry : mesh.geometries)
+    {
+        nvrhi::rt::GeometryDesc geometryDesc;
+        auto & triangles = geometryDesc.geometryData.triangles;
+        triangles.indexBuffer = mesh.buffers->indexBuffer;
+        triangles.indexOffset = (mesh.indexOffset + geometry->indexOffsetInMesh) * sizeof(uint32_t);
+        triangles.indexFormat = nvrhi::Format::R32_UINT;
+        triangles.indexCount = geometry->numIndices;
+        triangles.vertexBuffer = mesh.buffers->vertexBuffer;
+        triangles.vertexOffset = (mesh.vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh.buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
+        triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
+        triangles.vertexStride = sizeof(float3);
+        triangles.vertexCount = geometry->numVertices;
+        geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
+        geometryDesc.flags = (geometry->material->domain == engine::MaterialDomain::AlphaTested && !m_ForceOpaque)
+            ? nvrhi::rt::GeometryFlags::None
+            : nvrhi::rt::GeometryFlags::Opaque;
+        blasDesc.bottomLevelGeometries.push_back(geometryDesc);
+    }
+
+    // Skinned BLASes are refitted every frame. The others are built once, and compacted later by AccelStructCompactor.
+    if (mesh.skinPrototype != nullptr)
+    {
+        blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::PerferFastTrace | nvrhi::rt::AccelStructBuildFlags::AllowUpdate;
+    }
+    else
+    {
+        blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::PerferFastTrace;
+    }
+}
+
+BlasBuilder::Blas* BlasBuilder::FindStaticBlas(const nvrhi::rt::AccelStructDesc& blasDesc, size_t hash) const
+{
+    auto range = m_StaticBlasesByHash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (SameGeometries(it->second->desc.bottomLevelGeometries, blasDesc.bottomLevelGeometries))
+            return it->second;
+    }
+    return nullptr;
+}
+
+void BlasBuilder::CreateAccelStructs(const engine::SceneGraph& sceneGraph, nvrhi::ICommandList* commandList)
+{
+    for (const auto& mesh : sceneGraph.GetMeshes())
+    {
+        if (mesh->buffers->hasAttribute(engine::VertexAttribute::JointWeights))
+            continue; // skip the skinning prototypes
+
+        if (m_MeshBlases.count(mesh.get()))
+            continue;
+
+        auto blas = std::make_unique<Blas>();
+        GetMeshBlasDesc(*mesh, blas->desc);
+        blas->skinned = mesh->skinPrototype != nullptr;
+
+        // Skinned meshes have their own vertices, so only the static ones can share a BLAS
+        size_t hash = 0;
+        if (!blas->skinned)
+        {
+            hash = HashGeometries(blas->desc.bottomLevelGeometries);
+            if (Blas* existing = FindStaticBlas(blas->desc, hash))
+            {
+                existing->meshes.push_back(mesh);
+                mesh->accelStruct = existing->accelStruct;
+                m_MeshBlases[mesh.get()] = existing;
+                continue;
+            }
+        }
+
+        for (const auto& geometry : blas->desc.bottomLevelGeometries)
+            blas->triangles += geometry.geometryData.triangles.indexCount / 3;
+
+        blas->accelStruct = m_Device->createAccelStruct(blas->desc);
+        blas->bytes = m_Device->getAccelStructMemoryRequirements(blas->accelStruct).size;
+        blas->meshes.push_back(mesh);
+        mesh->accelStruct = blas->accelStruct;
+
+        if (blas->skinned)
+        {
+            m_Statistics.numSkinned++;
+        }
+        else
+        {
+            nvrhi::utils::BuildBottomLevelAccelStruct(commandList, blas->accelStruct, blas->desc);
+            blas->built = true;
+            m_StaticBlasesByHash.emplace(hash, blas.get());
+        }
+
+        m_Statistics.accelStructBytes += blas->bytes;
+        m_MeshBlases[mesh.get()] = blas.get();
+        m_Blases.push_back(std::move(blas));
+    }
+
+    m_Statistics.numMeshes = uint32_t(m_MeshBlases.size());
+    m_Statistics.numAccelStructs = uint32_t(m_Blases.size());
+}
+
+void BlasBuilder::UpdateSkinnedAccelStructs(const engine::SceneGraph& sceneGraph, uint32_t frameIndex, nvrhi::ICommandList* commandList)
+{
+    m_Statistics.buildsLastFrame = 0;
+    m_Statistics.refitsLastFrame = 0;
+
+    m_Batch.clear();
+    for (const auto& skinnedInstance : sceneGraph.GetSkinnedMeshInstances())
+    {
+        if (skinnedInstance->GetLastUpdateFrameIndex() < frameIndex)
+            continue;
+
+        auto it = m_MeshBlases.find(skinnedInstance->GetMesh().get());
+        if (it != m_MeshBlases.end())
+            m_Batch.push_back(it->second);
+    }
+
+    if (m_Batch.empty())
+        return;
+
+    commandList->beginMarker("Skinned BLAS Updates");
+
+    for (const Blas* blas : m_Batch)
+    {
+        commandList->setAccelStructState(blas->accelStruct, nvrhi::ResourceStates::AccelStructWrite);
+        commandList->setBufferState(blas->desc.bottomLevelGeometries[0].geometryData.triangles.vertexBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+    }
+    commandList->commitBarriers();
+
+    // The builds write to different acceleration structures and scratch ranges, so they need no barriers between them.
+    // The transitions to the TLAS build input state are flushed together by the TLAS build.
+    commandList->setEnableAutomaticBarriers(false);
+
+    for (Blas* blas : m_Batch)
+    {
+        const auto& geometries = blas->desc.bottomLevelGeometries;
+        if (blas->built)
+        {
+            commandList->buildBottomLevelAccelStruct(blas->accelStruct, geometries.data(), geometries.size(),
+                blas->desc.buildFlags | nvrhi::rt::AccelStructBuildFlags::PerformUpdate);
+            m_Statistics.refitsLastFrame++;
+        }
+        else
+        {
+            commandList->buildBottomLevelAccelStruct(blas->accelStruct, geometries.data(), geometries.size(), blas->desc.buildFlags);
+            blas->built = true;
+            m_Statistics.buildsLastFrame++;
+        }
+    }
+
+    commandList->setEnableAutomaticBarriers(true);
+    commandList->endMarker();
+}
+
+void BlasBuilder::ReplaceAccelStruct(Blas& blas, nvrhi::rt::IAccelStruct* accelStruct)
+{
+    const uint64_t bytes = m_Device->getAccelStructMemoryRequirements(accelStruct).size;
+    m_Statistics.accelStructBytes = m_Statistics.accelStructBytes - blas.bytes + bytes;
+    blas.bytes = bytes;
+
+    // The previous one is released once the GPU is done with the frames that use it
+    blas.accelStruct = accelStruct;
+    for (const auto& mesh : blas.meshes)
+        mesh->accelStruct = accelStruct;
+}
@@ -0,0 +1,91 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <nvrhi/nvrhi.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Size of the scratch chunks of the command list that builds the acceleration structures. The builds of a frame
+// sub-allocate their scratch memory from the current chunk, which the command list reuses once the GPU has
+// finished with it, so a chunk that fits all skinned BLAS updates of a frame works as a per-frame arena.
+constexpr size_t c_ScratchArenaChunkSize = 16 * 1024 * 1024;
+
+// Creates the bottom level acceleration structures of the scene meshes and keeps their geometry descriptions,
+// which only reference the mesh buffers and do not change after loading. Meshes with the same geometry, such as
+// the glTF meshes that reference the same accessors, share one BLAS. Skinned BLASes allow updates: they are
+// built on the first frame that skins them and refitted to the new vertex positions on the later ones.
+class BlasBuilder
+{
+public:
+    struct Statistics
+    {
+        uint32_t numMeshes = 0;
+        uint32_t numAccelStructs = 0;
+        uint32_t numSkinned = 0;
+        uint32_t buildsLastFrame = 0;
+        uint32_t refitsLastFrame = 0;
+        uint64_t accelStructBytes = 0;
+    };
+
+    struct Blas
+    {
+        nvrhi::rt::AccelStructDesc desc;
+        nvrhi::rt::AccelStructHandle accelStruct;
+        std::vector<std::shared_ptr<donut::engine::MeshInfo>> meshes;
+        uint64_t triangles = 0;
+        uint64_t bytes = 0;
+        bool skinned = false;
+        bool built = false;
+    };
+
+    // Alpha tested geometry is marked as non-opaque unless forceOpaque is set, for pipelines without any-hit shaders
+    BlasBuilder(nvrhi::IDevice* device, bool forceOpaque);
+
+    // Creates the BLAS of every mesh and builds the ones of the static meshes
+    void CreateAccelStructs(const donut::engine::SceneGraph& sceneGraph, nvrhi::ICommandList* commandList);
+
+    // Builds or refits the BLASes of the skinned instances that were updated in this frame. The buffers of all of
+    // them are transitioned with one barrier flush, and the builds follow each other without barriers in between.
+    void UpdateSkinnedAccelStructs(const donut::engine::SceneGraph& sceneGraph, uint32_t frameIndex, nvrhi::ICommandList* commandList);
+
+    // Makes all meshes that share the BLAS use another acceleration structure with the same geometry
+    void ReplaceAccelStruct(Blas& blas, nvrhi::rt::IAccelStruct* accelStruct);
+
+    const std::vector<std::unique_ptr<Blas>>& GetAccelStructs() const { return m_Blases; }
+    const Statistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    nvrhi::DeviceHandle m_Device;
+    bool m_ForceOpaque;
+    std::vector<std::unique_ptr<Blas>> m_Blases;
+    std::unordered_map<const donut::engine::MeshInfo*, Blas*> m_MeshBlases;
+    std::unordered_multimap<size_t, Blas*> m_StaticBlasesByHash;
+    std::vector<Blas*> m_Batch;
+    Statistics m_Statistics;
+
+    void GetMeshBlasDesc(const donut::engine::MeshInfo& mesh, nvrhi::rt::AccelStructDesc& blasDesc) const;
+    Blas* FindStaticBlas(const nvrhi::rt::AccelStructDesc& blasDesc, size_t hash) const;
+};
@@ -0,0 +1,288 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CpuBvh.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut::math;
+
+static constexpr uint32_t c_NumBins = 16;
+static constexpr uint32_t c_MaxLeafSize = 8;
+static constexpr uint32_t c_ParallelBuildThreshold = 16 * 1024;
+static constexpr float c_TraversalCost = 1.f;
+static constexpr float c_IntersectionCost = 1.f;
+
+void CpuAabb::Grow(const float3& point)
+{
+    min = float3(std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z));
+    max = float3(std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z));
+}
+
+void CpuAabb::Grow(const CpuAabb& other)
+{
+    Grow(other.min);
+    Grow(other.max);
+}
+
+float CpuAabb::SurfaceArea() const
+{
+    if (IsEmpty())
+        return 0.f;
+
+    const float3 size = max - min;
+    return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+struct CpuBvh::BuildContext
+{
+    const std::vector<CpuAabb>& bounds;
+    std::vector<float3> centroids;
+    std::atomic<uint32_t> numNodes;
+
+    BuildContext(const std::vector<CpuAabb>& bounds)
+        : bounds(bounds)
+        , numNodes(bounds.empty() ? 0 : 1) // without primitives, there is no root
+    {
+    }
+};
+
+static float GetAxis(const float3& v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+void CpuBvh::Build(const std::vector<CpuAabb>& primitiveBounds, tf::Executor* executor)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    const uint32_t numPrimitives = uint32_t(primitiveBounds.size());
+
+    m_PrimitiveIndices.resize(numPrimitives);
+    for (uint32_t index = 0; index < numPrimitives; index++)
+        m_PrimitiveIndices[index] = index;
+
+    // A binary tree over N primitives has at most 2N - 1 nodes, so the nodes never move during the build
+    m_Nodes.clear();
+    m_Nodes.resize(std::max(2 * numPrimitives, 2u) - 1);
+
+    BuildContext context(primitiveBounds);
+    context.centroids.resize(numPrimitives);
+    for (uint32_t index = 0; index < numPrimitives; index++)
+        context.centroids[index] = primitiveBounds[index].Center();
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && numPrimitives >= c_ParallelBuildThreshold)
+    {
+        tf::Taskflow taskFlow;
+        taskFlow.emplace([this, &context, numPrimitives](tf::Subflow& subflow)
+        {
+            BuildNode(context, 0, 0, numPrimitives, 0, &subflow);
+        });
+
+        executor->run(taskFlow).wait();
+    }
+    else if (numPrimitives > 0)
+        BuildNode(context, 0, 0, numPrimitives, 0, nullptr);
+#else
+    if (numPrimitives > 0)
+        BuildNode(context, 0, 0, numPrimitives, 0, nullptr);
+#endif
+
+    m_Nodes.resize(context.numNodes.load());
+    m_Nodes.shrink_to_fit();
+
+    ComputeStatistics();
+    m_Statistics.numPrimitives = numPrimitives;
+    m_Statistics.buildMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void CpuBvh::BuildNode(BuildContext& context, uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth, tf::Subflow* subflow)
+{
+    CpuBvhNode& node = m_Nodes[nodeIndex];
+    const uint32_t count = end - begin;
+
+    CpuAabb bounds;
+    CpuAabb centroidBounds;
+    for (uint32_t index = begin; index < end; index++)
+    {
+        const uint32_t primitive = m_PrimitiveIndices[index];
+        bounds.Grow(context.bounds[primitive]);
+        centroidBounds.Grow(context.centroids[primitive]);
+    }
+
+    node.boundsMin = bounds.min;
+    node.boundsMax = bounds.max;
+    node.leftOrFirst = begin;
+    node.count = count;
+
+    if (count <= 2 || depth + 1 >= c_CpuBvhMaxDepth)
+        return;
+
+    struct Bin
+    {
+        CpuAabb bounds;
+        uint32_t count = 0;
+    };
+
+    // Cost of the best split, in surface area times primitive count
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const float axisMin = GetAxis(centroidBounds.min, axis);
+        const float extent = GetAxis(centroidBounds.max, axis) - axisMin;
+        if (extent <= 0.f)
+            continue;
+
+        Bin bins[c_NumBins];
+        const float scale = float(c_NumBins) / extent;
+        for (uint32_t index = begin; index < end; index++)
+        {
+            const uint32_t primitive = m_PrimitiveIndices[index];
+            const uint32_t bin = std::min(uint32_t((GetAxis(context.centroids[primitive], axis) - axisMin) * scale), c_NumBins - 1);
+            bins[bin].bounds.Grow(context.bounds[primitive]);
+            bins[bin].count++;
+        }
+
+        // Sweep from the right to get the cost of the right side of every split, then from the left
+        float rightCosts[c_NumBins];
+        CpuAabb rightBounds;
+        uint32_t rightCount = 0;
+        for (uint32_t bin = c_NumBins - 1; bin > 0; bin--)
+        {
+            rightBounds.Grow(bins[bin].bounds);
+            rightCount += bins[bin].count;
+            rightCosts[bin] = rightBounds.SurfaceArea() * float(rightCount);
+        }
+
+        CpuAabb leftBounds;
+        uint32_t leftCount = 0;
+        for (uint32_t split = 1; split < c_NumBins; split++)
+        {
+            leftBounds.Grow(bins[split - 1].bounds);
+            leftCount += bins[split - 1].count;
+            if (leftCount == 0 || leftCount == count)
+                continue;
+
+            const float cost = leftBounds.SurfaceArea() * float(leftCount) + rightCosts[split];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    const float area = bounds.SurfaceArea();
+    const float leafCost = c_IntersectionCost * area * float(count);
+    const float splitCost = c_TraversalCost * area + c_IntersectionCost * bestCost;
+
+    uint32_t middle;
+    if (bestAxis >= 0)
+    {
+        if (splitCost >= leafCost && count <= c_MaxLeafSize)
+            return;
+
+        const float axisMin = GetAxis(centroidBounds.min, bestAxis);
+        const float scale = float(c_NumBins) / (GetAxis(centroidBounds.max, bestAxis) - axisMin);
+        auto split = std::partition(m_PrimitiveIndices.begin() + begin, m_PrimitiveIndices.begin() + end, [&](uint32_t primitive)
+        {
+            return std::min(uint32_t((GetAxis(context.centroids[primitive], bestAxis) - axisMin) * scale), c_NumBins - 1) < bestSplit;
+        });
+        middle = uint32_t(split - m_PrimitiveIndices.begin());
+    }
+    else
+    {
+        // All centroids are in the same place, so any split is as good as another one
+        if (count <= c_MaxLeafSize)
+            return;
+
+        middle = begin + count / 2;
+    }
+
+    const uint32_t left = context.numNodes.fetch_add(2);
+    node.leftOrFirst = left;
+    node.count = 0;
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (subflow && count >= c_ParallelBuildThreshold)
+    {
+        // Every task builds one child, the worker runs the tasks of the subflow while it joins
+        subflow->emplace([this, &context, left, begin, middle, depth](tf::Subflow& childSubflow)
+        {
+            BuildNode(context, left, begin, middle, depth + 1, &childSubflow);
+        });
+        subflow->emplace([this, &context, left, middle, end, depth](tf::Subflow& childSubflow)
+        {
+            BuildNode(context, left + 1, middle, end, depth + 1, &childSubflow);
+        });
+        subflow->join();
+        return;
+    }
+#endif
+
+    BuildNode(context, left, begin, middle, depth + 1, nullptr);
+    BuildNode(context, left + 1, middle, end, depth + 1, nullptr);
+}
+
+void CpuBvh::ComputeStatistics()
+{
+    m_Statistics = CpuBvhStatistics();
+    m_Statistics.numNodes = uint32_t(m_Nodes.size());
+
+    if (m_Nodes.empty())
+        return;
+
+    const float rootArea = std::max(CpuAabb{ m_Nodes[0].boundsMin, m_Nodes[0].boundsMax }.SurfaceArea(), FLT_MIN);
+
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 1 } };
+    while (!stack.empty())
+    {
+        const auto [nodeIndex, depth] = stack.back();
+        stack.pop_back();
+
+        const CpuBvhNode& node = m_Nodes[nodeIndex];
+        const float probability = CpuAabb{ node.boundsMin, node.boundsMax }.SurfaceArea() / rootArea;
+        m_Statistics.maxDepth = std::max(m_Statistics.maxDepth, depth);
+
+        if (node.count > 0)
+        {
+            m_Statistics.numLeaves++;
+            m_Statistics.sahCost += probability * c_IntersectionCost * float(node.count);
+        }
+        else
+        {
+            m_Statistics.sahCost += probability * c_TraversalCost;
+            stack.push_back({ node.leftOrFirst, depth + 1 });
+            stack.push_back({ node.leftOrFirst + 1, depth + 1 });
+        }
+    }
+}
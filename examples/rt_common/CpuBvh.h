@@ -0,0 +1,95 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+namespace tf
+{
+    class Executor;
+    class Subflow;
+}
+
+// Subtrees deeper than this are made leaves, so that traversal stacks have a fixed size
+constexpr uint32_t c_CpuBvhMaxDepth = 64;
+
+struct CpuAabb
+{
+    donut::math::float3 min = donut::math::float3(FLT_MAX, FLT_MAX, FLT_MAX);
+    donut::math::float3 max = donut::math::float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    void Grow(const donut::math::float3& point);
+    void Grow(const CpuAabb& other);
+    bool IsEmpty() const { return min.x > max.x; }
+    float SurfaceArea() const;
+    donut::math::float3 Center() const { return (min + max) * 0.5f; }
+};
+
+// 32 bytes. Interior nodes have count == 0 and their children at leftOrFirst and leftOrFirst + 1,
+// leaves reference count primitives starting at leftOrFirst in the primitive order of the BVH.
+struct CpuBvhNode
+{
+    donut::math::float3 boundsMin;
+    uint32_t leftOrFirst = 0;
+    donut::math::float3 boundsMax;
+    uint32_t count = 0;
+};
+
+struct CpuBvhStatistics
+{
+    uint32_t numPrimitives = 0;
+    uint32_t numNodes = 0;
+    uint32_t numLeaves = 0;
+    uint32_t maxDepth = 0;
+    float sahCost = 0.f; // expected cost of a ray that hits the root, in box tests plus primitive tests
+    float buildMs = 0.f;
+};
+
+// Bounding volume hierarchy over primitive bounds, built with a binned surface area heuristic. Large subtrees
+// are built as separate tasks of the executor. The tree is the same with or without an executor, only the order
+// of the nodes in memory changes.
+class CpuBvh
+{
+public:
+    // The executor may be null, then the tree is built on the calling thread. Must not be called from a task of
+    // the same executor, the call waits for the build.
+    void Build(const std::vector<CpuAabb>& primitiveBounds, tf::Executor* executor);
+
+    const std::vector<CpuBvhNode>& GetNodes() const { return m_Nodes; }
+    const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+    const CpuBvhStatistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    struct BuildContext;
+
+    std::vector<CpuBvhNode> m_Nodes;
+    std::vector<uint32_t> m_PrimitiveIndices;
+    CpuBvhStatistics m_Statistics;
+
+    // With a subflow, the children of large nodes are built as tasks of the subflow
+    void BuildNode(BuildContext& context, uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth, tf::Subflow* subflow);
+    void ComputeStatistics();
+};
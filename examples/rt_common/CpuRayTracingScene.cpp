@@ -0,0 +1,732 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CpuRayTracingScene.h"
+#include "SimdFloat.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <thread>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+
+// Meshes with more triangles are built one after another with all workers, the smaller ones in parallel
+static constexpr size_t c_ParallelMeshThreshold = 64 * 1024;
+
+struct CpuRayTracingScene::Packet
+{
+    SimdFloat originX, originY, originZ;
+    SimdFloat directionX, directionY, directionZ;
+    SimdFloat tMin, tMax;
+    SimdMask active;
+    uint32_t instanceIndex[c_SimdWidth];
+    uint32_t triangleIndex[c_SimdWidth];
+};
+
+struct PacketRays
+{
+    SimdFloat originX, originY, originZ;
+    SimdFloat inverseDirectionX, inverseDirectionY, inverseDirectionZ;
+
+    // The rays of the first active lane, to choose the order of the children
+    float3 firstOrigin;
+    float3 firstDirection;
+};
+
+static SimdFloat SafeInverse(SimdFloat direction)
+{
+    // Avoids 0 * inf in the slab test for rays parallel to an axis
+    const SimdMask tiny = SimdLessEqual(SimdMul(direction, direction), SimdSet(1e-30f));
+    return SimdDiv(SimdSet(1.f), SimdSelect(tiny, SimdSet(1e-15f), direction));
+}
+
+static void PreparePacketRays(PacketRays& rays, SimdFloat originX, SimdFloat originY, SimdFloat originZ,
+    SimdFloat directionX, SimdFloat directionY, SimdFloat directionZ, SimdMask active)
+{
+    rays.originX = originX;
+    rays.originY = originY;
+    rays.originZ = originZ;
+    rays.inverseDirectionX = SafeInverse(directionX);
+    rays.inverseDirectionY = SafeInverse(directionY);
+    rays.inverseDirectionZ = SafeInverse(directionZ);
+
+    float values[6][c_SimdWidth];
+    SimdStore(values[0], originX);
+    SimdStore(values[1], originY);
+    SimdStore(values[2], originZ);
+    SimdStore(values[3], directionX);
+    SimdStore(values[4], directionY);
+    SimdStore(values[5], directionZ);
+
+    int lane = 0;
+    const int activeBits = SimdMoveMask(active);
+    while (lane < int(c_SimdWidth) - 1 && !(activeBits & (1 << lane)))
+        lane++;
+
+    rays.firstOrigin = float3(values[0][lane], values[1][lane], values[2][lane]);
+    rays.firstDirection = float3(values[3][lane], values[4][lane], values[5][lane]);
+}
+
+static SimdMask IntersectBox(const PacketRays& rays, const CpuBvhNode& node, SimdFloat tMin, SimdFloat tMax, SimdMask active)
+{
+    const SimdFloat t0x = SimdMul(SimdSub(SimdSet(node.boundsMin.x), rays.originX), rays.inverseDirectionX);
+    const SimdFloat t1x = SimdMul(SimdSub(SimdSet(node.boundsMax.x), rays.originX), rays.inverseDirectionX);
+    const SimdFloat t0y = SimdMul(SimdSub(SimdSet(node.boundsMin.y), rays.originY), rays.inverseDirectionY);
+    const SimdFloat t1y = SimdMul(SimdSub(SimdSet(node.boundsMax.y), rays.originY), rays.inverseDirectionY);
+    const SimdFloat t0z = SimdMul(SimdSub(SimdSet(node.boundsMin.z), rays.originZ), rays.inverseDirectionZ);
+    const SimdFloat t1z = SimdMul(SimdSub(SimdSet(node.boundsMax.z), rays.originZ), rays.inverseDirectionZ);
+
+    const SimdFloat tNear = SimdMax(SimdMax(SimdMin(t0x, t1x), SimdMin(t0y, t1y)), SimdMax(SimdMin(t0z, t1z), tMin));
+    const SimdFloat tFar = SimdMin(SimdMin(SimdMax(t0x, t1x), SimdMax(t0y, t1y)), SimdMin(SimdMax(t0z, t1z), tMax));
+
+    return SimdAnd(SimdLessEqual(tNear, tFar), active);
+}
+
+// Pushes the children of an interior node so that the one closer along the first active ray is visited first
+static void PushChildren(const std::vector<CpuBvhNode>& nodes, const CpuBvhNode& node, const PacketRays& rays, uint32_t* stack, uint32_t& stackSize)
+{
+    const CpuBvhNode& left = nodes[node.leftOrFirst];
+    const CpuBvhNode& right = nodes[node.leftOrFirst + 1];
+    const float leftDistance = dot((left.boundsMin + left.boundsMax) * 0.5f - rays.firstOrigin, rays.firstDirection);
+    const float rightDistance = dot((right.boundsMin + right.boundsMax) * 0.5f - rays.firstOrigin, rays.firstDirection);
+
+    if (leftDistance <= rightDistance)
+    {
+        stack[stackSize++] = node.leftOrFirst + 1;
+        stack[stackSize++] = node.leftOrFirst;
+    }
+    else
+    {
+        stack[stackSize++] = node.leftOrFirst;
+        stack[stackSize++] = node.leftOrFirst + 1;
+    }
+}
+
+uint32_t CpuRayTracingScene::AddMesh(const engine::MeshInfo& mesh)
+{
+    auto it = m_MeshIndices.find(&mesh);
+    if (it != m_MeshIndices.end())
+        return it->second;
+
+    const uint32_t meshIndex = uint32_t(m_Meshes.size());
+    m_MeshIndices[&mesh] = meshIndex;
+    Mesh& cpuMesh = m_Meshes.emplace_back();
+
+    const std::vector<uint32_t>& indices = mesh.buffers->indexData;
+    const std::vector<float3>& positions = mesh.buffers->positionData;
+
+    uint32_t triangleIndex = 0;
+    for (const auto& geometry : mesh.geometries)
+    {
+        // Same ranges as the BLAS geometry, whose indices are relative to the first vertex of the geometry
+        const size_t firstIndex = mesh.indexOffset + geometry->indexOffsetInMesh;
+        const size_t firstVertex = mesh.vertexOffset + geometry->vertexOffsetInMesh;
+        if (firstIndex + geometry->numIndices > indices.size() || firstVertex + geometry->numVertices > positions.size())
+        {
+            log::warning("Mesh '%s' has no CPU copy of its geometry, it is not ray traced on the CPU", mesh.name.c_str());
+            triangleIndex += geometry->numIndices / 3;
+            continue;
+        }
+
+        for (uint32_t index = 0; index + 2 < geometry->numIndices; index += 3)
+        {
+            const float3 p0 = positions[firstVertex + indices[firstIndex + index]];
+            const float3 p1 = positions[firstVertex + indices[firstIndex + index + 1]];
+            const float3 p2 = positions[firstVertex + indices[firstIndex + index + 2]];
+
+            Triangle triangle;
+            triangle.v0 = p0;
+            triangle.edge1 = p1 - p0;
+            triangle.edge2 = p2 - p0;
+            triangle.index = triangleIndex++;
+            cpuMesh.triangles.push_back(triangle);
+        }
+    }
+
+    return meshIndex;
+}
+
+void CpuRayTracingScene::AddInstance(uint32_t meshIndex, const affine3& localToWorld)
+{
+    m_InstanceMeshes.push_back(meshIndex);
+    m_InstanceTransforms.push_back(localToWorld);
+}
+
+void CpuRayTracingScene::AddSceneGraph(const engine::SceneGraph& sceneGraph)
+{
+    for (const auto& instance : sceneGraph.GetMeshInstances())
+    {
+        const auto& mesh = instance->GetMesh();
+
+        // Skinning happens on the GPU, so the CPU copies of skinned meshes are in the bind pose
+        if (mesh->buffers->hasAttribute(engine::VertexAttribute::JointWeights) || mesh->skinPrototype)
+            continue;
+
+        AddInstance(AddMesh(*mesh), instance->GetNode()->GetLocalToWorldTransformFloat());
+    }
+}
+
+void CpuRayTracingScene::Build(tf::Executor* executor)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    auto buildMesh = [](Mesh& mesh, tf::Executor* meshExecutor)
+    {
+        std::vector<CpuAabb> bounds(mesh.triangles.size());
+        for (size_t index = 0; index < mesh.triangles.size(); index++)
+        {
+            const Triangle& triangle = mesh.triangles[index];
+            bounds[index].Grow(triangle.v0);
+            bounds[index].Grow(triangle.v0 + triangle.edge1);
+            bounds[index].Grow(triangle.v0 + triangle.edge2);
+        }
+
+        mesh.bvh.Build(bounds, meshExecutor);
+
+        std::vector<Triangle> ordered;
+        ordered.reserve(mesh.triangles.size());
+        for (uint32_t primitive : mesh.bvh.GetPrimitiveIndices())
+            ordered.push_back(mesh.triangles[primitive]);
+        mesh.triangles = std::move(ordered);
+    };
+
+    std::vector<Mesh*> smallMeshes;
+    for (Mesh& mesh : m_Meshes)
+    {
+        if (mesh.triangles.size() >= c_ParallelMeshThreshold)
+            buildMesh(mesh, executor);
+        else
+            smallMeshes.push_back(&mesh);
+    }
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && smallMeshes.size() > 1)
+    {
+        // One task per mesh, which builds its hierarchy on the worker that runs it
+        tf::Taskflow taskFlow;
+        for (Mesh* mesh : smallMeshes)
+        {
+            taskFlow.emplace([&buildMesh, mesh]()
+            {
+                buildMesh(*mesh, nullptr);
+            });
+        }
+
+        executor->run(taskFlow).wait();
+        smallMeshes.clear();
+    }
+#endif
+
+    for (Mesh* mesh : smallMeshes)
+        buildMesh(*mesh, nullptr);
+
+    std::vector<Instance> instances(m_InstanceMeshes.size());
+    std::vector<CpuAabb> instanceBounds(m_InstanceMeshes.size());
+    for (size_t index = 0; index < instances.size(); index++)
+    {
+        Instance& instance = instances[index];
+        instance.index = uint32_t(index);
+        instance.meshIndex = m_InstanceMeshes[index];
+
+        const affine3& localToWorld = m_InstanceTransforms[index];
+        const affine3 worldToObject = inverse(localToWorld);
+        const float3 columns[4] = {
+            worldToObject.transformVector(float3(1.f, 0.f, 0.f)),
+            worldToObject.transformVector(float3(0.f, 1.f, 0.f)),
+            worldToObject.transformVector(float3(0.f, 0.f, 1.f)),
+            worldToObject.transformPoint(float3(0.f, 0.f, 0.f))
+        };
+        for (int column = 0; column < 4; column++)
+        {
+            instance.worldToObject[column] = columns[column].x;
+            instance.worldToObject[4 + column] = columns[column].y;
+            instance.worldToObject[8 + column] = columns[column].z;
+        }
+
+        const Mesh& mesh = m_Meshes[instance.meshIndex];
+        if (!mesh.bvh.GetNodes().empty())
+        {
+            const CpuBvhNode& root = mesh.bvh.GetNodes()[0];
+            for (int corner = 0; corner < 8; corner++)
+            {
+                const float3 point((corner & 1) ? root.boundsMax.x : root.boundsMin.x,
+                    (corner & 2) ? root.boundsMax.y : root.boundsMin.y,
+                    (corner & 4) ? root.boundsMax.z : root.boundsMin.z);
+                instance.bounds.Grow(localToWorld.transformPoint(point));
+            }
+        }
+        instanceBounds[index] = instance.bounds;
+    }
+
+    m_InstanceBvh.Build(instanceBounds, executor);
+
+    m_Instances.clear();
+    m_Instances.reserve(instances.size());
+    for (uint32_t primitive : m_InstanceBvh.GetPrimitiveIndices())
+        m_Instances.push_back(instances[primitive]);
+
+    m_Statistics = Statistics();
+    m_Statistics.numMeshes = uint32_t(m_Meshes.size());
+    m_Statistics.numInstances = uint32_t(m_Instances.size());
+    m_Statistics.numNodes = m_InstanceBvh.GetStatistics().numNodes;
+    m_Statistics.instanceSahCost = m_InstanceBvh.GetStatistics().sahCost;
+    for (const Mesh& mesh : m_Meshes)
+    {
+        m_Statistics.numTriangles += mesh.triangles.size();
+        m_Statistics.numNodes += mesh.bvh.GetStatistics().numNodes;
+        m_Statistics.meshSahCost += mesh.bvh.GetStatistics().sahCost * float(mesh.triangles.size());
+    }
+    if (m_Statistics.numTriangles > 0)
+        m_Statistics.meshSahCost /= float(m_Statistics.numTriangles);
+
+    m_Statistics.buildMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template <bool AnyHit>
+void CpuRayTracingScene::TraceMeshPacket(const Mesh& mesh, uint32_t instanceIndex, Packet& packet, bool cullBackFaces) const
+{
+    const std::vector<CpuBvhNode>& nodes = mesh.bvh.GetNodes();
+    if (nodes.empty())
+        return;
+
+    // The directions are not normalized, so that the hit distances are the same in object and world space
+    const float* m = m_Instances[instanceIndex].worldToObject;
+    const SimdFloat originX = SimdMulAdd(SimdSet(m[0]), packet.originX, SimdMulAdd(SimdSet(m[1]), packet.originY, SimdMulAdd(SimdSet(m[2]), packet.originZ, SimdSet(m[3]))));
+    const SimdFloat originY = SimdMulAdd(SimdSet(m[4]), packet.originX, SimdMulAdd(SimdSet(m[5]), packet.originY, SimdMulAdd(SimdSet(m[6]), packet.originZ, SimdSet(m[7]))));
+    const SimdFloat originZ = SimdMulAdd(SimdSet(m[8]), packet.originX, SimdMulAdd(SimdSet(m[9]), packet.originY, SimdMulAdd(SimdSet(m[10]), packet.originZ, SimdSet(m[11]))));
+    const SimdFloat directionX = SimdMulAdd(SimdSet(m[0]), packet.directionX, SimdMulAdd(SimdSet(m[1]), packet.directionY, SimdMul(SimdSet(m[2]), packet.directionZ)));
+    const SimdFloat directionY = SimdMulAdd(SimdSet(m[4]), packet.directionX, SimdMulAdd(SimdSet(m[5]), packet.directionY, SimdMul(SimdSet(m[6]), packet.directionZ)));
+    const SimdFloat directionZ = SimdMulAdd(SimdSet(m[8]), packet.directionX, SimdMulAdd(SimdSet(m[9]), packet.directionY, SimdMul(SimdSet(m[10]), packet.directionZ)));
+
+    PacketRays rays;
+    PreparePacketRays(rays, originX, originY, originZ, directionX, directionY, directionZ, packet.active);
+
+    const SimdFloat zero = SimdSet(0.f);
+    const SimdFloat one = SimdSet(1.f);
+
+    uint32_t stack[c_CpuBvhMaxDepth + 1];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const CpuBvhNode& node = nodes[stack[--stackSize]];
+        if (!SimdMoveMask(IntersectBox(rays, node, packet.tMin, packet.tMax, packet.active)))
+            continue;
+
+        if (node.count == 0)
+        {
+            PushChildren(nodes, node, rays, stack, stackSize);
+            continue;
+        }
+
+        for (uint32_t primitive = node.leftOrFirst; primitive < node.leftOrFirst + node.count; primitive++)
+        {
+            const Triangle& triangle = mesh.triangles[primitive];
+            const SimdFloat edge1X = SimdSet(triangle.edge1.x), edge1Y = SimdSet(triangle.edge1.y), edge1Z = SimdSet(triangle.edge1.z);
+            const SimdFloat edge2X = SimdSet(triangle.edge2.x), edge2Y = SimdSet(triangle.edge2.y), edge2Z = SimdSet(triangle.edge2.z);
+
+            // Moller-Trumbore. The determinant is positive for triangles that are clockwise from the ray origin.
+            const SimdFloat pX = SimdSub(SimdMul(directionY, edge2Z), SimdMul(directionZ, edge2Y));
+            const SimdFloat pY = SimdSub(SimdMul(directionZ, edge2X), SimdMul(directionX, edge2Z));
+            const SimdFloat pZ = SimdSub(SimdMul(directionX, edge2Y), SimdMul(directionY, edge2X));
+            const SimdFloat det = SimdMulAdd(edge1X, pX, SimdMulAdd(edge1Y, pY, SimdMul(edge1Z, pZ)));
+            const SimdMask facing = cullBackFaces ? SimdLess(zero, det) : SimdOr(SimdLess(zero, det), SimdLess(det, zero));
+            const SimdFloat inverseDet = SimdDiv(one, det);
+
+            const SimdFloat tX = SimdSub(originX, SimdSet(triangle.v0.x));
+            const SimdFloat tY = SimdSub(originY, SimdSet(triangle.v0.y));
+            const SimdFloat tZ = SimdSub(originZ, SimdSet(triangle.v0.z));
+            const SimdFloat u = SimdMul(SimdMulAdd(tX, pX, SimdMulAdd(tY, pY, SimdMul(tZ, pZ))), inverseDet);
+
+            const SimdFloat qX = SimdSub(SimdMul(tY, edge1Z), SimdMul(tZ, edge1Y));
+            const SimdFloat qY = SimdSub(SimdMul(tZ, edge1X), SimdMul(tX, edge1Z));
+            const SimdFloat qZ = SimdSub(SimdMul(tX, edge1Y), SimdMul(tY, edge1X));
+            const SimdFloat v = SimdMul(SimdMulAdd(directionX, qX, SimdMulAdd(directionY, qY, SimdMul(directionZ, qZ))), inverseDet);
+            const SimdFloat t = SimdMul(SimdMulAdd(edge2X, qX, SimdMulAdd(edge2Y, qY, SimdMul(edge2Z, qZ))), inverseDet);
+
+            SimdMask hit = SimdAnd(facing, packet.active);
+            hit = SimdAnd(hit, SimdAnd(SimdGreaterEqualZero(u), SimdGreaterEqualZero(v)));
+            hit = SimdAnd(hit, SimdLessEqual(SimdAdd(u, v), one));
+            hit = SimdAnd(hit, SimdAnd(SimdLess(packet.tMin, t), SimdLess(t, packet.tMax)));
+
+            const int hitBits = SimdMoveMask(hit);
+            if (!hitBits)
+                continue;
+
+            for (uint32_t lane = 0; lane < c_SimdWidth; lane++)
+            {
+                if (hitBits & (1 << lane))
+                {
+                    packet.instanceIndex[lane] = m_Instances[instanceIndex].index;
+                    packet.triangleIndex[lane] = triangle.index;
+                }
+            }
+
+            if (AnyHit)
+            {
+                packet.active = SimdAndNot(packet.active, hit);
+                if (!SimdMoveMask(packet.active))
+                    return;
+            }
+            else
+            {
+                packet.tMax = SimdSelect(hit, t, packet.tMax);
+            }
+        }
+    }
+}
+
+template <bool AnyHit>
+void CpuRayTracingScene::TracePacket(Packet& packet, bool cullBackFaces) const
+{
+    const std::vector<CpuBvhNode>& nodes = m_InstanceBvh.GetNodes();
+    if (nodes.empty())
+        return;
+
+    PacketRays rays;
+    PreparePacketRays(rays, packet.originX, packet.originY, packet.originZ,
+        packet.directionX, packet.directionY, packet.directionZ, packet.active);
+
+    uint32_t stack[c_CpuBvhMaxDepth + 1];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const CpuBvhNode& node = nodes[stack[--stackSize]];
+        if (!SimdMoveMask(IntersectBox(rays, node, packet.tMin, packet.tMax, packet.active)))
+            continue;
+
+        if (node.count == 0)
+        {
+            PushChildren(nodes, node, rays, stack, stackSize);
+            continue;
+        }
+
+        for (uint32_t instance = node.leftOrFirst; instance < node.leftOrFirst + node.count; instance++)
+        {
+            TraceMeshPacket<AnyHit>(m_Meshes[m_Instances[instance].meshIndex], instance, packet, cullBackFaces);
+
+            if (AnyHit && !SimdMoveMask(packet.active))
+                return;
+        }
+    }
+}
+
+void CpuRayTracingScene::LoadPacket(Packet& packet, const CpuRay* rays, size_t count)
+{
+    float values[8][c_SimdWidth];
+    for (size_t lane = 0; lane < c_SimdWidth; lane++)
+    {
+        // The unused lanes repeat the last ray and stay inactive
+        const CpuRay& ray = rays[std::min(lane, count - 1)];
+        values[0][lane] = ray.origin.x;
+        values[1][lane] = ray.origin.y;
+        values[2][lane] = ray.origin.z;
+        values[3][lane] = ray.direction.x;
+        values[4][lane] = ray.direction.y;
+        values[5][lane] = ray.direction.z;
+        values[6][lane] = ray.tMin;
+        values[7][lane] = ray.tMax;
+        packet.instanceIndex[lane] = ~0u;
+        packet.triangleIndex[lane] = 0;
+    }
+
+    packet.originX = SimdLoad(values[0]);
+    packet.originY = SimdLoad(values[1]);
+    packet.originZ = SimdLoad(values[2]);
+    packet.directionX = SimdLoad(values[3]);
+    packet.directionY = SimdLoad(values[4]);
+    packet.directionZ = SimdLoad(values[5]);
+    packet.tMin = SimdLoad(values[6]);
+    packet.tMax = SimdLoad(values[7]);
+    packet.active = SimdAnd(SimdLess(SimdRamp(), SimdSet(float(count))), SimdLessEqual(packet.tMin, packet.tMax));
+}
+
+void CpuRayTracingScene::TraceClosestHit(const CpuRay* rays, size_t count, CpuHit* hits, bool cullBackFaces) const
+{
+    for (size_t first = 0; first < count; first += c_SimdWidth)
+    {
+        Packet packet;
+        const size_t lanes = std::min(count - first, c_SimdWidth);
+        LoadPacket(packet, rays + first, lanes);
+
+        TracePacket<false>(packet, cullBackFaces);
+
+        float tMax[c_SimdWidth];
+        SimdStore(tMax, packet.tMax);
+        for (size_t lane = 0; lane < lanes; lane++)
+        {
+            CpuHit& hit = hits[first + lane];
+            hit.instanceIndex = packet.instanceIndex[lane];
+            hit.triangleIndex = packet.triangleIndex[lane];
+            hit.t = hit.instanceIndex != ~0u ? tMax[lane] : FLT_MAX;
+        }
+    }
+}
+
+void CpuRayTracingScene::TraceOcclusion(const CpuRay* rays, size_t count, bool* occluded, bool cullBackFaces) const
+{
+    for (size_t first = 0; first < count; first += c_SimdWidth)
+    {
+        Packet packet;
+        const size_t lanes = std::min(count - first, c_SimdWidth);
+        LoadPacket(packet, rays + first, lanes);
+
+        TracePacket<true>(packet, cullBackFaces);
+
+        for (size_t lane = 0; lane < lanes; lane++)
+            occluded[first + lane] = packet.instanceIndex[lane] != ~0u;
+    }
+}
+
+static std::shared_ptr<engine::MeshInfo> CreateBenchmarkMesh(const char* name, const std::vector<float3>& positions, const std::vector<uint32_t>& indices)
+{
+    auto buffers = std::make_shared<engine::BufferGroup>();
+    buffers->positionData = positions;
+    buffers->indexData = indices;
+
+    auto geometry = std::make_shared<engine::MeshGeometry>();
+    geometry->numIndices = uint32_t(indices.size());
+    geometry->numVertices = uint32_t(positions.size());
+
+    auto mesh = std::make_shared<engine::MeshInfo>();
+    mesh->name = name;
+    mesh->buffers = buffers;
+    mesh->geometries.push_back(geometry);
+    mesh->totalIndices = geometry->numIndices;
+    mesh->totalVertices = geometry->numVertices;
+    return mesh;
+}
+
+// A height field with a clockwise front side facing up
+static std::shared_ptr<engine::MeshInfo> CreateTerrainMesh(uint32_t resolution, float size)
+{
+    std::vector<float3> positions;
+    for (uint32_t z = 0; z <= resolution; z++)
+    {
+        for (uint32_t x = 0; x <= resolution; x++)
+        {
+            const float u = float(x) / float(resolution) - 0.5f;
+            const float v = float(z) / float(resolution) - 0.5f;
+            const float height = (sinf(u * 17.f) * cosf(v * 13.f) + 0.3f * sinf(u * 71.f + v * 53.f)) * size * 0.02f;
+            positions.push_back(float3(u * size, height, v * size));
+        }
+    }
+
+    std::vector<uint32_t> indices;
+    for (uint32_t z = 0; z < resolution; z++)
+    {
+        for (uint32_t x = 0; x < resolution; x++)
+        {
+            const uint32_t corner = z * (resolution + 1) + x;
+            const uint32_t quad[4] = { corner, corner + 1, corner + resolution + 1, corner + resolution + 2 };
+            indices.insert(indices.end(), { quad[0], quad[2], quad[1], quad[1], quad[2], quad[3] });
+        }
+    }
+
+    return CreateBenchmarkMesh("Terrain", positions, indices);
+}
+
+// A unit sphere with clockwise front faces on the outside
+static std::shared_ptr<engine::MeshInfo> CreateSphereMesh(uint32_t segments, uint32_t rings)
+{
+    std::vector<float3> positions;
+    for (uint32_t ring = 0; ring <= rings; ring++)
+    {
+        const float theta = float(ring) / float(rings) * PI_f;
+        for (uint32_t segment = 0; segment <= segments; segment++)
+        {
+            const float phi = float(segment) / float(segments) * 2.f * PI_f;
+            positions.push_back(float3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)));
+        }
+    }
+
+    std::vector<uint32_t> indices;
+    for (uint32_t ring = 0; ring < rings; ring++)
+    {
+        for (uint32_t segment = 0; segment < segments; segment++)
+        {
+            const uint32_t corner = ring * (segments + 1) + segment;
+            const uint32_t quad[4] = { corner, corner + 1, corner + segments + 1, corner + segments + 2 };
+            indices.insert(indices.end(), { quad[0], quad[1], quad[2], quad[1], quad[3], quad[2] });
+        }
+    }
+
+    return CreateBenchmarkMesh("Sphere", positions, indices);
+}
+
+void RunCpuRayTracingBenchmark()
+{
+    constexpr float c_TerrainSize = 200.f;
+    constexpr uint32_t c_NumSpheres = 4096;
+    constexpr uint32_t c_ImageSize = 1024;
+
+    const auto terrain = CreateTerrainMesh(512, c_TerrainSize);
+    const auto sphere = CreateSphereMesh(64, 32);
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+    std::vector<affine3> sphereTransforms;
+    for (uint32_t index = 0; index < c_NumSpheres; index++)
+    {
+        const float3 position((uniform(random) - 0.5f) * c_TerrainSize, uniform(random) * 4.f, (uniform(random) - 0.5f) * c_TerrainSize);
+        sphereTransforms.push_back(scaling(float3(0.2f + uniform(random) * 1.5f)) * translation(position));
+    }
+
+    auto createScene = [&](CpuRayTracingScene& scene)
+    {
+        scene.AddInstance(scene.AddMesh(*terrain), affine3::identity());
+        const uint32_t sphereIndex = scene.AddMesh(*sphere);
+        for (const affine3& transform : sphereTransforms)
+            scene.AddInstance(sphereIndex, transform);
+    };
+
+    log::info("CPU ray tracing benchmark: %d rays per packet, %d hardware threads", int(c_SimdWidth), int(std::thread::hardware_concurrency()));
+
+#ifdef DONUT_WITH_TASKFLOW
+    const uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+#else
+    // Without taskflow, the hierarchies are always built on the calling thread
+    const uint32_t maxThreads = 1;
+#endif
+
+    CpuRayTracingScene scene;
+    for (uint32_t numThreads = 1; ; numThreads = std::min(numThreads * 2, maxThreads))
+    {
+        scene = CpuRayTracingScene();
+        createScene(scene);
+
+#ifdef DONUT_WITH_TASKFLOW
+        if (numThreads > 1)
+        {
+            tf::Executor executor(numThreads);
+            scene.Build(&executor);
+        }
+        else
+#endif
+        {
+            scene.Build(nullptr);
+        }
+
+        const auto& stats = scene.GetStatistics();
+        log::info("  build with %2u threads: %.1f ms for %llu triangles in %u meshes and %u instances, %llu nodes, SAH cost %.2f (meshes) %.2f (instances)",
+            numThreads, stats.buildMs, (unsigned long long)stats.numTriangles, stats.numMeshes, stats.numInstances,
+            (unsigned long long)stats.numNodes, stats.meshSahCost, stats.instanceSahCost);
+
+        if (numThreads == maxThreads)
+            break;
+    }
+
+    // Coherent rays: a pinhole camera looking over the terrain, and shadow rays from the primary hits to the sun
+    const float3 cameraPosition(0.f, 20.f, -c_TerrainSize * 0.5f);
+    const float3 cameraForward = normalize(float3(0.f, -0.3f, 1.f));
+    const float3 cameraRight = normalize(cross(float3(0.f, 1.f, 0.f), cameraForward));
+    const float3 cameraUp = cross(cameraForward, cameraRight);
+    const float3 sunDirection = normalize(float3(0.4f, 1.f, 0.3f));
+
+    std::vector<CpuRay> primaryRays(c_ImageSize * c_ImageSize);
+    for (uint32_t y = 0; y < c_ImageSize; y++)
+    {
+        for (uint32_t x = 0; x < c_ImageSize; x++)
+        {
+            const float u = (float(x) + 0.5f) / float(c_ImageSize) * 2.f - 1.f;
+            const float v = 1.f - (float(y) + 0.5f) / float(c_ImageSize) * 2.f;
+            CpuRay& ray = primaryRays[y * c_ImageSize + x];
+            ray.origin = cameraPosition;
+            ray.direction = normalize(cameraForward + cameraRight * u + cameraUp * v);
+        }
+    }
+
+    auto measure = [](const char* name, size_t numRays, const std::function<void()>& trace)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        trace();
+        const float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+        log::info("  %-32s %.2f Mrays/s on one thread", name, float(numRays) / std::max(seconds, 1e-6f) * 1e-6f);
+    };
+
+    std::vector<CpuHit> primaryHits(primaryRays.size());
+    measure("primary rays, closest hit:", primaryRays.size(), [&]()
+    {
+        scene.TraceClosestHit(primaryRays.data(), primaryRays.size(), primaryHits.data(), false);
+    });
+
+    std::vector<CpuRay> shadowRays;
+    for (size_t index = 0; index < primaryRays.size(); index++)
+    {
+        if (primaryHits[index].instanceIndex == ~0u)
+            continue;
+
+        CpuRay ray;
+        ray.origin = primaryRays[index].origin + primaryRays[index].direction * primaryHits[index].t;
+        ray.direction = sunDirection;
+        ray.tMin = 0.01f;
+        shadowRays.push_back(ray);
+    }
+
+    std::unique_ptr<bool[]> occluded(new bool[shadowRays.size()]);
+    measure("shadow rays, any hit:", shadowRays.size(), [&]()
+    {
+        scene.TraceOcclusion(shadowRays.data(), shadowRays.size(), occluded.get(), true);
+    });
+
+    // Incoherent rays: random points and directions above the terrain, like diffuse bounces
+    std::vector<CpuRay> randomRays(primaryRays.size());
+    for (CpuRay& ray : randomRays)
+    {
+        ray.origin = float3((uniform(random) - 0.5f) * c_TerrainSize, uniform(random) * 6.f, (uniform(random) - 0.5f) * c_TerrainSize);
+        const float cosTheta = uniform(random) * 2.f - 1.f;
+        const float sinTheta = sqrtf(std::max(0.f, 1.f - cosTheta * cosTheta));
+        const float phi = uniform(random) * 2.f * PI_f;
+        ray.direction = float3(sinTheta * cosf(phi), cosTheta, sinTheta * sinf(phi));
+        ray.tMax = 50.f;
+    }
+
+    std::vector<CpuHit> randomHits(randomRays.size());
+    measure("incoherent rays, closest hit:", randomRays.size(), [&]()
+    {
+        scene.TraceClosestHit(randomRays.data(), randomRays.size(), randomHits.data(), false);
+    });
+
+    // Packets of one ray take the same code path without sharing the traversal, their hits must be the same
+    size_t mismatches = 0;
+    for (size_t index = 0; index < randomRays.size(); index += 61)
+    {
+        CpuHit hit;
+        scene.TraceClosestHit(&randomRays[index], 1, &hit, false);
+        if (hit.instanceIndex != randomHits[index].instanceIndex || hit.t != randomHits[index].t)
+            mismatches++;
+    }
+
+    if (mismatches)
+        log::warning("  %zu single rays hit something other than in their packets", mismatches);
+}
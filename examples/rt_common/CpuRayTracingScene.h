@@ -0,0 +1,135 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CpuBvh.h"
+#include <donut/engine/SceneGraph.h>
+#include <cfloat>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace tf
+{
+    class Executor;
+}
+
+struct CpuRay
+{
+    donut::math::float3 origin;
+    float tMin = 0.f;
+    donut::math::float3 direction;
+    float tMax = FLT_MAX;
+};
+
+struct CpuHit
+{
+    float t = FLT_MAX;
+    uint32_t instanceIndex = ~0u; // in the order of AddInstance, ~0u for rays that hit nothing
+    uint32_t triangleIndex = 0;   // in the order of the mesh indices
+};
+
+// Two-level CPU version of the acceleration structures that RayTracingScene builds on the GPU, for validating the
+// ray tracing examples without a GPU and for measuring the quality of the scene hierarchies. Every mesh gets a BVH
+// over its triangles in object space, read from the CPU copies of the mesh buffers with the same offsets as the
+// BLAS geometry, and the instances get a BVH over their world space bounds. Rays are traced in packets of
+// c_SimdWidth rays that share the traversal, like the rays of a GPU wave. All geometry is opaque.
+class CpuRayTracingScene
+{
+public:
+    struct Statistics
+    {
+        uint32_t numMeshes = 0;
+        uint32_t numInstances = 0;
+        uint64_t numTriangles = 0;      // of the meshes, each counted once
+        uint64_t numNodes = 0;          // of all hierarchies
+        float meshSahCost = 0.f;        // of the mesh hierarchies, weighted by their triangle counts
+        float instanceSahCost = 0.f;
+        float buildMs = 0.f;
+    };
+
+    // Returns the index of the mesh, meshes that were added before are not added again
+    uint32_t AddMesh(const donut::engine::MeshInfo& mesh);
+    void AddInstance(uint32_t meshIndex, const donut::math::affine3& localToWorld);
+
+    // Adds the mesh instances of the scene graph with their current transforms, skipping the skinning prototypes
+    void AddSceneGraph(const donut::engine::SceneGraph& sceneGraph);
+
+    // Builds the mesh hierarchies, then the instance hierarchy. The executor may be null, then everything is
+    // built on the calling thread.
+    void Build(tf::Executor* executor);
+
+    // Finds the closest hit of every ray. With cullBackFaces, triangles that are counterclockwise in object space
+    // when seen from the ray origin are ignored, like with RAY_FLAG_CULL_BACK_FACING_TRIANGLES.
+    void TraceClosestHit(const CpuRay* rays, size_t count, CpuHit* hits, bool cullBackFaces) const;
+
+    // Finds out for every ray whether it hits anything, stopping at the first hit
+    void TraceOcclusion(const CpuRay* rays, size_t count, bool* occluded, bool cullBackFaces) const;
+
+    const Statistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    struct Triangle
+    {
+        donut::math::float3 v0;
+        donut::math::float3 edge1;
+        donut::math::float3 edge2;
+        uint32_t index;
+    };
+
+    struct Mesh
+    {
+        std::vector<Triangle> triangles; // in the primitive order of the BVH
+        CpuBvh bvh;
+    };
+
+    struct Instance
+    {
+        uint32_t index; // in the order of AddInstance
+        uint32_t meshIndex;
+        float worldToObject[12]; // row major 3x4
+        CpuAabb bounds;
+    };
+
+    struct Packet;
+
+    std::vector<Mesh> m_Meshes;
+    std::unordered_map<const donut::engine::MeshInfo*, uint32_t> m_MeshIndices;
+    std::vector<donut::math::affine3> m_InstanceTransforms;
+    std::vector<uint32_t> m_InstanceMeshes;
+    std::vector<Instance> m_Instances; // in the primitive order of the instance BVH
+    CpuBvh m_InstanceBvh;
+    Statistics m_Statistics;
+
+    static void LoadPacket(Packet& packet, const CpuRay* rays, size_t count);
+
+    template <bool AnyHit>
+    void TracePacket(Packet& packet, bool cullBackFaces) const;
+
+    template <bool AnyHit>
+    void TraceMeshPacket(const Mesh& mesh, uint32_t instanceIndex, Packet& packet, bool cullBackFaces) const;
+};
+
+// Builds a synthetic scene with executors of 1 to the hardware number of threads, and traces coherent and incoherent ray
+// packets through it. Prints the build times, the hierarchy statistics and the ray rates. Does not need a GPU.
+void RunCpuRayTracingBenchmark();
@@ -0,0 +1,138 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "RayTracingScene.h"
+#include <donut/core/math/math.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using namespace donut;
+using namespace donut::math;
+
+RayTracingScene::RayTracingScene(nvrhi::IDevice* device, const CreateParameters& params)
+    : m_Device(device)
+    , m_Params(params)
+    , m_BlasBuilder(device, params.forceOpaque)
+    , m_Compactor(device, params.compactionBudgetMs)
+{
+}
+
+void RayTracingScene::CreateAccelStructs(const engine::SceneGraph& sceneGraph, nvrhi::ICommandList* commandList)
+{
+    m_BlasBuilder.CreateAccelStructs(sceneGraph, commandList);
+    m_Compactor.BeginScene(m_BlasBuilder);
+
+    // The TLAS is built by the first Update, after the skinned BLASes
+    CollectInstances(sceneGraph);
+    CreateTopLevelAS();
+    UpdateStatistics();
+}
+
+void RayTracingScene::CreateTopLevelAS()
+{
+    m_TopLevelCapacity = std::max<size_t>(m_Instances.size(), 1);
+
+    nvrhi::rt::AccelStructDesc tlasDesc;
+    tlasDesc.isTopLevel = true;
+    tlasDesc.topLevelMaxInstances = m_TopLevelCapacity;
+    tlasDesc.debugName = "TopLevelAS";
+    m_TopLevelAS = m_Device->createAccelStruct(tlasDesc);
+    m_TopLevelBuilt = false;
+
+    m_Statistics.tlasBytes = m_Device->getAccelStructMemoryRequirements(m_TopLevelAS).size;
+}
+
+void RayTracingScene::CollectInstances(const engine::SceneGraph& sceneGraph)
+{
+    m_Instances.clear();
+
+    for (const auto& instance : sceneGraph.GetMeshInstances())
+    {
+        const auto& mesh = instance->GetMesh();
+        if (!mesh->accelStruct)
+            continue;
+
+        nvrhi::rt::InstanceDesc instanceDesc;
+        instanceDesc.bottomLevelAS = mesh->accelStruct;
+        instanceDesc.instanceMask = 1;
+        instanceDesc.instanceID = instance->GetInstanceIndex();
+        instanceDesc.instanceContributionToHitGroupIndex = mesh->geometries[0]->globalGeometryIndex * m_Params.hitGroupsPerGeometry;
+
+        auto node = instance->GetNode();
+        assert(node);
+        dm::affineToColumnMajor(node->GetLocalToWorldTransformFloat(), instanceDesc.transform);
+
+        m_Instances.push_back(instanceDesc);
+    }
+}
+
+void RayTracingScene::BuildTopLevelAS(nvrhi::ICommandList* commandList)
+{
+    if (m_Instances.size() > m_TopLevelCapacity)
+        CreateTopLevelAS();
+
+    commandList->beginMarker("TLAS Update");
+    commandList->buildTopLevelAccelStruct(m_TopLevelAS, m_Instances.data(), m_Instances.size());
+    commandList->endMarker();
+
+    m_BuiltInstances = m_Instances;
+    m_TopLevelBuilt = true;
+    m_Statistics.tlasBuildsLastFrame = 1;
+}
+
+void RayTracingScene::Update(const engine::SceneGraph& sceneGraph, uint32_t frameIndex, nvrhi::ICommandList* commandList)
+{
+    m_Statistics.tlasBuildsLastFrame = 0;
+
+    m_BlasBuilder.UpdateSkinnedAccelStructs(sceneGraph, frameIndex, commandList);
+
+    // Replaces some static BLASes with compacted ones, so it goes before the instances are collected
+    m_Compactor.Update(commandList);
+
+    CollectInstances(sceneGraph);
+
+    // Refitted BLASes have new bounds, and the other changes show up in the instance descriptions
+    const BlasBuilder::Statistics& blasStatistics = m_BlasBuilder.GetStatistics();
+    const bool changed = !m_TopLevelBuilt || blasStatistics.buildsLastFrame > 0 || blasStatistics.refitsLastFrame > 0 ||
+        m_Instances.size() != m_BuiltInstances.size() ||
+        memcmp(m_Instances.data(), m_BuiltInstances.data(), m_Instances.size() * sizeof(nvrhi::rt::InstanceDesc)) != 0;
+
+    if (changed)
+        BuildTopLevelAS(commandList);
+
+    UpdateStatistics();
+}
+
+void RayTracingScene::UpdateStatistics()
+{
+    const BlasBuilder::Statistics& blasStatistics = m_BlasBuilder.GetStatistics();
+    const AccelStructCompactor::Statistics& compactionStatistics = m_Compactor.GetStatistics();
+
+    m_Statistics.numInstances = uint32_t(m_BuiltInstances.size());
+    m_Statistics.numMeshes = blasStatistics.numMeshes;
+    m_Statistics.numAccelStructs = blasStatistics.numAccelStructs;
+    m_Statistics.numSkinned = blasStatistics.numSkinned;
+    m_Statistics.refitsLastFrame = blasStatistics.refitsLastFrame;
+    m_Statistics.blasBytes = blasStatistics.accelStructBytes;
+    m_Statistics.compactionSavedBytes = compactionStatistics.bytesBeforeCompaction - compactionStatistics.bytesAfterCompaction;
+}
@@ -0,0 +1,94 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "AccelStructCompactor.h"
+#include "BlasBuilder.h"
+#include <donut/engine/SceneGraph.h>
+#include <nvrhi/nvrhi.h>
+#include <vector>
+
+// The acceleration structures of a scene, shared by the ray tracing examples. Every unique mesh geometry has one
+// BLAS that all its instances use, skinned BLASes are refitted when the skinning changes them, and static ones
+// are compacted over the frames after loading. The TLAS is built again whenever an instance moves or uses another
+// BLAS, so it follows the transforms of the scene graph.
+class RayTracingScene
+{
+public:
+    struct CreateParameters
+    {
+        // Marks alpha tested geometry as opaque, for pipelines without any-hit shaders
+        bool forceOpaque = false;
+
+        // The hit group of an instance starts at globalGeometryIndex * hitGroupsPerGeometry in the shader table
+        uint32_t hitGroupsPerGeometry = 0;
+
+        // GPU time per frame that is spent on compacting the static BLASes
+        float compactionBudgetMs = 0.5f;
+    };
+
+    struct Statistics
+    {
+        uint32_t numInstances = 0;
+        uint32_t numMeshes = 0;
+        uint32_t numAccelStructs = 0;   // unique BLASes, meshes with the same geometry share one
+        uint32_t numSkinned = 0;
+        uint32_t refitsLastFrame = 0;
+        uint32_t tlasBuildsLastFrame = 0;
+        uint64_t blasBytes = 0;
+        uint64_t tlasBytes = 0;
+        uint64_t compactionSavedBytes = 0;
+    };
+
+    RayTracingScene(nvrhi::IDevice* device, const CreateParameters& params);
+
+    // Creates the BLASes of the meshes and builds the static ones, and creates the TLAS of the instances
+    void CreateAccelStructs(const donut::engine::SceneGraph& sceneGraph, nvrhi::ICommandList* commandList);
+
+    // Refits the skinned BLASes that changed in this frame, compacts some static ones, and builds the TLAS again
+    // if the instances changed. The scene graph must be refreshed before, so that the transforms are current.
+    void Update(const donut::engine::SceneGraph& sceneGraph, uint32_t frameIndex, nvrhi::ICommandList* commandList);
+
+    // Created again by Update when the scene has more instances than before, the binding sets must be updated then
+    nvrhi::rt::IAccelStruct* GetTopLevelAS() const { return m_TopLevelAS; }
+
+    const Statistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    nvrhi::DeviceHandle m_Device;
+    CreateParameters m_Params;
+    BlasBuilder m_BlasBuilder;
+    AccelStructCompactor m_Compactor;
+
+    nvrhi::rt::AccelStructHandle m_TopLevelAS;
+    size_t m_TopLevelCapacity = 0;
+    bool m_TopLevelBuilt = false;
+    std::vector<nvrhi::rt::InstanceDesc> m_Instances;
+    std::vector<nvrhi::rt::InstanceDesc> m_BuiltInstances;
+    Statistics m_Statistics;
+
+    void CollectInstances(const donut::engine::SceneGraph& sceneGraph);
+    void CreateTopLevelAS();
+    void BuildTopLevelAS(nvrhi::ICommandList* commandList);
+    void UpdateStatistics();
+};
@@ -0,0 +1,424 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// CPU-only test of the hierarchies and the packet ray caster of CpuRayTracingScene.
+// The BVH is checked for the structure that the traversal relies on and for the SAH cost it reports, and the
+// closest hit and occlusion rays of a synthetic scene are checked against a brute force test of every triangle.
+
+#include "CpuRayTracingScene.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut::math;
+using namespace donut::engine;
+
+// Same costs as the build, a box test and a primitive test count the same
+static constexpr float c_TraversalCost = 1.f;
+static constexpr float c_IntersectionCost = 1.f;
+
+static bool Contains(const CpuAabb& outer, const CpuAabb& inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+        && inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+}
+
+// Boxes in a few clusters, so that the hierarchy has both tight and loose levels
+static std::vector<CpuAabb> MakeClusteredBounds(uint32_t count, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+    float3 clusters[8];
+    for (float3& cluster : clusters)
+        cluster = float3(unit(rng), unit(rng), unit(rng)) * 50.f;
+
+    std::vector<CpuAabb> bounds(count);
+    for (uint32_t index = 0; index < count; index++)
+    {
+        const float3 center = clusters[index % 8] + float3(unit(rng), unit(rng), unit(rng)) * 5.f;
+        const float3 extent = float3(std::abs(unit(rng)), std::abs(unit(rng)), std::abs(unit(rng))) * 0.5f;
+        bounds[index].Grow(center - extent);
+        bounds[index].Grow(center + extent);
+    }
+    return bounds;
+}
+
+// Checks the structure of the tree and recomputes its statistics from the nodes
+static void CheckBvh(const CpuBvh& bvh, const std::vector<CpuAabb>& bounds, const char* name)
+{
+    const std::vector<CpuBvhNode>& nodes = bvh.GetNodes();
+    const std::vector<uint32_t>& primitiveIndices = bvh.GetPrimitiveIndices();
+    const CpuBvhStatistics& statistics = bvh.GetStatistics();
+    const uint32_t numPrimitives = uint32_t(bounds.size());
+
+    CHECK(statistics.numPrimitives == numPrimitives, "%s: %u primitives, expected %u", name, statistics.numPrimitives, numPrimitives);
+    CHECK(primitiveIndices.size() == numPrimitives, "%s: %d primitive indices, expected %u", name, int(primitiveIndices.size()), numPrimitives);
+    CHECK(statistics.numNodes == nodes.size(), "%s: %u nodes in the statistics, %d in the tree", name, statistics.numNodes, int(nodes.size()));
+
+    if (numPrimitives == 0)
+    {
+        CHECK(nodes.empty(), "%s: %d nodes without primitives", name, int(nodes.size()));
+        return;
+    }
+
+    // A binary tree where every interior node has two children
+    CHECK(statistics.numNodes == 2 * statistics.numLeaves - 1, "%s: %u nodes and %u leaves", name, statistics.numNodes, statistics.numLeaves);
+    CHECK(statistics.maxDepth <= c_CpuBvhMaxDepth, "%s: depth %u is larger than the traversal stack", name, statistics.maxDepth);
+
+    std::vector<uint32_t> primitiveCounts(numPrimitives, 0);
+    std::vector<uint32_t> nodeVisits(nodes.size(), 0);
+    const float rootArea = CpuAabb{ nodes[0].boundsMin, nodes[0].boundsMax }.SurfaceArea();
+    float sahCost = 0.f;
+    uint32_t numLeaves = 0;
+    uint32_t maxDepth = 0;
+
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 1 } };
+    while (!stack.empty())
+    {
+        const auto [nodeIndex, depth] = stack.back();
+        stack.pop_back();
+
+        if (nodeIndex >= nodes.size())
+        {
+            CHECK(false, "%s: child index %u is out of %d nodes", name, nodeIndex, int(nodes.size()));
+            continue;
+        }
+
+        nodeVisits[nodeIndex]++;
+        maxDepth = std::max(maxDepth, depth);
+
+        const CpuBvhNode& node = nodes[nodeIndex];
+        const CpuAabb nodeBounds{ node.boundsMin, node.boundsMax };
+        const float probability = nodeBounds.SurfaceArea() / rootArea;
+
+        if (node.count == 0)
+        {
+            sahCost += probability * c_TraversalCost;
+
+            for (uint32_t child = node.leftOrFirst; child < node.leftOrFirst + 2 && child < nodes.size(); child++)
+            {
+                const CpuAabb childBounds{ nodes[child].boundsMin, nodes[child].boundsMax };
+                CHECK(Contains(nodeBounds, childBounds), "%s: node %u does not contain its child %u", name, nodeIndex, child);
+                stack.push_back({ child, depth + 1 });
+            }
+            continue;
+        }
+
+        numLeaves++;
+        sahCost += probability * c_IntersectionCost * float(node.count);
+
+        CHECK(node.leftOrFirst + node.count <= numPrimitives, "%s: leaf %u references primitives %u to %u of %u", name,
+            nodeIndex, node.leftOrFirst, node.leftOrFirst + node.count, numPrimitives);
+
+        for (uint32_t index = node.leftOrFirst; index < node.leftOrFirst + node.count && index < numPrimitives; index++)
+        {
+            const uint32_t primitive = primitiveIndices[index];
+            if (primitive >= numPrimitives)
+            {
+                CHECK(false, "%s: primitive index %u is out of %u", name, primitive, numPrimitives);
+                continue;
+            }
+
+            primitiveCounts[primitive]++;
+            CHECK(Contains(nodeBounds, bounds[primitive]), "%s: leaf %u does not contain primitive %u", name, nodeIndex, primitive);
+        }
+    }
+
+    // Every node is reached once, and every primitive is in one leaf
+    const auto unreachedNode = std::find_if(nodeVisits.begin(), nodeVisits.end(), [](uint32_t visits) { return visits != 1; });
+    CHECK(unreachedNode == nodeVisits.end(), "%s: node %d is reached %u times", name, int(unreachedNode - nodeVisits.begin()),
+        unreachedNode != nodeVisits.end() ? *unreachedNode : 0);
+    const auto misplacedPrimitive = std::find_if(primitiveCounts.begin(), primitiveCounts.end(), [](uint32_t count) { return count != 1; });
+    CHECK(misplacedPrimitive == primitiveCounts.end(), "%s: primitive %d is in %u leaves", name, int(misplacedPrimitive - primitiveCounts.begin()),
+        misplacedPrimitive != primitiveCounts.end() ? *misplacedPrimitive : 0);
+
+    CHECK(numLeaves == statistics.numLeaves, "%s: %u leaves, the statistics have %u", name, numLeaves, statistics.numLeaves);
+    CHECK(maxDepth == statistics.maxDepth, "%s: depth %u, the statistics have %u", name, maxDepth, statistics.maxDepth);
+    CHECK(std::abs(sahCost - statistics.sahCost) <= 1e-4f * sahCost, "%s: SAH cost %f, the statistics have %f", name, sahCost, statistics.sahCost);
+}
+
+static void TestBvh()
+{
+    const std::vector<CpuAabb> noBounds;
+    CpuBvh empty;
+    empty.Build(noBounds, nullptr);
+    CheckBvh(empty, noBounds, "empty");
+
+    const std::vector<CpuAabb> oneBounds = MakeClusteredBounds(1, 1);
+    CpuBvh one;
+    one.Build(oneBounds, nullptr);
+    CheckBvh(one, oneBounds, "one primitive");
+    CHECK(one.GetNodes().size() == 1, "one primitive: %d nodes, expected a single leaf", int(one.GetNodes().size()));
+
+    const std::vector<CpuAabb> clusteredBounds = MakeClusteredBounds(5000, 2);
+    CpuBvh clustered;
+    clustered.Build(clusteredBounds, nullptr);
+    CheckBvh(clustered, clusteredBounds, "clustered");
+
+    // The cost of one leaf with every primitive is what a useful hierarchy must beat by far
+    const float sahCost = clustered.GetStatistics().sahCost;
+    CHECK(sahCost > c_TraversalCost && sahCost < 0.1f * float(clusteredBounds.size()), "clustered: SAH cost %f for %d primitives",
+        sahCost, int(clusteredBounds.size()));
+
+    // Primitives with the same centroid cannot be split by the heuristic, and are split in halves
+    const std::vector<CpuAabb> stackedBounds(100, clusteredBounds[0]);
+    CpuBvh stacked;
+    stacked.Build(stackedBounds, nullptr);
+    CheckBvh(stacked, stackedBounds, "stacked");
+
+#ifdef DONUT_WITH_TASKFLOW
+    // Large enough for the subtrees to be built as tasks, the tree must be the same as the one built on the calling thread
+    const std::vector<CpuAabb> largeBounds = MakeClusteredBounds(100000, 3);
+    CpuBvh serial;
+    serial.Build(largeBounds, nullptr);
+
+    tf::Executor executor(4);
+    CpuBvh parallel;
+    parallel.Build(largeBounds, &executor);
+    CheckBvh(parallel, largeBounds, "parallel");
+
+    const CpuBvhStatistics& serialStatistics = serial.GetStatistics();
+    const CpuBvhStatistics& parallelStatistics = parallel.GetStatistics();
+    CHECK(serialStatistics.numNodes == parallelStatistics.numNodes && serialStatistics.numLeaves == parallelStatistics.numLeaves
+        && serialStatistics.maxDepth == parallelStatistics.maxDepth, "parallel: %u nodes, %u leaves, depth %u, on the calling thread %u, %u, %u",
+        parallelStatistics.numNodes, parallelStatistics.numLeaves, parallelStatistics.maxDepth,
+        serialStatistics.numNodes, serialStatistics.numLeaves, serialStatistics.maxDepth);
+    CHECK(std::abs(serialStatistics.sahCost - parallelStatistics.sahCost) <= 1e-4f * serialStatistics.sahCost,
+        "parallel: SAH cost %f, on the calling thread %f", parallelStatistics.sahCost, serialStatistics.sahCost);
+#endif
+}
+
+struct TestMesh
+{
+    std::shared_ptr<MeshInfo> mesh;
+    std::vector<float3> positions; // three per triangle
+};
+
+// Small triangles scattered around the origin, each with its own vertices
+static TestMesh MakeMesh(uint32_t numTriangles, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+    auto buffers = std::make_shared<BufferGroup>();
+    for (uint32_t triangle = 0; triangle < numTriangles; triangle++)
+    {
+        const float3 center(unit(rng), unit(rng), unit(rng));
+        for (uint32_t vertex = 0; vertex < 3; vertex++)
+        {
+            buffers->positionData.push_back(center + float3(unit(rng), unit(rng), unit(rng)) * 0.3f);
+            buffers->indexData.push_back(triangle * 3 + vertex);
+        }
+    }
+
+    auto geometry = std::make_shared<MeshGeometry>();
+    geometry->numIndices = numTriangles * 3;
+    geometry->numVertices = numTriangles * 3;
+
+    TestMesh testMesh;
+    testMesh.mesh = std::make_shared<MeshInfo>();
+    testMesh.mesh->buffers = buffers;
+    testMesh.mesh->geometries.push_back(geometry);
+    testMesh.mesh->totalIndices = geometry->numIndices;
+    testMesh.mesh->totalVertices = geometry->numVertices;
+    testMesh.positions = buffers->positionData;
+    return testMesh;
+}
+
+struct TestInstance
+{
+    uint32_t mesh;
+    affine3 localToWorld;
+};
+
+struct ReferenceHit
+{
+    CpuHit hit;
+    // The ray passes close to a triangle edge, to the end of the ray, or to a second hit at almost the same
+    // distance, where rounding decides the result
+    bool ambiguous = false;
+};
+
+// Tests every triangle in object space, with the same transforms as the scene
+static ReferenceHit TraceBruteForce(const CpuRay& ray, const std::vector<TestMesh>& meshes, const std::vector<TestInstance>& instances, bool cullBackFaces)
+{
+    constexpr float c_Epsilon = 1e-3f;
+
+    ReferenceHit reference;
+    float secondT = FLT_MAX;
+
+    for (uint32_t instanceIndex = 0; instanceIndex < uint32_t(instances.size()); instanceIndex++)
+    {
+        const TestInstance& instance = instances[instanceIndex];
+        const affine3 worldToObject = inverse(instance.localToWorld);
+        const float3 origin = worldToObject.transformPoint(ray.origin);
+        const float3 direction = worldToObject.transformVector(ray.direction);
+        const std::vector<float3>& positions = meshes[instance.mesh].positions;
+
+        for (uint32_t triangle = 0; triangle < uint32_t(positions.size() / 3); triangle++)
+        {
+            const float3 v0 = positions[triangle * 3];
+            const float3 edge1 = positions[triangle * 3 + 1] - v0;
+            const float3 edge2 = positions[triangle * 3 + 2] - v0;
+
+            const float3 p = cross(direction, edge2);
+            const float det = dot(edge1, p);
+            if (cullBackFaces ? det <= 0.f : det == 0.f)
+                continue;
+
+            const float3 toOrigin = origin - v0;
+            const float3 q = cross(toOrigin, edge1);
+            const float u = dot(toOrigin, p) / det;
+            const float v = dot(direction, q) / det;
+            const float t = dot(edge2, q) / det;
+
+            // Barycentrics and distances within the epsilon of a boundary can go either way
+            const float w = 1.f - u - v;
+            const bool nearEdge = std::min(std::abs(u), std::min(std::abs(v), std::abs(w))) < c_Epsilon && u > -c_Epsilon && v > -c_Epsilon && w > -c_Epsilon;
+            const bool nearEnd = std::abs(t - ray.tMin) < c_Epsilon * std::max(1.f, ray.tMin) || std::abs(t - ray.tMax) < c_Epsilon * ray.tMax;
+            const bool inside = u >= 0.f && v >= 0.f && w >= 0.f && t > ray.tMin && t < ray.tMax;
+
+            if ((nearEdge && t > ray.tMin - c_Epsilon && t < ray.tMax + c_Epsilon) || (nearEnd && u > -c_Epsilon && v > -c_Epsilon && w > -c_Epsilon))
+                reference.ambiguous = true;
+
+            if (!inside)
+                continue;
+
+            if (t < reference.hit.t)
+            {
+                secondT = reference.hit.t;
+                reference.hit.t = t;
+                reference.hit.instanceIndex = instanceIndex;
+                reference.hit.triangleIndex = triangle;
+            }
+            else
+                secondT = std::min(secondT, t);
+        }
+    }
+
+    if (reference.hit.instanceIndex != ~0u && secondT - reference.hit.t < c_Epsilon * reference.hit.t)
+        reference.ambiguous = true;
+
+    return reference;
+}
+
+static void TestRayCasting(tf::Executor* executor)
+{
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+    std::vector<TestMesh> meshes;
+    for (uint32_t meshIndex = 0; meshIndex < 4; meshIndex++)
+        meshes.push_back(MakeMesh(40 + meshIndex * 150, rng));
+
+    // Rotated, non-uniformly scaled and moved copies of the meshes, some sharing a mesh
+    CpuRayTracingScene scene;
+    std::vector<TestInstance> instances;
+    for (uint32_t instanceIndex = 0; instanceIndex < 60; instanceIndex++)
+    {
+        TestInstance instance;
+        instance.mesh = uint32_t(rng() % meshes.size());
+        instance.localToWorld = scaling(float3(0.6f + 0.3f * unit(rng), 1.f, 0.8f))
+            * rotation(normalize(float3(unit(rng), unit(rng), unit(rng)) + float3(0.f, 0.f, 2.f)), unit(rng) * PI_f)
+            * translation(float3(unit(rng), unit(rng), unit(rng)) * 6.f);
+        instances.push_back(instance);
+
+        scene.AddInstance(scene.AddMesh(*meshes[instance.mesh].mesh), instance.localToWorld);
+    }
+
+    scene.Build(executor);
+
+    const CpuRayTracingScene::Statistics& statistics = scene.GetStatistics();
+    CHECK(statistics.numMeshes == meshes.size(), "scene: %u meshes, expected %d", statistics.numMeshes, int(meshes.size()));
+    CHECK(statistics.numInstances == instances.size(), "scene: %u instances, expected %d", statistics.numInstances, int(instances.size()));
+
+    // Short and long rays in all directions, including some that start inside the meshes and some that are empty
+    std::vector<CpuRay> rays(2000);
+    for (CpuRay& ray : rays)
+    {
+        ray.origin = float3(unit(rng), unit(rng), unit(rng)) * 8.f;
+        ray.direction = float3(unit(rng), unit(rng), unit(rng)) * 2.f;
+        ray.tMin = 0.01f;
+        ray.tMax = 2.f + 4.f * std::abs(unit(rng));
+    }
+    rays[1].tMax = rays[1].tMin * 0.5f;
+
+    for (bool cullBackFaces : { false, true })
+    {
+        const char* mode = cullBackFaces ? "culling back faces" : "without culling";
+
+        std::vector<CpuHit> hits(rays.size());
+        std::unique_ptr<bool[]> occluded(new bool[rays.size()]);
+        scene.TraceClosestHit(rays.data(), rays.size(), hits.data(), cullBackFaces);
+        scene.TraceOcclusion(rays.data(), rays.size(), occluded.get(), cullBackFaces);
+
+        uint32_t numHits = 0;
+        uint32_t numChecked = 0;
+        for (size_t index = 0; index < rays.size(); index++)
+        {
+            const ReferenceHit reference = TraceBruteForce(rays[index], meshes, instances, cullBackFaces);
+            if (reference.ambiguous)
+                continue;
+
+            numChecked++;
+            const CpuHit& expected = reference.hit;
+            const CpuHit& hit = hits[index];
+
+            if (expected.instanceIndex == ~0u)
+            {
+                CHECK(hit.instanceIndex == ~0u, "ray %d %s: hit instance %u at %f, expected a miss", int(index), mode, hit.instanceIndex, hit.t);
+                CHECK(!occluded[index], "ray %d %s: occluded, expected a miss", int(index), mode);
+                continue;
+            }
+
+            numHits++;
+            CHECK(hit.instanceIndex == expected.instanceIndex && hit.triangleIndex == expected.triangleIndex
+                && std::abs(hit.t - expected.t) <= 1e-3f * expected.t,
+                "ray %d %s: hit instance %u triangle %u at %f, expected instance %u triangle %u at %f", int(index), mode,
+                hit.instanceIndex, hit.triangleIndex, hit.t, expected.instanceIndex, expected.triangleIndex, expected.t);
+            CHECK(occluded[index], "ray %d %s: not occluded, expected a hit", int(index), mode);
+        }
+
+        // The rays must be mostly unambiguous, and hit and miss in useful proportions
+        CHECK(numChecked > rays.size() * 9 / 10, "%s: only %u of %d rays are unambiguous", mode, numChecked, int(rays.size()));
+        CHECK(numHits > numChecked / 10 && numHits < numChecked * 9 / 10, "%s: %u of %u rays hit", mode, numHits, numChecked);
+    }
+}
+
+int main()
+{
+    TestBvh();
+    TestRayCasting(nullptr);
+
+#ifdef DONUT_WITH_TASKFLOW
+    tf::Executor executor(4);
+    TestRayCasting(&executor);
+#endif
+
+    return ReportTestResults("All CPU BVH and ray casting checks passed");
+}
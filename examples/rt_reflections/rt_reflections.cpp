@@ -41,6 +41,7 @@ using namespace donut;
 using namespace donut::math;
 
 #include "lighting_cb.h"
+#include "RayTracingScene.h"
 
 static const char* g_WindowTitle = "Donut Example: Ray Traced Reflections";
 
@@ -151,8 +152,7 @@ private:
     nvrhi::BindingLayoutHandle m_LocalBindingLayout;
     nvrhi::BindingSetHandle m_BindingSet;
 
-    nvrhi::rt::AccelStructHandle m_BottomLevelAS;
-    nvrhi::rt::AccelStructHandle m_TopLevelAS;
+    std::unique_ptr<RayTracingScene> m_RayTracingScene;
 
     nvrhi::BufferHandle m_ConstantBuffer;
 
@@ -259,7 +259,16 @@ public:
     void Animate(float fElapsedTimeSeconds) override
     {
         m_Camera.Animate(fElapsedTimeSeconds);
-        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
+
+        RayTracingScene::Statistics stats;
+        if (m_RayTracingScene)
+            stats = m_RayTracingScene->GetStatistics();
+
+        char extraInfo[256];
+        snprintf(extraInfo, sizeof(extraInfo), "- %d instances, %d BLASes, %.1f MB - %.1f MB saved by compaction",
+            int(stats.numInstances), int(stats.numAccelStructs), double(stats.blasBytes + stats.tlasBytes) / double(1 << 20),
+            double(stats.compactionSavedBytes) / double(1 << 20));
+        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfo);
     }
 
     bool CreateRayTracingPipeline(engine::ShaderFactory& shaderFactory)
@@ -399,63 +408,14 @@ public:
 
     void CreateAccelStruct(nvrhi::ICommandList* commandList)
     {
-        for (const auto& mesh : m_Scene->GetSceneGraph()->GetMeshes())
-        {
-            nvrhi::rt::AccelStructDesc blasDesc;
-            blasDesc.isTopLevel = false;
-
-            for (const auto& geometry : mesh->geometries)
-            {
-                nvrhi::rt::GeometryDesc geometryDesc;
-                auto& triangles = geometryDesc.geometryData.triangles;
-                triangles.indexBuffer = mesh->buffers->indexBuffer;
-                triangles.indexOffset = (mesh->indexOffset + geometry->indexOffsetInMesh) * sizeof(uint32_t);
-                triangles.indexFormat = nvrhi::Format::R32_UINT;
-                triangles.indexCount = geometry->numIndices;
-                triangles.vertexBuffer = mesh->buffers->vertexBuffer;
-                triangles.vertexOffset = (mesh->vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh->buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
-                triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
-                triangles.vertexStride = sizeof(float3);
-                triangles.vertexCount = geometry->numVertices;
-                geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
-                geometryDesc.flags = nvrhi::rt::GeometryFlags::Opaque;
-                blasDesc.bottomLevelGeometries.push_back(geometryDesc);
-            }
-
-            nvrhi::rt::AccelStructHandle as = GetDevice()->createAccelStruct(blasDesc);
-            nvrhi::utils::BuildBottomLevelAccelStruct(commandList, as, blasDesc);
-
-            mesh->accelStruct = as;
-        }
-
-
-        nvrhi::rt::AccelStructDesc tlasDesc;
-        tlasDesc.isTopLevel = true;
-
-        std::vector<nvrhi::rt::InstanceDesc> instances;
-        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
-        {
-            const auto& mesh = instance->GetMesh();
-            
-            nvrhi::rt::InstanceDesc instanceDesc;
-            instanceDesc.bottomLevelAS = mesh->accelStruct;
-            assert(instanceDesc.bottomLevelAS);
-            instanceDesc.instanceMask = 1;
-            instanceDesc.instanceContributionToHitGroupIndex = mesh->geometries[0]->globalGeometryIndex * 2;
-            
-            auto node = instance->GetNode();
-            assert(node);
-            dm::affineToColumnMajor(node->GetLocalToWorldTransformFloat(), instanceDesc.transform);
-            
-            instances.push_back(instanceDesc);
-        }
-
-        tlasDesc.topLevelMaxInstances = instances.size();
-        m_TopLevelAS = GetDevice()->createAccelStruct(tlasDesc);
-
-        commandList->buildTopLevelAccelStruct(m_TopLevelAS, instances.data(), instances.size());
+        // The shaders have no any-hit shaders, so all geometry is traced as opaque
+        RayTracingScene::CreateParameters params;
+        params.forceOpaque = true;
+        params.hitGroupsPerGeometry = 2; // shadow and reflection hit groups
+        m_RayTracingScene = std::make_unique<RayTracingScene>(GetDevice(), params);
+        m_RayTracingScene->CreateAccelStructs(*m_Scene->GetSceneGraph(), commandList);
     }
-    
+
     void BackBufferResizing() override
     { 
         m_RenderTargets = nullptr;
@@ -475,7 +435,7 @@ public:
             nvrhi::BindingSetDesc bindingSetDesc;
             bindingSetDesc.bindings = {
                 nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer),
-                nvrhi::BindingSetItem::RayTracingAccelStruct(0, m_TopLevelAS),
+                nvrhi::BindingSetItem::RayTracingAccelStruct(0, m_RayTracingScene->GetTopLevelAS()),
                 nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_Depth),
                 nvrhi::BindingSetItem::Texture_SRV(2, m_RenderTargets->m_GBufferDiffuse),
                 nvrhi::BindingSetItem::Texture_SRV(3, m_RenderTargets->m_GBufferSpecular),
@@ -512,6 +472,9 @@ public:
 
         m_CommandList->open();
 
+        m_Scene->Refresh(m_CommandList, GetFrameIndex());
+        m_RayTracingScene->Update(*m_Scene->GetSceneGraph(), GetFrameIndex(), m_CommandList);
+
         m_RenderTargets->Clear(m_CommandList);
         render::GBufferFillPass::Context gbufferContext;
         render::RenderCompositeView(m_CommandList, &m_View, &m_View, *m_RenderTargets->m_GBufferFramebuffer, 
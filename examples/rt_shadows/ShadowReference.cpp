@@ -0,0 +1,174 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShadowReference.h"
+#include "CpuRayTracingScene.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+
+// Rows of pixels that one task traces
+constexpr uint32_t c_RowsPerTask = 8;
+
+std::vector<uint8_t> RenderShadowReference(const CpuRayTracingScene& scene, const ShadowReferenceView& view, tf::Executor* executor)
+{
+    std::vector<uint8_t> mask(size_t(view.size.x) * view.size.y, c_ShadowMaskSky);
+
+    const float3 forward = normalize(view.cameraDirection);
+    const float3 right = normalize(cross(view.cameraUp, forward));
+    const float3 up = cross(forward, right);
+    const float tanHalfFov = tanf(view.verticalFov * 0.5f);
+    const float aspectRatio = float(view.size.x) / float(view.size.y);
+    const float3 toLight = -normalize(view.lightDirection);
+
+    auto renderRows = [&](uint32_t firstRow, uint32_t lastRow)
+    {
+        std::vector<CpuRay> rays(view.size.x);
+        std::vector<CpuHit> hits(view.size.x);
+        std::vector<uint32_t> pixels;
+        std::unique_ptr<bool[]> occluded(new bool[view.size.x]);
+
+        for (uint32_t row = firstRow; row < lastRow; row++)
+        {
+            const float v = (1.f - (float(row) + 0.5f) / float(view.size.y) * 2.f) * tanHalfFov;
+            for (uint32_t column = 0; column < view.size.x; column++)
+            {
+                const float u = ((float(column) + 0.5f) / float(view.size.x) * 2.f - 1.f) * tanHalfFov * aspectRatio;
+                rays[column] = CpuRay();
+                rays[column].origin = view.cameraPosition;
+                rays[column].direction = normalize(forward + right * u + up * v);
+            }
+
+            scene.TraceClosestHit(rays.data(), rays.size(), hits.data(), false);
+
+            // Same rays as the ray generation shader
+            pixels.clear();
+            for (uint32_t column = 0; column < view.size.x; column++)
+            {
+                if (hits[column].instanceIndex == ~0u)
+                    continue;
+
+                CpuRay& ray = rays[pixels.size()];
+                ray.origin = view.cameraPosition + rays[column].direction * hits[column].t;
+                ray.direction = toLight;
+                ray.tMin = 0.01f;
+                ray.tMax = 100.f;
+                pixels.push_back(column);
+            }
+
+            scene.TraceOcclusion(rays.data(), pixels.size(), occluded.get(), true);
+
+            for (size_t index = 0; index < pixels.size(); index++)
+                mask[size_t(row) * view.size.x + pixels[index]] = occluded[index] ? c_ShadowMaskShadowed : c_ShadowMaskLit;
+        }
+    };
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && view.size.y > c_RowsPerTask)
+    {
+        tf::Taskflow taskFlow;
+        for (uint32_t firstRow = 0; firstRow < view.size.y; firstRow += c_RowsPerTask)
+        {
+            const uint32_t lastRow = std::min(firstRow + c_RowsPerTask, view.size.y);
+            taskFlow.emplace([&renderRows, firstRow, lastRow]()
+            {
+                renderRows(firstRow, lastRow);
+            });
+        }
+
+        executor->run(taskFlow).wait();
+        return mask;
+    }
+#endif
+
+    renderRows(0, view.size.y);
+    return mask;
+}
+
+bool WriteShadowMask(const std::filesystem::path& fileName, const std::vector<uint8_t>& mask, uint2 size)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+    {
+        log::error("Cannot open file '%s' for writing", fileName.generic_string().c_str());
+        return false;
+    }
+
+    file << "P5\n" << size.x << " " << size.y << "\n255\n";
+    file.write(reinterpret_cast<const char*>(mask.data()), std::streamsize(mask.size()));
+    return file.good();
+}
+
+bool ReadShadowMask(const std::filesystem::path& fileName, std::vector<uint8_t>& mask, uint2& size)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+    {
+        log::error("Cannot open file '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    std::string magic;
+    uint32_t maxValue = 0;
+    file >> magic >> size.x >> size.y >> maxValue;
+    file.get(); // the single whitespace character before the pixels
+
+    if (!file.good() || magic != "P5" || maxValue != 255)
+    {
+        log::error("File '%s' is not a binary 8-bit PGM image", fileName.generic_string().c_str());
+        return false;
+    }
+
+    mask.resize(size_t(size.x) * size.y);
+    file.read(reinterpret_cast<char*>(mask.data()), std::streamsize(mask.size()));
+    if (!file.good())
+    {
+        log::error("File '%s' is truncated", fileName.generic_string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+float CompareShadowMasks(const std::vector<uint8_t>& mask, uint2 size, const std::vector<uint8_t>& golden, uint2 goldenSize)
+{
+    if (size.x != goldenSize.x || size.y != goldenSize.y || mask.empty())
+        return 1.f;
+
+    size_t differentPixels = 0;
+    for (size_t index = 0; index < mask.size(); index++)
+    {
+        if (mask[index] != golden[index])
+            differentPixels++;
+    }
+
+    return float(differentPixels) / float(mask.size());
+}
@@ -0,0 +1,62 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <filesystem>
+#include <vector>
+
+class CpuRayTracingScene;
+
+namespace tf
+{
+    class Executor;
+}
+
+struct ShadowReferenceView
+{
+    donut::math::float3 cameraPosition;
+    donut::math::float3 cameraDirection;
+    donut::math::float3 cameraUp;
+    float verticalFov = 0.f;
+    donut::math::float3 lightDirection;
+    donut::math::uint2 size;
+};
+
+// Values of the pixels in a shadow mask
+constexpr uint8_t c_ShadowMaskShadowed = 0;
+constexpr uint8_t c_ShadowMaskSky = 128;
+constexpr uint8_t c_ShadowMaskLit = 255;
+
+// Traces the shadow rays of rt_shadows on the CPU, one per pixel toward the center of the sun, which gives the
+// hard shadows that the GPU converges to when the sun is a point. The primary rays replace the G-buffer and are
+// traced against the same scene, so alpha tested surfaces are opaque for both. Blocks of rows are traced as tasks
+// of the executor, or on the calling thread when it is null.
+std::vector<uint8_t> RenderShadowReference(const CpuRayTracingScene& scene, const ShadowReferenceView& view, tf::Executor* executor);
+
+// Binary PGM files, which most image viewers and diff tools can open
+bool WriteShadowMask(const std::filesystem::path& fileName, const std::vector<uint8_t>& mask, donut::math::uint2 size);
+bool ReadShadowMask(const std::filesystem::path& fileName, std::vector<uint8_t>& mask, donut::math::uint2& size);
+
+// Returns the fraction of pixels that differ, or 1 if the sizes differ
+float CompareShadowMasks(const std::vector<uint8_t>& mask, donut::math::uint2 size, const std::vector<uint8_t>& golden, donut::math::uint2 goldenSize);
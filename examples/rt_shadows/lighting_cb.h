@@ -26,12 +26,23 @@
 #include <donut/shaders/light_cb.h>
 #include <donut/shaders/view_cb.h>
 
+#define SHADOW_RESOLVE_GROUP_SIZE 8
+
 struct LightingConstants
 {
     float4 ambientColor;
 
     LightConstants light;
     PlanarViewConstants view;
+    PlanarViewConstants viewPrev;
+
+    uint2 shadowSize;           // number of shadow rays traced in each direction
+    uint2 shadowSampleOffset;   // pixel inside each shadowScale x shadowScale block that traces a ray this frame
+
+    uint shadowScale;           // 1, 2 or 4 pixels per shadow ray in each direction
+    uint frameIndex;
+    uint historyValid;
+    uint maxHistoryLength;      // frames averaged by the temporal accumulation
 };
 
 #endif // LIGHTING_CB_H
\ No newline at end of file
@@ -28,6 +28,7 @@
 #include <donut/engine/CommonRenderPasses.h>
 #include <donut/engine/TextureCache.h>
 #include <donut/engine/Scene.h>
+#include <donut/engine/GltfImporter.h>
 #include <donut/engine/FramebufferFactory.h>
 #include <donut/app/DeviceManager.h>
 #include <donut/core/log.h>
@@ -35,15 +36,97 @@
 #include <donut/core/math/math.h>
 #include <nvrhi/utils.h>
 
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
 #include "donut/engine/BindingCache.h"
 
 using namespace donut;
 using namespace donut::math;
 
 #include "lighting_cb.h"
+#include "RayTracingScene.h"
+#include "CpuRayTracingScene.h"
+#include "ShadowReference.h"
 
 static const char* g_WindowTitle = "Donut Example: Ray Traced Shadows";
 
+// Initial view and sun, the CPU reference traces the same ones without creating the application
+static const float3 c_InitialCameraPosition = float3(0.f, 1.8f, 0.f);
+static const float3 c_InitialCameraTarget = float3(1.f, 1.8f, 0.f);
+static const double3 c_SunDirection = double3(0.1, -1.0, 0.15);
+static const float c_VerticalFov = dm::PI_f * 0.25f;
+
+static std::filesystem::path GetSceneFileName()
+{
+    return app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Models/2.0/Sponza/glTF/Sponza.gltf";
+}
+
+static ShadowReferenceView GetShadowReferenceView(const float3& cameraPosition, const float3& cameraDirection, const float3& cameraUp,
+    const float3& lightDirection, uint2 size)
+{
+    ShadowReferenceView view;
+    view.cameraPosition = cameraPosition;
+    view.cameraDirection = cameraDirection;
+    view.cameraUp = cameraUp;
+    view.verticalFov = c_VerticalFov;
+    view.lightDirection = lightDirection;
+    view.size = size;
+    return view;
+}
+
+static void BuildCpuScene(CpuRayTracingScene& scene, const engine::SceneGraph& sceneGraph, tf::Executor* executor)
+{
+    scene.AddSceneGraph(sceneGraph);
+    scene.Build(executor);
+
+    const CpuRayTracingScene::Statistics& stats = scene.GetStatistics();
+    log::info("CPU BVH: %u instances of %u meshes, %llu triangles, %llu nodes, SAH cost %.2f (meshes) %.2f (instances), built in %.1f ms",
+        stats.numInstances, stats.numMeshes, (unsigned long long)stats.numTriangles, (unsigned long long)stats.numNodes,
+        stats.meshSahCost, stats.instanceSahCost, stats.buildMs);
+}
+
+// Returns false when more than maxDifferentPixels of the pixels differ
+static bool CompareWithReference(const std::vector<uint8_t>& mask, uint2 size, const std::vector<uint8_t>& reference, uint2 referenceSize,
+    float maxDifferentPixels, const char* referenceName)
+{
+    const float difference = CompareShadowMasks(mask, size, reference, referenceSize);
+    if (difference > maxDifferentPixels)
+    {
+        log::error("The shadow mask differs from %s in %.3f%% of the pixels", referenceName, difference * 100.f);
+        return false;
+    }
+
+    log::info("The shadow mask matches %s, %.3f%% of the pixels differ", referenceName, difference * 100.f);
+    return true;
+}
+
+// Pixel of a scale x scale block that traces the shadow ray in a frame. Consecutive frames are far apart
+// in the block, and every pixel is visited once in scale * scale frames, like in a Bayer matrix.
+static uint2 GetShadowSampleOffset(uint32_t scale, uint32_t frameIndex)
+{
+    static const uint2 c_Bayer2x2[4] = { uint2(0, 0), uint2(1, 1), uint2(1, 0), uint2(0, 1) };
+
+    uint2 offset = uint2(0, 0);
+    for (uint32_t blockSize = scale / 2; blockSize > 0; blockSize /= 2)
+    {
+        offset = offset + c_Bayer2x2[frameIndex % 4] * blockSize;
+        frameIndex /= 4;
+    }
+    return offset;
+}
+
+static const char* GetShadowResolutionName(uint32_t shadowScale)
+{
+    switch (shadowScale)
+    {
+    case 1: return "full";
+    case 2: return "half";
+    default: return "quarter";
+    }
+}
+
 class RenderTargets
 {
 public:
@@ -53,14 +136,18 @@ public:
     nvrhi::TextureHandle m_GBufferNormals;
     nvrhi::TextureHandle m_GBufferEmissive;
     nvrhi::TextureHandle m_HdrColor;
+    nvrhi::TextureHandle m_Shadow;
+    nvrhi::TextureHandle m_ShadowHistory[2];
 
     std::shared_ptr<engine::FramebufferFactory> m_HdrFramebuffer;
     std::shared_ptr<engine::FramebufferFactory> m_GBufferFramebuffer;
     
     int2 m_Size;
+    uint2 m_ShadowSize;
     
-    RenderTargets(nvrhi::IDevice* device, int2 size)
+    RenderTargets(nvrhi::IDevice* device, int2 size, uint32_t shadowScale)
         : m_Size(size)
+        , m_ShadowSize((uint2(size) + shadowScale - 1) / shadowScale)
     {
         nvrhi::TextureDesc desc;
         desc.width = size.x;
@@ -107,6 +194,24 @@ public:
 
         m_HdrFramebuffer = std::make_shared<engine::FramebufferFactory>(device);
         m_HdrFramebuffer->RenderTargets = { m_HdrColor };
+
+        nvrhi::TextureDesc shadowDesc;
+        shadowDesc.width = m_ShadowSize.x;
+        shadowDesc.height = m_ShadowSize.y;
+        shadowDesc.format = nvrhi::Format::R16_FLOAT;
+        shadowDesc.isUAV = true;
+        shadowDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+        shadowDesc.keepInitialState = true;
+        shadowDesc.debugName = "Shadow";
+        m_Shadow = device->createTexture(shadowDesc);
+
+        // Accumulated shadow, view depth and number of accumulated frames, alternately read and written
+        shadowDesc.width = size.x;
+        shadowDesc.height = size.y;
+        shadowDesc.format = nvrhi::Format::RGBA16_FLOAT;
+        shadowDesc.debugName = "ShadowHistory";
+        m_ShadowHistory[0] = device->createTexture(shadowDesc);
+        m_ShadowHistory[1] = device->createTexture(shadowDesc);
     }
 
     bool IsUpdateRequired(int2 size)
@@ -145,9 +250,23 @@ private:
     nvrhi::BindingLayoutHandle m_BindingLayout;
     nvrhi::BindingSetHandle m_BindingSet;
 
-    std::unordered_map<std::shared_ptr<engine::MeshInfo>, nvrhi::rt::AccelStructHandle> m_MeshAccelStructs;
-    nvrhi::rt::AccelStructHandle m_BottomLevelAS;
-    nvrhi::rt::AccelStructHandle m_TopLevelAS;
+    nvrhi::ShaderHandle m_ResolveShader;
+    nvrhi::ComputePipelineHandle m_ResolvePipeline;
+    nvrhi::BindingLayoutHandle m_ResolveBindingLayout;
+    nvrhi::BindingSetHandle m_ResolveBindingSets[2];
+    uint32_t m_HistoryIndex = 0;
+
+    // Shadow rays per shadowScale x shadowScale pixels, selected with R
+    uint32_t m_ShadowScale = 1;
+
+    nvrhi::BufferHandle m_RayCounterBuffer;
+    static constexpr uint32_t c_NumRayCountReadbacks = 3;
+    nvrhi::BufferHandle m_RayCountReadback[c_NumRayCountReadbacks];
+    bool m_RayCountPending[c_NumRayCountReadbacks] = {};
+    uint32_t m_RayCountIndex = 0;
+    uint32_t m_RaysPerFrame = 0;
+
+    std::unique_ptr<RayTracingScene> m_RayTracingScene;
 
     nvrhi::BufferHandle m_ConstantBuffer;
 
@@ -157,6 +276,8 @@ private:
     std::unique_ptr<RenderTargets> m_RenderTargets;
     app::FirstPersonCamera m_Camera;
     engine::PlanarView m_View;
+    engine::PlanarView m_ViewPrevious;
+    bool m_PreviousViewsValid = false;
     std::shared_ptr<engine::DirectionalLight> m_SunLight;
     std::unique_ptr<render::InstancedOpaqueDrawStrategy> m_OpaqueDrawStrategy;
     std::unique_ptr<engine::BindingCache> m_BindingCache;
@@ -164,9 +285,11 @@ private:
 public:
     using ApplicationBase::ApplicationBase;
 
-    bool Init()
+    bool Init(uint32_t shadowScale)
     {
-        std::filesystem::path sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Models/2.0/Sponza/glTF/Sponza.gltf";
+        m_ShadowScale = shadowScale;
+
+        std::filesystem::path sceneFileName = GetSceneFileName();
         std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
         std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/rt_shadows" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
         
@@ -187,14 +310,14 @@ public:
         m_SunLight = std::make_shared<engine::DirectionalLight>();
         m_Scene->GetSceneGraph()->AttachLeafNode(m_Scene->GetSceneGraph()->GetRootNode(), m_SunLight);
 
-        m_SunLight->SetDirection(double3(0.1, -1.0, 0.15));
+        m_SunLight->SetDirection(c_SunDirection);
         m_SunLight->angularSize = 0.53f;
         m_SunLight->irradiance = 1.f;
 
         m_Scene->FinishedLoading(GetFrameIndex());
         m_OpaqueDrawStrategy = std::make_unique<render::InstancedOpaqueDrawStrategy>();
 
-        m_Camera.LookAt(float3(0.f, 1.8f, 0.f), float3(1.f, 1.8f, 0.f));
+        m_Camera.LookAt(c_InitialCameraPosition, c_InitialCameraTarget);
         m_Camera.SetMoveSpeed(3.f);
 
         m_ConstantBuffer = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(LightingConstants), "LightingConstants", engine::c_MaxRenderPassConstantBufferVersions));
@@ -202,6 +325,27 @@ public:
         if (!CreateRayTracingPipeline(*m_ShaderFactory))
             return false;
 
+        if (!CreateResolvePipeline(*m_ShaderFactory))
+            return false;
+
+        m_RayCounterBuffer = GetDevice()->createBuffer(nvrhi::BufferDesc()
+            .setByteSize(sizeof(uint32_t))
+            .setCanHaveUAVs(true)
+            .setCanHaveRawViews(true)
+            .setInitialState(nvrhi::ResourceStates::UnorderedAccess)
+            .setKeepInitialState(true)
+            .setDebugName("RayCounter"));
+
+        for (auto& readback : m_RayCountReadback)
+        {
+            readback = GetDevice()->createBuffer(nvrhi::BufferDesc()
+                .setByteSize(sizeof(uint32_t))
+                .setCpuAccess(nvrhi::CpuAccessMode::Read)
+                .setInitialState(nvrhi::ResourceStates::CopyDest)
+                .setKeepInitialState(true)
+                .setDebugName("RayCountReadback"));
+        }
+
         m_CommandList = GetDevice()->createCommandList();
 
         m_CommandList->open();
@@ -216,6 +360,28 @@ public:
         return true;
     }
 
+    // Makes the sun a point, so that every shadow ray goes toward its center like the rays of the CPU reference
+    void SetPointSun()
+    {
+        m_SunLight->angularSize = 0.f;
+    }
+
+    const engine::SceneGraph& GetSceneGraph() const
+    {
+        return *m_Scene->GetSceneGraph();
+    }
+
+    // Created by the first frame, one texel per shadow ray
+    nvrhi::ITexture* GetShadowTexture() const
+    {
+        return m_RenderTargets ? m_RenderTargets->m_Shadow.Get() : nullptr;
+    }
+
+    ShadowReferenceView GetCurrentShadowReferenceView(uint2 size)
+    {
+        return GetShadowReferenceView(m_Camera.GetPosition(), m_Camera.GetDir(), m_Camera.GetUp(), float3(m_SunLight->GetDirection()), size);
+    }
+
     bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override 
     {
         engine::Scene* scene = new engine::Scene(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
@@ -231,6 +397,13 @@ public:
 
     bool KeyboardUpdate(int key, int scancode, int action, int mods) override
     {
+        if (key == GLFW_KEY_R && action == GLFW_PRESS)
+        {
+            m_ShadowScale = (m_ShadowScale == 4) ? 1 : m_ShadowScale * 2;
+            m_RenderTargets = nullptr;
+            m_BindingCache->Clear();
+        }
+
         m_Camera.KeyboardUpdate(key, scancode, action, mods);
         return true;
     }
@@ -250,7 +423,16 @@ public:
     void Animate(float fElapsedTimeSeconds) override
     {
         m_Camera.Animate(fElapsedTimeSeconds);
-        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
+
+        RayTracingScene::Statistics stats;
+        if (m_RayTracingScene)
+            stats = m_RayTracingScene->GetStatistics();
+
+        char extraInfo[256];
+        snprintf(extraInfo, sizeof(extraInfo), "- %d instances, %d BLASes, %.1f MB - %.1f MB saved by compaction - %s resolution shadows, %.2f Mrays",
+            int(stats.numInstances), int(stats.numAccelStructs), double(stats.blasBytes + stats.tlasBytes) / double(1 << 20),
+            double(stats.compactionSavedBytes) / double(1 << 20), GetShadowResolutionName(m_ShadowScale), double(m_RaysPerFrame) * 1e-6);
+        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfo);
     }
 
     bool CreateRayTracingPipeline(engine::ShaderFactory& shaderFactory)
@@ -266,11 +448,8 @@ public:
             { 0, nvrhi::ResourceType::VolatileConstantBuffer },
             { 0, nvrhi::ResourceType::RayTracingAccelStruct },
             { 1, nvrhi::ResourceType::Texture_SRV },
-            { 2, nvrhi::ResourceType::Texture_SRV },
-            { 3, nvrhi::ResourceType::Texture_SRV },
-            { 4, nvrhi::ResourceType::Texture_SRV },
-            { 5, nvrhi::ResourceType::Texture_SRV },
-            { 0, nvrhi::ResourceType::Texture_UAV }
+            { 0, nvrhi::ResourceType::Texture_UAV },
+            { 1, nvrhi::ResourceType::RawBuffer_UAV }
         };
 
         m_BindingLayout = GetDevice()->createBindingLayout(globalBindingLayoutDesc);
@@ -303,63 +482,64 @@ public:
         return true;
     }
 
-    void CreateAccelStruct(nvrhi::ICommandList* commandList)
+    bool CreateResolvePipeline(engine::ShaderFactory& shaderFactory)
     {
-        for (const auto& mesh : m_Scene->GetSceneGraph()->GetMeshes())
-        {
-            nvrhi::rt::AccelStructDesc blasDesc;
-            blasDesc.isTopLevel = false;
+        m_ResolveShader = shaderFactory.CreateShader("app/shadow_resolve.hlsl", "main_cs", nullptr, nvrhi::ShaderType::Compute);
 
-            for (const auto& geometry : mesh->geometries)
-            {
-                nvrhi::rt::GeometryDesc geometryDesc;
-                auto& triangles = geometryDesc.geometryData.triangles;
-                triangles.indexBuffer = mesh->buffers->indexBuffer;
-                triangles.indexOffset = (mesh->indexOffset + geometry->indexOffsetInMesh) * sizeof(uint32_t);
-                triangles.indexFormat = nvrhi::Format::R32_UINT;
-                triangles.indexCount = geometry->numIndices;
-                triangles.vertexBuffer = mesh->buffers->vertexBuffer;
-                triangles.vertexOffset = (mesh->vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh->buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
-                triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
-                triangles.vertexStride = sizeof(float3);
-                triangles.vertexCount = geometry->numVertices;
-                geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
-                geometryDesc.flags = nvrhi::rt::GeometryFlags::Opaque;
-                blasDesc.bottomLevelGeometries.push_back(geometryDesc);
-            }
-
-            nvrhi::rt::AccelStructHandle as = GetDevice()->createAccelStruct(blasDesc);
-            nvrhi::utils::BuildBottomLevelAccelStruct(commandList, as, blasDesc);
+        if (!m_ResolveShader)
+            return false;
 
-            m_MeshAccelStructs[mesh] = as;
-        }
+        nvrhi::BindingLayoutDesc layoutDesc;
+        layoutDesc.visibility = nvrhi::ShaderType::Compute;
+        layoutDesc.bindings = {
+            { 0, nvrhi::ResourceType::VolatileConstantBuffer },
+            { 0, nvrhi::ResourceType::Texture_SRV },
+            { 1, nvrhi::ResourceType::Texture_SRV },
+            { 2, nvrhi::ResourceType::Texture_SRV },
+            { 3, nvrhi::ResourceType::Texture_SRV },
+            { 4, nvrhi::ResourceType::Texture_SRV },
+            { 5, nvrhi::ResourceType::Texture_SRV },
+            { 6, nvrhi::ResourceType::Texture_SRV },
+            { 0, nvrhi::ResourceType::Sampler },
+            { 0, nvrhi::ResourceType::Texture_UAV },
+            { 1, nvrhi::ResourceType::Texture_UAV }
+        };
 
+        m_ResolveBindingLayout = GetDevice()->createBindingLayout(layoutDesc);
 
-        nvrhi::rt::AccelStructDesc tlasDesc;
-        tlasDesc.isTopLevel = true;
+        nvrhi::ComputePipelineDesc pipelineDesc;
+        pipelineDesc.CS = m_ResolveShader;
+        pipelineDesc.bindingLayouts = { m_ResolveBindingLayout };
 
-        std::vector<nvrhi::rt::InstanceDesc> instances;
+        m_ResolvePipeline = GetDevice()->createComputePipeline(pipelineDesc);
 
-        for (auto instance : m_Scene->GetSceneGraph()->GetMeshInstances())
-        {
-            nvrhi::rt::InstanceDesc instanceDesc;
-            instanceDesc.bottomLevelAS = m_MeshAccelStructs[instance->GetMesh()];
-            assert(instanceDesc.bottomLevelAS);
-            instanceDesc.instanceMask = 1;
+        return true;
+    }
 
-            auto node = instance->GetNode();
-            assert(node);
-            dm::affineToColumnMajor(node->GetLocalToWorldTransformFloat(), instanceDesc.transform);
+    void ReadRayCount()
+    {
+        nvrhi::IBuffer* readback = m_RayCountReadback[m_RayCountIndex];
+        if (!m_RayCountPending[m_RayCountIndex])
+            return;
 
-            instances.push_back(instanceDesc);
+        const uint32_t* rayCount = static_cast<const uint32_t*>(GetDevice()->mapBuffer(readback, nvrhi::CpuAccessMode::Read));
+        if (rayCount)
+        {
+            m_RaysPerFrame = *rayCount;
+            GetDevice()->unmapBuffer(readback);
         }
-        tlasDesc.topLevelMaxInstances = instances.size();
 
-        m_TopLevelAS = GetDevice()->createAccelStruct(tlasDesc);
-        commandList->buildTopLevelAccelStruct(m_TopLevelAS, instances.data(), instances.size());
-        
+        m_RayCountPending[m_RayCountIndex] = false;
     }
 
+    void CreateAccelStruct(nvrhi::ICommandList* commandList)
+    {
+        // The shaders have no any-hit shaders, so all geometry is traced as opaque
+        RayTracingScene::CreateParameters params;
+        params.forceOpaque = true;
+        m_RayTracingScene = std::make_unique<RayTracingScene>(GetDevice(), params);
+        m_RayTracingScene->CreateAccelStructs(*m_Scene->GetSceneGraph(), commandList);
+    }
 
     void BackBufferResizing() override
     { 
@@ -372,28 +552,49 @@ public:
     {
         const auto& fbinfo = framebuffer->getFramebufferInfo();
 
+        ReadRayCount();
+
         if (!m_RenderTargets)
         {
-            m_RenderTargets = std::make_unique<RenderTargets>(GetDevice(), int2(fbinfo.width, fbinfo.height));
+            m_RenderTargets = std::make_unique<RenderTargets>(GetDevice(), int2(fbinfo.width, fbinfo.height), m_ShadowScale);
+            m_PreviousViewsValid = false;
 
             nvrhi::BindingSetDesc bindingSetDesc;
             bindingSetDesc.bindings = {
                 nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer),
-                nvrhi::BindingSetItem::RayTracingAccelStruct(0, m_TopLevelAS),
+                nvrhi::BindingSetItem::RayTracingAccelStruct(0, m_RayTracingScene->GetTopLevelAS()),
                 nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_Depth),
-                nvrhi::BindingSetItem::Texture_SRV(2, m_RenderTargets->m_GBufferDiffuse),
-                nvrhi::BindingSetItem::Texture_SRV(3, m_RenderTargets->m_GBufferSpecular),
-                nvrhi::BindingSetItem::Texture_SRV(4, m_RenderTargets->m_GBufferNormals),
-                nvrhi::BindingSetItem::Texture_SRV(5, m_RenderTargets->m_GBufferEmissive),
-                nvrhi::BindingSetItem::Texture_UAV(0, m_RenderTargets->m_HdrColor)
+                nvrhi::BindingSetItem::Texture_UAV(0, m_RenderTargets->m_Shadow),
+                nvrhi::BindingSetItem::RawBuffer_UAV(1, m_RayCounterBuffer)
             };
 
             m_BindingSet = GetDevice()->createBindingSet(bindingSetDesc, m_BindingLayout);
+
+            // Each set reads one history texture and writes the other
+            for (uint32_t index = 0; index < 2; index++)
+            {
+                nvrhi::BindingSetDesc resolveSetDesc;
+                resolveSetDesc.bindings = {
+                    nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer),
+                    nvrhi::BindingSetItem::Texture_SRV(0, m_RenderTargets->m_Depth),
+                    nvrhi::BindingSetItem::Texture_SRV(1, m_RenderTargets->m_GBufferDiffuse),
+                    nvrhi::BindingSetItem::Texture_SRV(2, m_RenderTargets->m_GBufferSpecular),
+                    nvrhi::BindingSetItem::Texture_SRV(3, m_RenderTargets->m_GBufferNormals),
+                    nvrhi::BindingSetItem::Texture_SRV(4, m_RenderTargets->m_GBufferEmissive),
+                    nvrhi::BindingSetItem::Texture_SRV(5, m_RenderTargets->m_Shadow),
+                    nvrhi::BindingSetItem::Texture_SRV(6, m_RenderTargets->m_ShadowHistory[index]),
+                    nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_LinearClampSampler),
+                    nvrhi::BindingSetItem::Texture_UAV(0, m_RenderTargets->m_HdrColor),
+                    nvrhi::BindingSetItem::Texture_UAV(1, m_RenderTargets->m_ShadowHistory[index ^ 1])
+                };
+
+                m_ResolveBindingSets[index] = GetDevice()->createBindingSet(resolveSetDesc, m_ResolveBindingLayout);
+            }
         }
 
         nvrhi::Viewport windowViewport(float(fbinfo.width), float(fbinfo.height));
         m_View.SetViewport(windowViewport);
-        m_View.SetMatrices(m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(dm::PI_f * 0.25f, windowViewport.width() / windowViewport.height(), 0.1f));
+        m_View.SetMatrices(m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(c_VerticalFov, windowViewport.width() / windowViewport.height(), 0.1f));
         m_View.UpdateCache();
 
         if (!m_GBufferPass)
@@ -407,6 +608,9 @@ public:
 
         m_CommandList->open();
 
+        m_Scene->Refresh(m_CommandList, GetFrameIndex());
+        m_RayTracingScene->Update(*m_Scene->GetSceneGraph(), GetFrameIndex(), m_CommandList);
+
         m_RenderTargets->Clear(m_CommandList);
         render::GBufferFillPass::Context gbufferContext;
         render::RenderCompositeView(m_CommandList, &m_View, &m_View, *m_RenderTargets->m_GBufferFramebuffer,
@@ -415,27 +619,182 @@ public:
         LightingConstants constants = {};
         constants.ambientColor = float4(0.05f);
         m_View.FillPlanarViewConstants(constants.view);
+        (m_PreviousViewsValid ? m_ViewPrevious : m_View).FillPlanarViewConstants(constants.viewPrev);
         m_SunLight->FillLightConstants(constants.light);
+        constants.shadowSize = m_RenderTargets->m_ShadowSize;
+        constants.shadowSampleOffset = GetShadowSampleOffset(m_ShadowScale, GetFrameIndex());
+        constants.shadowScale = m_ShadowScale;
+        constants.frameIndex = GetFrameIndex();
+        constants.historyValid = m_PreviousViewsValid ? 1 : 0;
+        // Long enough to visit every pixel of the blocks a few times
+        constants.maxHistoryLength = std::max(8u, 2 * m_ShadowScale * m_ShadowScale);
         m_CommandList->writeBuffer(m_ConstantBuffer, &constants, sizeof(constants));
 
+        m_CommandList->clearBufferUInt(m_RayCounterBuffer, 0);
+
         nvrhi::rt::State state;
         state.shaderTable = m_ShaderTable;
         state.bindings = { m_BindingSet };
         m_CommandList->setRayTracingState(state);
 
         nvrhi::rt::DispatchRaysArguments args;
-        args.width = fbinfo.width;
-        args.height = fbinfo.height;
+        args.width = m_RenderTargets->m_ShadowSize.x;
+        args.height = m_RenderTargets->m_ShadowSize.y;
         m_CommandList->dispatchRays(args);
+
+        nvrhi::ComputeState resolveState;
+        resolveState.pipeline = m_ResolvePipeline;
+        resolveState.bindings = { m_ResolveBindingSets[m_HistoryIndex] };
+        m_CommandList->setComputeState(resolveState);
+        m_CommandList->dispatch(
+            dm::div_ceil(fbinfo.width, SHADOW_RESOLVE_GROUP_SIZE),
+            dm::div_ceil(fbinfo.height, SHADOW_RESOLVE_GROUP_SIZE));
+
+        m_CommandList->copyBuffer(m_RayCountReadback[m_RayCountIndex], 0, m_RayCounterBuffer, 0, sizeof(uint32_t));
+        m_RayCountPending[m_RayCountIndex] = true;
         
         m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTargets->m_HdrColor, m_BindingCache.get());
 
         m_CommandList->close();
         GetDevice()->executeCommandList(m_CommandList);
+
+        m_ViewPrevious = m_View;
+        m_PreviousViewsValid = true;
+        m_HistoryIndex ^= 1;
+        m_RayCountIndex = (m_RayCountIndex + 1) % c_NumRayCountReadbacks;
     }
 
 };
 
+// Traces the shadow rays of the initial view on the CPU and writes the shadow mask, then compares it with the
+// golden image if there is one. Needs no device: the glTF importer fills the CPU copies of the mesh buffers that
+// the CPU ray tracer reads, and decodes the textures into a texture cache that never uploads them.
+static bool RunCpuReference(uint2 size, const std::filesystem::path& outputFile, const std::filesystem::path& goldenFile, tf::Executor* executor)
+{
+    const std::filesystem::path sceneFileName = GetSceneFileName();
+
+    auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+    engine::TextureCache textureCache(nullptr, nativeFS, nullptr);
+    engine::GltfImporter importer(nativeFS, std::make_shared<engine::SceneTypeFactory>());
+    engine::SceneLoadingStats loadingStats;
+    engine::SceneImportResult importResult;
+    const bool loaded = importer.Load(sceneFileName, textureCache, loadingStats, executor, importResult);
+
+#ifdef DONUT_WITH_TASKFLOW
+    // The textures are decoded by tasks that outlive the import, and the texture cache must outlive them
+    if (executor)
+        executor->wait_for_all();
+#endif
+
+    if (!loaded)
+    {
+        log::error("Cannot load the scene from '%s'", sceneFileName.generic_string().c_str());
+        return false;
+    }
+
+    auto sceneGraph = std::make_shared<engine::SceneGraph>();
+    sceneGraph->SetRootNode(importResult.rootNode);
+    sceneGraph->Refresh(0);
+
+    CpuRayTracingScene scene;
+    BuildCpuScene(scene, *sceneGraph, executor);
+
+    const float3 cameraDirection = normalize(c_InitialCameraTarget - c_InitialCameraPosition);
+    const ShadowReferenceView view = GetShadowReferenceView(c_InitialCameraPosition, cameraDirection, float3(0.f, 1.f, 0.f),
+        float3(c_SunDirection), size);
+
+    const std::vector<uint8_t> mask = RenderShadowReference(scene, view, executor);
+    if (!WriteShadowMask(outputFile, mask, size))
+        return false;
+
+    log::info("Shadow mask written to '%s'", outputFile.generic_string().c_str());
+
+    if (goldenFile.empty())
+        return true;
+
+    std::vector<uint8_t> golden;
+    uint2 goldenSize;
+    if (!ReadShadowMask(goldenFile, golden, goldenSize))
+        return false;
+
+    // Allows for rounding differences on silhouettes between compilers and instruction sets
+    constexpr float c_MaxDifferentPixels = 0.001f;
+    const std::string goldenName = "'" + goldenFile.generic_string() + "'";
+    return CompareWithReference(mask, size, golden, goldenSize, c_MaxDifferentPixels, goldenName.c_str());
+}
+
+// Renders the initial view on the GPU with a point sun and one shadow ray per pixel, so that every ray goes toward
+// the center of the sun like the rays of the CPU reference. Reads back the shadow rays, writes them as a shadow
+// mask, and compares them with the CPU reference traced over the same scene graph.
+static bool RunGpuComparison(RayTracedShadows& example, nvrhi::IDevice* device, uint2 size, const std::filesystem::path& outputFile,
+    tf::Executor* executor)
+{
+    // The G-buffer pass alpha tests the foliage that both ray tracers treat as opaque, and the GPU rays start
+    // from positions reconstructed from the depth buffer, so some pixels on silhouettes and leaves differ
+    constexpr float c_MaxDifferentPixels = 0.02f;
+
+    nvrhi::TextureHandle colorTarget = device->createTexture(nvrhi::TextureDesc()
+        .setDimension(nvrhi::TextureDimension::Texture2D)
+        .setWidth(size.x)
+        .setHeight(size.y)
+        .setFormat(nvrhi::Format::SRGBA8_UNORM)
+        .setIsRenderTarget(true)
+        .setInitialState(nvrhi::ResourceStates::RenderTarget)
+        .setKeepInitialState(true)
+        .setDebugName("OffscreenLdrColor"));
+
+    nvrhi::FramebufferHandle framebuffer = device->createFramebuffer(nvrhi::FramebufferDesc()
+        .addColorAttachment(colorTarget));
+
+    example.SetPointSun();
+    example.Render(framebuffer);
+
+    nvrhi::ITexture* shadowTexture = example.GetShadowTexture();
+    nvrhi::TextureDesc readbackDesc = shadowTexture->getDesc();
+    readbackDesc.isUAV = false;
+    readbackDesc.initialState = nvrhi::ResourceStates::CopyDest;
+    readbackDesc.debugName = "ShadowReadback";
+    nvrhi::StagingTextureHandle shadowReadback = device->createStagingTexture(readbackDesc, nvrhi::CpuAccessMode::Read);
+
+    nvrhi::CommandListHandle commandList = device->createCommandList();
+    commandList->open();
+    commandList->copyTexture(shadowReadback, nvrhi::TextureSlice(), shadowTexture, nvrhi::TextureSlice());
+    commandList->close();
+    device->executeCommandList(commandList);
+    device->waitForIdle();
+
+    // The ray generation shader writes 1 for lit pixels and for the sky, and 0 for shadowed pixels, in R16_FLOAT
+    std::vector<uint8_t> gpuMask(size_t(size.x) * size.y);
+    size_t rowPitch = 0;
+    const uint8_t* texels = static_cast<const uint8_t*>(device->mapStagingTexture(shadowReadback, nvrhi::TextureSlice(), nvrhi::CpuAccessMode::Read, &rowPitch));
+    for (uint32_t y = 0; y < size.y; y++)
+    {
+        const uint16_t* row = reinterpret_cast<const uint16_t*>(texels + y * rowPitch);
+        for (uint32_t x = 0; x < size.x; x++)
+            gpuMask[size_t(y) * size.x + x] = (row[x] & 0x7fff) != 0 ? c_ShadowMaskLit : c_ShadowMaskShadowed;
+    }
+    device->unmapStagingTexture(shadowReadback);
+
+    CpuRayTracingScene scene;
+    BuildCpuScene(scene, example.GetSceneGraph(), executor);
+    const std::vector<uint8_t> reference = RenderShadowReference(scene, example.GetCurrentShadowReferenceView(size), executor);
+
+    // The GPU does not tell the sky from lit pixels, so lit pixels where the reference sees the sky are sky.
+    // Pixels that are sky on one side and shadowed on the other still differ.
+    for (size_t index = 0; index < gpuMask.size(); index++)
+    {
+        if (reference[index] == c_ShadowMaskSky && gpuMask[index] == c_ShadowMaskLit)
+            gpuMask[index] = c_ShadowMaskSky;
+    }
+
+    if (!WriteShadowMask(outputFile, gpuMask, size))
+        return false;
+
+    log::info("GPU shadow mask written to '%s'", outputFile.generic_string().c_str());
+
+    return CompareWithReference(gpuMask, size, reference, size, c_MaxDifferentPixels, "the CPU reference");
+}
+
 #ifdef WIN32
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 #else
@@ -443,7 +802,55 @@ int main(int __argc, const char** __argv)
 #endif
 {
     nvrhi::GraphicsAPI api = app::GetGraphicsAPIFromCommandLine(__argc, __argv);
-    app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
+
+    std::filesystem::path cpuReferenceFile;
+    std::filesystem::path goldenFile;
+    std::filesystem::path gpuComparisonFile;
+    bool runBvhBenchmark = false;
+    uint32_t shadowScale = 1;
+    for (int i = 1; i < __argc; i++)
+    {
+        if (strcmp(__argv[i], "-cpuReference") == 0 && i + 1 < __argc)
+        {
+            cpuReferenceFile = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-golden") == 0 && i + 1 < __argc)
+        {
+            goldenFile = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-compareGpu") == 0 && i + 1 < __argc)
+        {
+            gpuComparisonFile = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-bvhBenchmark") == 0)
+        {
+            runBvhBenchmark = true;
+        }
+        else if (strcmp(__argv[i], "-shadowResolution") == 0 && i + 1 < __argc)
+        {
+            const char* resolution = __argv[++i];
+            if (strcmp(resolution, "half") == 0)
+                shadowScale = 2;
+            else if (strcmp(resolution, "quarter") == 0)
+                shadowScale = 4;
+            else if (strcmp(resolution, "full") != 0)
+                log::warning("Unknown shadow resolution '%s', use full, half or quarter", resolution);
+        }
+    }
+
+    if (runBvhBenchmark)
+    {
+        // CPU only, no device needed
+        RunCpuRayTracingBenchmark();
+        return 0;
+    }
+
+#ifdef DONUT_WITH_TASKFLOW
+    tf::Executor executor;
+    tf::Executor* cpuExecutor = &executor;
+#else
+    tf::Executor* cpuExecutor = nullptr;
+#endif
 
     app::DeviceCreationParameters deviceParams;
     deviceParams.enableRayTracingExtensions = true;
@@ -452,7 +859,23 @@ int main(int __argc, const char** __argv)
     deviceParams.enableNvrhiValidationLayer = true;
 #endif
 
-    if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
+    if (!cpuReferenceFile.empty())
+    {
+        // CPU only, no device needed
+        const uint2 size = uint2(deviceParams.backBufferWidth, deviceParams.backBufferHeight);
+        return RunCpuReference(size, cpuReferenceFile, goldenFile, cpuExecutor) ? 0 : 1;
+    }
+
+    const bool compareGpu = !gpuComparisonFile.empty();
+
+    app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
+
+    // The GPU comparison renders offscreen and never presents
+    bool deviceCreated = compareGpu
+        ? deviceManager->CreateHeadlessDevice(deviceParams)
+        : deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle);
+
+    if (!deviceCreated)
     {
         log::fatal("Cannot initialize a graphics device with the requested parameters");
         return 1;
@@ -464,9 +887,22 @@ int main(int __argc, const char** __argv)
         return 1;
     }
 
+    int exitCode = 0;
+
     {
         RayTracedShadows example(deviceManager);
-        if (example.Init())
+        // The CPU reference traces one shadow ray per pixel
+        if (!example.Init(compareGpu ? 1 : shadowScale))
+        {
+            exitCode = 1;
+        }
+        else if (compareGpu)
+        {
+            const uint2 size = uint2(deviceParams.backBufferWidth, deviceParams.backBufferHeight);
+            if (!RunGpuComparison(example, deviceManager->GetDevice(), size, gpuComparisonFile, cpuExecutor))
+                exitCode = 1;
+        }
+        else
         {
             deviceManager->AddRenderPassToBack(&example);
             deviceManager->RunMessageLoop();
@@ -478,5 +914,5 @@ int main(int __argc, const char** __argv)
 
     delete deviceManager;
 
-    return 0;
+    return exitCode;
 }
@@ -37,69 +37,91 @@ struct HitInfo
 
 ConstantBuffer<LightingConstants> g_Lighting : register(b0);
 
-RWTexture2D<float4> u_Output : register(u0);
+RWTexture2D<float> u_Shadow : register(u0);
+RWByteAddressBuffer u_RayCounter : register(u1);
 
 RaytracingAccelerationStructure SceneBVH : register(t0);
 Texture2D t_GBufferDepth : register(t1);
-Texture2D t_GBuffer0 : register(t2);
-Texture2D t_GBuffer1 : register(t3);
-Texture2D t_GBuffer2 : register(t4);
-Texture2D t_GBuffer3 : register(t5);
 
+// ---[ Helpers ]---
+
+// Interleaved gradient noise, which is close to blue noise in screen space. The golden ratio
+// rotation per frame makes the values of every pixel well distributed over time.
+float2 GetInterleavedGradientNoise(uint2 pixel, uint frameIndex)
+{
+    const float2 offsets[2] = { float2(0, 0), float2(47, 17) };
+    float2 noise;
+    [unroll]
+    for (int i = 0; i < 2; i++)
+    {
+        float2 position = float2(pixel) + offsets[i];
+        noise[i] = frac(52.9829189 * frac(dot(position, float2(0.06711056, 0.00583715))));
+    }
+    return frac(noise + float(frameIndex) * float2(0.61803399, 0.75487767));
+}
+
+// Direction inside the cone that the sun covers, from a uniform sample of a disk
+float3 SampleSunCone(float3 toLight, float halfAngle, float2 random)
+{
+    float3 tangent = normalize(cross(toLight, abs(toLight.y) < 0.9 ? float3(0, 1, 0) : float3(1, 0, 0)));
+    float3 bitangent = cross(toLight, tangent);
+
+    float radius = sqrt(random.x) * tan(halfAngle);
+    float angle = random.y * 6.28318531;
+
+    return normalize(toLight + radius * (cos(angle) * tangent + sin(angle) * bitangent));
+}
 
 // ---[ Ray Generation Shader ]---
 
 [shader("raygeneration")]
 void RayGen()
 {
-    uint2 globalIdx = DispatchRaysIndex().xy;
+    uint2 shadowIdx = DispatchRaysIndex().xy;
+
+    // One pixel of every block traces a ray, a different one every frame
+    uint2 globalIdx = shadowIdx * g_Lighting.shadowScale + g_Lighting.shadowSampleOffset;
+    globalIdx = min(globalIdx, uint2(g_Lighting.view.viewportSize) - 1);
     float2 pixelPosition = float2(globalIdx) + 0.5;
-    
-    MaterialSample surfaceMaterial = DecodeGBuffer(globalIdx, t_GBuffer0, t_GBuffer1, t_GBuffer2, t_GBuffer3);
-
-    float3 surfaceWorldPos = ReconstructWorldPosition(g_Lighting.view, pixelPosition.xy, t_GBufferDepth[pixelPosition.xy].x);
-
-    float3 viewIncident = GetIncidentVector(g_Lighting.view.cameraDirectionOrPosition, surfaceWorldPos);
-
-    // Setup the ray
-    RayDesc ray;
-    ray.Origin = surfaceWorldPos;
-    ray.Direction = -normalize(g_Lighting.light.direction);
-    ray.TMin = 0.01f;
-    ray.TMax = 100.f;
-
-    // Trace the ray
-    HitInfo payload;
-    payload.missed = false;
-
-    TraceRay(
-        SceneBVH,
-        RAY_FLAG_CULL_BACK_FACING_TRIANGLES,
-        0xFF,
-        0,
-        0,
-        0,
-        ray,
-        payload);
-
-    float shadow = (payload.missed) ? 1 : 0;
-
-    float3 diffuseTerm = 0;
-    float3 specularTerm = 0;
-
-    float3 diffuseRadiance, specularRadiance;
-    ShadeSurface(g_Lighting.light, surfaceMaterial, surfaceWorldPos, viewIncident, diffuseRadiance, specularRadiance);
-    
-    diffuseTerm += (shadow * diffuseRadiance) * g_Lighting.light.color;
-    specularTerm += (shadow * specularRadiance) * g_Lighting.light.color;
-
-    diffuseTerm += g_Lighting.ambientColor.rgb * surfaceMaterial.diffuseAlbedo;
-    
-    float3 outputColor = diffuseTerm
-        + specularTerm
-        + surfaceMaterial.emissiveColor;
-
-    u_Output[globalIdx] = float4(outputColor, 1);
+
+    float depth = t_GBufferDepth[globalIdx].x;
+    bool traceRay = depth != 0;
+
+    float shadow = 1;
+    if (traceRay)
+    {
+        float3 surfaceWorldPos = ReconstructWorldPosition(g_Lighting.view, pixelPosition.xy, depth);
+
+        // Setup the ray
+        RayDesc ray;
+        ray.Origin = surfaceWorldPos;
+        ray.Direction = SampleSunCone(-normalize(g_Lighting.light.direction), g_Lighting.light.angularSizeOrInvRange * 0.5,
+            GetInterleavedGradientNoise(shadowIdx, g_Lighting.frameIndex));
+        ray.TMin = 0.01f;
+        ray.TMax = 100.f;
+
+        // Trace the ray
+        HitInfo payload;
+        payload.missed = false;
+
+        TraceRay(
+            SceneBVH,
+            RAY_FLAG_CULL_BACK_FACING_TRIANGLES,
+            0xFF,
+            0,
+            0,
+            0,
+            ray,
+            payload);
+
+        shadow = (payload.missed) ? 1 : 0;
+    }
+
+    uint rayCount = WaveActiveCountBits(traceRay);
+    if (WaveIsFirstLane() && rayCount != 0)
+        u_RayCounter.InterlockedAdd(0, rayCount);
+
+    u_Shadow[shadowIdx] = shadow;
 }
 
 // ---[ Miss Shader ]---
@@ -0,0 +1,157 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/gbuffer.hlsli>
+#include <donut/shaders/lighting.hlsli>
+#include "lighting_cb.h"
+
+// Upsamples the shadow rays that rt_shadows.hlsl traces at a lower resolution, accumulates them over time,
+// and shades the G-buffer with the result.
+
+ConstantBuffer<LightingConstants> g_Lighting : register(b0);
+
+Texture2D t_GBufferDepth : register(t0);
+Texture2D t_GBuffer0 : register(t1);
+Texture2D t_GBuffer1 : register(t2);
+Texture2D t_GBuffer2 : register(t3);
+Texture2D t_GBuffer3 : register(t4);
+Texture2D<float> t_Shadow : register(t5);
+Texture2D<float4> t_ShadowHistory : register(t6);
+SamplerState s_LinearClamp : register(s0);
+
+RWTexture2D<float4> u_Output : register(u0);
+RWTexture2D<float4> u_ShadowHistory : register(u1);
+
+float GetViewDepth(PlanarViewConstants view, float3 worldPos)
+{
+    return mul(float4(worldPos, 1), view.matWorldToView).z;
+}
+
+[numthreads(SHADOW_RESOLVE_GROUP_SIZE, SHADOW_RESOLVE_GROUP_SIZE, 1)]
+void main_cs(uint2 globalIdx : SV_DispatchThreadID)
+{
+    if (any(globalIdx >= uint2(g_Lighting.view.viewportSize)))
+        return;
+
+    float2 pixelPosition = float2(globalIdx) + 0.5;
+
+    MaterialSample surfaceMaterial = DecodeGBuffer(globalIdx, t_GBuffer0, t_GBuffer1, t_GBuffer2, t_GBuffer3);
+
+    float depth = t_GBufferDepth[globalIdx].x;
+    if (depth == 0)
+    {
+        // Background, nothing to shade
+        u_ShadowHistory[globalIdx] = 0;
+        u_Output[globalIdx] = float4(surfaceMaterial.emissiveColor, 1);
+        return;
+    }
+
+    float3 surfaceWorldPos = ReconstructWorldPosition(g_Lighting.view, pixelPosition.xy, depth);
+    float3 normal = surfaceMaterial.shadingNormal;
+    float viewDepth = GetViewDepth(g_Lighting.view, surfaceWorldPos);
+
+    // Bilateral upsample: the four shadow rays around the pixel, weighted by their distance to the plane
+    // of the pixel and by the similarity of the normals, so that shadows do not leak across edges
+    float2 shadowPosition = (float2(globalIdx) - float2(g_Lighting.shadowSampleOffset)) / float(g_Lighting.shadowScale);
+    int2 baseIdx = int2(floor(shadowPosition));
+    float2 bilinear = shadowPosition - float2(baseIdx);
+
+    float shadowSum = 0;
+    float weightSum = 0;
+    float fallbackShadow = 1;
+    float fallbackWeight = -1;
+
+    [unroll]
+    for (int i = 0; i < 4; i++)
+    {
+        int2 offset = int2(i & 1, i >> 1);
+        int2 shadowIdx = clamp(baseIdx + offset, 0, int2(g_Lighting.shadowSize) - 1);
+        uint2 sampleIdx = min(uint2(shadowIdx) * g_Lighting.shadowScale + g_Lighting.shadowSampleOffset, uint2(g_Lighting.view.viewportSize) - 1);
+
+        float sampleDepth = t_GBufferDepth[sampleIdx].x;
+        float3 sampleWorldPos = ReconstructWorldPosition(g_Lighting.view, float2(sampleIdx) + 0.5, sampleDepth);
+        float3 sampleNormal = t_GBuffer2[sampleIdx].xyz;
+
+        float planeDistance = abs(dot(sampleWorldPos - surfaceWorldPos, normal));
+        float depthWeight = (sampleDepth != 0) ? saturate(1 - planeDistance / (0.02 * abs(viewDepth) + 0.001)) : 0;
+        float normalWeight = pow(saturate(dot(normal, sampleNormal)), 8);
+        float bilinearWeight = (offset.x ? bilinear.x : 1 - bilinear.x) * (offset.y ? bilinear.y : 1 - bilinear.y);
+
+        float shadowSample = t_Shadow[shadowIdx];
+        float geometryWeight = depthWeight * normalWeight;
+
+        shadowSum += shadowSample * bilinearWeight * geometryWeight;
+        weightSum += bilinearWeight * geometryWeight;
+
+        if (geometryWeight > fallbackWeight)
+        {
+            fallbackShadow = shadowSample;
+            fallbackWeight = geometryWeight;
+        }
+    }
+
+    // Thin features can have no similar ray around them, use the most similar one
+    float shadow = (weightSum > 1e-4) ? shadowSum / weightSum : fallbackShadow;
+
+    // Temporal accumulation with the reprojected history, which is discarded on disocclusion
+    float historyLength = 0;
+    if (g_Lighting.historyValid != 0)
+    {
+        float4 prevClipPos = mul(float4(surfaceWorldPos, 1), g_Lighting.viewPrev.matWorldToClip);
+        float2 prevWindowPos = prevClipPos.xy / prevClipPos.w * g_Lighting.viewPrev.clipToWindowScale + g_Lighting.viewPrev.clipToWindowBias;
+
+        if (prevClipPos.w > 0 && all(prevWindowPos >= 0) && all(prevWindowPos < g_Lighting.viewPrev.viewportSize))
+        {
+            float4 history = t_ShadowHistory.SampleLevel(s_LinearClamp, prevWindowPos * g_Lighting.viewPrev.viewportSizeInv, 0);
+            float prevViewDepth = GetViewDepth(g_Lighting.viewPrev, surfaceWorldPos);
+
+            if (abs(history.y - prevViewDepth) < 0.05 * abs(prevViewDepth))
+            {
+                historyLength = min(history.z, float(g_Lighting.maxHistoryLength - 1));
+                shadow = lerp(history.x, shadow, 1 / (historyLength + 1));
+            }
+        }
+    }
+
+    u_ShadowHistory[globalIdx] = float4(shadow, viewDepth, historyLength + 1, 0);
+
+    float3 viewIncident = GetIncidentVector(g_Lighting.view.cameraDirectionOrPosition, surfaceWorldPos);
+
+    float3 diffuseTerm = 0;
+    float3 specularTerm = 0;
+
+    float3 diffuseRadiance, specularRadiance;
+    ShadeSurface(g_Lighting.light, surfaceMaterial, surfaceWorldPos, viewIncident, diffuseRadiance, specularRadiance);
+    
+    diffuseTerm += (shadow * diffuseRadiance) * g_Lighting.light.color;
+    specularTerm += (shadow * specularRadiance) * g_Lighting.light.color;
+
+    diffuseTerm += g_Lighting.ambientColor.rgb * surfaceMaterial.diffuseAlbedo;
+    
+    float3 outputColor = diffuseTerm
+        + specularTerm
+        + surfaceMaterial.emissiveColor;
+
+    u_Output[globalIdx] = float4(outputColor, 1);
+}
@@ -35,11 +35,23 @@
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/math/math.h>
 #include <taskflow/taskflow.hpp>
+#include <chrono>
+
+#include "InstanceCuller.h"
+#include "OcclusionRasterizer.h"
 
 using namespace donut;
+using namespace donut::math;
 
 static const char* g_WindowTitle = "Donut Example: Threaded Rendering";
 
+// Views culled together by the multi-view culler: the 6 cube faces
+constexpr int c_NumCulledViews = 6;
+
+// Geometries become occluders when their bounds are at least this large along two axes, in meters
+constexpr float c_MinOccluderSize = 2.f;
+constexpr size_t c_MaxOccluderTriangles = 16384;
+
 class ThreadedRendering : public app::ApplicationBase
 {
 private:
@@ -49,6 +61,8 @@ private:
     std::array<nvrhi::CommandListHandle, 6> m_FaceCommandLists;
 
     bool m_UseThreads = true;
+    bool m_UseCuller = true;
+    bool m_UseOcclusion = true;
     std::unique_ptr<tf::Executor> m_Executor;
     
     nvrhi::TextureHandle m_DepthBuffer;
@@ -60,6 +74,14 @@ private:
     std::unique_ptr<engine::Scene> m_Scene;
     std::unique_ptr<engine::BindingCache> m_BindingCache;
 
+    InstanceCuller m_Culler;
+    std::vector<uint32_t> m_ViewMasks;
+    std::vector<std::vector<uint32_t>> m_VisibleInstances;
+
+    OccluderMesh m_Occluders;
+    std::array<OcclusionRasterizer, c_NumCulledViews> m_OcclusionRasterizers;
+    std::array<size_t, c_NumCulledViews> m_OccludedGeometries = {};
+
     app::FirstPersonCamera m_Camera;
     engine::CubemapView m_CubemapView;
 
@@ -87,6 +109,12 @@ public:
         BeginLoadingScene(nativeFS, sceneFileName);
 
         m_Scene->FinishedLoading(GetFrameIndex());
+
+        m_Culler.Build(*m_Scene->GetSceneGraph());
+        m_VisibleInstances.resize(c_NumCulledViews);
+
+        m_Occluders.Build(*m_Scene->GetSceneGraph(), c_MinOccluderSize, c_MaxOccluderTriangles);
+        log::info("Occlusion culling uses %d occluder triangles", int(m_Occluders.GetNumTriangles()));
         
         m_Camera.LookAt(dm::float3(0.f, 1.8f, 0.f), dm::float3(1.f, 1.8f, 0.f));
         m_Camera.SetMoveSpeed(3.f);
@@ -158,6 +186,16 @@ public:
             m_UseThreads = !m_UseThreads;
         }
 
+        if (key == GLFW_KEY_C && action == GLFW_PRESS)
+        {
+            m_UseCuller = !m_UseCuller;
+        }
+
+        if (key == GLFW_KEY_O && action == GLFW_PRESS)
+        {
+            m_UseOcclusion = !m_UseOcclusion;
+        }
+
         return true;
     }
 
@@ -177,7 +215,17 @@ public:
     {
         m_Camera.Animate(fElapsedTimeSeconds);
 
-        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle,m_UseThreads ? "(With threads)" : "(No threads)");
+        std::string extraInfo = m_UseThreads ? "(With threads" : "(No threads";
+        extraInfo += m_UseCuller ? ", SIMD culling" : ", scene graph culling";
+        if (IsOcclusionEnabled())
+        {
+            size_t occludedGeometries = 0;
+            for (size_t count : m_OccludedGeometries)
+                occludedGeometries += count;
+            extraInfo += ", " + std::to_string(occludedGeometries) + " geometries occluded";
+        }
+        extraInfo += ")";
+        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfo.c_str());
     }
 
     void BackBufferResizing() override
@@ -185,6 +233,26 @@ public:
         m_BindingCache->Clear();
     }
 
+    bool IsOcclusionEnabled() const
+    {
+        return m_UseCuller && m_UseOcclusion && m_Occluders.GetNumTriangles() != 0;
+    }
+
+    // Draws the occluders for one of the culled views, returns null when occlusion culling is off
+    OcclusionRasterizer* RenderOccluders(int viewIndex, const engine::IView& view)
+    {
+        if (!IsOcclusionEnabled())
+        {
+            m_OccludedGeometries[viewIndex] = 0;
+            return nullptr;
+        }
+
+        OcclusionRasterizer& rasterizer = m_OcclusionRasterizers[viewIndex];
+        rasterizer.Begin(view.GetViewProjectionMatrix(), view.IsReverseDepth());
+        rasterizer.DrawOccluders(m_Occluders);
+        return &rasterizer;
+    }
+
     void RenderCubeFace(int face)
     {
         const engine::IView* faceView = m_CubemapView.GetChildView(engine::ViewType::PLANAR, face);
@@ -201,22 +269,253 @@ public:
         commandList->setResourceStatesForFramebuffer(m_Framebuffer->GetFramebuffer(*faceView));
         commandList->commitBarriers();
 
-        render::InstancedOpaqueDrawStrategy strategy;
+        render::InstancedOpaqueDrawStrategy instancedStrategy;
+        OcclusionRasterizer* occlusion = RenderOccluders(face, *faceView);
+        CulledOpaqueDrawStrategy culledStrategy(m_Culler, &m_VisibleInstances[face], occlusion);
+        render::IDrawStrategy& strategy = m_UseCuller ? static_cast<render::IDrawStrategy&>(culledStrategy) : instancedStrategy;
 
         render::RenderCompositeView(commandList, faceView, faceView, *m_Framebuffer,
             m_Scene->GetSceneGraph()->GetRootNode(), strategy, *m_ForwardShadingPass, context);
 
+        if (occlusion)
+            m_OccludedGeometries[face] = culledStrategy.GetNumOccludedGeometries();
+
         commandList->setEnableAutomaticBarriers(true);
 
         commandList->close();
     }
 
+    // Culls the cube faces in one sweep over the instance bounds
+    void CullViews()
+    {
+        std::array<CullingFrustum, c_NumCulledViews> frustums;
+
+        for (int face = 0; face < 6; face++)
+        {
+            const engine::IView* faceView = m_CubemapView.GetChildView(engine::ViewType::PLANAR, face);
+            frustums[face] = CullingFrustum::FromViewProjection(faceView->GetViewProjectionMatrix());
+        }
+
+        m_Culler.CullViews(frustums.data(), c_NumCulledViews, m_ViewMasks);
+        InstanceCuller::GatherVisibleInstances(m_ViewMasks, c_NumCulledViews, m_VisibleInstances);
+    }
+
+    std::shared_ptr<engine::SceneGraph> CreateSyntheticScene(int numInstances)
+    {
+        const auto& meshes = m_Scene->GetSceneGraph()->GetMeshes();
+
+        auto sceneGraph = std::make_shared<engine::SceneGraph>();
+        auto rootNode = std::make_shared<engine::SceneGraphNode>();
+        sceneGraph->SetRootNode(rootNode);
+
+        // a flat grid of scaled down Sponza pieces around the camera, 1 meter apart
+        const int gridSize = int(ceilf(sqrtf(float(numInstances))));
+        const dm::float3 cameraPosition = m_Camera.GetPosition();
+
+        for (int index = 0; index < numInstances; index++)
+        {
+            auto node = std::make_shared<engine::SceneGraphNode>();
+            node->SetTranslation(double3(
+                double(cameraPosition.x) + double(index % gridSize - gridSize / 2),
+                0.0,
+                double(cameraPosition.z) + double(index / gridSize - gridSize / 2)));
+            node->SetScaling(double3(0.02));
+            sceneGraph->Attach(rootNode, node);
+            sceneGraph->AttachLeafNode(node, std::make_shared<engine::MeshInstance>(meshes[index % meshes.size()]));
+        }
+
+        sceneGraph->Refresh(0);
+
+        return sceneGraph;
+    }
+
+    void BenchmarkCulling(const char* sceneName, const std::shared_ptr<engine::SceneGraphNode>& rootNode, const InstanceCuller& culler, int iterations)
+    {
+        auto drainItems = [](render::IDrawStrategy& strategy)
+        {
+            size_t numItems = 0;
+            while (strategy.GetNextItem())
+                numItems++;
+            return numItems;
+        };
+
+        using clock = std::chrono::high_resolution_clock;
+
+        render::InstancedOpaqueDrawStrategy instancedStrategy;
+        CulledOpaqueDrawStrategy culledStrategy(culler);
+        std::vector<uint32_t> visibleInstances;
+        size_t instancedItems = 0;
+        size_t culledItems = 0;
+        size_t culledInstances = 0;
+
+        auto start = clock::now();
+        for (int iteration = 0; iteration < iterations; iteration++)
+        {
+            instancedItems = 0;
+            for (int face = 0; face < 6; face++)
+            {
+                instancedStrategy.PrepareForView(rootNode, *m_CubemapView.GetChildView(engine::ViewType::PLANAR, face));
+                instancedItems += drainItems(instancedStrategy);
+            }
+        }
+        auto traversalEnd = clock::now();
+
+        for (int iteration = 0; iteration < iterations; iteration++)
+        {
+            culledItems = 0;
+            for (int face = 0; face < 6; face++)
+            {
+                culledStrategy.PrepareForView(rootNode, *m_CubemapView.GetChildView(engine::ViewType::PLANAR, face));
+                culledItems += drainItems(culledStrategy);
+            }
+        }
+        auto strategyEnd = clock::now();
+
+        for (int iteration = 0; iteration < iterations; iteration++)
+        {
+            culledInstances = 0;
+            for (int face = 0; face < 6; face++)
+            {
+                const engine::IView* faceView = m_CubemapView.GetChildView(engine::ViewType::PLANAR, face);
+                culler.Cull(CullingFrustum::FromViewProjection(faceView->GetViewProjectionMatrix()), visibleInstances);
+                culledInstances += visibleInstances.size();
+            }
+        }
+        auto cullEnd = clock::now();
+
+        std::array<CullingFrustum, 6> faceFrustums;
+        for (int face = 0; face < 6; face++)
+        {
+            const engine::IView* faceView = m_CubemapView.GetChildView(engine::ViewType::PLANAR, face);
+            faceFrustums[face] = CullingFrustum::FromViewProjection(faceView->GetViewProjectionMatrix());
+        }
+
+        std::vector<uint32_t> viewMasks;
+        std::vector<std::vector<uint32_t>> visibleInstancesPerView;
+        size_t multiViewInstances = 0;
+
+        for (int iteration = 0; iteration < iterations; iteration++)
+        {
+            culler.CullViews(faceFrustums.data(), uint32_t(faceFrustums.size()), viewMasks);
+            InstanceCuller::GatherVisibleInstances(viewMasks, uint32_t(faceFrustums.size()), visibleInstancesPerView);
+
+            multiViewInstances = 0;
+            for (const auto& list : visibleInstancesPerView)
+                multiViewInstances += list.size();
+        }
+        auto multiViewEnd = clock::now();
+
+        auto averageMs = [iterations](clock::time_point begin, clock::time_point end)
+        {
+            return std::chrono::duration<double, std::milli>(end - begin).count() / double(iterations);
+        };
+
+        log::info("%s: %d instances, 6 cube faces per iteration", sceneName, int(culler.GetNumInstances()));
+        log::info("  scene graph traversal:  %8.3f ms, %d draw items", averageMs(start, traversalEnd), int(instancedItems));
+        log::info("  %-6s culler + items:   %8.3f ms, %d draw items", InstanceCuller::GetInstructionSetName(), averageMs(traversalEnd, strategyEnd), int(culledItems));
+        log::info("  %-6s culler only:      %8.3f ms, %d visible instances", InstanceCuller::GetInstructionSetName(), averageMs(strategyEnd, cullEnd), int(culledInstances));
+        log::info("  %-6s multi-view culler:%8.3f ms, %d visible instances", InstanceCuller::GetInstructionSetName(), averageMs(cullEnd, multiViewEnd), int(multiViewInstances));
+    }
+
+    // Measures the cost of drawing the occluders and of the occlusion tests for the cube faces, and the draw items they save
+    void BenchmarkOcclusion(int iterations)
+    {
+        using clock = std::chrono::high_resolution_clock;
+
+        auto drainItems = [](render::IDrawStrategy& strategy)
+        {
+            size_t numItems = 0;
+            while (strategy.GetNextItem())
+                numItems++;
+            return numItems;
+        };
+
+        std::array<CullingFrustum, 6> faceFrustums;
+        for (int face = 0; face < 6; face++)
+        {
+            const engine::IView* faceView = m_CubemapView.GetChildView(engine::ViewType::PLANAR, face);
+            faceFrustums[face] = CullingFrustum::FromViewProjection(faceView->GetViewProjectionMatrix());
+        }
+
+        std::vector<uint32_t> viewMasks;
+        std::vector<std::vector<uint32_t>> visibleInstances;
+        m_Culler.CullViews(faceFrustums.data(), uint32_t(faceFrustums.size()), viewMasks);
+        InstanceCuller::GatherVisibleInstances(viewMasks, uint32_t(faceFrustums.size()), visibleInstances);
+
+        OcclusionRasterizer rasterizer;
+        size_t frustumItems = 0;
+        size_t occlusionItems = 0;
+        size_t occluderTriangles = 0;
+        double rasterizeMs = 0.0;
+        double testMs = 0.0;
+
+        for (int iteration = 0; iteration < iterations; iteration++)
+        {
+            frustumItems = 0;
+            occlusionItems = 0;
+            occluderTriangles = 0;
+
+            for (int face = 0; face < 6; face++)
+            {
+                const engine::IView* faceView = m_CubemapView.GetChildView(engine::ViewType::PLANAR, face);
+                const std::shared_ptr<engine::SceneGraphNode>& rootNode = m_Scene->GetSceneGraph()->GetRootNode();
+
+                CulledOpaqueDrawStrategy frustumStrategy(m_Culler, &visibleInstances[face]);
+                frustumStrategy.PrepareForView(rootNode, *faceView);
+                frustumItems += drainItems(frustumStrategy);
+
+                auto start = clock::now();
+                rasterizer.Begin(faceView->GetViewProjectionMatrix(), faceView->IsReverseDepth());
+                rasterizer.DrawOccluders(m_Occluders);
+                auto rasterizeEnd = clock::now();
+
+                CulledOpaqueDrawStrategy occlusionStrategy(m_Culler, &visibleInstances[face], &rasterizer);
+                occlusionStrategy.PrepareForView(rootNode, *faceView);
+                auto testEnd = clock::now();
+
+                occlusionItems += drainItems(occlusionStrategy);
+                occluderTriangles += rasterizer.GetStatistics().numTriangles;
+                rasterizeMs += std::chrono::duration<double, std::milli>(rasterizeEnd - start).count();
+                testMs += std::chrono::duration<double, std::milli>(testEnd - rasterizeEnd).count();
+            }
+        }
+
+        log::info("Occlusion culling: %d occluder triangles, %dx%d buffer, 6 cube faces per iteration",
+            int(m_Occluders.GetNumTriangles()), int(OcclusionRasterizer::c_Width), int(OcclusionRasterizer::c_Height));
+        log::info("  %-6s occluder rasterization: %8.3f ms, %d triangles after clipping", InstanceCuller::GetInstructionSetName(), rasterizeMs / iterations, int(occluderTriangles));
+        log::info("  occlusion tests + items:       %8.3f ms", testMs / iterations);
+        log::info("  draw items: %d with frustum culling, %d with occlusion culling", int(frustumItems), int(occlusionItems));
+    }
+
+    // Measures the CPU cost of culling the cube faces with the scene graph traversal and with the SIMD culler
+    void RunCullingBenchmark(int iterations)
+    {
+        m_CubemapView.SetTransform(m_Camera.GetWorldToViewMatrix(), 0.1f, 100.f);
+        m_CubemapView.UpdateCache();
+
+        BenchmarkCulling("Sponza", m_Scene->GetSceneGraph()->GetRootNode(), m_Culler, iterations);
+
+        if (m_Occluders.GetNumTriangles() != 0)
+            BenchmarkOcclusion(std::max(iterations / 10, 1));
+
+        std::shared_ptr<engine::SceneGraph> syntheticScene = CreateSyntheticScene(100000);
+        InstanceCuller syntheticCuller;
+        syntheticCuller.Build(*syntheticScene);
+
+        BenchmarkCulling("Synthetic", syntheticScene->GetRootNode(), syntheticCuller, std::max(iterations / 10, 1));
+    }
+
     void Render(nvrhi::IFramebuffer* framebuffer) override
     {
         dm::affine viewMatrix = m_Camera.GetWorldToViewMatrix();
         m_CubemapView.SetTransform(viewMatrix, 0.1f, 100.f);
         m_CubemapView.UpdateCache();
 
+        if (m_UseCuller)
+        {
+            CullViews();
+        }
+
         tf::Taskflow taskFlow;
         if (m_UseThreads)
         {
@@ -301,6 +600,15 @@ int main(int __argc, const char** __argv)
         return 1;
     }
 
+    bool cullingBenchmark = false;
+    for (int i = 1; i < __argc; i++)
+    {
+        if (strcmp(__argv[i], "-cullingBenchmark") == 0)
+        {
+            cullingBenchmark = true;
+        }
+    }
+
     app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
 
     app::DeviceCreationParameters deviceParams;
@@ -321,9 +629,16 @@ int main(int __argc, const char** __argv)
         ThreadedRendering example(deviceManager);
         if (example.Init())
         {
-            deviceManager->AddRenderPassToBack(&example);
-            deviceManager->RunMessageLoop();
-            deviceManager->RemoveRenderPass(&example);
+            if (cullingBenchmark)
+            {
+                example.RunCullingBenchmark(1000);
+            }
+            else
+            {
+                deviceManager->AddRenderPassToBack(&example);
+                deviceManager->RunMessageLoop();
+                deviceManager->RemoveRenderPass(&example);
+            }
         }
     }
     
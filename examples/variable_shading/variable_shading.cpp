@@ -25,6 +25,7 @@
 #include <donut/render/TemporalAntiAliasingPass.h>
 #include <donut/render/DrawStrategy.h>
 #include <donut/app/ApplicationBase.h>
+#include <donut/app/imgui_renderer.h>
 #include <donut/app/Camera.h>
 #include <donut/engine/ShaderFactory.h>
 #include <donut/engine/CommonRenderPasses.h>
@@ -43,6 +44,9 @@ using namespace donut;
 using namespace donut::math;
 
 #include "lighting_cb.h"
+#include "PassProfiler.h"
+#include "PersistentDrawStrategy.h"
+#include "RadixSortDrawStrategy.h"
 
 static const char* g_WindowTitle = "Donut Example: Variable Rate Shading";
 
@@ -165,7 +169,12 @@ private:
     engine::PlanarView m_View;
     std::shared_ptr<engine::DirectionalLight>  m_SunLight;
     std::unique_ptr<render::InstancedOpaqueDrawStrategy> m_OpaqueDrawStrategy;
+    PersistentDrawList m_PersistentDrawList;
+    std::unique_ptr<PersistentOpaqueDrawStrategy> m_PersistentOpaqueDrawStrategy;
+    bool m_UsePersistentDrawList = true;
     std::unique_ptr<render::TransparentDrawStrategy> m_TransparentDrawStrategy;
+    std::unique_ptr<RadixSortTransparentDrawStrategy> m_RadixSortTransparentDrawStrategy;
+    bool m_UseRadixSort = true;
     std::unique_ptr<engine::BindingCache> m_BindingCache;
 
     nvrhi::ShaderHandle m_shadingRateSurfaceShader;
@@ -180,12 +189,16 @@ private:
 
     bool m_UseRawD3D12 = false;
 
+    std::unique_ptr<PassProfiler> m_Profiler;
+    std::filesystem::path m_ProfileDumpFile = "variable_shading_profile.json";
+
 public:
     using ApplicationBase::ApplicationBase;
 
-    bool Init(bool useRawD3D12)
+    bool Init(bool useRawD3D12, const std::filesystem::path& profileDumpFile)
     {
         m_UseRawD3D12 = useRawD3D12;
+        m_ProfileDumpFile = profileDumpFile;
 
         std::filesystem::path sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Models/2.0/Sponza/glTF/Sponza.gltf";
         std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
@@ -212,7 +225,9 @@ public:
         BeginLoadingScene(nativeFS, sceneFileName);
 
         m_OpaqueDrawStrategy = std::make_unique<render::InstancedOpaqueDrawStrategy>();
+        m_PersistentOpaqueDrawStrategy = std::make_unique<PersistentOpaqueDrawStrategy>(m_PersistentDrawList);
         m_TransparentDrawStrategy = std::make_unique<render::TransparentDrawStrategy>();
+        m_RadixSortTransparentDrawStrategy = std::make_unique<RadixSortTransparentDrawStrategy>();
 
         m_SunLight = std::make_shared<engine::DirectionalLight>();
         m_Scene->GetSceneGraph()->AttachLeafNode(m_Scene->GetSceneGraph()->GetRootNode(), m_SunLight);
@@ -229,6 +244,8 @@ public:
         m_ConstantBuffer = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(LightingConstants), "LightingConstants", engine::c_MaxRenderPassConstantBufferVersions));
 
         m_CommandList = GetDevice()->createCommandList();
+
+        m_Profiler = std::make_unique<PassProfiler>(GetDevice());
         
 #ifdef DONUT_WITH_DX12
         // Query VRS tile size (it can vary depending on hardware)
@@ -265,9 +282,69 @@ public:
         return false;
     }
 
+    std::shared_ptr<engine::ShaderFactory> GetShaderFactory() const
+    {
+        return m_ShaderFactory;
+    }
+
+    PassProfiler& GetProfiler() const
+    {
+        return *m_Profiler;
+    }
+
+    const PersistentDrawList& GetPersistentDrawList() const
+    {
+        return m_PersistentDrawList;
+    }
+
+    const PersistentOpaqueDrawStrategy& GetPersistentDrawStrategy() const
+    {
+        return *m_PersistentOpaqueDrawStrategy;
+    }
+
+    bool IsPersistentDrawListEnabled() const
+    {
+        return m_UsePersistentDrawList;
+    }
+
+    void SetPersistentDrawListEnabled(bool enabled)
+    {
+        m_UsePersistentDrawList = enabled;
+    }
+
+    const RadixSortTransparentDrawStrategy& GetRadixSortDrawStrategy() const
+    {
+        return *m_RadixSortTransparentDrawStrategy;
+    }
+
+    bool IsRadixSortEnabled() const
+    {
+        return m_UseRadixSort;
+    }
+
+    void SetRadixSortEnabled(bool enabled)
+    {
+        m_UseRadixSort = enabled;
+    }
+
+    bool DumpProfile() const
+    {
+        if (!m_Profiler->WriteJSON(m_ProfileDumpFile))
+            return false;
+
+        log::info("Pass timings written to '%s'", m_ProfileDumpFile.generic_string().c_str());
+        return true;
+    }
+
     bool KeyboardUpdate(int key, int scancode, int action, int mods) override
     {
         m_Camera.KeyboardUpdate(key, scancode, action, mods);
+
+        if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        {
+            DumpProfile();
+        }
+
         return true;
     }
 
@@ -390,22 +467,32 @@ public:
             m_Pipeline = GetDevice()->createComputePipeline(psoDesc);
         }
 
+        m_Profiler->BeginFrame();
+
         m_CommandList->open();
 
         if (m_PreviousViewsValid)
         {
+            ProfilerScope scope(*m_Profiler, m_CommandList, "Motion Vectors");
             m_temporalPass->RenderMotionVectors(m_CommandList, m_View, m_ViewPrevious);
         }
 
-        nvrhi::ComputeState state;
-        state.pipeline = m_Pipeline;
-        state.bindings = { m_bindingSet };
-        m_CommandList->setComputeState(state);
+        {
+            ProfilerScope scope(*m_Profiler, m_CommandList, "Shading Rate Surface");
 
-        // Dispatch call to generate the VRS surface
-        m_CommandList->dispatch(surfaceDimensions.x, surfaceDimensions.y, 1);
+            nvrhi::ComputeState state;
+            state.pipeline = m_Pipeline;
+            state.bindings = { m_bindingSet };
+            m_CommandList->setComputeState(state);
 
-        m_RenderTargets->Clear(m_CommandList);
+            // Dispatch call to generate the VRS surface
+            m_CommandList->dispatch(surfaceDimensions.x, surfaceDimensions.y, 1);
+        }
+
+        {
+            ProfilerScope scope(*m_Profiler, m_CommandList, "Clear");
+            m_RenderTargets->Clear(m_CommandList);
+        }
 
         LightingConstants constants = {};
         constants.ambientColor = float4(0.2f);
@@ -451,9 +538,33 @@ public:
 
         // Forward pass to draw the scene with the VRS surface set above
         render::ForwardShadingPass::Context forwardContext;
-        m_ForwardPass->PrepareLights(forwardContext, m_CommandList, m_Scene->GetSceneGraph()->GetLights(), constants.ambientColor, constants.ambientColor, {});
-        render::RenderCompositeView(m_CommandList, &m_View, &m_View, *m_RenderTargets->m_HdrFramebufferDepth, m_Scene->GetSceneGraph()->GetRootNode(), *m_OpaqueDrawStrategy, *m_ForwardPass, forwardContext);
-        render::RenderCompositeView(m_CommandList, &m_View, &m_View, *m_RenderTargets->m_HdrFramebufferDepth, m_Scene->GetSceneGraph()->GetRootNode(), *m_TransparentDrawStrategy, *m_ForwardPass, forwardContext);
+        {
+            ProfilerScope scope(*m_Profiler, m_CommandList, "Forward Opaque");
+            m_ForwardPass->PrepareLights(forwardContext, m_CommandList, m_Scene->GetSceneGraph()->GetLights(), constants.ambientColor, constants.ambientColor, {});
+
+            render::IDrawStrategy* opaqueStrategy = m_OpaqueDrawStrategy.get();
+            if (m_UsePersistentDrawList)
+            {
+                m_PersistentDrawList.Update(*m_Scene->GetSceneGraph());
+                opaqueStrategy = m_PersistentOpaqueDrawStrategy.get();
+            }
+
+            render::RenderCompositeView(m_CommandList, &m_View, &m_View, *m_RenderTargets->m_HdrFramebufferDepth, m_Scene->GetSceneGraph()->GetRootNode(), *opaqueStrategy, *m_ForwardPass, forwardContext);
+        }
+        {
+            ProfilerScope scope(*m_Profiler, m_CommandList, "Forward Transparent");
+
+            // The radix sort strategy keeps its order until the next BeginFrame, so any other pass
+            // over the transparent geometry of this view in the same frame would reuse it
+            render::IDrawStrategy* transparentStrategy = m_TransparentDrawStrategy.get();
+            if (m_UseRadixSort)
+            {
+                m_RadixSortTransparentDrawStrategy->BeginFrame(*m_Scene->GetSceneGraph());
+                transparentStrategy = m_RadixSortTransparentDrawStrategy.get();
+            }
+
+            render::RenderCompositeView(m_CommandList, &m_View, &m_View, *m_RenderTargets->m_HdrFramebufferDepth, m_Scene->GetSceneGraph()->GetRootNode(), *transparentStrategy, *m_ForwardPass, forwardContext);
+        }
 
 #ifdef DONUT_WITH_DX12
         if (m_UseRawD3D12)
@@ -484,20 +595,71 @@ public:
 
         // TAA pass (runs at full rate)
         {
+            ProfilerScope scope(*m_Profiler, m_CommandList, "TAA");
+
             render::TemporalAntiAliasingParameters params = {};
             m_temporalPass->TemporalResolve(m_CommandList, params, m_PreviousViewsValid, m_View, m_View);
             m_ViewPrevious = m_View;
             m_PreviousViewsValid = true;
         }
 
-        m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTargets->m_ResolvedColor, m_BindingCache.get());
+        {
+            ProfilerScope scope(*m_Profiler, m_CommandList, "Blit");
+            m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTargets->m_ResolvedColor, m_BindingCache.get());
+        }
 
         m_CommandList->close();
         GetDevice()->executeCommandList(m_CommandList);
+
+        m_Profiler->EndFrame();
     }
 
 };
 
+class UIRenderer : public app::ImGui_Renderer
+{
+private:
+    VariableRateShading& m_App;
+    std::vector<PassProfiler::PassStats> m_Stats;
+
+public:
+    UIRenderer(app::DeviceManager* deviceManager, VariableRateShading& app)
+        : ImGui_Renderer(deviceManager)
+        , m_App(app)
+    {
+    }
+
+protected:
+    void buildUI() override
+    {
+        ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), 0);
+        ImGui::Begin("Pass Timings", 0, ImGuiWindowFlags_AlwaysAutoResize);
+
+        if (DrawPassProfilerTable(m_App.GetProfiler(), m_Stats))
+            m_App.DumpProfile();
+
+        ImGui::Separator();
+
+        bool persistentDrawList = m_App.IsPersistentDrawListEnabled();
+        if (ImGui::Checkbox("Persistent opaque draw list", &persistentDrawList))
+            m_App.SetPersistentDrawListEnabled(persistentDrawList);
+
+        const auto& drawListStats = m_App.GetPersistentDrawList().GetStatistics();
+        ImGui::Text("Draw items: %u, visible: %u", drawListStats.numItems, m_App.GetPersistentDrawStrategy().GetNumVisibleItems());
+        ImGui::Text("Cache hits: %llu, re-sorts: %llu", (unsigned long long)drawListStats.cacheHits, (unsigned long long)drawListStats.resorts);
+
+        bool radixSort = m_App.IsRadixSortEnabled();
+        if (ImGui::Checkbox("Radix sorted transparency", &radixSort))
+            m_App.SetRadixSortEnabled(radixSort);
+
+        const auto& radixSortStats = m_App.GetRadixSortDrawStrategy().GetStatistics();
+        ImGui::Text("Transparent items: %u, sorts: %llu, reused: %llu", radixSortStats.numItems, (unsigned long long)radixSortStats.sorts, (unsigned long long)radixSortStats.reuses);
+        ImGui::Text("Transparent cache hits: %llu, rebuilds: %llu", (unsigned long long)radixSortStats.cacheHits, (unsigned long long)radixSortStats.rebuilds);
+
+        ImGui::End();
+    }
+};
+
 #ifdef WIN32
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 #else
@@ -513,15 +675,26 @@ int main(int __argc, const char** __argv)
 
     // if d3d12 is selected and -raw flag is on, use raw d3d12 API path
     bool rawD3D12 = false;
-#ifdef DONUT_WITH_DX12
+    std::filesystem::path profileDumpFile = "variable_shading_profile.json";
     for (int i = 1; i < __argc; i++)
     {
+#ifdef DONUT_WITH_DX12
         if (!strcmp(__argv[i], "-raw"))
         {
             rawD3D12 = (api == nvrhi::GraphicsAPI::D3D12);
         }
-    }
 #endif
+        if (!strcmp(__argv[i], "-profileDump") && i + 1 < __argc)
+        {
+            profileDumpFile = __argv[++i];
+        }
+        if (!strcmp(__argv[i], "-sortBenchmark"))
+        {
+            // CPU only, no device needed
+            RunTransparentSortBenchmark();
+            return 0;
+        }
+    }
 
     app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
 
@@ -545,10 +718,13 @@ int main(int __argc, const char** __argv)
 
     {
         VariableRateShading example(deviceManager);
-        if (example.Init(rawD3D12))
+        UIRenderer gui(deviceManager, example);
+        if (example.Init(rawD3D12, profileDumpFile) && gui.Init(example.GetShaderFactory()))
         {
             deviceManager->AddRenderPassToBack(&example);
+            deviceManager->AddRenderPassToBack(&gui);
             deviceManager->RunMessageLoop();
+            deviceManager->RemoveRenderPass(&gui);
             deviceManager->RemoveRenderPass(&example);
         }
     }
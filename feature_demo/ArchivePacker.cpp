@@ -0,0 +1,234 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+// Command line tool that packs directories into an archive for PackedFileSystem.
+// Every directory is stored under the given folder of the archive, for example
+//     feature_demo_packer -lz4 ../feature_demo.pak media=../media shaders/donut=shaders/framework/dxil
+// packs the media tree and the framework shaders for D3D12 into one file that FeatureDemo loads with -archive.
+
+#include "PackedArchive.h"
+#include "Lz4.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct InputFile
+{
+    std::string archiveName;
+    std::filesystem::path nativePath;
+};
+
+// Entries are only compressed when that saves at least 1/8 of their size, other files stay readable in place
+static bool ShouldKeepCompressed(uint64_t size, uint64_t compressedSize)
+{
+    return compressedSize < size - size / 8;
+}
+
+static bool ReadWholeFile(const std::filesystem::path& fileName, std::vector<uint8_t>& data)
+{
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+
+    data.resize(size_t(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()));
+
+    return file.good() || data.empty();
+}
+
+static void PadTo(std::ofstream& output, uint64_t& offset, uint64_t alignment)
+{
+    static const char zeros[c_PackedArchiveAlignment] = {};
+    const uint64_t padding = (alignment - offset % alignment) % alignment;
+    output.write(zeros, std::streamsize(padding));
+    offset += padding;
+}
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: feature_demo_packer [-lz4] <archive> <folder in archive>=<directory> [...]\n");
+}
+
+int main(int argc, const char* const* argv)
+{
+    bool compress = false;
+    std::filesystem::path archiveFileName;
+    std::vector<std::pair<std::string, std::filesystem::path>> inputs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-lz4"))
+        {
+            compress = true;
+        }
+        else if (archiveFileName.empty())
+        {
+            archiveFileName = argv[i];
+        }
+        else
+        {
+            const std::string argument = argv[i];
+            const size_t separator = argument.find('=');
+            if (separator == std::string::npos)
+            {
+                PrintUsage();
+                return 1;
+            }
+
+            inputs.push_back(std::make_pair(PackedFileSystem::GetArchiveName(argument.substr(0, separator)), std::filesystem::path(argument.substr(separator + 1))));
+        }
+    }
+
+    if (archiveFileName.empty() || inputs.empty())
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<InputFile> files;
+    for (const auto& [folder, directory] : inputs)
+    {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, error))
+        {
+            if (!entry.is_regular_file())
+                continue;
+
+            InputFile file;
+            file.archiveName = PackedFileSystem::GetArchiveName(std::filesystem::path(folder) / entry.path().lexically_relative(directory));
+            file.nativePath = entry.path();
+            files.push_back(file);
+        }
+
+        if (error)
+        {
+            fprintf(stderr, "Cannot read the directory '%s': %s\n", directory.generic_string().c_str(), error.message().c_str());
+            return 1;
+        }
+    }
+
+    // The table of contents is searched with a binary search at runtime
+    std::sort(files.begin(), files.end(), [](const InputFile& a, const InputFile& b) { return a.archiveName < b.archiveName; });
+
+    for (size_t index = 1; index < files.size(); index++)
+    {
+        if (files[index].archiveName == files[index - 1].archiveName)
+        {
+            fprintf(stderr, "'%s' is packed from both '%s' and '%s'\n", files[index].archiveName.c_str(),
+                files[index - 1].nativePath.generic_string().c_str(), files[index].nativePath.generic_string().c_str());
+            return 1;
+        }
+    }
+
+    std::ofstream output(archiveFileName, std::ios::binary);
+    if (!output.is_open())
+    {
+        fprintf(stderr, "Cannot open '%s' for writing\n", archiveFileName.generic_string().c_str());
+        return 1;
+    }
+
+    // The header is written again at the end, when the offsets are known
+    PackedArchiveHeader header{};
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t offset = sizeof(header);
+
+    std::vector<PackedArchiveEntry> entries;
+    std::string names;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> compressedData;
+    uint64_t totalSize = 0;
+    uint64_t totalStoredSize = 0;
+    int numCompressed = 0;
+
+    for (const InputFile& file : files)
+    {
+        if (!ReadWholeFile(file.nativePath, data))
+        {
+            fprintf(stderr, "Cannot read '%s'\n", file.nativePath.generic_string().c_str());
+            return 1;
+        }
+
+        PackedArchiveEntry entry{};
+        entry.nameOffset = uint32_t(names.size());
+        entry.nameLength = uint32_t(file.archiveName.size());
+        entry.size = data.size();
+        names += file.archiveName;
+
+        const uint8_t* storedData = data.data();
+        entry.storedSize = data.size();
+
+        if (compress && !data.empty())
+        {
+            compressedData.resize(Lz4CompressBound(data.size()));
+            const size_t compressedSize = Lz4Compress(data.data(), data.size(), compressedData.data(), compressedData.size());
+
+            if (compressedSize > 0 && ShouldKeepCompressed(data.size(), compressedSize))
+            {
+                entry.flags |= PackedArchiveEntry_Lz4;
+                storedData = compressedData.data();
+                entry.storedSize = compressedSize;
+                numCompressed++;
+            }
+        }
+
+        PadTo(output, offset, c_PackedArchiveAlignment);
+        entry.dataOffset = offset;
+        output.write(reinterpret_cast<const char*>(storedData), std::streamsize(entry.storedSize));
+        offset += entry.storedSize;
+
+        totalSize += entry.size;
+        totalStoredSize += entry.storedSize;
+        entries.push_back(entry);
+    }
+
+    header.magic = c_PackedArchiveMagic;
+    header.version = c_PackedArchiveVersion;
+    header.numEntries = uint32_t(entries.size());
+
+    header.namesOffset = offset;
+    header.namesSize = names.size();
+    output.write(names.data(), std::streamsize(names.size()));
+    offset += names.size();
+
+    PadTo(output, offset, c_PackedArchiveAlignment);
+    header.entriesOffset = offset;
+    output.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(PackedArchiveEntry)));
+
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (!output.good())
+    {
+        fprintf(stderr, "Cannot write '%s'\n", archiveFileName.generic_string().c_str());
+        return 1;
+    }
+
+    printf("Packed %d files into '%s': %.1f MB, %.1f MB stored, %d files compressed\n", int(entries.size()),
+        archiveFileName.generic_string().c_str(), double(totalSize) / (1024.0 * 1024.0), double(totalStoredSize) / (1024.0 * 1024.0), numCompressed);
+
+    return 0;
+}
@@ -0,0 +1,729 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "BcEncoder.h"
+#include "SimdFloat.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+constexpr uint32_t c_BlockPixels = 16;
+
+// Rows of blocks that one encoding task processes
+constexpr uint32_t c_BlockRowsPerTask = 8;
+
+// Interpolation weights of the 4-bit BC7 indices, in 64ths
+static const uint8_t c_Bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// BC1 index of each position along the segment from color 0 to color 1
+static const uint8_t c_Bc1IndexOrder[4] = { 0, 2, 3, 1 };
+
+// Pixels of one block with one array per channel, so that the loops over the pixels map to SIMD lanes
+struct BlockPixels
+{
+    alignas(32) float channels[4][c_BlockPixels];
+};
+
+// Collects the bits of a 128-bit block from the least significant bit up
+struct BlockBitWriter
+{
+    uint64_t bits[2] = {};
+    uint32_t position = 0;
+
+    void Write(uint32_t value, uint32_t count)
+    {
+        for (uint32_t bit = 0; bit < count; bit++, position++)
+        {
+            if ((value >> bit) & 1)
+                bits[position >> 6] |= uint64_t(1) << (position & 63);
+        }
+    }
+};
+
+static uint32_t ReadBits(const uint64_t bits[2], uint32_t& position, uint32_t count)
+{
+    uint32_t value = 0;
+    for (uint32_t bit = 0; bit < count; bit++, position++)
+        value |= uint32_t((bits[position >> 6] >> (position & 63)) & 1) << bit;
+    return value;
+}
+
+static void LoadBlock(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, BlockPixels& block)
+{
+    for (uint32_t y = 0; y < 4; y++)
+    {
+        const uint32_t sourceY = std::min(blockY * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; x++)
+        {
+            const uint32_t sourceX = std::min(blockX * 4 + x, width - 1);
+            const uint8_t* pixel = pixels + (size_t(sourceY) * width + sourceX) * 4;
+            for (uint32_t channel = 0; channel < 4; channel++)
+                block.channels[channel][y * 4 + x] = float(pixel[channel]);
+        }
+    }
+}
+
+// Mean of the first numChannels channels and the direction of their largest variance, found with power iteration
+static void FitPrincipalAxis(const BlockPixels& block, int numChannels, float mean[4], float axis[4])
+{
+    float minimum[4], maximum[4];
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        float sum = 0.f;
+        minimum[channel] = FLT_MAX;
+        maximum[channel] = -FLT_MAX;
+        for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+        {
+            const float value = block.channels[channel][pixel];
+            sum += value;
+            minimum[channel] = std::min(minimum[channel], value);
+            maximum[channel] = std::max(maximum[channel], value);
+        }
+        mean[channel] = sum / float(c_BlockPixels);
+    }
+
+    float covariance[4][4] = {};
+    for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+    {
+        float delta[4];
+        for (int channel = 0; channel < numChannels; channel++)
+            delta[channel] = block.channels[channel][pixel] - mean[channel];
+
+        for (int row = 0; row < numChannels; row++)
+            for (int column = row; column < numChannels; column++)
+                covariance[row][column] += delta[row] * delta[column];
+    }
+
+    for (int row = 0; row < numChannels; row++)
+        for (int column = 0; column < row; column++)
+            covariance[row][column] = covariance[column][row];
+
+    // The diagonal of the bounding box is a good start, it only fails for anti-correlated channels
+    float vector[4];
+    for (int channel = 0; channel < numChannels; channel++)
+        vector[channel] = maximum[channel] - minimum[channel];
+
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float product[4] = {};
+        float largest = 0.f;
+        for (int row = 0; row < numChannels; row++)
+        {
+            for (int column = 0; column < numChannels; column++)
+                product[row] += covariance[row][column] * vector[column];
+            largest = std::max(largest, fabsf(product[row]));
+        }
+
+        if (largest == 0.f)
+            break;
+
+        for (int channel = 0; channel < numChannels; channel++)
+            vector[channel] = product[channel] / largest;
+    }
+
+    float lengthSquared = 0.f;
+    for (int channel = 0; channel < numChannels; channel++)
+        lengthSquared += vector[channel] * vector[channel];
+
+    const float scale = lengthSquared > 0.f ? 1.f / sqrtf(lengthSquared) : 0.f;
+    for (int channel = 0; channel < numChannels; channel++)
+        axis[channel] = vector[channel] * scale;
+}
+
+// Places the endpoints at the extreme projections of the pixels onto the axis through the mean
+static void FitEndpoints(const BlockPixels& block, int numChannels, float e0[4], float e1[4])
+{
+    float mean[4], axis[4];
+    FitPrincipalAxis(block, numChannels, mean, axis);
+
+    float minimum = FLT_MAX, maximum = -FLT_MAX;
+    for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+    {
+        float t = 0.f;
+        for (int channel = 0; channel < numChannels; channel++)
+            t += (block.channels[channel][pixel] - mean[channel]) * axis[channel];
+        minimum = std::min(minimum, t);
+        maximum = std::max(maximum, t);
+    }
+
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        e0[channel] = std::clamp(mean[channel] + axis[channel] * minimum, 0.f, 255.f);
+        e1[channel] = std::clamp(mean[channel] + axis[channel] * maximum, 0.f, 255.f);
+    }
+}
+
+// Projects the pixels onto the segment between the endpoints and rounds to the nearest of numSteps + 1 evenly spaced positions
+static void SelectIndices(const BlockPixels& block, int numChannels, const float e0[4], const float e1[4], int numSteps, uint8_t indices[c_BlockPixels])
+{
+    float direction[4];
+    float lengthSquared = 0.f;
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        direction[channel] = e1[channel] - e0[channel];
+        lengthSquared += direction[channel] * direction[channel];
+    }
+
+    if (lengthSquared == 0.f)
+    {
+        memset(indices, 0, c_BlockPixels);
+        return;
+    }
+
+    const float scale = float(numSteps) / lengthSquared;
+    alignas(32) float positions[c_BlockPixels];
+
+    for (uint32_t base = 0; base < c_BlockPixels; base += uint32_t(c_SimdWidth))
+    {
+        SimdFloat t = SimdSet(0.5f);
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            const SimdFloat offset = SimdSub(SimdLoad(&block.channels[channel][base]), SimdSet(e0[channel]));
+            t = SimdMulAdd(offset, SimdSet(direction[channel] * scale), t);
+        }
+
+        t = SimdMin(SimdMax(t, SimdSet(0.f)), SimdSet(float(numSteps)));
+        SimdStore(&positions[base], t);
+    }
+
+    // Truncating t + 0.5 rounds to the nearest position
+    for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+        indices[pixel] = uint8_t(positions[pixel]);
+}
+
+static float BlockError(const BlockPixels& block, int numChannels, const float palette[][4], const uint8_t indices[c_BlockPixels])
+{
+    alignas(32) float reconstructed[4][c_BlockPixels];
+    for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+        for (int channel = 0; channel < numChannels; channel++)
+            reconstructed[channel][pixel] = palette[indices[pixel]][channel];
+
+    SimdFloat sum = SimdSet(0.f);
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        for (uint32_t base = 0; base < c_BlockPixels; base += uint32_t(c_SimdWidth))
+        {
+            const SimdFloat delta = SimdSub(SimdLoad(&block.channels[channel][base]), SimdLoad(&reconstructed[channel][base]));
+            sum = SimdMulAdd(delta, delta, sum);
+        }
+    }
+
+    alignas(32) float lanes[c_SimdWidth];
+    SimdStore(lanes, sum);
+
+    float error = 0.f;
+    for (float lane : lanes)
+        error += lane;
+    return error;
+}
+
+// Least squares endpoints for the interpolation weights of the pixels. Returns false when all weights are the same.
+static bool RefitEndpoints(const BlockPixels& block, int numChannels, const float weights[c_BlockPixels], float e0[4], float e1[4])
+{
+    float aa = 0.f, ab = 0.f, bb = 0.f;
+    float ax[4] = {}, bx[4] = {};
+
+    for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+    {
+        const float b = weights[pixel];
+        const float a = 1.f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            ax[channel] += a * block.channels[channel][pixel];
+            bx[channel] += b * block.channels[channel][pixel];
+        }
+    }
+
+    const float determinant = aa * bb - ab * ab;
+    if (fabsf(determinant) < 1e-6f)
+        return false;
+
+    const float inverse = 1.f / determinant;
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        e0[channel] = std::clamp((ax[channel] * bb - bx[channel] * ab) * inverse, 0.f, 255.f);
+        e1[channel] = std::clamp((bx[channel] * aa - ax[channel] * ab) * inverse, 0.f, 255.f);
+    }
+
+    return true;
+}
+
+static uint16_t QuantizeRgb565(const float color[4])
+{
+    const uint32_t r = uint32_t(lroundf(color[0] * (31.f / 255.f)));
+    const uint32_t g = uint32_t(lroundf(color[1] * (63.f / 255.f)));
+    const uint32_t b = uint32_t(lroundf(color[2] * (31.f / 255.f)));
+    return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void ExpandRgb565(uint16_t value, uint32_t color[3])
+{
+    const uint32_t r = value >> 11;
+    const uint32_t g = (value >> 5) & 63;
+    const uint32_t b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 color block in the 4-color mode, also the color part of BC3
+static void EncodeColorBlock(const BlockPixels& block, uint8_t* output)
+{
+    float e0[4], e1[4];
+    FitEndpoints(block, 3, e0, e1);
+
+    uint64_t bestBits = 0;
+    float bestError = FLT_MAX;
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        uint16_t color0 = QuantizeRgb565(e0);
+        uint16_t color1 = QuantizeRgb565(e1);
+        // The 4-color mode is selected by color0 > color1, the positions are measured from color0
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        uint32_t expanded0[3], expanded1[3];
+        ExpandRgb565(color0, expanded0);
+        ExpandRgb565(color1, expanded1);
+
+        // Palette in the order of the positions along the segment
+        float palette[4][4];
+        for (int channel = 0; channel < 3; channel++)
+        {
+            palette[0][channel] = float(expanded0[channel]);
+            palette[1][channel] = float((2 * expanded0[channel] + expanded1[channel]) / 3);
+            palette[2][channel] = float((expanded0[channel] + 2 * expanded1[channel]) / 3);
+            palette[3][channel] = float(expanded1[channel]);
+        }
+
+        uint8_t positions[c_BlockPixels];
+        if (color0 == color1)
+            memset(positions, 0, sizeof(positions));
+        else
+            SelectIndices(block, 3, palette[0], palette[3], 3, positions);
+
+        const float error = BlockError(block, 3, palette, positions);
+        if (error < bestError)
+        {
+            bestError = error;
+            bestBits = uint64_t(color0) | (uint64_t(color1) << 16);
+            for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+                bestBits |= uint64_t(c_Bc1IndexOrder[positions[pixel]]) << (32 + pixel * 2);
+        }
+
+        if (attempt == 0)
+        {
+            float weights[c_BlockPixels];
+            for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+                weights[pixel] = float(positions[pixel]) / 3.f;
+
+            if (!RefitEndpoints(block, 3, weights, e0, e1))
+                break;
+        }
+    }
+
+    memcpy(output, &bestBits, sizeof(bestBits));
+}
+
+// BC4 block in the 8-value mode, also the alpha part of BC3 and each channel of BC5
+static void EncodeSingleChannelBlock(const float values[c_BlockPixels], uint8_t* output)
+{
+    float minimum = 255.f, maximum = 0.f;
+    for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+    {
+        minimum = std::min(minimum, values[pixel]);
+        maximum = std::max(maximum, values[pixel]);
+    }
+
+    const uint32_t value0 = uint32_t(lroundf(maximum));
+    const uint32_t value1 = uint32_t(lroundf(minimum));
+    uint64_t bits = uint64_t(value0) | (uint64_t(value1) << 8);
+
+    if (value0 > value1)
+    {
+        const float scale = 7.f / float(value0 - value1);
+        for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+        {
+            // Position 0 is value1 and position 7 is value0, indices 2 to 7 interpolate from value0 down
+            const int position = std::clamp(int((values[pixel] - float(value1)) * scale + 0.5f), 0, 7);
+            const uint32_t index = position == 7 ? 0 : position == 0 ? 1 : uint32_t(8 - position);
+            bits |= uint64_t(index) << (16 + pixel * 3);
+        }
+    }
+
+    memcpy(output, &bits, sizeof(bits));
+}
+
+// Rounds an endpoint to 7 bits per channel and the p-bit that is shared by its channels, whichever p-bit is closer
+static void QuantizeBc7Endpoint(const float endpoint[4], uint32_t quantized[4], uint32_t& pBit, float expanded[4])
+{
+    float bestError = FLT_MAX;
+    for (uint32_t candidate = 0; candidate < 2; candidate++)
+    {
+        uint32_t values[4];
+        float error = 0.f;
+        for (int channel = 0; channel < 4; channel++)
+        {
+            values[channel] = uint32_t(std::clamp(lroundf((endpoint[channel] - float(candidate)) * 0.5f), 0l, 127l));
+            const float delta = float(values[channel] * 2 + candidate) - endpoint[channel];
+            error += delta * delta;
+        }
+
+        if (error < bestError)
+        {
+            bestError = error;
+            pBit = candidate;
+            for (int channel = 0; channel < 4; channel++)
+            {
+                quantized[channel] = values[channel];
+                expanded[channel] = float(values[channel] * 2 + candidate);
+            }
+        }
+    }
+}
+
+// BC7 mode 6
+static void EncodeBc7Block(const BlockPixels& block, uint8_t* output)
+{
+    float e0[4], e1[4];
+    FitEndpoints(block, 4, e0, e1);
+
+    uint32_t bestEndpoints[2][4] = {};
+    uint32_t bestPBits[2] = {};
+    uint8_t bestIndices[c_BlockPixels] = {};
+    float bestError = FLT_MAX;
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        uint32_t quantized[2][4], pBits[2];
+        float expanded[2][4];
+        QuantizeBc7Endpoint(e0, quantized[0], pBits[0], expanded[0]);
+        QuantizeBc7Endpoint(e1, quantized[1], pBits[1], expanded[1]);
+
+        uint8_t indices[c_BlockPixels];
+        SelectIndices(block, 4, expanded[0], expanded[1], 15, indices);
+
+        float palette[16][4];
+        for (int index = 0; index < 16; index++)
+        {
+            const uint32_t weight = c_Bc7Weights[index];
+            for (int channel = 0; channel < 4; channel++)
+                palette[index][channel] = float(((64 - weight) * uint32_t(expanded[0][channel]) + weight * uint32_t(expanded[1][channel]) + 32) >> 6);
+        }
+
+        const float error = BlockError(block, 4, palette, indices);
+        if (error < bestError)
+        {
+            bestError = error;
+            memcpy(bestEndpoints, quantized, sizeof(bestEndpoints));
+            memcpy(bestPBits, pBits, sizeof(bestPBits));
+            memcpy(bestIndices, indices, sizeof(bestIndices));
+        }
+
+        if (attempt == 0)
+        {
+            float weights[c_BlockPixels];
+            for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+                weights[pixel] = float(c_Bc7Weights[indices[pixel]]) / 64.f;
+
+            if (!RefitEndpoints(block, 4, weights, e0, e1))
+                break;
+        }
+    }
+
+    // The most significant bit of the first index is implied to be 0, the endpoints are swapped to make it so
+    if (bestIndices[0] >= 8)
+    {
+        std::swap(bestEndpoints[0], bestEndpoints[1]);
+        std::swap(bestPBits[0], bestPBits[1]);
+        for (uint8_t& index : bestIndices)
+            index = uint8_t(15 - index);
+    }
+
+    BlockBitWriter writer;
+    writer.Write(1 << 6, 7);
+    for (int channel = 0; channel < 4; channel++)
+    {
+        writer.Write(bestEndpoints[0][channel], 7);
+        writer.Write(bestEndpoints[1][channel], 7);
+    }
+    writer.Write(bestPBits[0], 1);
+    writer.Write(bestPBits[1], 1);
+    writer.Write(bestIndices[0], 3);
+    for (uint32_t pixel = 1; pixel < c_BlockPixels; pixel++)
+        writer.Write(bestIndices[pixel], 4);
+
+    memcpy(output, writer.bits, sizeof(writer.bits));
+}
+
+static void EncodeBlock(BcFormat format, const BlockPixels& block, uint8_t* output)
+{
+    switch (format)
+    {
+    case BcFormat::BC1:
+        EncodeColorBlock(block, output);
+        break;
+    case BcFormat::BC3:
+        EncodeSingleChannelBlock(block.channels[3], output);
+        EncodeColorBlock(block, output + 8);
+        break;
+    case BcFormat::BC5:
+        EncodeSingleChannelBlock(block.channels[0], output);
+        EncodeSingleChannelBlock(block.channels[1], output + 8);
+        break;
+    case BcFormat::BC7:
+        EncodeBc7Block(block, output);
+        break;
+    }
+}
+
+static void DecodeColorBlock(const uint8_t* input, uint8_t pixels[c_BlockPixels][4])
+{
+    uint64_t bits;
+    memcpy(&bits, input, sizeof(bits));
+
+    const uint16_t color0 = uint16_t(bits);
+    const uint16_t color1 = uint16_t(bits >> 16);
+
+    uint32_t palette[4][4];
+    ExpandRgb565(color0, palette[0]);
+    ExpandRgb565(color1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = color0 > color1 ? 255 : 0;
+
+    for (int channel = 0; channel < 3; channel++)
+    {
+        if (color0 > color1)
+        {
+            palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+            palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+        }
+        else
+        {
+            palette[2][channel] = (palette[0][channel] + palette[1][channel]) / 2;
+            palette[3][channel] = 0;
+        }
+    }
+
+    for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+    {
+        const uint32_t index = uint32_t(bits >> (32 + pixel * 2)) & 3;
+        for (int channel = 0; channel < 4; channel++)
+            pixels[pixel][channel] = uint8_t(palette[index][channel]);
+    }
+}
+
+static void DecodeSingleChannelBlock(const uint8_t* input, uint8_t pixels[c_BlockPixels][4], int channel)
+{
+    uint64_t bits;
+    memcpy(&bits, input, sizeof(bits));
+
+    uint32_t palette[8];
+    palette[0] = uint32_t(bits & 0xff);
+    palette[1] = uint32_t((bits >> 8) & 0xff);
+    if (palette[0] > palette[1])
+    {
+        for (uint32_t index = 2; index < 8; index++)
+            palette[index] = ((8 - index) * palette[0] + (index - 1) * palette[1]) / 7;
+    }
+    else
+    {
+        for (uint32_t index = 2; index < 6; index++)
+            palette[index] = ((6 - index) * palette[0] + (index - 1) * palette[1]) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+        pixels[pixel][channel] = uint8_t(palette[(bits >> (16 + pixel * 3)) & 7]);
+}
+
+// Only mode 6 is decoded, blocks in other modes come out black
+static void DecodeBc7Block(const uint8_t* input, uint8_t pixels[c_BlockPixels][4])
+{
+    uint64_t bits[2];
+    memcpy(bits, input, sizeof(bits));
+
+    memset(pixels, 0, c_BlockPixels * 4);
+    if ((bits[0] & 0x7f) != 0x40)
+        return;
+
+    uint32_t position = 7;
+    uint32_t endpoints[2][4];
+    for (int channel = 0; channel < 4; channel++)
+    {
+        endpoints[0][channel] = ReadBits(bits, position, 7) << 1;
+        endpoints[1][channel] = ReadBits(bits, position, 7) << 1;
+    }
+
+    const uint32_t pBit0 = ReadBits(bits, position, 1);
+    const uint32_t pBit1 = ReadBits(bits, position, 1);
+    for (int channel = 0; channel < 4; channel++)
+    {
+        endpoints[0][channel] |= pBit0;
+        endpoints[1][channel] |= pBit1;
+    }
+
+    for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+    {
+        const uint32_t index = ReadBits(bits, position, pixel == 0 ? 3 : 4);
+        const uint32_t weight = c_Bc7Weights[index];
+        for (int channel = 0; channel < 4; channel++)
+            pixels[pixel][channel] = uint8_t(((64 - weight) * endpoints[0][channel] + weight * endpoints[1][channel] + 32) >> 6);
+    }
+}
+
+static void EncodeBlockRows(BcFormat format, const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t* output,
+    uint32_t firstRow, uint32_t lastRow)
+{
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t bytesPerBlock = GetBcBytesPerBlock(format);
+
+    BlockPixels block;
+    for (uint32_t blockY = firstRow; blockY < lastRow; blockY++)
+    {
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+        {
+            LoadBlock(pixels, width, height, blockX, blockY, block);
+            EncodeBlock(format, block, output + (size_t(blockY) * blocksX + blockX) * bytesPerBlock);
+        }
+    }
+}
+
+const char* GetBcFormatName(BcFormat format)
+{
+    switch (format)
+    {
+    case BcFormat::BC1: return "BC1";
+    case BcFormat::BC3: return "BC3";
+    case BcFormat::BC5: return "BC5";
+    case BcFormat::BC7: return "BC7";
+    }
+    return "";
+}
+
+uint32_t GetBcBytesPerBlock(BcFormat format)
+{
+    return format == BcFormat::BC1 ? 8 : 16;
+}
+
+uint32_t GetBcDxgiFormat(BcFormat format)
+{
+    switch (format)
+    {
+    case BcFormat::BC1: return 71; // DXGI_FORMAT_BC1_UNORM
+    case BcFormat::BC3: return 77; // DXGI_FORMAT_BC3_UNORM
+    case BcFormat::BC5: return 83; // DXGI_FORMAT_BC5_UNORM
+    case BcFormat::BC7: return 98; // DXGI_FORMAT_BC7_UNORM
+    }
+    return 0;
+}
+
+size_t GetBcImageSize(BcFormat format, uint32_t width, uint32_t height)
+{
+    return size_t((width + 3) / 4) * size_t((height + 3) / 4) * GetBcBytesPerBlock(format);
+}
+
+void EncodeBcImage(BcFormat format, const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t* output, tf::Executor* executor)
+{
+    const uint32_t blocksY = (height + 3) / 4;
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && blocksY > c_BlockRowsPerTask)
+    {
+        tf::Taskflow taskFlow;
+        for (uint32_t firstRow = 0; firstRow < blocksY; firstRow += c_BlockRowsPerTask)
+        {
+            const uint32_t lastRow = std::min(firstRow + c_BlockRowsPerTask, blocksY);
+            taskFlow.emplace([=]()
+            {
+                EncodeBlockRows(format, pixels, width, height, output, firstRow, lastRow);
+            });
+        }
+
+        executor->run(taskFlow).wait();
+        return;
+    }
+#endif
+
+    EncodeBlockRows(format, pixels, width, height, output, 0, blocksY);
+}
+
+void DecodeBcImage(BcFormat format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* pixels)
+{
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    const uint32_t bytesPerBlock = GetBcBytesPerBlock(format);
+
+    for (uint32_t blockY = 0; blockY < blocksY; blockY++)
+    {
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+        {
+            const uint8_t* input = blocks + (size_t(blockY) * blocksX + blockX) * bytesPerBlock;
+            uint8_t decoded[c_BlockPixels][4];
+
+            switch (format)
+            {
+            case BcFormat::BC1:
+                DecodeColorBlock(input, decoded);
+                break;
+            case BcFormat::BC3:
+                DecodeColorBlock(input + 8, decoded);
+                DecodeSingleChannelBlock(input, decoded, 3);
+                break;
+            case BcFormat::BC5:
+                for (uint32_t pixel = 0; pixel < c_BlockPixels; pixel++)
+                {
+                    decoded[pixel][2] = 0;
+                    decoded[pixel][3] = 255;
+                }
+                DecodeSingleChannelBlock(input, decoded, 0);
+                DecodeSingleChannelBlock(input + 8, decoded, 1);
+                break;
+            case BcFormat::BC7:
+                DecodeBc7Block(input, decoded);
+                break;
+            }
+
+            for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++)
+            {
+                for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++)
+                    memcpy(pixels + (size_t(blockY * 4 + y) * width + blockX * 4 + x) * 4, decoded[y * 4 + x], 4);
+            }
+        }
+    }
+}
+
+const char* GetBcEncoderInstructionSetName()
+{
+    return GetSimdInstructionSetName();
+}
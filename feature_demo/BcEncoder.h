@@ -0,0 +1,59 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tf
+{
+    class Executor;
+}
+
+// CPU encoders for the block compressed formats. Every encoder fits the endpoints along the principal axis
+// of the block, selects the indices by projecting the pixels onto the quantized endpoints, and refits the
+// endpoints to the indices with least squares once, keeping the better of the two results.
+// BC7 blocks are always written in mode 6: one subset, RGBA endpoints with 7 bits and a p-bit, 4-bit indices.
+enum class BcFormat
+{
+    BC1,    // RGB, opaque
+    BC3,    // RGBA, BC1 color with a BC4 alpha block
+    BC5,    // RG, two BC4 blocks
+    BC7     // RGBA
+};
+
+const char* GetBcFormatName(BcFormat format);
+uint32_t GetBcBytesPerBlock(BcFormat format);
+uint32_t GetBcDxgiFormat(BcFormat format);
+size_t GetBcImageSize(BcFormat format, uint32_t width, uint32_t height);
+
+// Encodes an RGBA8 image with tightly packed rows. Edge blocks of sizes that are not a multiple of 4 repeat
+// the last row and column. With an executor, rows of blocks are encoded in parallel.
+void EncodeBcImage(BcFormat format, const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t* output, tf::Executor* executor);
+
+// Decodes the blocks that EncodeBcImage writes back to RGBA8, for measuring the error.
+// Channels that the format does not store are set to 0 for RG and to 255 for alpha.
+void DecodeBcImage(BcFormat format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* pixels);
+
+// "AVX", "SSE" or "Scalar", depending on the instruction set the encoders were compiled for
+const char* GetBcEncoderInstructionSetName();
@@ -20,6 +20,9 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <cassert>
+#include <array>
 #include <string>
 #include <vector>
 #include <memory>
@@ -62,6 +65,21 @@
 #include <taskflow/taskflow.hpp>
 #endif
 
+#include "Benchmark.h"
+#include "InstanceCuller.h"
+#include "LoadTimingFileSystem.h"
+#include "MappedFileSystem.h"
+#include "OcclusionRasterizer.h"
+#include "PackedArchive.h"
+#include "PassProfiler.h"
+#include "PersistentDrawStrategy.h"
+#include "RadixSortDrawStrategy.h"
+#include "SceneCache.h"
+#include "TextureBudget.h"
+#include "TextureStreamer.h"
+#include "TextureTranscoder.h"
+#include "TransientResourcePool.h"
+
 using namespace donut;
 using namespace donut::math;
 using namespace donut::app;
@@ -69,8 +87,41 @@ using namespace donut::vfs;
 using namespace donut::engine;
 using namespace donut::render;
 
+constexpr int c_NumShadowCascades = 4;
+
+// Opaque geometries that are at least 2 meters wide along two axes hide the instances behind them
+constexpr float c_MinOccluderSize = 2.f;
+constexpr size_t c_MaxOccluderTriangles = 16384;
+
 static bool g_PrintSceneGraph = false;
 static bool g_PrintFormats = false;
+static bool g_Headless = false;
+static std::filesystem::path g_ProfileDumpFile = "feature_demo_profile.json";
+static bool g_UseSceneCache = true;
+static bool g_BakeSceneCache = false;
+static bool g_UseMappedFiles = true;
+static bool g_RunFileSystemBenchmark = false;
+static std::filesystem::path g_ArchiveFile;
+static bool g_StreamTextures = false;
+static bool g_TranscodeTextures = true;
+static bool g_RunTranscodingBenchmark = false;
+static int g_TextureMemoryBudgetMB = 2048;
+static bool g_AliasRenderTargets = true;
+
+// Passes of a frame in the order they are recorded, which bound the lifetimes of the render targets that share memory
+enum FramePass : uint32_t
+{
+    FramePass_Clear,
+    FramePass_Opaque,
+    FramePass_Ssao,
+    FramePass_DeferredLighting,
+    FramePass_MaterialID,
+    FramePass_Translucent,
+    FramePass_Resolve,
+    FramePass_Bloom,
+    FramePass_ToneMapping,
+    FramePass_Blit
+};
 
 class RenderTargets : public GBufferRenderTargets
 {
@@ -83,7 +134,7 @@ public:
     nvrhi::TextureHandle TemporalFeedback2;
     nvrhi::TextureHandle AmbientOcclusion;
 
-    nvrhi::HeapHandle Heap;
+    std::unique_ptr<TransientTexturePool> TexturePool;
 
     std::shared_ptr<FramebufferFactory> ForwardFramebuffer;
     std::shared_ptr<FramebufferFactory> HdrFramebuffer;
@@ -109,7 +160,8 @@ public:
         desc.sampleCount = sampleCount;
         desc.dimension = sampleCount > 1 ? nvrhi::TextureDimension::Texture2DMS : nvrhi::TextureDimension::Texture2D;
         desc.keepInitialState = true;
-        desc.isVirtual = device->queryFeatureSupport(nvrhi::Feature::VirtualResources);
+
+        TexturePool = std::make_unique<TransientTexturePool>(device, g_AliasRenderTargets);
 
         desc.clearValue = nvrhi::Color(0.f);
         desc.isTypeless = false;
@@ -117,12 +169,12 @@ public:
         desc.format = nvrhi::Format::RGBA16_FLOAT;
         desc.initialState = nvrhi::ResourceStates::RenderTarget;
         desc.debugName = "HdrColor";
-        HdrColor = device->createTexture(desc);
+        HdrColor = TexturePool->CreateTexture(desc, FramePass_Clear, FramePass_ToneMapping);
 
         desc.format = nvrhi::Format::RG16_UINT;
         desc.isUAV = false;
         desc.debugName = "MaterialIDs";
-        MaterialIDs = device->createTexture(desc);
+        MaterialIDs = TexturePool->CreateTexture(desc, FramePass_MaterialID, FramePass_MaterialID);
 
         // The render targets below this point are non-MSAA
         desc.sampleCount = 1;
@@ -131,61 +183,41 @@ public:
         desc.format = nvrhi::Format::RGBA16_FLOAT;
         desc.isUAV = true;
         desc.debugName = "ResolvedColor";
-        ResolvedColor = device->createTexture(desc);
+        ResolvedColor = TexturePool->CreateTexture(desc, FramePass_Resolve, FramePass_ToneMapping);
 
+        // The TAA history is read in the next frame
         desc.format = nvrhi::Format::RGBA16_SNORM;
         desc.debugName = "TemporalFeedback1";
-        TemporalFeedback1 = device->createTexture(desc);
+        TemporalFeedback1 = TexturePool->CreateTexture(desc, FramePass_Clear);
         desc.debugName = "TemporalFeedback2";
-        TemporalFeedback2 = device->createTexture(desc);
+        TemporalFeedback2 = TexturePool->CreateTexture(desc, FramePass_Clear);
 
         desc.format = nvrhi::Format::SRGBA8_UNORM;
         desc.isUAV = false;
         desc.debugName = "LdrColor";
-        LdrColor = device->createTexture(desc);
+        LdrColor = TexturePool->CreateTexture(desc, FramePass_ToneMapping, FramePass_Blit);
 
         desc.format = nvrhi::Format::R8_UNORM;
         desc.isUAV = true;
         desc.debugName = "AmbientOcclusion";
-        AmbientOcclusion = device->createTexture(desc);
-
-        if (desc.isVirtual)
-        {
-            uint64_t heapSize = 0;
-            nvrhi::ITexture* const textures[] = {
-                HdrColor,
-                MaterialIDs,
-                ResolvedColor,
-                TemporalFeedback1,
-                TemporalFeedback2,
-                LdrColor,
-                AmbientOcclusion
-            };
-
-            for (auto texture : textures)
-            {
-                nvrhi::MemoryRequirements memReq = device->getTextureMemoryRequirements(texture);
-                heapSize = nvrhi::align(heapSize, memReq.alignment);
-                heapSize += memReq.size;
-            }
-
-            nvrhi::HeapDesc heapDesc;
-            heapDesc.type = nvrhi::HeapType::DeviceLocal;
-            heapDesc.capacity = heapSize;
-            heapDesc.debugName = "RenderTargetHeap";
-
-            Heap = device->createHeap(heapDesc);
+        AmbientOcclusion = TexturePool->CreateTexture(desc, FramePass_Ssao, FramePass_DeferredLighting);
 
-            uint64_t offset = 0;
-            for (auto texture : textures)
-            {
-                nvrhi::MemoryRequirements memReq = device->getTextureMemoryRequirements(texture);
-                offset = nvrhi::align(offset, memReq.alignment);
+        // The GBuffer is only read up to the lighting pass, so the base class textures are replaced with ones in the pool.
+        // Depth and motion vectors are read until the temporal resolve and stay where they are.
+        nvrhi::TextureHandle* gbufferTextures[] = { &GBufferDiffuse, &GBufferSpecular, &GBufferNormals, &GBufferEmissive };
+        for (nvrhi::TextureHandle* texture : gbufferTextures)
+        {
+            nvrhi::TextureHandle pooledTexture = TexturePool->CreateTexture((*texture)->getDesc(), FramePass_Clear, FramePass_DeferredLighting);
+            std::replace(GBufferFramebuffer->RenderTargets.begin(), GBufferFramebuffer->RenderTargets.end(), *texture, pooledTexture);
+            *texture = pooledTexture;
+        }
 
-                device->bindTextureMemory(texture, Heap, offset);
+        TexturePool->Allocate("RenderTargetHeap");
 
-                offset += memReq.size;
-            }
+        if (TexturePool->GetHeapSize() != 0)
+        {
+            log::info("Render target heap: %.1f MB, %.1f MB saved by aliasing", double(TexturePool->GetHeapSize()) / double(1 << 20),
+                double(TexturePool->GetUnaliasedSize() - TexturePool->GetHeapSize()) / double(1 << 20));
         }
         
         ForwardFramebuffer = std::make_shared<FramebufferFactory>(device);
@@ -214,12 +246,19 @@ public:
         return false;
     }
 
+    // Starts FramePass_Clear, and clears all the targets whose lifetime starts with it
     void Clear(nvrhi::ICommandList* commandList) override
     {
         GBufferRenderTargets::Clear(commandList);
 
         commandList->clearTextureFloat(HdrColor, nvrhi::AllSubresources, nvrhi::Color(0.f));
     }
+
+    // Targets that share memory with others start their lifetime with undefined content, the pool clears the ones that start with the pass
+    void BeginPass(nvrhi::ICommandList* commandList, FramePass pass) const
+    {
+        TexturePool->BeginPass(commandList, pass);
+    }
 };
 
 enum class AntiAliasingMode
@@ -246,6 +285,7 @@ struct UIData
     enum TemporalAntiAliasingJitter     TemporalAntiAliasingJitter = TemporalAntiAliasingJitter::MSAA;
     bool                                EnableVsync = true;
     bool                                ShaderReoladRequested = false;
+    bool                                ProfileDumpRequested = false;
     bool                                EnableProceduralSky = true;
     bool                                EnableBloom = true;
     float                               BloomSigma = 32.f;
@@ -261,6 +301,13 @@ struct UIData
     bool                                DisplayShadowMap = false;
     bool                                UseThirdPersonCamera = false;
     bool                                EnableAnimations = false;
+    bool                                EnableParallelRecording = true;
+    bool                                UsePersistentDrawList = true;
+    bool                                UseRadixSort = true;
+    bool                                UseInstanceCuller = true;
+    bool                                UseOcclusionCulling = true;
+    int                                 TextureStreamingBudgetMB = 8;
+    int                                 TextureMemoryBudgetMB = g_TextureMemoryBudgetMB;
     std::shared_ptr<Material>           SelectedMaterial;
     std::shared_ptr<SceneGraphNode>     SelectedNode;
     std::string                         ScreenshotFileName;
@@ -273,6 +320,9 @@ private:
     typedef ApplicationBase Super;
 
     std::shared_ptr<RootFileSystem>     m_RootFs;
+    std::shared_ptr<LoadTimingFileSystem> m_LoadTimingFs;  // m_RootFs, timing the scene loading stages
+    std::filesystem::path               m_MediaPath;
+    bool                                m_MediaFromArchive = false;
 	std::vector<std::string>            m_SceneFilesAvailable;
     std::string                         m_CurrentSceneName;
 	std::shared_ptr<Scene>				m_Scene;
@@ -282,7 +332,21 @@ private:
     std::shared_ptr<FramebufferFactory> m_ShadowFramebuffer;
     std::shared_ptr<DepthPass>          m_ShadowDepthPass;
     std::shared_ptr<InstancedOpaqueDrawStrategy> m_OpaqueDrawStrategy;
+    std::array<std::shared_ptr<InstancedOpaqueDrawStrategy>, c_NumShadowCascades> m_ShadowDrawStrategies;
     std::shared_ptr<TransparentDrawStrategy> m_TransparentDrawStrategy;
+    PersistentDrawList                  m_OpaqueDrawList;
+    std::shared_ptr<PersistentOpaqueDrawStrategy> m_PersistentOpaqueDrawStrategy;
+    std::array<std::shared_ptr<PersistentOpaqueDrawStrategy>, c_NumShadowCascades> m_PersistentShadowDrawStrategies;
+    std::shared_ptr<RadixSortTransparentDrawStrategy> m_RadixSortTransparentDrawStrategy;
+    InstanceCuller                      m_InstanceCuller;
+    bool                                m_InstanceCullerDirty = true;
+    std::vector<uint32_t>               m_ViewMasks;
+    std::vector<std::vector<uint32_t>>  m_VisibleInstances;
+    std::shared_ptr<CulledOpaqueDrawStrategy> m_CulledOpaqueDrawStrategy;
+    std::array<std::shared_ptr<CulledOpaqueDrawStrategy>, c_NumShadowCascades> m_CulledShadowDrawStrategies;
+    OccluderMesh                        m_Occluders;
+    bool                                m_OccludersDirty = true;
+    std::array<OcclusionRasterizer, c_NumShadowCascades> m_CascadeOcclusion;
     std::unique_ptr<RenderTargets>      m_RenderTargets;
     std::shared_ptr<ForwardShadingPass> m_ForwardPass;
     std::unique_ptr<GBufferFillPass>    m_GBufferPass;
@@ -300,6 +364,16 @@ private:
     std::shared_ptr<IView>              m_ViewPrevious;
     
     nvrhi::CommandListHandle            m_CommandList;
+    std::unique_ptr<PassProfiler>       m_Profiler;
+
+#ifdef DONUT_WITH_TASKFLOW
+    std::unique_ptr<tf::Executor>       m_Executor;
+    // Deferred command lists for recording the frame on several threads, submitted in this order
+    nvrhi::CommandListHandle            m_SetupCommandList;
+    std::array<nvrhi::CommandListHandle, c_NumShadowCascades> m_CascadeCommandLists;
+    nvrhi::CommandListHandle            m_OpaqueCommandList;
+    nvrhi::CommandListHandle            m_TranslucentCommandList;
+#endif
     bool                                m_PreviousViewsValid = false;
     FirstPersonCamera                   m_FirstPersonCamera;
     ThirdPersonCamera                   m_ThirdPersonCamera;
@@ -316,6 +390,13 @@ private:
     nvrhi::TextureHandle                m_LightProbeSpecularTexture;
 
     float                               m_WallclockTime = 0.f;
+    std::chrono::high_resolution_clock::time_point m_SceneLoadStartTime;
+    uint32_t                            m_SceneFramesRendered = 0;
+    bool                                m_SceneCacheWritten = false;
+    std::unique_ptr<TextureStreamer>    m_TextureStreamer;
+    bool                                m_TextureStreamingLogged = false;
+    std::shared_ptr<TextureTranscoder>  m_TextureTranscoder;
+    std::unique_ptr<TextureBudget>      m_TextureBudget;
     
     UIData&                             m_ui;
 
@@ -326,16 +407,51 @@ public:
         , m_ui(ui)
         , m_BindingCache(deviceManager->GetDevice())
     { 
-        std::shared_ptr<NativeFileSystem> nativeFS = std::make_shared<NativeFileSystem>();
+        // Large glTF buffers and textures are mapped instead of copied into heap blobs
+        std::shared_ptr<IFileSystem> nativeFS;
+        if (g_UseMappedFiles)
+            nativeFS = std::make_shared<MappedFileSystem>();
+        else
+            nativeFS = std::make_shared<NativeFileSystem>();
 
-        std::filesystem::path mediaPath = app::GetDirectoryWithExecutable().parent_path() / "media";
+        m_MediaPath = app::GetDirectoryWithExecutable().parent_path() / "media";
         std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
         
+        // The media and the framework shaders can come from one packed archive, the folders that it does not have are read from disk
+        std::shared_ptr<PackedFileSystem> archiveFS;
+        if (!g_ArchiveFile.empty())
+        {
+            archiveFS = PackedFileSystem::Open(g_ArchiveFile);
+            if (archiveFS)
+                log::info("Mounted the archive '%s' with %d files", g_ArchiveFile.generic_string().c_str(), int(archiveFS->GetNumEntries()));
+        }
+
         m_RootFs = std::make_shared<RootFileSystem>();
-        m_RootFs->mount("/media", mediaPath);
-        m_RootFs->mount("/shaders/donut", frameworkShaderPath);
+
+        m_MediaFromArchive = archiveFS && archiveFS->folderExists("/media");
+        if (m_MediaFromArchive)
+            m_RootFs->mount("/media", std::make_shared<RelativeFileSystem>(archiveFS, "/media"));
+        else
+            m_RootFs->mount("/media", std::make_shared<RelativeFileSystem>(nativeFS, m_MediaPath));
+
+        if (archiveFS && archiveFS->folderExists("/shaders/donut"))
+            m_RootFs->mount("/shaders/donut", std::make_shared<RelativeFileSystem>(archiveFS, "/shaders/donut"));
+        else
+            m_RootFs->mount("/shaders/donut", frameworkShaderPath);
+
         m_RootFs->mount("/native", nativeFS);
 
+        // Block compressed copies of the scene textures, made on the first load of a scene
+        std::filesystem::path textureCachePath = app::GetDirectoryWithExecutable() / "texture_cache";
+        if (g_TranscodeTextures)
+        {
+            std::error_code error;
+            std::filesystem::create_directories(textureCachePath, error);
+            m_RootFs->mount("/texture_cache", std::make_shared<RelativeFileSystem>(nativeFS, textureCachePath));
+        }
+
+        m_LoadTimingFs = std::make_shared<LoadTimingFileSystem>(m_RootFs);
+
         std::filesystem::path scenePath = "/media/glTF-Sample-Models/2.0";
         m_SceneFilesAvailable = FindScenes(*m_RootFs, scenePath);
 
@@ -345,14 +461,30 @@ public:
                 "Please make sure that folder contains valid scene files.", scenePath.generic_string().c_str());
         }
         
-        m_TextureCache = std::make_shared<TextureCache>(GetDevice(), m_RootFs, nullptr);
+        m_TextureCache = std::make_shared<TextureCache>(GetDevice(), m_LoadTimingFs, nullptr);
+        m_TextureStreamer = std::make_unique<TextureStreamer>(GetDevice(), m_RootFs, m_TextureCache);
+        m_TextureBudget = std::make_unique<TextureBudget>(GetDevice(), m_TextureCache);
 
         m_ShaderFactory = std::make_shared<ShaderFactory>(GetDevice(), m_RootFs, "/shaders");
         m_CommonPasses = std::make_shared<CommonRenderPasses>(GetDevice(), m_ShaderFactory);
 
         m_OpaqueDrawStrategy = std::make_shared<InstancedOpaqueDrawStrategy>();
+        // The strategies keep the draw items of the current view, so every shadow cascade needs its own to be recorded in parallel
+        for (auto& strategy : m_ShadowDrawStrategies)
+            strategy = std::make_shared<InstancedOpaqueDrawStrategy>();
         m_TransparentDrawStrategy = std::make_shared<TransparentDrawStrategy>();
 
+        // The persistent strategies share one sorted list and only filter it per view
+        m_PersistentOpaqueDrawStrategy = std::make_shared<PersistentOpaqueDrawStrategy>(m_OpaqueDrawList);
+        for (auto& strategy : m_PersistentShadowDrawStrategies)
+            strategy = std::make_shared<PersistentOpaqueDrawStrategy>(m_OpaqueDrawList);
+        m_RadixSortTransparentDrawStrategy = std::make_shared<RadixSortTransparentDrawStrategy>();
+
+        // The culled strategies take the visible instances of the eyes and cascades from one InstanceCuller::CullViews sweep
+        m_CulledOpaqueDrawStrategy = std::make_shared<CulledOpaqueDrawStrategy>(m_InstanceCuller);
+        for (auto& strategy : m_CulledShadowDrawStrategies)
+            strategy = std::make_shared<CulledOpaqueDrawStrategy>(m_InstanceCuller);
+
 
         const nvrhi::Format shadowMapFormats[] = {
             nvrhi::Format::D24S8,
@@ -367,7 +499,7 @@ public:
         
         nvrhi::Format shadowMapFormat = nvrhi::utils::ChooseFormat(GetDevice(), shadowMapFeatures, shadowMapFormats, std::size(shadowMapFormats));
         
-        m_ShadowMap = std::make_shared<CascadedShadowMap>(GetDevice(), 2048, 4, 0, shadowMapFormat);
+        m_ShadowMap = std::make_shared<CascadedShadowMap>(GetDevice(), 2048, c_NumShadowCascades, 0, shadowMapFormat);
         m_ShadowMap->SetupProxyViews();
         
         m_ShadowFramebuffer = std::make_shared<FramebufferFactory>(GetDevice());
@@ -380,11 +512,39 @@ public:
         m_ShadowDepthPass->Init(*m_ShaderFactory, shadowDepthParams);
 
         m_CommandList = GetDevice()->createCommandList();
+        m_Profiler = std::make_unique<PassProfiler>(GetDevice());
+
+#ifdef DONUT_WITH_TASKFLOW
+        m_Executor = std::make_unique<tf::Executor>();
+
+        // D3D11 has no deferred command lists, the frame is always recorded serially there
+        if (GetDevice()->getGraphicsAPI() != nvrhi::GraphicsAPI::D3D11)
+        {
+            auto commandListParams = nvrhi::CommandListParameters()
+                .setEnableImmediateExecution(false);
+            m_SetupCommandList = GetDevice()->createCommandList(commandListParams);
+            for (auto& commandList : m_CascadeCommandLists)
+                commandList = GetDevice()->createCommandList(commandListParams);
+            m_OpaqueCommandList = GetDevice()->createCommandList(commandListParams);
+            m_TranslucentCommandList = GetDevice()->createCommandList(commandListParams);
+        }
+#endif
+
+        if (g_TranscodeTextures)
+        {
+#ifdef DONUT_WITH_TASKFLOW
+            tf::Executor* transcoderExecutor = m_Executor.get();
+#else
+            tf::Executor* transcoderExecutor = nullptr;
+#endif
+            m_TextureTranscoder = std::make_shared<TextureTranscoder>(m_RootFs, textureCachePath, "/texture_cache", transcoderExecutor);
+        }
 
         m_FirstPersonCamera.SetMoveSpeed(3.0f);
         m_ThirdPersonCamera.SetMoveSpeed(3.0f);
         
-        SetAsynchronousLoadingEnabled(true);
+        // The headless benchmark has no splash screen to show, so it loads the scene before the first frame
+        SetAsynchronousLoadingEnabled(!g_Headless);
 
         if (sceneName.empty())
             SetCurrentSceneName(app::FindPreferredScene(m_SceneFilesAvailable, "Sponza.gltf"));
@@ -421,7 +581,7 @@ public:
 
 		m_CurrentSceneName = sceneName;
 
-		BeginLoadingScene(m_RootFs, m_CurrentSceneName);
+		BeginLoadingScene(m_LoadTimingFs, m_CurrentSceneName);
     }
 
     void CopyActiveCameraToFirstPerson()
@@ -438,6 +598,33 @@ public:
         }
     }
 
+    void SetCameraPose(const float3& position, const float3& target)
+    {
+        m_ui.ActiveSceneCamera = nullptr;
+        m_ui.UseThirdPersonCamera = false;
+        m_FirstPersonCamera.LookAt(position, target);
+    }
+
+    PassProfiler& GetProfiler() const
+    {
+        return *m_Profiler;
+    }
+
+    bool DumpProfile() const
+    {
+        if (!m_Profiler->WriteJSON(g_ProfileDumpFile))
+            return false;
+
+        log::info("Pass timings written to '%s'", g_ProfileDumpFile.generic_string().c_str());
+        return true;
+    }
+
+    // Number of frames rendered with the current scene, as opposed to splash screen frames
+    uint32_t GetSceneFramesRendered() const
+    {
+        return m_SceneFramesRendered;
+    }
+
     virtual bool KeyboardUpdate(int key, int scancode, int action, int mods) override
     {
 		if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
@@ -458,6 +645,12 @@ public:
             return true;
         }
 
+        if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        {
+            m_ui.ProfileDumpRequested = true;
+            return true;
+        }
+
         if (key == GLFW_KEY_T && action == GLFW_PRESS)
         {
             CopyActiveCameraToFirstPerson();
@@ -538,6 +731,14 @@ public:
         if (m_LightProbePass) m_LightProbePass->ResetCaches();
         if (m_ShadowDepthPass) m_ShadowDepthPass->ResetBindingCache();
         m_BindingCache.Clear();
+        m_TextureStreamer->Clear();
+        m_TextureBudget->EndScene();
+        m_OpaqueDrawList.Clear();
+        m_RadixSortTransparentDrawStrategy->Clear();
+        m_InstanceCuller = InstanceCuller();
+        m_InstanceCullerDirty = true;
+        m_Occluders = OccluderMesh();
+        m_OccludersDirty = true;
         m_SunLight.reset();
         m_ui.SelectedMaterial = nullptr;
         m_ui.SelectedNode = nullptr;
@@ -552,24 +753,133 @@ public:
     {
         using namespace std::chrono;
 
-        Scene* scene = new Scene(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
+        // Baking needs the CPU side data that only the scene file loader produces
+        std::filesystem::path nativeFileName = GetNativeSceneFileName(fileName);
+        Scene* scene;
+        if (g_UseSceneCache && !g_BakeSceneCache && !nativeFileName.empty())
+        {
+            CachedScene* cachedScene = new CachedScene(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr,
+                GetSceneCacheFileName(nativeFileName));
+            // The scene is rendered with the mip tails of its textures while the streamer loads the rest
+            cachedScene->SetDeferTextureLoading(g_StreamTextures);
+            cachedScene->SetTextureTranscoder(m_TextureTranscoder);
+            scene = cachedScene;
+        }
+        else
+            scene = new Scene(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
+
+        if (m_TextureTranscoder)
+            m_TextureTranscoder->ResetStatistics();
+
+        m_LoadTimingFs->Reset();
 
         auto startTime = high_resolution_clock::now();
+        m_SceneLoadStartTime = startTime;
 
-        if (scene->Load(fileName))
+#ifdef DONUT_WITH_TASKFLOW
+        // The textures are decoded by tasks on the shared executor while the scene graph and the geometry are loaded
+        bool loaded = scene->LoadWithExecutor(fileName, m_Executor.get());
+        int numWorkers = int(m_Executor->num_workers());
+#else
+        bool loaded = scene->Load(fileName);
+        int numWorkers = 0;
+#endif
+
+        if (loaded)
         {
             m_Scene = std::unique_ptr<Scene>(scene);
 
+            auto geometryTime = high_resolution_clock::now();
+
+#ifdef DONUT_WITH_TASKFLOW
+            // Waits for the texture decoding tasks, including the ones for files that fail to load
+            m_Executor->wait_for_all();
+#endif
+
             auto endTime = high_resolution_clock::now();
-            auto duration = duration_cast<milliseconds>(endTime - startTime).count();
-            log::info("Scene loading time: %llu ms", duration);
+            auto toMilliseconds = [](high_resolution_clock::duration duration) { return duration_cast<milliseconds>(duration).count(); };
+            const CachedScene* cachedScene = dynamic_cast<const CachedScene*>(scene);
+            const bool loadedFromCache = cachedScene && cachedScene->IsLoadedFromCache();
+            log::info("Scene loading time: %llu ms%s", toMilliseconds(endTime - startTime), loadedFromCache ? " (from the scene cache)" : "");
+
+            // The glTF importer is not instrumented, so the only times inside it are the reads of its files.
+            // The spans are split at the first and last buffer file read, which is not where parsing, decoding
+            // and vertex packing start and end, and they overlap when the models of a scene are loaded in parallel.
+            const LoadTimingFileSystem::Span descriptionSpan = m_LoadTimingFs->GetSpan(LoadTimingFileSystem::Stage::Description);
+            const LoadTimingFileSystem::Span bufferSpan = m_LoadTimingFs->GetSpan(LoadTimingFileSystem::Stage::Buffers);
+            const LoadTimingFileSystem::Span textureSpan = m_LoadTimingFs->GetSpan(LoadTimingFileSystem::Stage::Textures);
+            if (descriptionSpan.numFiles != 0 && bufferSpan.numFiles != 0 && !loadedFromCache)
+            {
+                log::info("  file read spans: %llu ms before the first buffer read, %llu ms between the first and last buffer reads (%d files), %llu ms after the last one",
+                    toMilliseconds(bufferSpan.firstRead - startTime), toMilliseconds(bufferSpan.lastRead - bufferSpan.firstRead), int(bufferSpan.numFiles),
+                    toMilliseconds(geometryTime - bufferSpan.lastRead));
+            }
+            log::info("  scene graph and geometry: %llu ms", toMilliseconds(geometryTime - startTime));
+
+            const int requestedTextures = int(m_TextureCache->GetNumberOfRequestedTextures());
+            const int loadedTextures = int(m_TextureCache->GetNumberOfLoadedTextures());
+            log::info("  textures: %llu ms from the first texture read to the last decoded texture, %llu ms after the geometry (%d textures, %d failed, %d worker threads)",
+                textureSpan.numFiles != 0 ? toMilliseconds(endTime - textureSpan.firstRead) : 0ull, toMilliseconds(endTime - geometryTime),
+                requestedTextures, requestedTextures - loadedTextures, numWorkers);
+
+            if (m_TextureTranscoder && loadedFromCache)
+            {
+                const TextureTranscoder::Statistics& transcoderStats = m_TextureTranscoder->GetStatistics();
+                log::info("  block compressed textures: %d transcoded in %.1f s, %d from the texture cache, %d failed",
+                    int(transcoderStats.transcoded), transcoderStats.encodeSeconds, int(transcoderStats.cacheHits), int(transcoderStats.failed));
+            }
+
+            // The buffer groups still have their CPU data here, the GPU buffers are only created on the first refresh
+            if (g_BakeSceneCache && !nativeFileName.empty())
+                m_SceneCacheWritten = WriteSceneCache(*scene->GetSceneGraph(), GetSceneCacheFileName(nativeFileName), GetSceneSourceFiles(nativeFileName));
 
             return true;
         }
         
         return false;
     }
-    
+
+    // Maps a scene path in the root file system to a file on disk, or returns an empty path for other mount points
+    std::filesystem::path GetNativeSceneFileName(const std::filesystem::path& fileName) const
+    {
+        const std::string name = fileName.generic_string();
+
+        if (string_utils::starts_with(name, "/media/") && !m_MediaFromArchive)
+            return m_MediaPath / name.substr(strlen("/media/"));
+
+        if (string_utils::starts_with(name, "/native/"))
+            return name.substr(strlen("/native/"));
+
+        return std::filesystem::path();
+    }
+
+    // The files on disk that the scene was just loaded from, which the scene cache depends on
+    std::vector<std::filesystem::path> GetSceneSourceFiles(const std::filesystem::path& nativeSceneFileName) const
+    {
+        std::vector<std::filesystem::path> sourceFiles = { nativeSceneFileName };
+
+        for (const std::filesystem::path& fileName : m_LoadTimingFs->GetReadFiles())
+        {
+            std::filesystem::path nativeFileName = GetNativeSceneFileName(fileName);
+            if (!nativeFileName.empty() && nativeFileName != nativeSceneFileName)
+                sourceFiles.push_back(nativeFileName);
+        }
+
+        return sourceFiles;
+    }
+
+    static std::filesystem::path GetSceneCacheFileName(const std::filesystem::path& nativeSceneFileName)
+    {
+        std::filesystem::path cacheFileName = nativeSceneFileName;
+        cacheFileName += ".scenecache";
+        return cacheFileName;
+    }
+
+    bool IsSceneCacheWritten() const
+    {
+        return m_SceneCacheWritten;
+    }
+
     virtual void SceneLoaded() override
     {
         Super::SceneLoaded();
@@ -577,6 +887,7 @@ public:
         m_Scene->FinishedLoading(GetFrameIndex());
 
         m_WallclockTime = 0.f;
+        m_SceneFramesRendered = 0;
         m_PreviousViewsValid = false;
 
         for (auto light : m_Scene->GetSceneGraph()->GetLights())
@@ -624,6 +935,28 @@ public:
 
         CopyActiveCameraToFirstPerson();
 
+        const CachedScene* cachedScene = dynamic_cast<const CachedScene*>(m_Scene.get());
+        if (cachedScene && !cachedScene->GetDeferredTextures().empty())
+        {
+            m_CommandList->open();
+#ifdef DONUT_WITH_TASKFLOW
+            m_TextureStreamer->Init(*m_Scene->GetSceneGraph(), cachedScene->GetDeferredTextures(), m_CommandList, m_Executor.get());
+#else
+            m_TextureStreamer->Init(*m_Scene->GetSceneGraph(), cachedScene->GetDeferredTextures(), m_CommandList, nullptr);
+#endif
+            m_CommandList->close();
+            GetDevice()->executeCommandList(m_CommandList);
+        }
+        m_TextureStreamingLogged = false;
+
+        // The textures of earlier scenes stay in the cache until they exceed the budget
+        const std::vector<CachedScene::DeferredTexture> noStreamedTextures;
+#ifdef DONUT_WITH_TASKFLOW
+        m_TextureBudget->BeginScene(*m_Scene->GetSceneGraph(), cachedScene ? cachedScene->GetDeferredTextures() : noStreamedTextures, m_Executor.get());
+#else
+        m_TextureBudget->BeginScene(*m_Scene->GetSceneGraph(), cachedScene ? cachedScene->GetDeferredTextures() : noStreamedTextures, nullptr);
+#endif
+
         if (g_PrintSceneGraph)
             PrintSceneGraph(m_Scene->GetSceneGraph()->GetRootNode());
     }
@@ -653,6 +986,31 @@ public:
         return m_Scene;
     }
 
+    const TextureStreamer& GetTextureStreamer() const
+    {
+        return *m_TextureStreamer;
+    }
+
+    const TextureBudget& GetTextureBudget() const
+    {
+        return *m_TextureBudget;
+    }
+
+    const PersistentDrawList& GetOpaqueDrawList() const
+    {
+        return m_OpaqueDrawList;
+    }
+
+    const PersistentOpaqueDrawStrategy& GetPersistentOpaqueDrawStrategy() const
+    {
+        return *m_PersistentOpaqueDrawStrategy;
+    }
+
+    const RadixSortTransparentDrawStrategy& GetRadixSortTransparentDrawStrategy() const
+    {
+        return *m_RadixSortTransparentDrawStrategy;
+    }
+
     bool SetupView()
     {
         float2 renderTargetSize = float2(m_RenderTargets->GetSize());
@@ -826,13 +1184,30 @@ public:
 
     virtual void RenderScene(nvrhi::IFramebuffer* framebuffer) override
     {
-        int windowWidth, windowHeight;
-        GetDeviceManager()->GetWindowDimensions(windowWidth, windowHeight);
+        // Size everything after the framebuffer, which is an offscreen target in the headless benchmark
+        const nvrhi::FramebufferInfo& fbinfo = framebuffer->getFramebufferInfo();
+        int windowWidth = int(fbinfo.width);
+        int windowHeight = int(fbinfo.height);
         nvrhi::Viewport windowViewport = nvrhi::Viewport(float(windowWidth), float(windowHeight));
         nvrhi::Viewport renderViewport = windowViewport;
 
+        // Only structure changes collect the culled instances again, moving instances are culled with their new bounds.
+        // The persistent draw list and the radix sort strategy detect the changes that affect them by themselves.
+        if (m_Scene->GetSceneGraph()->HasPendingStructureChanges())
+        {
+            m_InstanceCullerDirty = true;
+            m_OccludersDirty = true;
+        }
+
         m_Scene->RefreshSceneGraph(GetFrameIndex());
 
+        if (m_ui.UsePersistentDrawList)
+            m_OpaqueDrawList.Update(*m_Scene->GetSceneGraph());
+
+        // The material ID and forward transparent passes draw the same view, so they share one sort
+        if (m_ui.UseRadixSort)
+            m_RadixSortTransparentDrawStrategy->BeginFrame(*m_Scene->GetSceneGraph());
+
         bool exposureResetRequired = false;
         
         {
@@ -879,12 +1254,9 @@ public:
             m_ui.ShaderReoladRequested = false;
         }
 
-        m_CommandList->open();
-
-        m_Scene->RefreshBuffers(m_CommandList, GetFrameIndex());
+        m_Profiler->BeginFrame();
 
         nvrhi::ITexture* framebufferTexture = framebuffer->getDesc().colorAttachments[0].texture;
-        m_CommandList->clearTextureFloat(framebufferTexture, nvrhi::AllSubresources, nvrhi::Color(0.f));
         
         m_AmbientTop = m_ui.AmbientIntensity * m_ui.SkyParams.skyColor * m_ui.SkyParams.brightness;
         m_AmbientBottom = m_ui.AmbientIntensity * m_ui.SkyParams.groundColor * m_ui.SkyParams.brightness;
@@ -900,26 +1272,15 @@ public:
 
             float zRange = length(sceneBounds.diagonal()) * 0.5f;
             m_ShadowMap->SetupForPlanarViewStable(*m_SunLight, projectionFrustum, viewMatrixInv, maxShadowDistance, zRange, zRange, m_ui.CsmExponent);
-
-            m_ShadowMap->Clear(m_CommandList);
-
-            DepthPass::Context context;
-
-            RenderCompositeView(m_CommandList, 
-                &m_ShadowMap->GetView(), nullptr, 
-                *m_ShadowFramebuffer,
-                m_Scene->GetSceneGraph()->GetRootNode(),
-                *m_OpaqueDrawStrategy, 
-                *m_ShadowDepthPass,
-                context,
-                "ShadowMap",
-                m_ui.EnableMaterialEvents);
         }
         else
         {
             m_SunLight->shadowMap = nullptr;
         }
 
+        if (m_ui.UseInstanceCuller)
+            CullMainViews();
+
         std::vector<std::shared_ptr<LightProbe>> lightProbes;
         if (m_ui.EnableLightProbe)
         {
@@ -934,227 +1295,556 @@ public:
             }
         }
 
-        m_RenderTargets->Clear(m_CommandList);
-
-        if (exposureResetRequired)
-            m_ToneMappingPass->ResetExposure(m_CommandList, 0.5f);
-
-        ForwardShadingPass::Context forwardContext;
-
-        if (!m_ui.UseDeferredShading || m_ui.EnableTranslucency)
-        {
-            m_ForwardPass->PrepareLights(forwardContext, m_CommandList, m_Scene->GetSceneGraph()->GetLights(), m_AmbientTop, m_AmbientBottom, lightProbes);
-        }
-
-        if (m_ui.UseDeferredShading)
+#ifdef DONUT_WITH_TASKFLOW
+        if (m_ui.EnableParallelRecording && m_SetupCommandList)
         {
-            GBufferFillPass::Context gbufferContext;
+            // The setup list refreshes the scene buffers that the other lists reference, so it is recorded before the tasks start
+            m_SetupCommandList->open();
+            RecordSetupCommands(m_SetupCommandList, framebufferTexture, exposureResetRequired);
+            m_SetupCommandList->close();
 
-            RenderCompositeView(m_CommandList,
-                m_View.get(), m_ViewPrevious.get(), 
-                *m_RenderTargets->GBufferFramebuffer, 
-                m_Scene->GetSceneGraph()->GetRootNode(),
-                *m_OpaqueDrawStrategy,
-                *m_GBufferPass,
-                gbufferContext,
-                "GBufferFill",
-                m_ui.EnableMaterialEvents);
+            tf::Taskflow taskFlow;
 
-            nvrhi::ITexture* ambientOcclusionTarget = nullptr;
-            if (m_ui.EnableSsao && m_SsaoPass)
+            for (int cascade = 0; cascade < c_NumShadowCascades; cascade++)
             {
-                m_SsaoPass->Render(m_CommandList, m_ui.SsaoParams, *m_View);
-                ambientOcclusionTarget = m_RenderTargets->AmbientOcclusion;
+                // Each cascade is a separate view over the shared scene graph, so the cascades are culled and recorded independently
+                taskFlow.emplace([this, cascade]()
+                {
+                    nvrhi::ICommandList* commandList = m_CascadeCommandLists[cascade];
+                    commandList->open();
+                    RecordShadowCascadeCommands(commandList, cascade);
+                    commandList->close();
+                });
             }
 
-            DeferredLightingPass::Inputs deferredInputs;
-            deferredInputs.SetGBuffer(*m_RenderTargets);
-            deferredInputs.ambientOcclusion = m_ui.EnableSsao ? m_RenderTargets->AmbientOcclusion : nullptr;
-            deferredInputs.ambientColorTop = m_AmbientTop;
-            deferredInputs.ambientColorBottom = m_AmbientBottom;
-            deferredInputs.lights = &m_Scene->GetSceneGraph()->GetLights();
-            deferredInputs.lightProbes = m_ui.EnableLightProbe ? &m_LightProbes : nullptr;
-            deferredInputs.output = m_RenderTargets->HdrColor;
+            tf::Task opaqueTask = taskFlow.emplace([this, &lightProbes]()
+            {
+                m_OpaqueCommandList->open();
+                RecordOpaqueCommands(m_OpaqueCommandList, lightProbes);
+                m_OpaqueCommandList->close();
+            });
+
+            tf::Task translucentTask = taskFlow.emplace([this, framebuffer, &lightProbes, &windowViewport, exposureResetRequired]()
+            {
+                m_TranslucentCommandList->open();
+                RecordTranslucentAndPostCommands(m_TranslucentCommandList, framebuffer, lightProbes, windowViewport, exposureResetRequired);
+                m_TranslucentCommandList->close();
+            });
+
+            // Forward shading uses the forward pass in both lists, and picking draws the transparent geometry
+            // with the same strategy as the translucent pass, so these cases record the two lists one after the other
+            if (!m_ui.UseDeferredShading || m_Pick)
+                opaqueTask.precede(translucentTask);
+
+            m_Executor->run(taskFlow).wait();
+
+            // Each list depends on the results of the lists before it
+            nvrhi::ICommandList* commandLists[] = {
+                m_SetupCommandList,
+                m_CascadeCommandLists[0],
+                m_CascadeCommandLists[1],
+                m_CascadeCommandLists[2],
+                m_CascadeCommandLists[3],
+                m_OpaqueCommandList,
+                m_TranslucentCommandList
+            };
 
-            m_DeferredLightingPass->Render(m_CommandList, *m_View, deferredInputs);
+            GetDevice()->executeCommandLists(commandLists, std::size(commandLists));
         }
         else
+#endif
         {
-            RenderCompositeView(m_CommandList,
-                m_View.get(), m_ViewPrevious.get(),
-                *m_RenderTargets->ForwardFramebuffer,
-                m_Scene->GetSceneGraph()->GetRootNode(),
-                *m_OpaqueDrawStrategy,
-                *m_ForwardPass,
-                forwardContext,
-                "ForwardOpaque",
-                m_ui.EnableMaterialEvents);
-        }
-
-        if(m_Pick)
-        {
-            m_CommandList->clearTextureUInt(m_RenderTargets->MaterialIDs, nvrhi::AllSubresources, 0xffff);
-
-            MaterialIDPass::Context materialIdContext;
+            m_CommandList->open();
 
-            RenderCompositeView(m_CommandList, 
-                m_View.get(), m_ViewPrevious.get(),
-                *m_RenderTargets->MaterialIDFramebuffer,
-                m_Scene->GetSceneGraph()->GetRootNode(),
-                *m_OpaqueDrawStrategy,
-                *m_MaterialIDPass,
-                materialIdContext,
-                "MaterialID");
-            
-            if (m_ui.EnableTranslucency)
-            {
-                RenderCompositeView(m_CommandList,
-                    m_View.get(), m_ViewPrevious.get(),
-                    *m_RenderTargets->MaterialIDFramebuffer,
-                    m_Scene->GetSceneGraph()->GetRootNode(),
-                    *m_TransparentDrawStrategy,
-                    *m_MaterialIDPass,
-                    materialIdContext,
-                    "MaterialID - Translucent");
-            }
+            RecordSetupCommands(m_CommandList, framebufferTexture, exposureResetRequired);
+            for (int cascade = 0; cascade < c_NumShadowCascades; cascade++)
+                RecordShadowCascadeCommands(m_CommandList, cascade);
+            RecordOpaqueCommands(m_CommandList, lightProbes);
+            RecordTranslucentAndPostCommands(m_CommandList, framebuffer, lightProbes, windowViewport, exposureResetRequired);
 
-            m_PixelReadbackPass->Capture(m_CommandList, m_PickPosition);
+            m_CommandList->close();
+            GetDevice()->executeCommandList(m_CommandList);
         }
 
-        if (m_ui.EnableProceduralSky)
-            m_SkyPass->Render(m_CommandList, *m_View, *m_SunLight, m_ui.SkyParams);
+        m_Profiler->EndFrame();
 
-        if (m_ui.EnableTranslucency)
+        if (m_ui.ProfileDumpRequested)
         {
-            RenderCompositeView(m_CommandList,
-                m_View.get(), m_ViewPrevious.get(),
-                *m_RenderTargets->ForwardFramebuffer,
-                m_Scene->GetSceneGraph()->GetRootNode(),
-                *m_TransparentDrawStrategy,
-                *m_ForwardPass,
-                forwardContext,
-                "ForwardTransparent",
-                m_ui.EnableMaterialEvents);
+            DumpProfile();
+            m_ui.ProfileDumpRequested = false;
         }
 
-        nvrhi::ITexture* finalHdrColor = m_RenderTargets->HdrColor;
-
-        if (m_ui.AntiAliasingMode == AntiAliasingMode::TEMPORAL)
+        if (!m_ui.ScreenshotFileName.empty())
         {
-            if (m_PreviousViewsValid)
-            {
-                m_TemporalAntiAliasingPass->RenderMotionVectors(m_CommandList, *m_View, *m_ViewPrevious);
-            }
+            SaveTextureToFile(GetDevice(), m_CommonPasses.get(), framebufferTexture, nvrhi::ResourceStates::RenderTarget, m_ui.ScreenshotFileName.c_str());
+            m_ui.ScreenshotFileName = "";
+        }
 
-            m_TemporalAntiAliasingPass->TemporalResolve(m_CommandList, m_ui.TemporalAntiAliasingParams, m_PreviousViewsValid, *m_View, *m_View);
+        if (m_Pick)
+        {
+            m_Pick = false;
+            GetDevice()->waitForIdle();
+            uint4 pixelValue = m_PixelReadbackPass->ReadUInts();
+            m_ui.SelectedMaterial = nullptr;
+            m_ui.SelectedNode = nullptr;
 
-            finalHdrColor = m_RenderTargets->ResolvedColor;
-            
-            if (m_ui.EnableBloom)
+            for (const auto& material : m_Scene->GetSceneGraph()->GetMaterials())
             {
-                m_BloomPass->Render(m_CommandList, m_RenderTargets->ResolvedFramebuffer, *m_View, m_RenderTargets->ResolvedColor, m_ui.BloomSigma, m_ui.BloomAlpha);
+                if (material->materialID == int(pixelValue.x))
+                {
+                    m_ui.SelectedMaterial = material;
+                    break;
+                }
             }
-            m_PreviousViewsValid = true;
-        }
-        else
-        {
-            std::shared_ptr<FramebufferFactory> finalHdrFramebuffer = m_RenderTargets->HdrFramebuffer;
 
-            if (m_RenderTargets->GetSampleCount() > 1)
+            for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
             {
-                m_CommandList->resolveTexture(m_RenderTargets->ResolvedColor, nvrhi::AllSubresources, m_RenderTargets->HdrColor, nvrhi::AllSubresources);
-                finalHdrColor = m_RenderTargets->ResolvedColor;
-                finalHdrFramebuffer = m_RenderTargets->ResolvedFramebuffer;
+                if (instance->GetInstanceIndex() == int(pixelValue.y))
+                {
+                    m_ui.SelectedNode = instance->GetNodeSharedPtr();
+                    break;
+                }
             }
 
-            if (m_ui.EnableBloom)
+            if (m_ui.SelectedNode)
             {
-                m_BloomPass->Render(m_CommandList, finalHdrFramebuffer, *m_View, finalHdrColor, m_ui.BloomSigma, m_ui.BloomAlpha);
+                log::info("Picked node: %s", m_ui.SelectedNode->GetPath().generic_string().c_str());
+                PointThirdPersonCameraAt(m_ui.SelectedNode);
+            }
+            else
+            {
+                PointThirdPersonCameraAt(m_Scene->GetSceneGraph()->GetRootNode());
             }
-
-            m_PreviousViewsValid = false;
         }
 
-        auto toneMappingParams = m_ui.ToneMappingParams;
-        if (exposureResetRequired)
+        m_TemporalAntiAliasingPass->AdvanceFrame();
+        std::swap(m_View, m_ViewPrevious);
+
+        if (m_SceneFramesRendered == 0)
         {
-            toneMappingParams.eyeAdaptationSpeedUp = 0.f;
-            toneMappingParams.eyeAdaptationSpeedDown = 0.f;
+            // Includes the texture uploads, which are spread over the splash screen frames after loading
+            using namespace std::chrono;
+            auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - m_SceneLoadStartTime).count();
+            log::info("  time to the first frame: %llu ms", duration);
         }
-        m_ToneMappingPass->SimpleRender(m_CommandList, toneMappingParams, *m_View, finalHdrColor);
-        
-        m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTargets->LdrColor, &m_BindingCache);
+        m_SceneFramesRendered++;
 
-        if (m_ui.DisplayShadowMap)
+        GetDeviceManager()->SetVsyncEnabled(m_ui.EnableVsync);
+    }
+
+    IDrawStrategy& GetOpaqueDrawStrategy()
+    {
+        if (m_ui.UseInstanceCuller)
+            return *m_CulledOpaqueDrawStrategy;
+
+        if (m_ui.UsePersistentDrawList)
+            return *m_PersistentOpaqueDrawStrategy;
+
+        return *m_OpaqueDrawStrategy;
+    }
+
+    IDrawStrategy& GetTransparentDrawStrategy()
+    {
+        if (m_ui.UseRadixSort)
+            return *m_RadixSortTransparentDrawStrategy;
+
+        return *m_TransparentDrawStrategy;
+    }
+
+    IDrawStrategy& GetShadowDrawStrategy(int cascade)
+    {
+        if (m_ui.UseInstanceCuller)
+            return *m_CulledShadowDrawStrategies[cascade];
+
+        if (m_ui.UsePersistentDrawList)
+            return *m_PersistentShadowDrawStrategies[cascade];
+
+        return *m_ShadowDrawStrategies[cascade];
+    }
+
+    // Collects the mesh instances again after structure changes, otherwise only reads their moved bounds.
+    // The occluders are world space triangles, so they are also collected again while animations move the scene.
+    void UpdateInstanceCuller()
+    {
+        if (m_InstanceCullerDirty)
+        {
+            m_InstanceCuller.Build(*m_Scene->GetSceneGraph());
+            m_InstanceCullerDirty = false;
+        }
+        else
+            m_InstanceCuller.UpdateBounds();
+
+        if (m_ui.UseOcclusionCulling && (m_OccludersDirty || m_ui.EnableAnimations))
+        {
+            m_Occluders.Build(*m_Scene->GetSceneGraph(), c_MinOccluderSize, c_MaxOccluderTriangles);
+            m_OccludersDirty = false;
+        }
+    }
+
+    bool IsOcclusionEnabled() const
+    {
+        return m_ui.UseInstanceCuller && m_ui.UseOcclusionCulling && m_Occluders.GetNumTriangles() != 0;
+    }
+
+    void RenderOccluders(OcclusionRasterizer& rasterizer, const IView& view)
+    {
+        rasterizer.Begin(view.GetViewProjectionMatrix(), view.IsReverseDepth());
+        rasterizer.DrawOccluders(m_Occluders);
+    }
+
+    // Culls the planar children of the given views in one sweep over the instance bounds,
+    // the visible instances of the N-th child are in visibleInstances[N]
+    void CullViews(const std::vector<const IView*>& views, std::vector<uint32_t>& viewMasks, std::vector<std::vector<uint32_t>>& visibleInstances)
+    {
+        std::vector<CullingFrustum> frustums;
+        for (const IView* view : views)
+        {
+            for (uint32_t index = 0; index < view->GetNumChildViews(ViewType::PLANAR); index++)
+                frustums.push_back(CullingFrustum::FromViewProjection(view->GetChildView(ViewType::PLANAR, index)->GetViewProjectionMatrix()));
+        }
+
+        assert(frustums.size() <= c_MaxCullingViews);
+
+        m_InstanceCuller.CullViews(frustums.data(), uint32_t(frustums.size()), viewMasks);
+        InstanceCuller::GatherVisibleInstances(viewMasks, uint32_t(frustums.size()), visibleInstances);
+    }
+
+    // Hands the visible instances of the child views to a strategy, starting at visibleInstances[firstList],
+    // and the occlusion rasterizers of the child views when there are any
+    static uint32_t SetCulledViews(CulledOpaqueDrawStrategy& strategy, const IView& view, const std::vector<std::vector<uint32_t>>& visibleInstances, uint32_t firstList,
+        OcclusionRasterizer* occlusion = nullptr)
+    {
+        strategy.ClearViews();
+
+        const uint32_t numChildViews = view.GetNumChildViews(ViewType::PLANAR);
+        for (uint32_t index = 0; index < numChildViews; index++)
+            strategy.SetView(view.GetChildView(ViewType::PLANAR, index), &visibleInstances[firstList + index], occlusion ? &occlusion[index] : nullptr);
+
+        return firstList + numChildViews;
+    }
+
+    // The eyes of the main view and the shadow cascades load every instance box once for all of them
+    void CullMainViews()
+    {
+        UpdateInstanceCuller();
+
+        std::vector<const IView*> views = { m_View.get() };
+        if (m_ui.EnableShadows)
         {
-            for (int cascade = 0; cascade < 4; cascade++)
+            for (int cascade = 0; cascade < c_NumShadowCascades; cascade++)
+                views.push_back(&m_ShadowMap->GetCascade(cascade)->GetView());
+        }
+
+        CullViews(views, m_ViewMasks, m_VisibleInstances);
+
+        uint32_t list = SetCulledViews(*m_CulledOpaqueDrawStrategy, *m_View, m_VisibleInstances, 0);
+        if (m_ui.EnableShadows)
+        {
+            // The occluders of each cascade are drawn when the cascade is recorded, on the thread that records it
+            const bool occlusion = IsOcclusionEnabled();
+            for (int cascade = 0; cascade < c_NumShadowCascades; cascade++)
             {
-                nvrhi::Viewport viewport = nvrhi::Viewport(
-                    10.f + 266.f * cascade,
-                    266.f * (1 + cascade),
-                    windowViewport.maxY - 266.f,
-                    windowViewport.maxY - 10.f, 0.f, 1.f
-                );
+                list = SetCulledViews(*m_CulledShadowDrawStrategies[cascade], m_ShadowMap->GetCascade(cascade)->GetView(), m_VisibleInstances, list,
+                    occlusion ? &m_CascadeOcclusion[cascade] : nullptr);
+            }
+        }
+    }
 
-                engine::BlitParameters blitParams;
-                blitParams.targetFramebuffer = framebuffer;
-                blitParams.targetViewport = viewport;
-                blitParams.sourceTexture = m_ShadowMap->GetTexture();
-                blitParams.sourceArraySlice = cascade;
-                m_CommonPasses->BlitTexture(m_CommandList, blitParams, &m_BindingCache);
+    // The passes that draw materials keep binding sets with the material textures
+    void ResetMaterialBindingCaches()
+    {
+        if (m_ForwardPass) m_ForwardPass->ResetBindingCache();
+        if (m_GBufferPass) m_GBufferPass->ResetBindingCache();
+        if (m_MaterialIDPass) m_MaterialIDPass->ResetBindingCache();
+        if (m_ShadowDepthPass) m_ShadowDepthPass->ResetBindingCache();
+    }
+
+    void UpdateTextureStreaming(nvrhi::ICommandList* commandList)
+    {
+        if (!m_TextureStreamer->IsActive() || m_TextureStreamer->IsComplete())
+            return;
+
+        ProfilerScope scope(*m_Profiler, commandList, "Texture Streaming");
+
+        const float pixelsPerRadian = float(m_RenderTargets->GetSize().y) * 0.5f / tanf(dm::radians(m_CameraVerticalFov) * 0.5f);
+        const uint64_t byteBudget = uint64_t(m_ui.TextureStreamingBudgetMB) << 20;
+
+        // Updates the material flags before the scene buffers are refreshed
+        if (m_TextureStreamer->Update(*m_View, pixelsPerRadian, commandList, byteBudget))
+            ResetMaterialBindingCaches();
+
+        if (m_TextureStreamer->IsComplete() && !m_TextureStreamingLogged)
+        {
+            using namespace std::chrono;
+            auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - m_SceneLoadStartTime).count();
+            log::info("  all streamed textures resident after %llu ms (%.1f MB uploaded, %d failed)", duration,
+                double(m_TextureStreamer->GetStatistics().uploadedBytes) / double(1 << 20), int(m_TextureStreamer->GetStatistics().numFailed));
+            m_TextureStreamingLogged = true;
+        }
+    }
+
+    void RecordSetupCommands(nvrhi::ICommandList* commandList, nvrhi::ITexture* framebufferTexture, bool exposureResetRequired)
+    {
+        UpdateTextureStreaming(commandList);
+
+        if (m_TextureBudget->Update(commandList, uint64_t(m_ui.TextureMemoryBudgetMB) << 20))
+            ResetMaterialBindingCaches();
+
+        {
+            ProfilerScope scope(*m_Profiler, commandList, "Scene Buffers");
+            m_Scene->RefreshBuffers(commandList, GetFrameIndex());
+        }
+
+        commandList->clearTextureFloat(framebufferTexture, nvrhi::AllSubresources, nvrhi::Color(0.f));
+
+        {
+            ProfilerScope scope(*m_Profiler, commandList, "Clear");
+
+            m_RenderTargets->Clear(commandList);
+
+            if (exposureResetRequired)
+                m_ToneMappingPass->ResetExposure(commandList, 0.5f);
+        }
+    }
+
+    void RecordShadowCascadeCommands(nvrhi::ICommandList* commandList, int cascade)
+    {
+        if (!m_ui.EnableShadows)
+            return;
+
+        ProfilerScope scope(*m_Profiler, commandList, "Shadow Map");
+
+        const IView& cascadeView = m_ShadowMap->GetCascade(cascade)->GetView();
+        commandList->clearDepthStencilTexture(m_ShadowMap->GetTexture(), cascadeView.GetSubresources(), true, 1.f, false, 0);
+
+        // Instances behind the occluders as seen from the light only cast shadows onto the occluders' own shadow
+        if (IsOcclusionEnabled())
+            RenderOccluders(m_CascadeOcclusion[cascade], cascadeView);
+
+        DepthPass::Context context;
+
+        RenderCompositeView(commandList, 
+            &cascadeView, nullptr, 
+            *m_ShadowFramebuffer,
+            m_Scene->GetSceneGraph()->GetRootNode(),
+            GetShadowDrawStrategy(cascade),
+            *m_ShadowDepthPass,
+            context,
+            "ShadowMap",
+            m_ui.EnableMaterialEvents);
+    }
+
+    void RecordOpaqueCommands(nvrhi::ICommandList* commandList, const std::vector<std::shared_ptr<LightProbe>>& lightProbes)
+    {
+        if (m_ui.UseDeferredShading)
+        {
+            GBufferFillPass::Context gbufferContext;
+
+            {
+                ProfilerScope scope(*m_Profiler, commandList, "GBuffer Fill");
+
+                RenderCompositeView(commandList,
+                    m_View.get(), m_ViewPrevious.get(), 
+                    *m_RenderTargets->GBufferFramebuffer, 
+                    m_Scene->GetSceneGraph()->GetRootNode(),
+                    GetOpaqueDrawStrategy(),
+                    *m_GBufferPass,
+                    gbufferContext,
+                    "GBufferFill",
+                    m_ui.EnableMaterialEvents);
             }
+
+            nvrhi::ITexture* ambientOcclusionTarget = nullptr;
+            if (m_ui.EnableSsao && m_SsaoPass)
+            {
+                ProfilerScope scope(*m_Profiler, commandList, "SSAO");
+                m_RenderTargets->BeginPass(commandList, FramePass_Ssao);
+                m_SsaoPass->Render(commandList, m_ui.SsaoParams, *m_View);
+                ambientOcclusionTarget = m_RenderTargets->AmbientOcclusion;
+            }
+
+            DeferredLightingPass::Inputs deferredInputs;
+            deferredInputs.SetGBuffer(*m_RenderTargets);
+            deferredInputs.ambientOcclusion = m_ui.EnableSsao ? m_RenderTargets->AmbientOcclusion : nullptr;
+            deferredInputs.ambientColorTop = m_AmbientTop;
+            deferredInputs.ambientColorBottom = m_AmbientBottom;
+            deferredInputs.lights = &m_Scene->GetSceneGraph()->GetLights();
+            deferredInputs.lightProbes = m_ui.EnableLightProbe ? &m_LightProbes : nullptr;
+            deferredInputs.output = m_RenderTargets->HdrColor;
+
+            ProfilerScope scope(*m_Profiler, commandList, "Deferred Lighting");
+            m_DeferredLightingPass->Render(commandList, *m_View, deferredInputs);
         }
+        else
+        {
+            ForwardShadingPass::Context forwardContext;
 
-        m_CommandList->close();
-        GetDevice()->executeCommandList(m_CommandList);
+            {
+                ProfilerScope scope(*m_Profiler, commandList, "Prepare Lights");
+                m_ForwardPass->PrepareLights(forwardContext, commandList, m_Scene->GetSceneGraph()->GetLights(), m_AmbientTop, m_AmbientBottom, lightProbes);
+            }
 
-        if (!m_ui.ScreenshotFileName.empty())
+            ProfilerScope scope(*m_Profiler, commandList, "Forward Opaque");
+
+            RenderCompositeView(commandList,
+                m_View.get(), m_ViewPrevious.get(),
+                *m_RenderTargets->ForwardFramebuffer,
+                m_Scene->GetSceneGraph()->GetRootNode(),
+                GetOpaqueDrawStrategy(),
+                *m_ForwardPass,
+                forwardContext,
+                "ForwardOpaque",
+                m_ui.EnableMaterialEvents);
+        }
+
+        if(m_Pick)
         {
-            SaveTextureToFile(GetDevice(), m_CommonPasses.get(), framebufferTexture, nvrhi::ResourceStates::RenderTarget, m_ui.ScreenshotFileName.c_str());
-            m_ui.ScreenshotFileName = "";
+            ProfilerScope scope(*m_Profiler, commandList, "Material ID");
+
+            m_RenderTargets->BeginPass(commandList, FramePass_MaterialID);
+            commandList->clearTextureUInt(m_RenderTargets->MaterialIDs, nvrhi::AllSubresources, 0xffff);
+
+            MaterialIDPass::Context materialIdContext;
+
+            RenderCompositeView(commandList, 
+                m_View.get(), m_ViewPrevious.get(),
+                *m_RenderTargets->MaterialIDFramebuffer,
+                m_Scene->GetSceneGraph()->GetRootNode(),
+                GetOpaqueDrawStrategy(),
+                *m_MaterialIDPass,
+                materialIdContext,
+                "MaterialID");
+            
+            if (m_ui.EnableTranslucency)
+            {
+                RenderCompositeView(commandList,
+                    m_View.get(), m_ViewPrevious.get(),
+                    *m_RenderTargets->MaterialIDFramebuffer,
+                    m_Scene->GetSceneGraph()->GetRootNode(),
+                    GetTransparentDrawStrategy(),
+                    *m_MaterialIDPass,
+                    materialIdContext,
+                    "MaterialID - Translucent");
+            }
+
+            m_PixelReadbackPass->Capture(commandList, m_PickPosition);
         }
+    }
 
-        if (m_Pick)
+    void RecordTranslucentAndPostCommands(nvrhi::ICommandList* commandList, nvrhi::IFramebuffer* framebuffer,
+        const std::vector<std::shared_ptr<LightProbe>>& lightProbes, const nvrhi::Viewport& windowViewport, bool exposureResetRequired)
+    {
+        if (m_ui.EnableProceduralSky)
         {
-            m_Pick = false;
-            GetDevice()->waitForIdle();
-            uint4 pixelValue = m_PixelReadbackPass->ReadUInts();
-            m_ui.SelectedMaterial = nullptr;
-            m_ui.SelectedNode = nullptr;
+            ProfilerScope scope(*m_Profiler, commandList, "Sky");
+            m_SkyPass->Render(commandList, *m_View, *m_SunLight, m_ui.SkyParams);
+        }
+
+        if (m_ui.EnableTranslucency)
+        {
+            ForwardShadingPass::Context forwardContext;
 
-            for (const auto& material : m_Scene->GetSceneGraph()->GetMaterials())
             {
-                if (material->materialID == int(pixelValue.x))
-                {
-                    m_ui.SelectedMaterial = material;
-                    break;
-                }
+                ProfilerScope scope(*m_Profiler, commandList, "Prepare Lights");
+                m_ForwardPass->PrepareLights(forwardContext, commandList, m_Scene->GetSceneGraph()->GetLights(), m_AmbientTop, m_AmbientBottom, lightProbes);
             }
 
-            for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+            ProfilerScope scope(*m_Profiler, commandList, "Forward Transparent");
+
+            RenderCompositeView(commandList,
+                m_View.get(), m_ViewPrevious.get(),
+                *m_RenderTargets->ForwardFramebuffer,
+                m_Scene->GetSceneGraph()->GetRootNode(),
+                GetTransparentDrawStrategy(),
+                *m_ForwardPass,
+                forwardContext,
+                "ForwardTransparent",
+                m_ui.EnableMaterialEvents);
+        }
+
+        nvrhi::ITexture* finalHdrColor = m_RenderTargets->HdrColor;
+
+        if (m_ui.AntiAliasingMode == AntiAliasingMode::TEMPORAL)
+        {
             {
-                if (instance->GetInstanceIndex() == int(pixelValue.y))
+                ProfilerScope scope(*m_Profiler, commandList, "TAA");
+
+                m_RenderTargets->BeginPass(commandList, FramePass_Resolve);
+                if (m_PreviousViewsValid)
                 {
-                    m_ui.SelectedNode = instance->GetNodeSharedPtr();
-                    break;
+                    m_TemporalAntiAliasingPass->RenderMotionVectors(commandList, *m_View, *m_ViewPrevious);
                 }
+
+                m_TemporalAntiAliasingPass->TemporalResolve(commandList, m_ui.TemporalAntiAliasingParams, m_PreviousViewsValid, *m_View, *m_View);
             }
 
-            if (m_ui.SelectedNode)
+            finalHdrColor = m_RenderTargets->ResolvedColor;
+            
+            if (m_ui.EnableBloom)
             {
-                log::info("Picked node: %s", m_ui.SelectedNode->GetPath().generic_string().c_str());
-                PointThirdPersonCameraAt(m_ui.SelectedNode);
+                ProfilerScope scope(*m_Profiler, commandList, "Bloom");
+                m_BloomPass->Render(commandList, m_RenderTargets->ResolvedFramebuffer, *m_View, m_RenderTargets->ResolvedColor, m_ui.BloomSigma, m_ui.BloomAlpha);
             }
-            else
+            m_PreviousViewsValid = true;
+        }
+        else
+        {
+            std::shared_ptr<FramebufferFactory> finalHdrFramebuffer = m_RenderTargets->HdrFramebuffer;
+
+            if (m_RenderTargets->GetSampleCount() > 1)
             {
-                PointThirdPersonCameraAt(m_Scene->GetSceneGraph()->GetRootNode());
+                ProfilerScope scope(*m_Profiler, commandList, "MSAA Resolve");
+                m_RenderTargets->BeginPass(commandList, FramePass_Resolve);
+                commandList->resolveTexture(m_RenderTargets->ResolvedColor, nvrhi::AllSubresources, m_RenderTargets->HdrColor, nvrhi::AllSubresources);
+                finalHdrColor = m_RenderTargets->ResolvedColor;
+                finalHdrFramebuffer = m_RenderTargets->ResolvedFramebuffer;
+            }
+
+            if (m_ui.EnableBloom)
+            {
+                ProfilerScope scope(*m_Profiler, commandList, "Bloom");
+                m_BloomPass->Render(commandList, finalHdrFramebuffer, *m_View, finalHdrColor, m_ui.BloomSigma, m_ui.BloomAlpha);
             }
+
+            m_PreviousViewsValid = false;
         }
 
-        m_TemporalAntiAliasingPass->AdvanceFrame();
-        std::swap(m_View, m_ViewPrevious);
+        auto toneMappingParams = m_ui.ToneMappingParams;
+        if (exposureResetRequired)
+        {
+            toneMappingParams.eyeAdaptationSpeedUp = 0.f;
+            toneMappingParams.eyeAdaptationSpeedDown = 0.f;
+        }
+        {
+            ProfilerScope scope(*m_Profiler, commandList, "Tone Mapping");
+            m_RenderTargets->BeginPass(commandList, FramePass_ToneMapping);
+            m_ToneMappingPass->SimpleRender(commandList, toneMappingParams, *m_View, finalHdrColor);
+        }
+        
+        {
+            ProfilerScope scope(*m_Profiler, commandList, "Blit");
+            m_CommonPasses->BlitTexture(commandList, framebuffer, m_RenderTargets->LdrColor, &m_BindingCache);
+        }
 
-        GetDeviceManager()->SetVsyncEnabled(m_ui.EnableVsync);
+        if (m_ui.DisplayShadowMap)
+        {
+            for (int cascade = 0; cascade < c_NumShadowCascades; cascade++)
+            {
+                nvrhi::Viewport viewport = nvrhi::Viewport(
+                    10.f + 266.f * cascade,
+                    266.f * (1 + cascade),
+                    windowViewport.maxY - 266.f,
+                    windowViewport.maxY - 10.f, 0.f, 1.f
+                );
+
+                engine::BlitParameters blitParams;
+                blitParams.targetFramebuffer = framebuffer;
+                blitParams.targetViewport = viewport;
+                blitParams.sourceTexture = m_ShadowMap->GetTexture();
+                blitParams.sourceArraySlice = cascade;
+                m_CommonPasses->BlitTexture(commandList, blitParams, &m_BindingCache);
+            }
+        }
     }
 
     std::shared_ptr<ShaderFactory> GetShaderFactory()
@@ -1293,13 +1983,51 @@ public:
         m_ShadowMap->SetupForCubemapView(*m_SunLight, view.GetViewOrigin(), cullDistance, zRange, zRange, m_ui.CsmExponent);
         m_ShadowMap->Clear(commandList);
 
+        // The cascades and the cube faces are culled in one sweep, the forward pass may draw all faces at once with the union of them
+        std::vector<uint32_t> viewMasks;
+        std::vector<std::vector<uint32_t>> visibleInstances;
+        std::vector<uint32_t> allFacesVisibleInstances;
+        std::vector<OcclusionRasterizer> occlusion;
+        CulledOpaqueDrawStrategy culledShadowStrategy(m_InstanceCuller);
+        CulledOpaqueDrawStrategy culledFaceStrategy(m_InstanceCuller);
+        if (m_ui.UseInstanceCuller)
+        {
+            UpdateInstanceCuller();
+            CullViews({ &m_ShadowMap->GetView(), &view }, viewMasks, visibleInstances);
+
+            // One rasterizer for each cascade and face, in the same order as the lists of visible instances
+            if (IsOcclusionEnabled())
+            {
+                occlusion.resize(visibleInstances.size());
+                uint32_t rasterizer = 0;
+                for (const IView* compositeView : { static_cast<const IView*>(&m_ShadowMap->GetView()), static_cast<const IView*>(&view) })
+                {
+                    for (uint32_t index = 0; index < compositeView->GetNumChildViews(ViewType::PLANAR); index++)
+                        RenderOccluders(occlusion[rasterizer++], *compositeView->GetChildView(ViewType::PLANAR, index));
+                }
+            }
+
+            const uint32_t firstFace = SetCulledViews(culledShadowStrategy, m_ShadowMap->GetView(), visibleInstances, 0, occlusion.empty() ? nullptr : occlusion.data());
+            SetCulledViews(culledFaceStrategy, view, visibleInstances, firstFace, occlusion.empty() ? nullptr : occlusion.data() + firstFace);
+
+            const uint32_t faceBits = ((1u << view.GetNumChildViews(ViewType::PLANAR)) - 1) << firstFace;
+            for (uint32_t instanceIndex = 0; instanceIndex < uint32_t(viewMasks.size()); instanceIndex++)
+            {
+                if (viewMasks[instanceIndex] & faceBits)
+                    allFacesVisibleInstances.push_back(instanceIndex);
+            }
+            culledFaceStrategy.SetView(&view, &allFacesVisibleInstances);
+        }
+        IDrawStrategy& shadowStrategy = m_ui.UseInstanceCuller ? static_cast<IDrawStrategy&>(culledShadowStrategy) : *m_OpaqueDrawStrategy;
+        IDrawStrategy& faceStrategy = m_ui.UseInstanceCuller ? static_cast<IDrawStrategy&>(culledFaceStrategy) : *m_OpaqueDrawStrategy;
+
         DepthPass::Context shadowContext;
 
         RenderCompositeView(commandList,
             &m_ShadowMap->GetView(), nullptr,
             *m_ShadowFramebuffer,
             m_Scene->GetSceneGraph()->GetRootNode(),
-            *m_OpaqueDrawStrategy,
+            shadowStrategy,
             *m_ShadowDepthPass,
             shadowContext,
             "ShadowMap");
@@ -1313,7 +2041,7 @@ public:
             &view, nullptr,
             *framebuffer,
             m_Scene->GetSceneGraph()->GetRootNode(),
-            *m_OpaqueDrawStrategy,
+            faceStrategy,
             *forwardPass,
             forwardContext,
             "ForwardOpaque");
@@ -1367,6 +2095,7 @@ private:
 
 	UIData& m_ui;
     nvrhi::CommandListHandle m_CommandList;
+    std::vector<PassProfiler::PassStats> m_PassStats;
 
 public:
     UIRenderer(DeviceManager* deviceManager, std::shared_ptr<FeatureDemo> app, UIData& ui)
@@ -1388,6 +2117,12 @@ public:
     }
 
 protected:
+    void BuildProfilerUI()
+    {
+        if (DrawPassProfilerTable(m_app->GetProfiler(), m_PassStats))
+            m_ui.ProfileDumpRequested = true;
+    }
+
     virtual void buildUI(void) override
     {
         if (!m_ui.ShowUI)
@@ -1507,8 +2242,50 @@ protected:
         ImGui::Separator();
         ImGui::Checkbox("Temporal AA Clamping", &m_ui.TemporalAntiAliasingParams.enableHistoryClamping);
         ImGui::Checkbox("Material Events", &m_ui.EnableMaterialEvents);
+#ifdef DONUT_WITH_TASKFLOW
+        ImGui::Checkbox("Parallel Recording", &m_ui.EnableParallelRecording);
+#endif
+        ImGui::Checkbox("Persistent Opaque Draw List", &m_ui.UsePersistentDrawList);
+        ImGui::Checkbox("Radix Sorted Transparency", &m_ui.UseRadixSort);
+        ImGui::Checkbox("Multi-View Instance Culling", &m_ui.UseInstanceCuller);
+        if (m_ui.UseInstanceCuller)
+            ImGui::Checkbox("Occlusion Culling (Shadows, Light Probes)", &m_ui.UseOcclusionCulling);
         ImGui::Separator();
 
+        if (ImGui::CollapsingHeader("Pass Timings"))
+        {
+            BuildProfilerUI();
+        }
+
+        if (ImGui::CollapsingHeader("Draw Lists"))
+        {
+            const PersistentDrawList::Statistics& opaqueStats = m_app->GetOpaqueDrawList().GetStatistics();
+            ImGui::Text("Opaque items: %d, visible: %d", int(opaqueStats.numItems), int(m_app->GetPersistentOpaqueDrawStrategy().GetNumVisibleItems()));
+            ImGui::Text("Opaque cache hits: %llu, re-sorts: %llu", (unsigned long long)opaqueStats.cacheHits, (unsigned long long)opaqueStats.resorts);
+
+            const RadixSortTransparentDrawStrategy::Statistics& transparentStats = m_app->GetRadixSortTransparentDrawStrategy().GetStatistics();
+            ImGui::Text("Transparent items: %d, sorts: %llu, reused: %llu", int(transparentStats.numItems), (unsigned long long)transparentStats.sorts, (unsigned long long)transparentStats.reuses);
+            ImGui::Text("Transparent cache hits: %llu, rebuilds: %llu", (unsigned long long)transparentStats.cacheHits, (unsigned long long)transparentStats.rebuilds);
+        }
+
+        if (m_app->GetTextureStreamer().IsActive() && ImGui::CollapsingHeader("Texture Streaming"))
+        {
+            const TextureStreamer::Statistics& stats = m_app->GetTextureStreamer().GetStatistics();
+            ImGui::SliderInt("Upload Budget (MB/frame)", &m_ui.TextureStreamingBudgetMB, 1, 64);
+            ImGui::Text("Textures: %d complete of %d, %d streamed by mip, %d failed", int(stats.numComplete), int(stats.numTextures), int(stats.numStreamed), int(stats.numFailed));
+            ImGui::Text("Resident: %.1f MB, uploaded: %.1f MB", double(stats.residentBytes) / double(1 << 20), double(stats.uploadedBytes) / double(1 << 20));
+            ImGui::Text("Last frame: %d steps, %.2f MB", int(stats.stepsLastFrame), double(stats.uploadedBytesLastFrame) / double(1 << 20));
+        }
+
+        if (ImGui::CollapsingHeader("Texture Memory"))
+        {
+            const TextureBudget::Statistics& stats = m_app->GetTextureBudget().GetStatistics();
+            ImGui::SliderInt("Budget (MB)", &m_ui.TextureMemoryBudgetMB, 64, 8192);
+            ImGui::Text("Resident: %.1f MB in %d textures, %d trimmed", double(stats.residentBytes) / double(1 << 20), int(stats.numTextures), int(stats.numTrimmed));
+            ImGui::Text("Current scene: %.1f MB", double(stats.sceneBytes) / double(1 << 20));
+            ImGui::Text("Trims: %d, evictions: %d, reloads: %d", int(stats.trims), int(stats.evictions), int(stats.reloads));
+        }
+
         const auto& lights = m_app->GetScene()->GetSceneGraph()->GetLights();
 
         if (!lights.empty() && ImGui::CollapsingHeader("Lights"))
@@ -1580,7 +2357,97 @@ protected:
     }
 };
 
-bool ProcessCommandLine(int argc, const char* const* argv, DeviceCreationParameters& deviceParams, std::string& sceneName)
+struct BenchmarkParameters
+{
+    std::filesystem::path cameraPathFile;
+    std::filesystem::path csvFile = "feature_demo_benchmark.csv";
+    int frames = 600;
+    int warmupFrames = 10;
+    int maxLoadingFrames = 10000;
+};
+
+// Renders the scene into an offscreen LDR target without presenting, following a scripted camera path,
+// and records how long each frame takes to record and to complete on the GPU.
+static bool RunHeadlessBenchmark(FeatureDemo& demo, nvrhi::IDevice* device, uint2 size, const BenchmarkParameters& params)
+{
+    NativeFileSystem fs;
+    CameraPath cameraPath;
+    if (!cameraPath.Load(fs, params.cameraPathFile))
+        return false;
+
+    auto textureDesc = nvrhi::TextureDesc()
+        .setDimension(nvrhi::TextureDimension::Texture2D)
+        .setWidth(size.x)
+        .setHeight(size.y)
+        .setFormat(nvrhi::Format::SRGBA8_UNORM)
+        .setIsRenderTarget(true)
+        .setInitialState(nvrhi::ResourceStates::RenderTarget)
+        .setKeepInitialState(true)
+        .setDebugName("OffscreenLdrColor");
+    nvrhi::TextureHandle colorTarget = device->createTexture(textureDesc);
+
+    nvrhi::FramebufferHandle framebuffer = device->createFramebuffer(nvrhi::FramebufferDesc()
+        .addColorAttachment(colorTarget));
+
+    // The scene itself is loaded synchronously, but the textures are finalized on the rendering thread
+    // over several frames, during which the application renders the splash screen.
+    int loadingFrames = 0;
+    while (demo.GetSceneFramesRendered() == 0)
+    {
+        if (loadingFrames++ == params.maxLoadingFrames)
+        {
+            log::error("The scene did not finish loading after %d frames", params.maxLoadingFrames);
+            return false;
+        }
+
+        demo.Animate(0.f);
+        demo.Render(framebuffer);
+        device->waitForIdle();
+        device->runGarbageCollection();
+    }
+
+    const float frameTime = cameraPath.GetDuration() / float(std::max(params.frames - 1, 1));
+
+    FrameTimeReport report;
+
+    for (int frame = -params.warmupFrames; frame < params.frames; frame++)
+    {
+        float3 position, target;
+        cameraPath.Evaluate(float(std::max(frame, 0)) * frameTime, position, target);
+        demo.SetCameraPose(position, target);
+
+        auto frameStart = std::chrono::high_resolution_clock::now();
+
+        demo.Animate(frameTime);
+        demo.Render(framebuffer);
+
+        auto recordEnd = std::chrono::high_resolution_clock::now();
+
+        device->waitForIdle();
+        device->runGarbageCollection();
+
+        auto frameEnd = std::chrono::high_resolution_clock::now();
+
+        if (frame < 0)
+            continue;
+
+        FrameTimeReport::Sample sample;
+        sample.cpuMilliseconds = std::chrono::duration<double, std::milli>(recordEnd - frameStart).count();
+        sample.frameMilliseconds = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+        report.AddSample(sample);
+    }
+
+    report.PrintSummary();
+
+    if (!report.WriteCSV(params.csvFile))
+        return false;
+
+    log::info("Frame times written to '%s'", params.csvFile.generic_string().c_str());
+
+    return true;
+}
+
+bool ProcessCommandLine(int argc, const char* const* argv, DeviceCreationParameters& deviceParams, std::string& sceneName, BenchmarkParameters& benchmarkParams)
 {
     for (int i = 1; i < argc; i++)
     {
@@ -1613,6 +2480,69 @@ bool ProcessCommandLine(int argc, const char* const* argv, DeviceCreationParamet
         {
             g_PrintFormats = true;
         }
+        else if (!strcmp(argv[i], "-headless"))
+        {
+            g_Headless = true;
+            deviceParams.vsyncEnabled = false;
+        }
+        else if (!strcmp(argv[i], "-cameraPath"))
+        {
+            benchmarkParams.cameraPathFile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-frames"))
+        {
+            benchmarkParams.frames = std::max(std::stoi(argv[++i]), 1);
+        }
+        else if (!strcmp(argv[i], "-csv"))
+        {
+            benchmarkParams.csvFile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-profileDump"))
+        {
+            g_ProfileDumpFile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-noMappedFiles"))
+        {
+            g_UseMappedFiles = false;
+        }
+        else if (!strcmp(argv[i], "-archive"))
+        {
+            g_ArchiveFile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-fileSystemBenchmark"))
+        {
+            g_RunFileSystemBenchmark = true;
+        }
+        else if (!strcmp(argv[i], "-streamTextures"))
+        {
+            g_StreamTextures = true;
+        }
+        else if (!strcmp(argv[i], "-noRenderTargetAliasing"))
+        {
+            g_AliasRenderTargets = false;
+        }
+        else if (!strcmp(argv[i], "-textureBudget"))
+        {
+            g_TextureMemoryBudgetMB = std::max(std::stoi(argv[++i]), 1);
+        }
+        else if (!strcmp(argv[i], "-noTextureTranscoding"))
+        {
+            g_TranscodeTextures = false;
+        }
+        else if (!strcmp(argv[i], "-transcodeBenchmark"))
+        {
+            g_RunTranscodingBenchmark = true;
+        }
+        else if (!strcmp(argv[i], "-noSceneCache"))
+        {
+            g_UseSceneCache = false;
+        }
+        else if (!strcmp(argv[i], "-bakeSceneCache"))
+        {
+            // The scene is loaded synchronously while the application is created, which writes the cache
+            g_BakeSceneCache = true;
+            g_Headless = true;
+        }
         else if (argv[i][0] != '-')
         {
             sceneName = argv[i];
@@ -1643,18 +2573,43 @@ int main(int __argc, const char* const* __argv)
     deviceParams.vsyncEnabled = true;
 
     std::string sceneName;
-    if (!ProcessCommandLine(__argc, __argv, deviceParams, sceneName))
+    BenchmarkParameters benchmarkParams;
+    benchmarkParams.cameraPathFile = app::GetDirectoryWithExecutable().parent_path() / "media/sponza-flythrough.camera.json";
+    if (!ProcessCommandLine(__argc, __argv, deviceParams, sceneName, benchmarkParams))
     {
         log::error("Failed to process the command line.");
         return 1;
     }
+
+    if (g_RunFileSystemBenchmark)
+    {
+        // CPU only, no device needed
+        RunFileSystemBenchmark(app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Models/2.0/Sponza");
+        return 0;
+    }
+
+    if (g_RunTranscodingBenchmark)
+    {
+#ifdef DONUT_WITH_TASKFLOW
+        tf::Executor executor;
+        RunTextureTranscodingBenchmark(app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Models/2.0/Sponza", &executor);
+#else
+        RunTextureTranscodingBenchmark(app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Models/2.0/Sponza", nullptr);
+#endif
+        return 0;
+    }
     
     DeviceManager* deviceManager = DeviceManager::Create(api);
     const char* apiString = nvrhi::utils::GraphicsAPIToString(deviceManager->GetGraphicsAPI());
 
     std::string windowTitle = "Donut Feature Demo (" + std::string(apiString) + ")";
 
-    if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, windowTitle.c_str()))
+    // The headless benchmark and the cache baking never present, so they run without a window or swap chain
+    bool deviceCreated = (g_Headless || g_BakeSceneCache)
+        ? deviceManager->CreateHeadlessDevice(deviceParams)
+        : deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, windowTitle.c_str());
+
+    if (!deviceCreated)
 	{
         log::error("Cannot initialize a %s graphics device with the requested parameters", apiString);
 		return 1;
@@ -1686,6 +2641,32 @@ int main(int __argc, const char* const* __argv)
         }
     }
 
+    int exitCode = 0;
+
+    if (g_BakeSceneCache)
+    {
+        UIData uiData;
+        uiData.ShowUI = false;
+
+        std::shared_ptr<FeatureDemo> demo = std::make_shared<FeatureDemo>(deviceManager, uiData, sceneName);
+
+        if (!demo->IsSceneCacheWritten())
+            exitCode = 1;
+    }
+    else if (g_Headless)
+    {
+        UIData uiData;
+        uiData.ShowUI = false;
+        uiData.EnableVsync = false;
+
+        std::shared_ptr<FeatureDemo> demo = std::make_shared<FeatureDemo>(deviceManager, uiData, sceneName);
+
+        if (!RunHeadlessBenchmark(*demo, deviceManager->GetDevice(), uint2(deviceParams.backBufferWidth, deviceParams.backBufferHeight), benchmarkParams))
+            exitCode = 1;
+        else if (!demo->DumpProfile())
+            exitCode = 1;
+    }
+    else
     {
         UIData uiData;
 
@@ -1706,5 +2687,5 @@ int main(int __argc, const char* const* __argv)
 #endif
     delete deviceManager;
 	
-	return 0;
+	return exitCode;
 }
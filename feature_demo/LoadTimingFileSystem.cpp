@@ -0,0 +1,128 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "LoadTimingFileSystem.h"
+#include <algorithm>
+
+using namespace donut;
+
+LoadTimingFileSystem::LoadTimingFileSystem(std::shared_ptr<vfs::IFileSystem> fs)
+    : m_Fs(std::move(fs))
+{
+}
+
+void LoadTimingFileSystem::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for (Span& span : m_Spans)
+        span = Span();
+
+    m_ReadFiles.clear();
+}
+
+LoadTimingFileSystem::Span LoadTimingFileSystem::GetSpan(Stage stage) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    return m_Spans[size_t(stage)];
+}
+
+std::vector<std::filesystem::path> LoadTimingFileSystem::GetReadFiles() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    return std::vector<std::filesystem::path>(m_ReadFiles.begin(), m_ReadFiles.end());
+}
+
+// The stage that reads a file, or Stage::Count for files that are not part of the scene data
+static LoadTimingFileSystem::Stage GetFileStage(const std::filesystem::path& name)
+{
+    using Stage = LoadTimingFileSystem::Stage;
+
+    std::string extension = name.extension().generic_string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(tolower(c)); });
+
+    if (extension == ".gltf" || extension == ".glb" || extension == ".json")
+        return Stage::Description;
+
+    if (extension == ".bin")
+        return Stage::Buffers;
+
+    if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".dds" || extension == ".ktx" ||
+        extension == ".ktx2" || extension == ".tga" || extension == ".bmp" || extension == ".hdr" || extension == ".exr")
+        return Stage::Textures;
+
+    return Stage::Count;
+}
+
+std::shared_ptr<vfs::IBlob> LoadTimingFileSystem::readFile(const std::filesystem::path& name)
+{
+    using namespace std::chrono;
+
+    const Stage stage = GetFileStage(name);
+    if (stage == Stage::Count)
+        return m_Fs->readFile(name);
+
+    const auto startTime = high_resolution_clock::now();
+    std::shared_ptr<vfs::IBlob> blob = m_Fs->readFile(name);
+    const auto endTime = high_resolution_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    Span& span = m_Spans[size_t(stage)];
+    if (span.numFiles == 0 || startTime < span.firstRead)
+        span.firstRead = startTime;
+    if (span.numFiles == 0 || endTime > span.lastRead)
+        span.lastRead = endTime;
+    span.numFiles++;
+
+    m_ReadFiles.insert(name);
+
+    return blob;
+}
+
+bool LoadTimingFileSystem::folderExists(const std::filesystem::path& name)
+{
+    return m_Fs->folderExists(name);
+}
+
+bool LoadTimingFileSystem::fileExists(const std::filesystem::path& name)
+{
+    return m_Fs->fileExists(name);
+}
+
+bool LoadTimingFileSystem::writeFile(const std::filesystem::path& name, const void* data, size_t size)
+{
+    return m_Fs->writeFile(name, data, size);
+}
+
+int LoadTimingFileSystem::enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, vfs::enumerate_callback_t callback, bool allowDuplicates)
+{
+    return m_Fs->enumerateFiles(path, extensions, callback, allowDuplicates);
+}
+
+int LoadTimingFileSystem::enumerateDirectories(const std::filesystem::path& path, vfs::enumerate_callback_t callback, bool allowDuplicates)
+{
+    return m_Fs->enumerateDirectories(path, callback, allowDuplicates);
+}
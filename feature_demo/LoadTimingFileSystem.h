@@ -0,0 +1,76 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <donut/core/vfs/VFS.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// File system that forwards to another one and records when the files of each scene loading stage are read:
+// the scene and glTF descriptions, the glTF buffers, and the textures. The glTF parsing, buffer decoding and
+// vertex packing run inside the scene loader without timing of their own, so the read times only bound them roughly.
+// The spans are wall clock times, and overlap when the models of a scene file are loaded in parallel.
+// The names of the files are recorded too, they are the sources that a scene cache depends on.
+class LoadTimingFileSystem : public donut::vfs::IFileSystem
+{
+public:
+    enum class Stage
+    {
+        Description,
+        Buffers,
+        Textures,
+        Count
+    };
+
+    struct Span
+    {
+        std::chrono::high_resolution_clock::time_point firstRead;   // start of the first read
+        std::chrono::high_resolution_clock::time_point lastRead;    // end of the last read
+        uint32_t numFiles = 0;
+    };
+
+    explicit LoadTimingFileSystem(std::shared_ptr<donut::vfs::IFileSystem> fs);
+
+    // Clears the spans and the file names, call before loading a scene
+    void Reset();
+    Span GetSpan(Stage stage) const;
+    // Scene, glTF, buffer and texture files read since the last reset, in the order of their names
+    std::vector<std::filesystem::path> GetReadFiles() const;
+
+    bool folderExists(const std::filesystem::path& name) override;
+    bool fileExists(const std::filesystem::path& name) override;
+    std::shared_ptr<donut::vfs::IBlob> readFile(const std::filesystem::path& name) override;
+    bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override;
+    int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, donut::vfs::enumerate_callback_t callback, bool allowDuplicates = false) override;
+    int enumerateDirectories(const std::filesystem::path& path, donut::vfs::enumerate_callback_t callback, bool allowDuplicates = false) override;
+
+private:
+    std::shared_ptr<donut::vfs::IFileSystem> m_Fs;
+    mutable std::mutex m_Mutex;
+    Span m_Spans[size_t(Stage::Count)];
+    std::set<std::filesystem::path> m_ReadFiles;
+};
@@ -0,0 +1,220 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "Lz4.h"
+#include <cstring>
+#include <vector>
+
+constexpr size_t c_MinMatch = 4;
+// The last 5 bytes are always literals, and the last match must start at least 12 bytes before the end
+constexpr size_t c_LastLiterals = 5;
+constexpr size_t c_MatchFindLimit = 12;
+constexpr size_t c_MaxOffset = 65535;
+constexpr uint32_t c_HashBits = 16;
+
+static uint32_t Read32(const uint8_t* pointer)
+{
+    uint32_t value;
+    memcpy(&value, pointer, sizeof(value));
+    return value;
+}
+
+static uint32_t HashSequence(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - c_HashBits);
+}
+
+// Writes the 15+ part of a length as a run of 255 bytes and a remainder
+static uint8_t* WriteLength(uint8_t* output, size_t length)
+{
+    while (length >= 255)
+    {
+        *output++ = 255;
+        length -= 255;
+    }
+    *output++ = uint8_t(length);
+    return output;
+}
+
+size_t Lz4CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t Lz4Compress(const void* source, size_t sourceSize, void* destination, size_t destinationCapacity)
+{
+    if (destinationCapacity < Lz4CompressBound(sourceSize))
+        return 0;
+
+    const uint8_t* const input = static_cast<const uint8_t*>(source);
+    const uint8_t* const inputEnd = input + sourceSize;
+    uint8_t* output = static_cast<uint8_t*>(destination);
+
+    const uint8_t* anchor = input;
+
+    if (sourceSize > c_MatchFindLimit)
+    {
+        // Positions of the last occurrence of each hashed 4-byte sequence, -1 when there is none
+        std::vector<int32_t> hashTable(size_t(1) << c_HashBits, -1);
+
+        const uint8_t* const matchFindEnd = inputEnd - c_MatchFindLimit;
+        const uint8_t* const matchEnd = inputEnd - c_LastLiterals;
+        const uint8_t* current = input;
+
+        while (current <= matchFindEnd)
+        {
+            const uint32_t sequence = Read32(current);
+            const uint32_t hash = HashSequence(sequence);
+            const int32_t candidate = hashTable[hash];
+            hashTable[hash] = int32_t(current - input);
+
+            if (candidate < 0 || size_t(current - input - candidate) > c_MaxOffset || Read32(input + candidate) != sequence)
+            {
+                current++;
+                continue;
+            }
+
+            const uint8_t* match = input + candidate;
+            size_t matchLength = c_MinMatch;
+            while (current + matchLength < matchEnd && match[matchLength] == current[matchLength])
+                matchLength++;
+
+            const size_t literalLength = size_t(current - anchor);
+            uint8_t* token = output++;
+
+            if (literalLength >= 15)
+            {
+                *token = 15 << 4;
+                output = WriteLength(output, literalLength - 15);
+            }
+            else
+                *token = uint8_t(literalLength << 4);
+
+            memcpy(output, anchor, literalLength);
+            output += literalLength;
+
+            const size_t offset = size_t(current - match);
+            *output++ = uint8_t(offset);
+            *output++ = uint8_t(offset >> 8);
+
+            const size_t extraMatchLength = matchLength - c_MinMatch;
+            if (extraMatchLength >= 15)
+            {
+                *token |= 15;
+                output = WriteLength(output, extraMatchLength - 15);
+            }
+            else
+                *token |= uint8_t(extraMatchLength);
+
+            current += matchLength;
+            anchor = current;
+        }
+    }
+
+    // The last sequence has only literals
+    const size_t literalLength = size_t(inputEnd - anchor);
+    uint8_t* token = output++;
+
+    if (literalLength >= 15)
+    {
+        *token = 15 << 4;
+        output = WriteLength(output, literalLength - 15);
+    }
+    else
+        *token = uint8_t(literalLength << 4);
+
+    memcpy(output, anchor, literalLength);
+    output += literalLength;
+
+    return size_t(output - static_cast<uint8_t*>(destination));
+}
+
+// Reads the 15+ part of a length, returns false when the input ends before the length does
+static bool ReadLength(const uint8_t*& input, const uint8_t* inputEnd, size_t& length)
+{
+    uint8_t value;
+    do
+    {
+        if (input >= inputEnd)
+            return false;
+
+        value = *input++;
+        length += value;
+    } while (value == 255);
+
+    return true;
+}
+
+bool Lz4Decompress(const void* source, size_t sourceSize, void* destination, size_t destinationSize)
+{
+    const uint8_t* input = static_cast<const uint8_t*>(source);
+    const uint8_t* const inputEnd = input + sourceSize;
+    uint8_t* const outputStart = static_cast<uint8_t*>(destination);
+    uint8_t* const outputEnd = outputStart + destinationSize;
+    uint8_t* output = outputStart;
+
+    while (input < inputEnd)
+    {
+        const uint8_t token = *input++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(input, inputEnd, literalLength))
+            return false;
+
+        if (literalLength > size_t(inputEnd - input) || literalLength > size_t(outputEnd - output))
+            return false;
+
+        memcpy(output, input, literalLength);
+        input += literalLength;
+        output += literalLength;
+
+        // The last sequence ends after its literals
+        if (input == inputEnd)
+            break;
+
+        if (inputEnd - input < 2)
+            return false;
+
+        const size_t offset = size_t(input[0]) | (size_t(input[1]) << 8);
+        input += 2;
+
+        if (offset == 0 || offset > size_t(output - outputStart))
+            return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(input, inputEnd, matchLength))
+            return false;
+        matchLength += c_MinMatch;
+
+        if (matchLength > size_t(outputEnd - output))
+            return false;
+
+        // Byte by byte, the match may overlap the output when the offset is smaller than the length
+        const uint8_t* match = output - offset;
+        for (size_t index = 0; index < matchLength; index++)
+            output[index] = match[index];
+        output += matchLength;
+    }
+
+    return output == outputEnd;
+}
@@ -0,0 +1,39 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Compression in the LZ4 block format, so that the data can also be produced or read by the reference LZ4 library.
+// The compressor is a simple greedy matcher, it trades ratio for speed like the fast mode of the reference.
+
+// Maximum size of the compressed data for an input of the given size
+size_t Lz4CompressBound(size_t size);
+
+// Returns the compressed size, or 0 when the destination is too small
+size_t Lz4Compress(const void* source, size_t sourceSize, void* destination, size_t destinationCapacity);
+
+// Returns false when the data is malformed or does not decompress to exactly destinationSize bytes
+bool Lz4Decompress(const void* source, size_t sourceSize, void* destination, size_t destinationSize);
@@ -0,0 +1,112 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "MappedBlob.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedBlob::~MappedBlob()
+{
+    if (!m_Data)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_Data);
+#else
+    munmap(const_cast<void*>(m_Data), m_Size);
+#endif
+}
+
+std::shared_ptr<MappedBlob> MappedBlob::Open(const std::filesystem::path& fileName)
+{
+    // The constructor is private, so make_shared cannot be used
+    std::shared_ptr<MappedBlob> blob(new MappedBlob());
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    // Empty files cannot be mapped, they are returned as an empty blob
+    if (fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return blob;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return nullptr;
+
+    // The view keeps the mapping alive after its handle is closed
+    blob->m_Data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!blob->m_Data)
+        return nullptr;
+
+    blob->m_Size = size_t(fileSize.QuadPart);
+#else
+    int file = open(fileName.c_str(), O_RDONLY);
+    if (file < 0)
+        return nullptr;
+
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0)
+    {
+        close(file);
+        return nullptr;
+    }
+
+    if (fileStat.st_size == 0)
+    {
+        close(file);
+        return blob;
+    }
+
+    void* data = mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    blob->m_Data = data;
+    blob->m_Size = size_t(fileStat.st_size);
+#endif
+
+    return blob;
+}
@@ -0,0 +1,48 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <donut/core/vfs/VFS.h>
+#include <filesystem>
+#include <memory>
+
+// Read-only view of a whole file that is mapped into memory instead of being read into a heap allocation.
+// The OS loads the pages when they are first accessed, so opening a large file is cheap.
+class MappedBlob : public donut::vfs::IBlob
+{
+public:
+    ~MappedBlob() override;
+
+    // Returns nullptr when the file cannot be opened or mapped
+    static std::shared_ptr<MappedBlob> Open(const std::filesystem::path& fileName);
+
+    [[nodiscard]] const void* data() const override { return m_Data; }
+    [[nodiscard]] size_t size() const override { return m_Size; }
+
+private:
+    MappedBlob() = default;
+
+    const void* m_Data = nullptr;
+    size_t m_Size = 0;
+};
@@ -0,0 +1,199 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "MappedFileSystem.h"
+#include "MappedBlob.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <fstream>
+#include <string>
+#endif
+
+using namespace donut;
+
+MappedFileSystem::MappedFileSystem(size_t minMappedFileSize)
+    : m_MinMappedFileSize(minMappedFileSize)
+{
+}
+
+std::shared_ptr<vfs::IBlob> MappedFileSystem::readFile(const std::filesystem::path& name)
+{
+    std::error_code error;
+    const uintmax_t fileSize = std::filesystem::file_size(name, error);
+    if (error || fileSize < m_MinMappedFileSize)
+        return NativeFileSystem::readFile(name);
+
+    if (auto blob = MappedBlob::Open(name))
+        return blob;
+
+    return NativeFileSystem::readFile(name);
+}
+
+// Size of the working set of the process, in bytes
+static size_t GetResidentMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.WorkingSetSize;
+    return 0;
+#else
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return size_t(std::stoull(line.substr(6))) * 1024;
+    }
+    return 0;
+#endif
+}
+
+// Stands in for a parser, reads every byte of the blob
+static uint64_t TouchBlob(const vfs::IBlob& blob)
+{
+    const uint8_t* data = static_cast<const uint8_t*>(blob.data());
+    const size_t size = blob.size();
+
+    uint64_t sum = 0;
+    size_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + offset, sizeof(word));
+        sum += word;
+    }
+    for (; offset < size; offset++)
+        sum += data[offset];
+
+    return sum;
+}
+
+struct FileSystemBenchmarkResult
+{
+    double milliseconds = 0.0;
+    size_t residentGrowth = 0;
+    uint64_t checksum = 0;
+};
+
+// Keeps all blobs alive until every file is read, so the memory growth is the peak that the loads add
+static FileSystemBenchmarkResult ReadAllFiles(vfs::IFileSystem& fs, const std::vector<std::filesystem::path>& files)
+{
+    FileSystemBenchmarkResult result;
+    std::vector<std::shared_ptr<vfs::IBlob>> blobs;
+    blobs.reserve(files.size());
+
+    const size_t residentBefore = GetResidentMemory();
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    for (const auto& file : files)
+    {
+        std::shared_ptr<vfs::IBlob> blob = fs.readFile(file);
+        if (!blob)
+            continue;
+
+        result.checksum += TouchBlob(*blob);
+        blobs.push_back(blob);
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    const size_t residentAfter = GetResidentMemory();
+
+    result.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    result.residentGrowth = residentAfter > residentBefore ? residentAfter - residentBefore : 0;
+
+    return result;
+}
+
+void RunFileSystemBenchmark(const std::filesystem::path& folder)
+{
+    constexpr int numIterations = 5;
+
+    std::vector<std::filesystem::path> files;
+    uint64_t totalSize = 0;
+
+    std::error_code error;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(folder, error))
+    {
+        if (!entry.is_regular_file())
+            continue;
+
+        files.push_back(entry.path());
+        totalSize += entry.file_size();
+    }
+
+    if (files.empty())
+    {
+        log::error("No files found in '%s'", folder.generic_string().c_str());
+        return;
+    }
+
+    log::info("Reading %d files, %.1f MB, from '%s'", int(files.size()), double(totalSize) / (1024.0 * 1024.0), folder.generic_string().c_str());
+
+    vfs::NativeFileSystem nativeFS;
+    MappedFileSystem mappedFS;
+
+    // Brings the files into the OS file cache, so that both file systems are measured with warm caches
+    const uint64_t expectedChecksum = ReadAllFiles(nativeFS, files).checksum;
+
+    struct Candidate
+    {
+        const char* name;
+        vfs::IFileSystem* fs;
+    };
+
+    const Candidate candidates[] = {
+        { "native", &nativeFS },
+        { "mapped", &mappedFS }
+    };
+
+    for (const Candidate& candidate : candidates)
+    {
+        double totalMilliseconds = 0.0;
+        size_t maxResidentGrowth = 0;
+        bool checksumMatches = true;
+
+        for (int iteration = 0; iteration < numIterations; iteration++)
+        {
+            FileSystemBenchmarkResult result = ReadAllFiles(*candidate.fs, files);
+            totalMilliseconds += result.milliseconds;
+            maxResidentGrowth = std::max(maxResidentGrowth, result.residentGrowth);
+
+            if (result.checksum != expectedChecksum)
+                checksumMatches = false;
+        }
+
+        log::info("%s: %.2f ms per pass, peak resident memory growth %.1f MB%s", candidate.name,
+            totalMilliseconds / numIterations, double(maxResidentGrowth) / (1024.0 * 1024.0),
+            checksumMatches ? "" : " (CONTENT MISMATCH)");
+    }
+}
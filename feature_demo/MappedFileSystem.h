@@ -0,0 +1,47 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <donut/core/vfs/VFS.h>
+#include <filesystem>
+#include <memory>
+
+// Native file system that returns memory-mapped blobs instead of copying whole files into heap blobs,
+// so that large glTF buffers and textures can be parsed and uploaded straight from the file pages.
+// Files smaller than minMappedFileSize are still read, mapping them costs more than the copy.
+// Mount it through a RelativeFileSystem to use it for a directory.
+class MappedFileSystem : public donut::vfs::NativeFileSystem
+{
+public:
+    explicit MappedFileSystem(size_t minMappedFileSize = 64 * 1024);
+
+    std::shared_ptr<donut::vfs::IBlob> readFile(const std::filesystem::path& name) override;
+
+private:
+    size_t m_MinMappedFileSize;
+};
+
+// Reads every file under a folder through NativeFileSystem and through MappedFileSystem, touching all bytes
+// the way a parser would, and prints the read times and the resident memory growth of both to the log.
+void RunFileSystemBenchmark(const std::filesystem::path& folder);
@@ -0,0 +1,294 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "PackedArchive.h"
+#include "MappedBlob.h"
+#include "Lz4.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+using namespace donut;
+
+// An uncompressed file in the archive, keeps the mapping alive while the file is used
+class ArchiveEntryBlob : public vfs::IBlob
+{
+public:
+    ArchiveEntryBlob(std::shared_ptr<MappedBlob> archive, const void* data, size_t size)
+        : m_Archive(std::move(archive))
+        , m_Data(data)
+        , m_Size(size)
+    { }
+
+    [[nodiscard]] const void* data() const override { return m_Data; }
+    [[nodiscard]] size_t size() const override { return m_Size; }
+
+private:
+    std::shared_ptr<MappedBlob> m_Archive;
+    const void* m_Data;
+    size_t m_Size;
+};
+
+static std::string ToLower(std::string_view value)
+{
+    std::string result(value);
+    std::transform(result.begin(), result.end(), result.begin(), [](char c) { return char(tolower(uint8_t(c))); });
+    return result;
+}
+
+std::shared_ptr<PackedFileSystem> PackedFileSystem::Open(const std::filesystem::path& archiveFileName)
+{
+    std::shared_ptr<MappedBlob> archive = MappedBlob::Open(archiveFileName);
+    if (!archive)
+    {
+        log::warning("Cannot open the archive '%s'", archiveFileName.generic_string().c_str());
+        return nullptr;
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(archive->data());
+    const uint64_t size = archive->size();
+
+    PackedArchiveHeader header{};
+    if (size >= sizeof(header))
+        memcpy(&header, data, sizeof(header));
+
+    // The table is used in place, so it must be aligned for its 64-bit fields
+    const bool headerValid = size >= sizeof(header)
+        && header.magic == c_PackedArchiveMagic
+        && header.version == c_PackedArchiveVersion
+        && header.entriesOffset % alignof(PackedArchiveEntry) == 0
+        && header.entriesOffset <= size
+        && uint64_t(header.numEntries) * sizeof(PackedArchiveEntry) <= size - header.entriesOffset
+        && header.namesOffset <= size
+        && header.namesSize <= size - header.namesOffset;
+
+    if (!headerValid)
+    {
+        log::warning("'%s' is not a valid archive", archiveFileName.generic_string().c_str());
+        return nullptr;
+    }
+
+    std::shared_ptr<PackedFileSystem> fs = std::make_shared<PackedFileSystem>();
+    fs->m_Archive = archive;
+    fs->m_Entries = reinterpret_cast<const PackedArchiveEntry*>(data + header.entriesOffset);
+    fs->m_NumEntries = header.numEntries;
+    fs->m_Names = reinterpret_cast<const char*>(data + header.namesOffset);
+
+    // Validating all entries once makes the lookups safe, the binary search also relies on the order
+    for (uint32_t index = 0; index < fs->m_NumEntries; index++)
+    {
+        const PackedArchiveEntry& entry = fs->m_Entries[index];
+
+        const bool entryValid = uint64_t(entry.nameOffset) + entry.nameLength <= header.namesSize
+            && entry.dataOffset <= size
+            && entry.storedSize <= size - entry.dataOffset
+            && ((entry.flags & PackedArchiveEntry_Lz4) != 0 || entry.storedSize == entry.size)
+            && (index == 0 || fs->GetName(index - 1) < fs->GetName(index));
+
+        if (!entryValid)
+        {
+            log::warning("The archive '%s' has an invalid entry %d", archiveFileName.generic_string().c_str(), int(index));
+            return nullptr;
+        }
+    }
+
+    return fs;
+}
+
+std::string PackedFileSystem::GetArchiveName(const std::filesystem::path& path)
+{
+    std::string name = path.lexically_normal().generic_string();
+
+    size_t start = 0;
+    while (start < name.size() && name[start] == '/')
+        start++;
+
+    size_t end = name.size();
+    while (end > start && name[end - 1] == '/')
+        end--;
+
+    name = name.substr(start, end - start);
+    return name == "." ? std::string() : name;
+}
+
+std::string PackedFileSystem::GetFolderPrefix(const std::filesystem::path& path)
+{
+    std::string prefix = GetArchiveName(path);
+    if (!prefix.empty())
+        prefix += '/';
+    return prefix;
+}
+
+std::string_view PackedFileSystem::GetName(uint32_t index) const
+{
+    const PackedArchiveEntry& entry = m_Entries[index];
+    return std::string_view(m_Names + entry.nameOffset, entry.nameLength);
+}
+
+uint32_t PackedFileSystem::LowerBound(std::string_view name) const
+{
+    uint32_t first = 0;
+    uint32_t count = m_NumEntries;
+
+    while (count > 0)
+    {
+        const uint32_t step = count / 2;
+        const uint32_t middle = first + step;
+        if (GetName(middle) < name)
+        {
+            first = middle + 1;
+            count -= step + 1;
+        }
+        else
+            count = step;
+    }
+
+    return first;
+}
+
+bool PackedFileSystem::folderExists(const std::filesystem::path& name)
+{
+    const std::string prefix = GetFolderPrefix(name);
+    const uint32_t index = LowerBound(prefix);
+
+    return index < m_NumEntries && GetName(index).substr(0, prefix.size()) == prefix;
+}
+
+bool PackedFileSystem::fileExists(const std::filesystem::path& name)
+{
+    const std::string archiveName = GetArchiveName(name);
+    const uint32_t index = LowerBound(archiveName);
+
+    return index < m_NumEntries && GetName(index) == archiveName;
+}
+
+std::shared_ptr<vfs::IBlob> PackedFileSystem::readFile(const std::filesystem::path& name)
+{
+    const std::string archiveName = GetArchiveName(name);
+    const uint32_t index = LowerBound(archiveName);
+
+    if (index >= m_NumEntries || GetName(index) != archiveName)
+        return nullptr;
+
+    const PackedArchiveEntry& entry = m_Entries[index];
+    const uint8_t* storedData = static_cast<const uint8_t*>(m_Archive->data()) + entry.dataOffset;
+
+    if ((entry.flags & PackedArchiveEntry_Lz4) == 0)
+        return std::make_shared<ArchiveEntryBlob>(m_Archive, storedData, size_t(entry.size));
+
+    // vfs::Blob releases the data with free()
+    void* data = malloc(size_t(entry.size));
+    if (!data)
+        return nullptr;
+
+    if (!Lz4Decompress(storedData, size_t(entry.storedSize), data, size_t(entry.size)))
+    {
+        log::warning("Cannot decompress '%s' from the archive", archiveName.c_str());
+        free(data);
+        return nullptr;
+    }
+
+    return std::make_shared<vfs::Blob>(data, size_t(entry.size));
+}
+
+bool PackedFileSystem::writeFile(const std::filesystem::path& name, const void* data, size_t size)
+{
+    // Archives are created with the packer and read-only at runtime
+    return false;
+}
+
+int PackedFileSystem::enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, vfs::enumerate_callback_t callback, bool allowDuplicates)
+{
+    const std::string prefix = GetFolderPrefix(path);
+    uint32_t index = LowerBound(prefix);
+
+    if (index >= m_NumEntries || GetName(index).substr(0, prefix.size()) != prefix)
+        return vfs::status::PathNotFound;
+
+    std::vector<std::string> lowerExtensions;
+    for (const std::string& extension : extensions)
+        lowerExtensions.push_back(ToLower(extension));
+
+    int numFiles = 0;
+
+    // The entries of a folder and its subfolders are contiguous in the sorted table
+    for (; index < m_NumEntries; index++)
+    {
+        const std::string_view name = GetName(index);
+        if (name.substr(0, prefix.size()) != prefix)
+            break;
+
+        const std::string_view fileName = name.substr(prefix.size());
+        if (fileName.find('/') != std::string_view::npos)
+            continue;
+
+        if (!lowerExtensions.empty())
+        {
+            const std::string extension = ToLower(std::filesystem::path(fileName).extension().generic_string());
+            if (std::find(lowerExtensions.begin(), lowerExtensions.end(), extension) == lowerExtensions.end())
+                continue;
+        }
+
+        callback(fileName);
+        numFiles++;
+    }
+
+    return numFiles;
+}
+
+int PackedFileSystem::enumerateDirectories(const std::filesystem::path& path, vfs::enumerate_callback_t callback, bool allowDuplicates)
+{
+    const std::string prefix = GetFolderPrefix(path);
+    uint32_t index = LowerBound(prefix);
+
+    if (index >= m_NumEntries || GetName(index).substr(0, prefix.size()) != prefix)
+        return vfs::status::PathNotFound;
+
+    int numDirectories = 0;
+    std::string_view previousDirectory;
+
+    for (; index < m_NumEntries; index++)
+    {
+        const std::string_view name = GetName(index);
+        if (name.substr(0, prefix.size()) != prefix)
+            break;
+
+        const std::string_view relativeName = name.substr(prefix.size());
+        const size_t slash = relativeName.find('/');
+        if (slash == std::string_view::npos)
+            continue;
+
+        // All files of a subfolder are next to each other, so every subfolder is reported once
+        const std::string_view directory = relativeName.substr(0, slash);
+        if (numDirectories > 0 && directory == previousDirectory)
+            continue;
+
+        callback(directory);
+        previousDirectory = directory;
+        numDirectories++;
+    }
+
+    return numDirectories;
+}
@@ -0,0 +1,101 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <donut/core/vfs/VFS.h>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class MappedBlob;
+
+// Packed archive layout: the header, the file data, the names of the files, and the table of contents.
+// Table entries are sorted by name, which is the path of the file relative to the archive root with forward slashes.
+// File data is aligned to 16 bytes, entries with the LZ4 flag are stored as one LZ4 block.
+constexpr uint32_t c_PackedArchiveMagic = 0x4B415044; // "DPAK" in little endian
+constexpr uint32_t c_PackedArchiveVersion = 1;
+constexpr uint64_t c_PackedArchiveAlignment = 16;
+
+struct PackedArchiveHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numEntries;
+    uint32_t reserved;
+    uint64_t entriesOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+enum PackedArchiveEntryFlags : uint32_t
+{
+    PackedArchiveEntry_Lz4 = 0x1
+};
+
+struct PackedArchiveEntry
+{
+    uint32_t nameOffset; // into the names block
+    uint32_t nameLength;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t dataOffset;
+    uint64_t storedSize;
+    uint64_t size;
+};
+
+// Read-only file system over a packed archive. The archive is mapped into memory once, files are looked up
+// with a binary search in the table of contents, and uncompressed files are returned as views into the mapping.
+// Mount a folder of the archive through a RelativeFileSystem to use it in place of a native directory.
+class PackedFileSystem : public donut::vfs::IFileSystem
+{
+public:
+    // Returns nullptr when the file cannot be mapped or is not a valid archive
+    static std::shared_ptr<PackedFileSystem> Open(const std::filesystem::path& archiveFileName);
+
+    bool folderExists(const std::filesystem::path& name) override;
+    bool fileExists(const std::filesystem::path& name) override;
+    std::shared_ptr<donut::vfs::IBlob> readFile(const std::filesystem::path& name) override;
+    bool writeFile(const std::filesystem::path& name, const void* data, size_t size) override;
+    int enumerateFiles(const std::filesystem::path& path, const std::vector<std::string>& extensions, donut::vfs::enumerate_callback_t callback, bool allowDuplicates = false) override;
+    int enumerateDirectories(const std::filesystem::path& path, donut::vfs::enumerate_callback_t callback, bool allowDuplicates = false) override;
+
+    uint32_t GetNumEntries() const { return m_NumEntries; }
+
+    // Converts a path to the form used for the names in the archive: relative, normalized, with forward slashes
+    static std::string GetArchiveName(const std::filesystem::path& path);
+
+private:
+    std::shared_ptr<MappedBlob> m_Archive;
+    const PackedArchiveEntry* m_Entries = nullptr;
+    uint32_t m_NumEntries = 0;
+    const char* m_Names = nullptr;
+
+    std::string_view GetName(uint32_t index) const;
+    // Index of the first entry whose name is not less than the given one
+    uint32_t LowerBound(std::string_view name) const;
+    // Prefix that the names of the entries in a folder start with
+    static std::string GetFolderPrefix(const std::filesystem::path& path);
+};
@@ -0,0 +1,1119 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "SceneCache.h"
+#include "MappedBlob.h"
+#include "TextureTranscoder.h"
+#include <donut/core/json.h>
+#include <donut/core/log.h>
+#include <donut/engine/TextureCache.h>
+#include <json/value.h>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+
+// "DSCC" in little endian
+constexpr uint32_t c_SceneCacheMagic = 0x43435344;
+// Increment when the file layout changes
+constexpr uint32_t c_SceneCacheVersion = 3;
+// Bulk data in the file is aligned so that it can be used directly from the mapped memory
+constexpr size_t c_SceneCacheAlignment = 16;
+
+// The vertex attributes that static meshes have, in the order in which they are packed into the vertex buffer
+static const VertexAttribute c_CachedAttributes[] = {
+    VertexAttribute::Position,
+    VertexAttribute::TexCoord1,
+    VertexAttribute::TexCoord2,
+    VertexAttribute::Normal,
+    VertexAttribute::Tangent
+};
+constexpr size_t c_NumCachedAttributes = std::size(c_CachedAttributes);
+
+struct MaterialTextureSlot
+{
+    std::shared_ptr<LoadedTexture> Material::* texture;
+    bool sRGB;
+    TextureUsage usage;
+};
+
+static const MaterialTextureSlot c_MaterialTextureSlots[] = {
+    { &Material::baseOrDiffuseTexture, true, TextureUsage::Color },
+    { &Material::metalRoughOrSpecularTexture, false, TextureUsage::Data },
+    { &Material::normalTexture, false, TextureUsage::Normal },
+    { &Material::emissiveTexture, true, TextureUsage::Color },
+    { &Material::occlusionTexture, false, TextureUsage::Data },
+    { &Material::transmissionTexture, false, TextureUsage::Data }
+};
+
+constexpr uint32_t c_NoMaterial = ~0u;
+
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceStamp;
+    uint32_t numSourceFiles;    // names of the source files follow the header
+    uint32_t materialConstantsSize;
+    uint32_t numBufferGroups;
+    uint32_t numMaterials;
+    uint32_t numMeshes;
+    uint32_t numNodes;
+};
+
+struct CachedBufferGroup
+{
+    uint64_t indexSize;
+    uint64_t vertexSize;
+    uint64_t rangeOffsets[c_NumCachedAttributes];
+    uint64_t rangeSizes[c_NumCachedAttributes];
+};
+
+enum CachedMaterialFlags : uint32_t
+{
+    CachedMaterial_UseSpecularGlossModel = 0x01,
+    CachedMaterial_DoubleSided = 0x02,
+    CachedMaterial_EnableBaseOrDiffuseTexture = 0x04,
+    CachedMaterial_EnableMetalRoughOrSpecularTexture = 0x08,
+    CachedMaterial_EnableNormalTexture = 0x10,
+    CachedMaterial_EnableEmissiveTexture = 0x20,
+    CachedMaterial_EnableOcclusionTexture = 0x40,
+    CachedMaterial_EnableTransmissionTexture = 0x80
+};
+
+struct CachedMaterial
+{
+    int32_t materialID;
+    uint32_t domain;
+    uint32_t flags;
+    float3 baseOrDiffuseColor;
+    float3 specularColor;
+    float3 emissiveColor;
+    float emissiveIntensity;
+    float metalness;
+    float roughness;
+    float opacity;
+    float alphaCutoff;
+    float transmissionFactor;
+    float normalTextureScale;
+    float occlusionStrength;
+};
+
+struct CachedMesh
+{
+    uint32_t bufferGroup;
+    uint32_t numGeometries;
+    uint32_t indexOffset;
+    uint32_t vertexOffset;
+    uint32_t totalIndices;
+    uint32_t totalVertices;
+    box3 objectSpaceBounds;
+};
+
+struct CachedGeometry
+{
+    uint32_t material;
+    uint32_t indexOffsetInMesh;
+    uint32_t vertexOffsetInMesh;
+    uint32_t numIndices;
+    uint32_t numVertices;
+    box3 objectSpaceBounds;
+};
+
+enum class CachedLeafType : uint32_t
+{
+    None,
+    MeshInstance,
+    DirectionalLight,
+    PointLight,
+    SpotLight,
+    PerspectiveCamera,
+    SourceModel // the subtree is imported from the model that the scene file places on the node
+};
+
+struct CachedNode
+{
+    int32_t parent; // -1 for the root node
+    CachedLeafType leafType;
+    uint32_t mesh;
+    double3 translation;
+    dquat rotation;
+    double3 scaling;
+};
+
+// Directional lights store their irradiance in 'intensity' and their angular size in 'radius'
+struct CachedLight
+{
+    float3 color;
+    float intensity;
+    float range;
+    float radius;
+    float innerAngle;
+    float outerAngle;
+};
+
+// Optional values are stored as 0 when they are not set
+struct CachedCamera
+{
+    float zNear;
+    float zFar;
+    float verticalFov;
+    float aspectRatio;
+};
+
+class CacheWriter
+{
+public:
+    template<typename T>
+    void Write(const T& value)
+    {
+        WriteBytes(&value, sizeof(T));
+    }
+
+    void WriteBytes(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        m_Data.insert(m_Data.end(), bytes, bytes + size);
+    }
+
+    void WriteString(const std::string& value)
+    {
+        Write(uint32_t(value.size()));
+        WriteBytes(value.data(), value.size());
+    }
+
+    void Align()
+    {
+        m_Data.resize((m_Data.size() + c_SceneCacheAlignment - 1) & ~(c_SceneCacheAlignment - 1), 0);
+    }
+
+    const std::vector<uint8_t>& GetData() const { return m_Data; }
+
+private:
+    std::vector<uint8_t> m_Data;
+};
+
+// Reads from the mapped file. Every read is checked against the end of the file, a truncated file makes all following reads fail.
+class CacheReader
+{
+public:
+    CacheReader(const void* data, size_t size)
+        : m_Data(static_cast<const uint8_t*>(data))
+        , m_Size(size)
+    { }
+
+    template<typename T>
+    bool Read(T& value)
+    {
+        const void* source = ReadBytes(sizeof(T), false);
+        if (!source)
+            return false;
+
+        memcpy(&value, source, sizeof(T));
+        return true;
+    }
+
+    bool ReadString(std::string& value)
+    {
+        uint32_t length = 0;
+        if (!Read(length))
+            return false;
+
+        const char* source = static_cast<const char*>(ReadBytes(length, false));
+        if (!source)
+            return false;
+
+        value.assign(source, length);
+        return true;
+    }
+
+    // Returns a pointer into the mapped file, or nullptr when the file is too short
+    const void* ReadBytes(size_t size, bool aligned)
+    {
+        if (aligned)
+            m_Offset = (m_Offset + c_SceneCacheAlignment - 1) & ~(c_SceneCacheAlignment - 1);
+
+        if (!m_Valid || m_Offset > m_Size || size > m_Size - m_Offset)
+        {
+            m_Valid = false;
+            return nullptr;
+        }
+
+        const void* result = m_Data + m_Offset;
+        m_Offset += size;
+        return result;
+    }
+
+    bool IsValid() const { return m_Valid; }
+
+private:
+    const uint8_t* m_Data;
+    size_t m_Size;
+    size_t m_Offset = 0;
+    bool m_Valid = true;
+};
+
+// Size and modification time of a file, or 0 when it does not exist
+static uint64_t GetFileStamp(const std::filesystem::path& fileName)
+{
+    std::error_code error;
+    const uint64_t fileSize = std::filesystem::file_size(fileName, error);
+    if (error)
+        return 0;
+
+    const auto writeTime = std::filesystem::last_write_time(fileName, error);
+    if (error)
+        return 0;
+
+    return uint64_t(writeTime.time_since_epoch().count()) * 0x9E3779B97F4A7C15ull ^ fileSize;
+}
+
+uint64_t GetSceneCacheSourceStamp(const std::vector<std::filesystem::path>& sourceFileNames)
+{
+    // FNV-1a over the names and the stamps of the files
+    uint64_t stamp = 0xCBF29CE484222325ull;
+    auto combine = [&stamp](uint64_t value)
+    {
+        stamp ^= value;
+        stamp *= 0x100000001B3ull;
+    };
+
+    for (const std::filesystem::path& fileName : sourceFileNames)
+    {
+        combine(std::hash<std::string>()(fileName.generic_string()));
+        combine(GetFileStamp(fileName));
+    }
+
+    return stamp;
+}
+
+static void CollectNodes(const SceneGraphNode* node, int32_t parent, const std::unordered_set<const SceneGraphNode*>& sourceModelNodes,
+    std::vector<std::pair<const SceneGraphNode*, int32_t>>& nodes)
+{
+    const int32_t index = int32_t(nodes.size());
+    nodes.push_back(std::make_pair(node, parent));
+
+    if (sourceModelNodes.count(node))
+        return;
+
+    for (const SceneGraphNode* child = node->GetFirstChild(); child; child = child->GetNextSibling())
+        CollectNodes(child, index, sourceModelNodes, nodes);
+}
+
+// Adds the top level node that contains a node to the set, or returns false when the node is the root
+static bool AddSourceModelNode(const SceneGraphNode* rootNode, const SceneGraphNode* node, std::unordered_set<const SceneGraphNode*>& sourceModelNodes)
+{
+    if (!node)
+        return true;
+
+    if (node == rootNode)
+        return false;
+
+    while (node->GetParent() && node->GetParent() != rootNode)
+        node = node->GetParent();
+
+    sourceModelNodes.insert(node);
+    return true;
+}
+
+// Finds the top level nodes of the scene graph that contain animated or skinned nodes, which are not baked
+static bool CollectSourceModelNodes(const SceneGraph& sceneGraph, std::unordered_set<const SceneGraphNode*>& sourceModelNodes)
+{
+    const SceneGraphNode* rootNode = sceneGraph.GetRootNode().get();
+    bool valid = true;
+
+    for (const auto& skinnedInstance : sceneGraph.GetSkinnedMeshInstances())
+    {
+        valid = AddSourceModelNode(rootNode, skinnedInstance->GetNode(), sourceModelNodes) && valid;
+
+        for (const auto& joint : skinnedInstance->joints)
+            valid = AddSourceModelNode(rootNode, joint.node.get(), sourceModelNodes) && valid;
+    }
+
+    for (const auto& animation : sceneGraph.GetAnimations())
+    {
+        valid = AddSourceModelNode(rootNode, animation->GetNode(), sourceModelNodes) && valid;
+
+        for (const auto& channel : animation->GetChannels())
+            valid = AddSourceModelNode(rootNode, channel->GetTargetNode().get(), sourceModelNodes) && valid;
+    }
+
+    return valid;
+}
+
+static bool WriteBufferGroup(CacheWriter& writer, const BufferGroup& buffers)
+{
+    if (buffers.positionData.empty())
+    {
+        log::warning("A buffer group has no CPU side vertex data, the scene cache must be written before the buffers are uploaded");
+        return false;
+    }
+
+    const std::pair<const void*, size_t> attributeData[c_NumCachedAttributes] = {
+        { buffers.positionData.data(), buffers.positionData.size() * sizeof(buffers.positionData[0]) },
+        { buffers.texcoord1Data.data(), buffers.texcoord1Data.size() * sizeof(buffers.texcoord1Data[0]) },
+        { buffers.texcoord2Data.data(), buffers.texcoord2Data.size() * sizeof(buffers.texcoord2Data[0]) },
+        { buffers.normalData.data(), buffers.normalData.size() * sizeof(buffers.normalData[0]) },
+        { buffers.tangentData.data(), buffers.tangentData.size() * sizeof(buffers.tangentData[0]) }
+    };
+
+    CachedBufferGroup cachedGroup{};
+    cachedGroup.indexSize = buffers.indexData.size() * sizeof(uint32_t);
+
+    for (size_t attribute = 0; attribute < c_NumCachedAttributes; attribute++)
+    {
+        cachedGroup.rangeOffsets[attribute] = cachedGroup.vertexSize;
+        cachedGroup.rangeSizes[attribute] = attributeData[attribute].second;
+        cachedGroup.vertexSize += (attributeData[attribute].second + c_SceneCacheAlignment - 1) & ~(c_SceneCacheAlignment - 1);
+    }
+
+    writer.Write(cachedGroup);
+
+    writer.Align();
+    writer.WriteBytes(buffers.indexData.data(), cachedGroup.indexSize);
+
+    // The vertex data is written in its final layout, with the padding between the attributes, so that it is uploaded in one piece
+    writer.Align();
+    for (const auto& [data, size] : attributeData)
+    {
+        writer.WriteBytes(data, size);
+        writer.Align();
+    }
+
+    return true;
+}
+
+static void WriteMaterial(CacheWriter& writer, const Material& material)
+{
+    CachedMaterial cachedMaterial{};
+    cachedMaterial.materialID = material.materialID;
+    cachedMaterial.domain = uint32_t(material.domain);
+    cachedMaterial.baseOrDiffuseColor = material.baseOrDiffuseColor;
+    cachedMaterial.specularColor = material.specularColor;
+    cachedMaterial.emissiveColor = material.emissiveColor;
+    cachedMaterial.emissiveIntensity = material.emissiveIntensity;
+    cachedMaterial.metalness = material.metalness;
+    cachedMaterial.roughness = material.roughness;
+    cachedMaterial.opacity = material.opacity;
+    cachedMaterial.alphaCutoff = material.alphaCutoff;
+    cachedMaterial.transmissionFactor = material.transmissionFactor;
+    cachedMaterial.normalTextureScale = material.normalTextureScale;
+    cachedMaterial.occlusionStrength = material.occlusionStrength;
+
+    if (material.useSpecularGlossModel) cachedMaterial.flags |= CachedMaterial_UseSpecularGlossModel;
+    if (material.doubleSided) cachedMaterial.flags |= CachedMaterial_DoubleSided;
+    if (material.enableBaseOrDiffuseTexture) cachedMaterial.flags |= CachedMaterial_EnableBaseOrDiffuseTexture;
+    if (material.enableMetalRoughOrSpecularTexture) cachedMaterial.flags |= CachedMaterial_EnableMetalRoughOrSpecularTexture;
+    if (material.enableNormalTexture) cachedMaterial.flags |= CachedMaterial_EnableNormalTexture;
+    if (material.enableEmissiveTexture) cachedMaterial.flags |= CachedMaterial_EnableEmissiveTexture;
+    if (material.enableOcclusionTexture) cachedMaterial.flags |= CachedMaterial_EnableOcclusionTexture;
+    if (material.enableTransmissionTexture) cachedMaterial.flags |= CachedMaterial_EnableTransmissionTexture;
+
+    writer.WriteString(material.name);
+    writer.Write(cachedMaterial);
+
+    for (const MaterialTextureSlot& slot : c_MaterialTextureSlots)
+    {
+        const auto& texture = material.*slot.texture;
+        writer.WriteString(texture ? texture->path : std::string());
+    }
+
+    MaterialConstants constants{};
+    material.FillConstantBuffer(constants);
+    writer.Align();
+    writer.Write(constants);
+}
+
+bool WriteSceneCache(const SceneGraph& sceneGraph, const std::filesystem::path& cacheFileName, const std::vector<std::filesystem::path>& sourceFileNames)
+{
+    // The animated and skinned models are imported from their files when the cache is loaded,
+    // which needs a scene file that places them on its top level nodes
+    std::unordered_set<const SceneGraphNode*> sourceModelNodes;
+    if (!CollectSourceModelNodes(sceneGraph, sourceModelNodes)
+        || (!sourceModelNodes.empty() && (sourceFileNames.empty() || sourceFileNames[0].extension() != ".json")))
+    {
+        log::warning("The scene has animations or skinned meshes that are not in a model of a scene file, which the scene cache does not support");
+        return false;
+    }
+
+    std::vector<const BufferGroup*> bufferGroups;
+    std::vector<const Material*> materials;
+    std::vector<const MeshInfo*> meshes;
+    std::unordered_map<const BufferGroup*, uint32_t> bufferGroupIndices;
+    std::unordered_map<const Material*, uint32_t> materialIndices;
+    std::unordered_map<const MeshInfo*, uint32_t> meshIndices;
+
+    std::vector<std::pair<const SceneGraphNode*, int32_t>> nodes;
+    CollectNodes(sceneGraph.GetRootNode().get(), -1, sourceModelNodes, nodes);
+
+    // Only the meshes and materials that are referenced from the node hierarchy are written
+    for (const auto& [node, parent] : nodes)
+    {
+        const MeshInstance* meshInstance = dynamic_cast<const MeshInstance*>(node->GetLeaf().get());
+        if (!meshInstance)
+            continue;
+
+        const MeshInfo* mesh = meshInstance->GetMesh().get();
+        if (!meshIndices.emplace(mesh, uint32_t(meshes.size())).second)
+            continue;
+        meshes.push_back(mesh);
+
+        if (bufferGroupIndices.emplace(mesh->buffers.get(), uint32_t(bufferGroups.size())).second)
+            bufferGroups.push_back(mesh->buffers.get());
+
+        for (const auto& geometry : mesh->geometries)
+        {
+            const Material* material = geometry->material.get();
+            if (material && materialIndices.emplace(material, uint32_t(materials.size())).second)
+                materials.push_back(material);
+        }
+    }
+
+    CacheWriter writer;
+
+    CacheHeader header{};
+    header.magic = c_SceneCacheMagic;
+    header.version = c_SceneCacheVersion;
+    header.sourceStamp = GetSceneCacheSourceStamp(sourceFileNames);
+    header.numSourceFiles = uint32_t(sourceFileNames.size());
+    header.materialConstantsSize = sizeof(MaterialConstants);
+    header.numBufferGroups = uint32_t(bufferGroups.size());
+    header.numMaterials = uint32_t(materials.size());
+    header.numMeshes = uint32_t(meshes.size());
+    header.numNodes = uint32_t(nodes.size());
+    writer.Write(header);
+
+    for (const std::filesystem::path& fileName : sourceFileNames)
+        writer.WriteString(fileName.generic_string());
+
+    for (const BufferGroup* buffers : bufferGroups)
+    {
+        if (!WriteBufferGroup(writer, *buffers))
+            return false;
+    }
+
+    for (const Material* material : materials)
+        WriteMaterial(writer, *material);
+
+    for (const MeshInfo* mesh : meshes)
+    {
+        CachedMesh cachedMesh{};
+        cachedMesh.bufferGroup = bufferGroupIndices[mesh->buffers.get()];
+        cachedMesh.numGeometries = uint32_t(mesh->geometries.size());
+        cachedMesh.indexOffset = mesh->indexOffset;
+        cachedMesh.vertexOffset = mesh->vertexOffset;
+        cachedMesh.totalIndices = mesh->totalIndices;
+        cachedMesh.totalVertices = mesh->totalVertices;
+        cachedMesh.objectSpaceBounds = mesh->objectSpaceBounds;
+
+        writer.WriteString(mesh->name);
+        writer.Write(cachedMesh);
+
+        for (const auto& geometry : mesh->geometries)
+        {
+            CachedGeometry cachedGeometry{};
+            cachedGeometry.material = geometry->material ? materialIndices[geometry->material.get()] : c_NoMaterial;
+            cachedGeometry.indexOffsetInMesh = geometry->indexOffsetInMesh;
+            cachedGeometry.vertexOffsetInMesh = geometry->vertexOffsetInMesh;
+            cachedGeometry.numIndices = geometry->numIndices;
+            cachedGeometry.numVertices = geometry->numVertices;
+            cachedGeometry.objectSpaceBounds = geometry->objectSpaceBounds;
+            writer.Write(cachedGeometry);
+        }
+    }
+
+    for (const auto& [node, parent] : nodes)
+    {
+        CachedNode cachedNode{};
+        cachedNode.parent = parent;
+        cachedNode.translation = node->GetTranslation();
+        cachedNode.rotation = node->GetRotation();
+        cachedNode.scaling = node->GetScaling();
+
+        CachedLight cachedLight{};
+        CachedCamera cachedCamera{};
+        const SceneGraphLeaf* leaf = node->GetLeaf().get();
+
+        if (sourceModelNodes.count(node))
+        {
+            // The scene file places the model on a node without a leaf
+            if (leaf)
+            {
+                log::warning("Node '%s' has animated or skinned children and a leaf, which the scene cache does not support", node->GetName().c_str());
+                return false;
+            }
+            cachedNode.leafType = CachedLeafType::SourceModel;
+        }
+        else if (!leaf)
+        {
+            cachedNode.leafType = CachedLeafType::None;
+        }
+        else if (auto meshInstance = dynamic_cast<const MeshInstance*>(leaf))
+        {
+            cachedNode.leafType = CachedLeafType::MeshInstance;
+            cachedNode.mesh = meshIndices[meshInstance->GetMesh().get()];
+        }
+        else if (auto directionalLight = dynamic_cast<const DirectionalLight*>(leaf))
+        {
+            cachedNode.leafType = CachedLeafType::DirectionalLight;
+            cachedLight.color = directionalLight->color;
+            cachedLight.intensity = directionalLight->irradiance;
+            cachedLight.radius = directionalLight->angularSize;
+        }
+        else if (auto spotLight = dynamic_cast<const SpotLight*>(leaf))
+        {
+            cachedNode.leafType = CachedLeafType::SpotLight;
+            cachedLight.color = spotLight->color;
+            cachedLight.intensity = spotLight->intensity;
+            cachedLight.range = spotLight->range;
+            cachedLight.radius = spotLight->radius;
+            cachedLight.innerAngle = spotLight->innerAngle;
+            cachedLight.outerAngle = spotLight->outerAngle;
+        }
+        else if (auto pointLight = dynamic_cast<const PointLight*>(leaf))
+        {
+            cachedNode.leafType = CachedLeafType::PointLight;
+            cachedLight.color = pointLight->color;
+            cachedLight.intensity = pointLight->intensity;
+            cachedLight.range = pointLight->range;
+            cachedLight.radius = pointLight->radius;
+        }
+        else if (auto camera = dynamic_cast<const PerspectiveCamera*>(leaf))
+        {
+            cachedNode.leafType = CachedLeafType::PerspectiveCamera;
+            cachedCamera.zNear = camera->zNear;
+            cachedCamera.zFar = camera->zFar.value_or(0.f);
+            cachedCamera.verticalFov = camera->verticalFov;
+            cachedCamera.aspectRatio = camera->aspectRatio.value_or(0.f);
+        }
+        else
+        {
+            log::warning("Node '%s' has a leaf type that the scene cache does not support", node->GetName().c_str());
+            return false;
+        }
+
+        writer.WriteString(node->GetName());
+        writer.Write(cachedNode);
+
+        if (cachedNode.leafType == CachedLeafType::DirectionalLight || cachedNode.leafType == CachedLeafType::PointLight || cachedNode.leafType == CachedLeafType::SpotLight)
+            writer.Write(cachedLight);
+        else if (cachedNode.leafType == CachedLeafType::PerspectiveCamera)
+            writer.Write(cachedCamera);
+    }
+
+    std::ofstream file(cacheFileName, std::ios::binary);
+    if (!file.is_open())
+    {
+        log::warning("Cannot open '%s' for writing", cacheFileName.generic_string().c_str());
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(writer.GetData().data()), std::streamsize(writer.GetData().size()));
+    if (!file.good())
+    {
+        log::warning("Cannot write the scene cache '%s'", cacheFileName.generic_string().c_str());
+        return false;
+    }
+
+    log::info("Scene cache written to '%s' (%d source files, %d buffer groups, %d materials, %d meshes, %d nodes, %d animated or skinned models, %.1f MB)",
+        cacheFileName.generic_string().c_str(), int(sourceFileNames.size()), int(bufferGroups.size()), int(materials.size()), int(meshes.size()), int(nodes.size()),
+        int(sourceModelNodes.size()), double(writer.GetData().size()) / (1024.0 * 1024.0));
+
+    return true;
+}
+
+CachedScene::CachedScene(nvrhi::IDevice* device, ShaderFactory& shaderFactory, std::shared_ptr<vfs::IFileSystem> fs,
+    std::shared_ptr<TextureCache> textureCache, std::shared_ptr<DescriptorTableManager> descriptorTable,
+    std::shared_ptr<SceneTypeFactory> sceneTypeFactory, const std::filesystem::path& cacheFileName)
+    : Scene(device, shaderFactory, fs, textureCache, descriptorTable, sceneTypeFactory)
+    , m_CacheFileName(cacheFileName)
+    , m_FileSystem(fs)
+    , m_ModelImporter(fs, sceneTypeFactory ? sceneTypeFactory : std::make_shared<SceneTypeFactory>())
+{
+}
+
+bool CachedScene::LoadWithExecutor(const std::filesystem::path& sceneFileName, tf::Executor* executor)
+{
+    if (!m_CacheFileName.empty() && LoadFromCache(sceneFileName, executor))
+    {
+        m_LoadedFromCache = true;
+        return true;
+    }
+
+    m_CacheBlob.reset();
+    m_PendingBufferGroups.clear();
+    m_PendingMaterials.clear();
+    m_DeferredTextures.clear();
+
+    return Scene::LoadWithExecutor(sceneFileName, executor);
+}
+
+bool CachedScene::LoadFromCache(const std::filesystem::path& sceneFileName, tf::Executor* executor)
+{
+    m_CacheBlob = MappedBlob::Open(m_CacheFileName);
+    if (!m_CacheBlob)
+        return false;
+
+    CacheReader reader(m_CacheBlob->data(), m_CacheBlob->size());
+
+    CacheHeader header{};
+    if (!reader.Read(header) || header.magic != c_SceneCacheMagic || header.version != c_SceneCacheVersion
+        || header.materialConstantsSize != sizeof(MaterialConstants))
+    {
+        log::info("The scene cache '%s' has an unsupported format, loading the scene file", m_CacheFileName.generic_string().c_str());
+        return false;
+    }
+
+    std::vector<std::filesystem::path> sourceFileNames;
+    for (uint32_t index = 0; index < header.numSourceFiles; index++)
+    {
+        std::string fileName;
+        if (!reader.ReadString(fileName))
+            break;
+        sourceFileNames.push_back(fileName);
+    }
+
+    if (!reader.IsValid() || header.sourceStamp != GetSceneCacheSourceStamp(sourceFileNames))
+    {
+        log::info("The scene cache '%s' is out of date, loading the scene file", m_CacheFileName.generic_string().c_str());
+        return false;
+    }
+
+    std::vector<std::shared_ptr<BufferGroup>> bufferGroups;
+    for (uint32_t index = 0; index < header.numBufferGroups; index++)
+    {
+        CachedBufferGroup cachedGroup{};
+        reader.Read(cachedGroup);
+
+        PendingBufferGroup pending;
+        pending.buffers = std::make_shared<BufferGroup>();
+        pending.indexSize = cachedGroup.indexSize;
+        pending.indexData = reader.ReadBytes(size_t(cachedGroup.indexSize), true);
+        pending.vertexSize = cachedGroup.vertexSize;
+        pending.vertexData = reader.ReadBytes(size_t(cachedGroup.vertexSize), true);
+
+        for (size_t attribute = 0; attribute < c_NumCachedAttributes; attribute++)
+        {
+            pending.buffers->getVertexBufferRange(c_CachedAttributes[attribute])
+                .setByteOffset(cachedGroup.rangeOffsets[attribute])
+                .setByteSize(cachedGroup.rangeSizes[attribute]);
+        }
+
+        bufferGroups.push_back(pending.buffers);
+        m_PendingBufferGroups.push_back(pending);
+    }
+
+    std::vector<std::shared_ptr<Material>> materials;
+    std::unordered_map<std::string, std::shared_ptr<LoadedTexture>> deferredTextures;
+    for (uint32_t index = 0; index < header.numMaterials; index++)
+    {
+        auto material = std::make_shared<Material>();
+        CachedMaterial cachedMaterial{};
+        reader.ReadString(material->name);
+        reader.Read(cachedMaterial);
+
+        material->materialID = cachedMaterial.materialID;
+        material->domain = MaterialDomain(cachedMaterial.domain);
+        material->baseOrDiffuseColor = cachedMaterial.baseOrDiffuseColor;
+        material->specularColor = cachedMaterial.specularColor;
+        material->emissiveColor = cachedMaterial.emissiveColor;
+        material->emissiveIntensity = cachedMaterial.emissiveIntensity;
+        material->metalness = cachedMaterial.metalness;
+        material->roughness = cachedMaterial.roughness;
+        material->opacity = cachedMaterial.opacity;
+        material->alphaCutoff = cachedMaterial.alphaCutoff;
+        material->transmissionFactor = cachedMaterial.transmissionFactor;
+        material->normalTextureScale = cachedMaterial.normalTextureScale;
+        material->occlusionStrength = cachedMaterial.occlusionStrength;
+        material->useSpecularGlossModel = (cachedMaterial.flags & CachedMaterial_UseSpecularGlossModel) != 0;
+        material->doubleSided = (cachedMaterial.flags & CachedMaterial_DoubleSided) != 0;
+        material->enableBaseOrDiffuseTexture = (cachedMaterial.flags & CachedMaterial_EnableBaseOrDiffuseTexture) != 0;
+        material->enableMetalRoughOrSpecularTexture = (cachedMaterial.flags & CachedMaterial_EnableMetalRoughOrSpecularTexture) != 0;
+        material->enableNormalTexture = (cachedMaterial.flags & CachedMaterial_EnableNormalTexture) != 0;
+        material->enableEmissiveTexture = (cachedMaterial.flags & CachedMaterial_EnableEmissiveTexture) != 0;
+        material->enableOcclusionTexture = (cachedMaterial.flags & CachedMaterial_EnableOcclusionTexture) != 0;
+        material->enableTransmissionTexture = (cachedMaterial.flags & CachedMaterial_EnableTransmissionTexture) != 0;
+
+        for (const MaterialTextureSlot& slot : c_MaterialTextureSlots)
+        {
+            std::string texturePath;
+            reader.ReadString(texturePath);
+            if (texturePath.empty())
+                continue;
+
+            if (m_TextureTranscoder)
+                texturePath = m_TextureTranscoder->GetTranscodedPath(texturePath, slot.usage);
+
+            if (m_DeferTextureLoading)
+            {
+                auto [placeholder, inserted] = deferredTextures.try_emplace(texturePath + (slot.sRGB ? "|sRGB" : ""), nullptr);
+                if (inserted)
+                {
+                    DeferredTexture deferred;
+                    deferred.texture = std::make_shared<LoadedTexture>();
+                    deferred.texture->path = texturePath;
+                    deferred.sRGB = slot.sRGB;
+                    m_DeferredTextures.push_back(deferred);
+                    placeholder->second = deferred.texture;
+                }
+                material.get()->*slot.texture = placeholder->second;
+                continue;
+            }
+
+#ifdef DONUT_WITH_TASKFLOW
+            if (executor)
+            {
+                material.get()->*slot.texture = m_TextureCache->LoadTextureFromFileAsync(texturePath, slot.sRGB, *executor);
+                continue;
+            }
+#endif
+            material.get()->*slot.texture = m_TextureCache->LoadTextureFromFileDeferred(texturePath, slot.sRGB);
+        }
+
+        PendingMaterial pending;
+        pending.material = material;
+        pending.constants = static_cast<const MaterialConstants*>(reader.ReadBytes(sizeof(MaterialConstants), true));
+        m_PendingMaterials.push_back(pending);
+
+        materials.push_back(material);
+    }
+
+    std::vector<std::shared_ptr<MeshInfo>> meshes;
+    for (uint32_t index = 0; index < header.numMeshes; index++)
+    {
+        auto mesh = std::make_shared<MeshInfo>();
+        CachedMesh cachedMesh{};
+        reader.ReadString(mesh->name);
+        if (!reader.Read(cachedMesh) || cachedMesh.bufferGroup >= bufferGroups.size())
+            break;
+
+        mesh->buffers = bufferGroups[cachedMesh.bufferGroup];
+        mesh->indexOffset = cachedMesh.indexOffset;
+        mesh->vertexOffset = cachedMesh.vertexOffset;
+        mesh->totalIndices = cachedMesh.totalIndices;
+        mesh->totalVertices = cachedMesh.totalVertices;
+        mesh->objectSpaceBounds = cachedMesh.objectSpaceBounds;
+
+        for (uint32_t geometryIndex = 0; geometryIndex < cachedMesh.numGeometries; geometryIndex++)
+        {
+            CachedGeometry cachedGeometry{};
+            if (!reader.Read(cachedGeometry))
+                break;
+
+            auto geometry = std::make_shared<MeshGeometry>();
+            if (cachedGeometry.material < materials.size())
+                geometry->material = materials[cachedGeometry.material];
+            geometry->indexOffsetInMesh = cachedGeometry.indexOffsetInMesh;
+            geometry->vertexOffsetInMesh = cachedGeometry.vertexOffsetInMesh;
+            geometry->numIndices = cachedGeometry.numIndices;
+            geometry->numVertices = cachedGeometry.numVertices;
+            geometry->objectSpaceBounds = cachedGeometry.objectSpaceBounds;
+            mesh->geometries.push_back(geometry);
+        }
+
+        meshes.push_back(mesh);
+    }
+
+    std::vector<std::shared_ptr<SceneGraphNode>> nodes;
+    std::vector<std::shared_ptr<SceneGraphNode>> sourceModelNodes;
+    std::vector<std::vector<uint32_t>> children(header.numNodes);
+    for (uint32_t index = 0; index < header.numNodes; index++)
+    {
+        auto node = std::make_shared<SceneGraphNode>();
+        std::string name;
+        CachedNode cachedNode{};
+        reader.ReadString(name);
+        if (!reader.Read(cachedNode))
+            break;
+
+        // Parents always precede their children, the root node is the first one
+        if ((index == 0) != (cachedNode.parent < 0) || cachedNode.parent >= int32_t(index))
+        {
+            log::warning("The scene cache '%s' has an invalid node hierarchy", m_CacheFileName.generic_string().c_str());
+            return false;
+        }
+
+        node->SetName(name);
+        node->SetTranslation(cachedNode.translation);
+        node->SetRotation(cachedNode.rotation);
+        node->SetScaling(cachedNode.scaling);
+
+        CachedLight cachedLight{};
+        CachedCamera cachedCamera{};
+
+        switch (cachedNode.leafType)
+        {
+        case CachedLeafType::None:
+            break;
+
+        case CachedLeafType::SourceModel:
+            sourceModelNodes.push_back(node);
+            break;
+
+        case CachedLeafType::MeshInstance:
+            if (cachedNode.mesh < meshes.size())
+                node->SetLeaf(std::make_shared<MeshInstance>(meshes[cachedNode.mesh]));
+            break;
+
+        case CachedLeafType::DirectionalLight: {
+            reader.Read(cachedLight);
+            auto light = std::make_shared<DirectionalLight>();
+            light->color = cachedLight.color;
+            light->irradiance = cachedLight.intensity;
+            light->angularSize = cachedLight.radius;
+            node->SetLeaf(light);
+            break;
+        }
+
+        case CachedLeafType::PointLight: {
+            reader.Read(cachedLight);
+            auto light = std::make_shared<PointLight>();
+            light->color = cachedLight.color;
+            light->intensity = cachedLight.intensity;
+            light->range = cachedLight.range;
+            light->radius = cachedLight.radius;
+            node->SetLeaf(light);
+            break;
+        }
+
+        case CachedLeafType::SpotLight: {
+            reader.Read(cachedLight);
+            auto light = std::make_shared<SpotLight>();
+            light->color = cachedLight.color;
+            light->intensity = cachedLight.intensity;
+            light->range = cachedLight.range;
+            light->radius = cachedLight.radius;
+            light->innerAngle = cachedLight.innerAngle;
+            light->outerAngle = cachedLight.outerAngle;
+            node->SetLeaf(light);
+            break;
+        }
+
+        case CachedLeafType::PerspectiveCamera: {
+            reader.Read(cachedCamera);
+            auto camera = std::make_shared<PerspectiveCamera>();
+            camera->zNear = cachedCamera.zNear;
+            if (cachedCamera.zFar > 0.f)
+                camera->zFar = cachedCamera.zFar;
+            camera->verticalFov = cachedCamera.verticalFov;
+            if (cachedCamera.aspectRatio > 0.f)
+                camera->aspectRatio = cachedCamera.aspectRatio;
+            node->SetLeaf(camera);
+            break;
+        }
+
+        default:
+            log::warning("The scene cache '%s' has an unknown leaf type", m_CacheFileName.generic_string().c_str());
+            return false;
+        }
+
+        if (index > 0)
+            children[cachedNode.parent].push_back(index);
+        nodes.push_back(node);
+    }
+
+    if (!reader.IsValid() || nodes.size() != header.numNodes || meshes.size() != header.numMeshes)
+    {
+        log::warning("The scene cache '%s' is truncated", m_CacheFileName.generic_string().c_str());
+        return false;
+    }
+
+    std::vector<std::shared_ptr<SceneGraphNode>> modelRoots;
+    if (!sourceModelNodes.empty() && !ImportSourceModels(sceneFileName, sourceModelNodes, executor, modelRoots))
+        return false;
+
+    m_SceneGraph = std::make_shared<SceneGraph>();
+    m_SceneGraph->SetRootNode(nodes[0]);
+
+    // Attach inserts a node in front of the existing children of its parent,
+    // so the children are attached in reverse to keep the order of the source scene.
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty())
+    {
+        const uint32_t parent = stack.back();
+        stack.pop_back();
+
+        for (auto child = children[parent].rbegin(); child != children[parent].rend(); ++child)
+        {
+            m_SceneGraph->Attach(nodes[parent], nodes[*child]);
+            stack.push_back(*child);
+        }
+    }
+
+    // Attaching a model makes a copy of it when it is already attached, as the scene file loader does for models that are placed more than once
+    for (size_t index = 0; index < sourceModelNodes.size(); index++)
+        m_SceneGraph->Attach(sourceModelNodes[index], modelRoots[index]);
+
+    return true;
+}
+
+// Finds a node by name in the graph of a scene file, or returns nullptr
+static const Json::Value* FindSceneFileNode(const Json::Value& nodeList, const std::string& name)
+{
+    if (!nodeList.isArray())
+        return nullptr;
+
+    for (const Json::Value& node : nodeList)
+    {
+        if (node["name"].asString() == name)
+            return &node;
+
+        if (const Json::Value* child = FindSceneFileNode(node["children"], name))
+            return child;
+    }
+
+    return nullptr;
+}
+
+bool CachedScene::ImportSourceModels(const std::filesystem::path& sceneFileName, const std::vector<std::shared_ptr<SceneGraphNode>>& nodes,
+    tf::Executor* executor, std::vector<std::shared_ptr<SceneGraphNode>>& modelRoots)
+{
+    Json::Value documentRoot;
+    if (!json::LoadFromFile(*m_FileSystem, sceneFileName, documentRoot))
+        return false;
+
+    const Json::Value& models = documentRoot["models"];
+    std::unordered_map<int, std::shared_ptr<SceneGraphNode>> importedModels;
+
+    for (const auto& node : nodes)
+    {
+        // The node must be where the scene file places the model, with nothing else below it
+        const Json::Value* sceneFileNode = FindSceneFileNode(documentRoot["graph"], node->GetName());
+        const int modelIndex = sceneFileNode ? (*sceneFileNode)["model"].asInt() : -1;
+        if (!sceneFileNode || !(*sceneFileNode)["model"].isInt() || (*sceneFileNode)["children"].isArray()
+            || modelIndex < 0 || modelIndex >= int(models.size()))
+        {
+            log::info("The scene cache '%s' does not match the models of the scene file, loading the scene file", m_CacheFileName.generic_string().c_str());
+            return false;
+        }
+
+        auto [model, inserted] = importedModels.try_emplace(modelIndex, nullptr);
+        if (inserted)
+        {
+            const std::filesystem::path modelFileName = sceneFileName.parent_path() / models[modelIndex].asString();
+            SceneLoadingStats loadingStats;
+            SceneImportResult importResult;
+            if (!m_ModelImporter.Load(modelFileName, *m_TextureCache, loadingStats, executor, importResult))
+                return false;
+
+            model->second = importResult.rootNode;
+        }
+
+        modelRoots.push_back(model->second);
+    }
+
+    return true;
+}
+
+void CachedScene::RefreshBuffers(nvrhi::ICommandList* commandList, uint32_t frameIndex)
+{
+    // The buffers must exist before the base class creates the geometry data that refers to them
+    if (m_CacheBlob)
+        UploadPendingData(commandList);
+
+    Scene::RefreshBuffers(commandList, frameIndex);
+}
+
+void CachedScene::UploadPendingData(nvrhi::ICommandList* commandList)
+{
+    const bool accelStructBuildInput = m_Device->queryFeatureSupport(nvrhi::Feature::RayTracingAccelStruct);
+
+    for (const PendingBufferGroup& pending : m_PendingBufferGroups)
+    {
+        BufferGroup& buffers = *pending.buffers;
+
+        nvrhi::BufferDesc bufferDesc;
+        bufferDesc.canHaveTypedViews = true;
+        bufferDesc.canHaveRawViews = true;
+        bufferDesc.isAccelStructBuildInput = accelStructBuildInput;
+        nvrhi::ResourceStates extraStates = nvrhi::ResourceStates::ShaderResource;
+        if (accelStructBuildInput)
+            extraStates = extraStates | nvrhi::ResourceStates::AccelStructBuildInput;
+
+        if (pending.indexSize > 0)
+        {
+            bufferDesc.byteSize = pending.indexSize;
+            bufferDesc.format = nvrhi::Format::R32_UINT;
+            bufferDesc.isIndexBuffer = true;
+            bufferDesc.debugName = "IndexBuffer";
+            buffers.indexBuffer = m_Device->createBuffer(bufferDesc);
+
+            commandList->beginTrackingBufferState(buffers.indexBuffer, nvrhi::ResourceStates::CopyDest);
+            commandList->writeBuffer(buffers.indexBuffer, pending.indexData, pending.indexSize);
+            commandList->setPermanentBufferState(buffers.indexBuffer, nvrhi::ResourceStates::IndexBuffer | extraStates);
+        }
+
+        bufferDesc.byteSize = pending.vertexSize;
+        bufferDesc.format = nvrhi::Format::UNKNOWN;
+        bufferDesc.isIndexBuffer = false;
+        bufferDesc.isVertexBuffer = true;
+        bufferDesc.debugName = "VertexBuffer";
+        buffers.vertexBuffer = m_Device->createBuffer(bufferDesc);
+
+        commandList->beginTrackingBufferState(buffers.vertexBuffer, nvrhi::ResourceStates::CopyDest);
+        commandList->writeBuffer(buffers.vertexBuffer, pending.vertexData, pending.vertexSize);
+        commandList->setPermanentBufferState(buffers.vertexBuffer, nvrhi::ResourceStates::VertexBuffer | extraStates);
+
+        if (m_DescriptorTable)
+        {
+            if (buffers.indexBuffer)
+                buffers.indexBufferDescriptor = std::make_shared<DescriptorHandle>(
+                    m_DescriptorTable->CreateDescriptorHandle(nvrhi::BindingSetItem::RawBuffer_SRV(0, buffers.indexBuffer)));
+            buffers.vertexBufferDescriptor = std::make_shared<DescriptorHandle>(
+                m_DescriptorTable->CreateDescriptorHandle(nvrhi::BindingSetItem::RawBuffer_SRV(0, buffers.vertexBuffer)));
+        }
+    }
+
+    for (const PendingMaterial& pending : m_PendingMaterials)
+    {
+        Material& material = *pending.material;
+
+        nvrhi::BufferDesc bufferDesc;
+        bufferDesc.byteSize = sizeof(MaterialConstants);
+        bufferDesc.debugName = material.name;
+        bufferDesc.isConstantBuffer = true;
+        bufferDesc.initialState = nvrhi::ResourceStates::ConstantBuffer;
+        bufferDesc.keepInitialState = true;
+        material.materialConstants = m_Device->createBuffer(bufferDesc);
+
+        commandList->writeBuffer(material.materialConstants, pending.constants, sizeof(MaterialConstants));
+
+        // The baked constants refer to bindless texture indices of the run that wrote the cache,
+        // with a descriptor table they are filled again from the material parameters.
+        material.dirty = m_DescriptorTable != nullptr;
+    }
+
+    m_PendingBufferGroups.clear();
+    m_PendingMaterials.clear();
+    m_CacheBlob.reset();
+}
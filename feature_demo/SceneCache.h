@@ -0,0 +1,123 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <donut/engine/GltfImporter.h>
+#include <donut/engine/Scene.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/SceneTypes.h>
+#include <donut/shaders/material_cb.h>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+class TextureTranscoder;
+
+class MappedBlob;
+
+// Binary cache of a loaded scene, to skip parsing the scene description and the glTF models on startup.
+// The cache holds the index and vertex buffers of every buffer group, packed in the layout described by the
+// vertex buffer ranges, the materials with their constants, the lights and cameras, and the node hierarchy
+// with the local transforms. Textures are referenced by path and loaded through the texture cache.
+// Animations and skinned meshes are not baked. A top level node of the scene file whose model has them is stored
+// without its subtree, and that model is imported from its glTF file when the cache is loaded, so that the static
+// rest of the scene still comes from the cache.
+
+// Returns a value that changes when any of the source files is modified, renamed or removed, stored in the cache to detect stale files
+uint64_t GetSceneCacheSourceStamp(const std::vector<std::filesystem::path>& sourceFileNames);
+
+// Writes the content of a scene graph into a cache file. Must be called before the scene buffers are
+// first refreshed, while the buffer groups still have their CPU data. The source files are the files that the scene
+// was loaded from: the scene file first, then the glTF models and their buffers and textures. Their names are stored in the cache,
+// and the cache is out of date when the stamp of those files changes.
+bool WriteSceneCache(const donut::engine::SceneGraph& sceneGraph, const std::filesystem::path& cacheFileName, const std::vector<std::filesystem::path>& sourceFileNames);
+
+// Scene that loads from a cache file when there is an up to date one, and from the scene file otherwise.
+// The cache file is mapped into memory, and the GPU buffers are written directly from the mapped data
+// on the next buffer refresh, so the geometry is never copied into CPU side arrays.
+class CachedScene : public donut::engine::Scene
+{
+public:
+    CachedScene(nvrhi::IDevice* device, donut::engine::ShaderFactory& shaderFactory, std::shared_ptr<donut::vfs::IFileSystem> fs,
+        std::shared_ptr<donut::engine::TextureCache> textureCache, std::shared_ptr<donut::engine::DescriptorTableManager> descriptorTable,
+        std::shared_ptr<donut::engine::SceneTypeFactory> sceneTypeFactory, const std::filesystem::path& cacheFileName);
+
+    bool LoadWithExecutor(const std::filesystem::path& sceneFileName, tf::Executor* executor) override;
+    void RefreshBuffers(nvrhi::ICommandList* commandList, uint32_t frameIndex) override;
+
+    bool IsLoadedFromCache() const { return m_LoadedFromCache; }
+
+    // Texture of a material that was left for a texture streamer to load
+    struct DeferredTexture
+    {
+        // Placeholder that only has the path, shared by all materials that use the file
+        std::shared_ptr<donut::engine::LoadedTexture> texture;
+        bool sRGB = false;
+    };
+
+    // Makes the materials loaded from the cache reference placeholder textures instead of requesting
+    // the files from the texture cache. Has no effect when the scene file is loaded, and on the models
+    // that are imported from their glTF files because they are animated or skinned.
+    void SetDeferTextureLoading(bool defer) { m_DeferTextureLoading = defer; }
+    const std::vector<DeferredTexture>& GetDeferredTextures() const { return m_DeferredTextures; }
+
+    // Replaces the image files referenced by the cached materials with block compressed DDS files
+    // made by the transcoder. Has no effect when the scene file is loaded, and on the imported models.
+    void SetTextureTranscoder(std::shared_ptr<TextureTranscoder> transcoder) { m_TextureTranscoder = std::move(transcoder); }
+
+private:
+    struct PendingBufferGroup
+    {
+        std::shared_ptr<donut::engine::BufferGroup> buffers;
+        const void* indexData = nullptr;
+        uint64_t indexSize = 0;
+        const void* vertexData = nullptr;
+        uint64_t vertexSize = 0;
+    };
+
+    struct PendingMaterial
+    {
+        std::shared_ptr<donut::engine::Material> material;
+        const MaterialConstants* constants = nullptr;
+    };
+
+    std::filesystem::path m_CacheFileName;
+    std::shared_ptr<donut::vfs::IFileSystem> m_FileSystem;
+    // Imports the animated and skinned models that the cache leaves to their glTF files
+    donut::engine::GltfImporter m_ModelImporter;
+    bool m_LoadedFromCache = false;
+    bool m_DeferTextureLoading = false;
+    std::vector<DeferredTexture> m_DeferredTextures;
+    std::shared_ptr<TextureTranscoder> m_TextureTranscoder;
+
+    // Kept mapped until the pending buffers are written
+    std::shared_ptr<MappedBlob> m_CacheBlob;
+    std::vector<PendingBufferGroup> m_PendingBufferGroups;
+    std::vector<PendingMaterial> m_PendingMaterials;
+
+    bool LoadFromCache(const std::filesystem::path& sceneFileName, tf::Executor* executor);
+    bool ImportSourceModels(const std::filesystem::path& sceneFileName, const std::vector<std::shared_ptr<donut::engine::SceneGraphNode>>& nodes,
+        tf::Executor* executor, std::vector<std::shared_ptr<donut::engine::SceneGraphNode>>& modelRoots);
+    void UploadPendingData(nvrhi::ICommandList* commandList);
+};
@@ -0,0 +1,280 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TextureBudget.h"
+#include <donut/core/log.h>
+#include <donut/engine/TextureCache.h>
+#include <algorithm>
+#include <unordered_set>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::engine;
+
+TextureBudget::TextureBudget(nvrhi::IDevice* device, std::shared_ptr<TextureCache> textureCache)
+    : m_Device(device)
+    , m_TextureCache(std::move(textureCache))
+{
+}
+
+void TextureBudget::BeginScene(const SceneGraph& sceneGraph, const std::vector<CachedScene::DeferredTexture>& streamedTextures,
+    tf::Executor* executor)
+{
+    m_SceneIndex++;
+    m_SceneActive = true;
+
+    for (auto& [path, entry] : m_Entries)
+        entry.materials.clear();
+
+    std::unordered_set<const LoadedTexture*> streamed;
+    for (const auto& deferred : streamedTextures)
+        streamed.insert(deferred.texture.get());
+
+    const std::pair<std::shared_ptr<LoadedTexture> Material::*, bool> slots[] = {
+        { &Material::baseOrDiffuseTexture, true },
+        { &Material::metalRoughOrSpecularTexture, false },
+        { &Material::normalTexture, false },
+        { &Material::emissiveTexture, true },
+        { &Material::occlusionTexture, false },
+        { &Material::transmissionTexture, false }
+    };
+
+    for (const auto& material : sceneGraph.GetMaterials())
+    {
+        for (const auto& [slot, sRGB] : slots)
+        {
+            const std::shared_ptr<LoadedTexture>& texture = material.get()->*slot;
+            if (!texture || texture->path.empty() || streamed.count(texture.get()))
+                continue;
+
+            auto [it, inserted] = m_Entries.try_emplace(texture->path);
+            Entry& entry = it->second;
+
+            // The cache loaded the file again after it was unloaded, or after a trimmed texture was requested again
+            if (entry.texture != texture)
+            {
+                if (inserted && m_EvictedPaths.erase(texture->path))
+                    m_Statistics.reloads++;
+
+                entry.texture = texture;
+                entry.sRGB = sRGB;
+                entry.measuredTexture = nullptr;
+                entry.trimmed = false;
+            }
+
+            entry.lastUsedScene = m_SceneIndex;
+            if (entry.materials.empty() || entry.materials.back() != material.get())
+                entry.materials.push_back(material.get());
+        }
+    }
+
+    for (auto& [path, entry] : m_Entries)
+    {
+        if (entry.lastUsedScene != m_SceneIndex || !entry.trimmed || entry.reloadTexture)
+            continue;
+
+        // The trimmed texture stays in the materials until the full one is loaded
+        m_TextureCache->UnloadTexture(entry.texture);
+#ifdef DONUT_WITH_TASKFLOW
+        if (executor)
+        {
+            entry.reloadTexture = m_TextureCache->LoadTextureFromFileAsync(path, entry.sRGB, *executor);
+            continue;
+        }
+#endif
+        entry.reloadTexture = m_TextureCache->LoadTextureFromFileDeferred(path, entry.sRGB);
+    }
+}
+
+void TextureBudget::EndScene()
+{
+    m_SceneActive = false;
+
+    // The materials are destroyed with the scene
+    for (auto& [path, entry] : m_Entries)
+        entry.materials.clear();
+}
+
+uint64_t TextureBudget::GetTextureSize(const nvrhi::TextureDesc& desc)
+{
+    const nvrhi::FormatInfo& formatInfo = nvrhi::getFormatInfo(desc.format);
+    const uint32_t blockSize = std::max(uint32_t(formatInfo.blockSize), 1u);
+
+    uint64_t size = 0;
+    for (uint32_t mip = 0; mip < desc.mipLevels; mip++)
+    {
+        const uint64_t blocksX = (std::max(desc.width >> mip, 1u) + blockSize - 1) / blockSize;
+        const uint64_t blocksY = (std::max(desc.height >> mip, 1u) + blockSize - 1) / blockSize;
+        const uint64_t depth = desc.dimension == nvrhi::TextureDimension::Texture3D ? std::max(desc.depth >> mip, 1u) : 1;
+        size += blocksX * blocksY * depth * formatInfo.bytesPerBlock;
+    }
+
+    return size * desc.arraySize;
+}
+
+bool TextureBudget::IsUnused(const Entry& entry) const
+{
+    // Only the materials of the current scene use the tracked textures: the earlier scenes are destroyed,
+    // the streamed textures are not tracked, and no scene loads while the budget releases textures
+    return entry.lastUsedScene != m_SceneIndex && !entry.reloadTexture;
+}
+
+bool TextureBudget::Trim(Entry& entry, nvrhi::ICommandList* commandList)
+{
+    const nvrhi::TextureDesc& desc = entry.texture->texture->getDesc();
+    if (desc.dimension != nvrhi::TextureDimension::Texture2D || desc.arraySize != 1)
+        return false;
+
+    uint32_t firstMip = 0;
+    while (firstMip < desc.mipLevels && std::max(desc.width >> firstMip, desc.height >> firstMip) > c_TrimmedMipTailSize)
+        firstMip++;
+
+    if (firstMip == 0 || firstMip == desc.mipLevels)
+        return false;
+
+    nvrhi::TextureDesc trimmedDesc;
+    trimmedDesc.width = std::max(desc.width >> firstMip, 1u);
+    trimmedDesc.height = std::max(desc.height >> firstMip, 1u);
+    trimmedDesc.mipLevels = desc.mipLevels - firstMip;
+    trimmedDesc.format = desc.format;
+    trimmedDesc.debugName = desc.debugName;
+    trimmedDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    trimmedDesc.keepInitialState = true;
+
+    nvrhi::TextureHandle texture = m_Device->createTexture(trimmedDesc);
+    for (uint32_t mip = firstMip; mip < desc.mipLevels; mip++)
+    {
+        commandList->copyTexture(texture, nvrhi::TextureSlice().setMipLevel(mip - firstMip),
+            entry.texture->texture, nvrhi::TextureSlice().setMipLevel(mip));
+    }
+
+    entry.texture->texture = texture;
+    entry.trimmed = true;
+    return true;
+}
+
+bool TextureBudget::Update(nvrhi::ICommandList* commandList, uint64_t byteBudget)
+{
+    bool texturesChanged = false;
+
+    if (!m_SceneActive)
+        return texturesChanged;
+
+    m_Statistics.numTextures = uint32_t(m_Entries.size());
+    m_Statistics.numTrimmed = 0;
+    m_Statistics.residentBytes = 0;
+    m_Statistics.sceneBytes = 0;
+
+    for (auto& [path, entry] : m_Entries)
+    {
+        if (entry.reloadTexture && entry.reloadTexture->texture)
+        {
+            entry.texture->texture = entry.reloadTexture->texture;
+            entry.texture = std::move(entry.reloadTexture);
+            entry.trimmed = false;
+            m_Statistics.reloads++;
+
+            for (Material* material : entry.materials)
+                material->dirty = true;
+            texturesChanged = true;
+        }
+
+        if (entry.texture->texture != entry.measuredTexture)
+        {
+            entry.measuredTexture = entry.texture->texture;
+            entry.bytes = entry.measuredTexture ? GetTextureSize(entry.measuredTexture->getDesc()) : 0;
+        }
+
+        m_Statistics.residentBytes += entry.bytes;
+        if (entry.lastUsedScene == m_SceneIndex)
+            m_Statistics.sceneBytes += entry.bytes;
+        if (entry.trimmed)
+            m_Statistics.numTrimmed++;
+    }
+
+    if (m_Statistics.residentBytes <= byteBudget)
+        return texturesChanged;
+
+    std::vector<std::unordered_map<std::string, Entry>::iterator> candidates;
+    for (auto it = m_Entries.begin(); it != m_Entries.end(); ++it)
+    {
+        if (IsUnused(it->second) && it->second.bytes > 0)
+            candidates.push_back(it);
+    }
+
+    // Least recently used first, the larger ones first within a scene
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b)
+    {
+        if (a->second.lastUsedScene != b->second.lastUsedScene)
+            return a->second.lastUsedScene < b->second.lastUsedScene;
+        return a->second.bytes > b->second.bytes;
+    });
+
+    uint32_t trims = 0;
+    for (auto& it : candidates)
+    {
+        if (m_Statistics.residentBytes <= byteBudget)
+            break;
+
+        Entry& entry = it->second;
+        if (entry.trimmed || !Trim(entry, commandList))
+            continue;
+
+        const uint64_t trimmedBytes = GetTextureSize(entry.texture->texture->getDesc());
+        m_Statistics.residentBytes -= entry.bytes - trimmedBytes;
+        entry.bytes = trimmedBytes;
+        entry.measuredTexture = entry.texture->texture;
+        m_Statistics.numTrimmed++;
+        trims++;
+    }
+
+    uint32_t evictions = 0;
+    for (auto& it : candidates)
+    {
+        if (m_Statistics.residentBytes <= byteBudget)
+            break;
+
+        m_TextureCache->UnloadTexture(it->second.texture);
+        m_Statistics.residentBytes -= it->second.bytes;
+        if (it->second.trimmed)
+            m_Statistics.numTrimmed--;
+
+        m_EvictedPaths.insert(it->first);
+        m_Entries.erase(it);
+        evictions++;
+    }
+
+    m_Statistics.numTextures = uint32_t(m_Entries.size());
+    m_Statistics.trims += trims;
+    m_Statistics.evictions += evictions;
+
+    if (trims || evictions)
+    {
+        log::info("Texture budget: trimmed %d and unloaded %d textures, %.1f MB resident of %.1f MB", int(trims), int(evictions),
+            double(m_Statistics.residentBytes) / double(1 << 20), double(byteBudget) / double(1 << 20));
+    }
+
+    return texturesChanged;
+}
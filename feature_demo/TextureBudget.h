@@ -0,0 +1,116 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "SceneCache.h"
+#include <donut/engine/SceneGraph.h>
+#include <nvrhi/nvrhi.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace donut::engine
+{
+    class TextureCache;
+}
+
+namespace tf
+{
+    class Executor;
+}
+
+// Largest mip, in texels, that a texture keeps when it is trimmed to stay within the budget
+constexpr uint32_t c_TrimmedMipTailSize = 64;
+
+// Keeps the material textures that the texture cache holds across scene loads within a memory budget.
+// Textures that the current scene does not use are released in the order of the scene that used them last,
+// oldest first: they are first trimmed to their mips up to c_TrimmedMipTailSize, which stay in the cache
+// for a quick return to that scene, and are unloaded from the cache only when trimming is not enough.
+// A trimmed texture that a new scene uses is rendered with its mip tail until the file is loaded again.
+class TextureBudget
+{
+public:
+    struct Statistics
+    {
+        uint32_t numTextures = 0;
+        uint32_t numTrimmed = 0;
+        uint64_t residentBytes = 0;
+        uint64_t sceneBytes = 0;    // used by the current scene, never released
+        uint32_t trims = 0;
+        uint32_t evictions = 0;     // textures unloaded from the cache
+        uint32_t reloads = 0;       // trimmed or unloaded textures that a later scene loaded again
+    };
+
+    TextureBudget(nvrhi::IDevice* device, std::shared_ptr<donut::engine::TextureCache> textureCache);
+
+    // Marks the textures of the scene materials as used by the current scene, and requests the full files of the
+    // ones that were trimmed. The streamed textures are owned by the texture streamer and are not tracked.
+    // The executor decodes the requested files, it may be null.
+    void BeginScene(const donut::engine::SceneGraph& sceneGraph, const std::vector<CachedScene::DeferredTexture>& streamedTextures,
+        tf::Executor* executor);
+
+    // Called when the current scene is unloaded. The next scene takes textures from the cache while it loads,
+    // before BeginScene marks them as used, so nothing is measured or released until then.
+    void EndScene();
+
+    // Measures the loaded textures and releases unused ones until the resident size is within the budget.
+    // Marks the materials that use reloaded textures as dirty and returns true in that case, the material
+    // binding sets must be created again.
+    bool Update(nvrhi::ICommandList* commandList, uint64_t byteBudget);
+
+    const Statistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<donut::engine::LoadedTexture> texture;
+        bool sRGB = false;
+        uint64_t lastUsedScene = 0;
+        std::vector<donut::engine::Material*> materials; // of the current scene
+
+        nvrhi::ITexture* measuredTexture = nullptr;
+        uint64_t bytes = 0;
+        bool trimmed = false;
+
+        // Full texture requested from the cache for a trimmed one
+        std::shared_ptr<donut::engine::LoadedTexture> reloadTexture;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    std::shared_ptr<donut::engine::TextureCache> m_TextureCache;
+
+    // By file path, like the texture cache
+    std::unordered_map<std::string, Entry> m_Entries;
+    std::unordered_set<std::string> m_EvictedPaths;
+    uint64_t m_SceneIndex = 0;
+    bool m_SceneActive = false;     // between BeginScene and EndScene
+    Statistics m_Statistics;
+
+    static uint64_t GetTextureSize(const nvrhi::TextureDesc& desc);
+
+    bool IsUnused(const Entry& entry) const;
+    // Replaces the texture with one that has only the mips up to c_TrimmedMipTailSize, returns false if it has no larger mips
+    bool Trim(Entry& entry, nvrhi::ICommandList* commandList);
+};
@@ -0,0 +1,586 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TextureStreamer.h"
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/engine/TextureCache.h>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+
+// Textures requested from the texture cache in one frame. They are decoded on the executor
+// and uploaded within the time limit of the texture cache, so they do not count against the byte budget.
+constexpr uint32_t c_MaxCacheRequestsPerFrame = 4;
+
+constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+{
+    return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
+constexpr uint32_t c_DdsMagic = MakeFourCC('D', 'D', 'S', ' ');
+constexpr uint32_t c_DdsPixelFormatFourCC = 0x4;
+constexpr uint32_t c_DdsPixelFormatRGB = 0x40;
+constexpr uint32_t c_DdsCaps2Cubemap = 0x200;
+constexpr uint32_t c_DdsCaps2Volume = 0x200000;
+constexpr uint32_t c_DdsDimensionTexture2D = 3;
+
+struct DdsPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask;
+    uint32_t gBitMask;
+    uint32_t bBitMask;
+    uint32_t aBitMask;
+};
+
+struct DdsHeader
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DdsPixelFormat pixelFormat;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+static_assert(sizeof(DdsHeader) == 124, "The DDS header must match the file layout");
+
+struct DdsHeaderDxt10
+{
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+struct DdsFormatInfo
+{
+    uint32_t dxgiFormat;
+    nvrhi::Format format;
+    nvrhi::Format srgbFormat;
+    uint32_t blockSize;
+    uint32_t bytesPerBlock;
+};
+
+// The formats that are streamed, other files are loaded by the texture cache
+static const DdsFormatInfo c_DdsFormats[] = {
+    { 28, nvrhi::Format::RGBA8_UNORM,    nvrhi::Format::SRGBA8_UNORM,   1, 4 },
+    { 29, nvrhi::Format::SRGBA8_UNORM,   nvrhi::Format::SRGBA8_UNORM,   1, 4 },
+    { 87, nvrhi::Format::BGRA8_UNORM,    nvrhi::Format::SBGRA8_UNORM,   1, 4 },
+    { 91, nvrhi::Format::SBGRA8_UNORM,   nvrhi::Format::SBGRA8_UNORM,   1, 4 },
+    { 71, nvrhi::Format::BC1_UNORM,      nvrhi::Format::BC1_UNORM_SRGB, 4, 8 },
+    { 72, nvrhi::Format::BC1_UNORM_SRGB, nvrhi::Format::BC1_UNORM_SRGB, 4, 8 },
+    { 74, nvrhi::Format::BC2_UNORM,      nvrhi::Format::BC2_UNORM_SRGB, 4, 16 },
+    { 75, nvrhi::Format::BC2_UNORM_SRGB, nvrhi::Format::BC2_UNORM_SRGB, 4, 16 },
+    { 77, nvrhi::Format::BC3_UNORM,      nvrhi::Format::BC3_UNORM_SRGB, 4, 16 },
+    { 78, nvrhi::Format::BC3_UNORM_SRGB, nvrhi::Format::BC3_UNORM_SRGB, 4, 16 },
+    { 80, nvrhi::Format::BC4_UNORM,      nvrhi::Format::BC4_UNORM,      4, 8 },
+    { 81, nvrhi::Format::BC4_SNORM,      nvrhi::Format::BC4_SNORM,      4, 8 },
+    { 83, nvrhi::Format::BC5_UNORM,      nvrhi::Format::BC5_UNORM,      4, 16 },
+    { 84, nvrhi::Format::BC5_SNORM,      nvrhi::Format::BC5_SNORM,      4, 16 },
+    { 95, nvrhi::Format::BC6H_UFLOAT,    nvrhi::Format::BC6H_UFLOAT,    4, 16 },
+    { 96, nvrhi::Format::BC6H_SFLOAT,    nvrhi::Format::BC6H_SFLOAT,    4, 16 },
+    { 98, nvrhi::Format::BC7_UNORM,      nvrhi::Format::BC7_UNORM_SRGB, 4, 16 },
+    { 99, nvrhi::Format::BC7_UNORM_SRGB, nvrhi::Format::BC7_UNORM_SRGB, 4, 16 },
+};
+
+// DXGI format of the files without the DX10 header
+static uint32_t GetLegacyDxgiFormat(const DdsPixelFormat& pixelFormat)
+{
+    if (pixelFormat.flags & c_DdsPixelFormatFourCC)
+    {
+        switch (pixelFormat.fourCC)
+        {
+        case MakeFourCC('D', 'X', 'T', '1'): return 71;
+        case MakeFourCC('D', 'X', 'T', '2'):
+        case MakeFourCC('D', 'X', 'T', '3'): return 74;
+        case MakeFourCC('D', 'X', 'T', '4'):
+        case MakeFourCC('D', 'X', 'T', '5'): return 77;
+        case MakeFourCC('A', 'T', 'I', '1'):
+        case MakeFourCC('B', 'C', '4', 'U'): return 80;
+        case MakeFourCC('B', 'C', '4', 'S'): return 81;
+        case MakeFourCC('A', 'T', 'I', '2'):
+        case MakeFourCC('B', 'C', '5', 'U'): return 83;
+        case MakeFourCC('B', 'C', '5', 'S'): return 84;
+        default: return 0;
+        }
+    }
+
+    if ((pixelFormat.flags & c_DdsPixelFormatRGB) && pixelFormat.rgbBitCount == 32)
+    {
+        if (pixelFormat.rBitMask == 0x000000ff && pixelFormat.gBitMask == 0x0000ff00 && pixelFormat.bBitMask == 0x00ff0000)
+            return 28;
+        if (pixelFormat.rBitMask == 0x00ff0000 && pixelFormat.gBitMask == 0x0000ff00 && pixelFormat.bBitMask == 0x000000ff)
+            return 87;
+    }
+
+    return 0;
+}
+
+static bool IsDdsFile(const std::string& path)
+{
+    if (path.size() < 4)
+        return false;
+
+    std::string extension = path.substr(path.size() - 4);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(tolower(c)); });
+    return extension == ".dds";
+}
+
+bool TextureStreamer::ParseDds(const void* data, size_t size, bool sRGB, DdsLayout& layout)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t magic;
+    DdsHeader header;
+    if (size < sizeof(magic) + sizeof(header))
+        return false;
+
+    memcpy(&magic, bytes, sizeof(magic));
+    memcpy(&header, bytes + sizeof(magic), sizeof(header));
+    if (magic != c_DdsMagic || header.size != sizeof(DdsHeader))
+        return false;
+
+    if ((header.caps2 & (c_DdsCaps2Cubemap | c_DdsCaps2Volume)) != 0 || header.width == 0 || header.height == 0)
+        return false;
+
+    uint64_t dataOffset = sizeof(magic) + sizeof(header);
+    uint32_t dxgiFormat;
+    if ((header.pixelFormat.flags & c_DdsPixelFormatFourCC) && header.pixelFormat.fourCC == MakeFourCC('D', 'X', '1', '0'))
+    {
+        DdsHeaderDxt10 header10;
+        if (size < dataOffset + sizeof(header10))
+            return false;
+
+        memcpy(&header10, bytes + dataOffset, sizeof(header10));
+        dataOffset += sizeof(header10);
+
+        if (header10.resourceDimension != c_DdsDimensionTexture2D || header10.arraySize > 1 || (header10.miscFlag & 0x4) != 0)
+            return false;
+
+        dxgiFormat = header10.dxgiFormat;
+    }
+    else
+        dxgiFormat = GetLegacyDxgiFormat(header.pixelFormat);
+
+    const DdsFormatInfo* formatInfo = nullptr;
+    for (const DdsFormatInfo& info : c_DdsFormats)
+    {
+        if (info.dxgiFormat == dxgiFormat)
+        {
+            formatInfo = &info;
+            break;
+        }
+    }
+
+    if (!formatInfo)
+        return false;
+
+    layout.format = sRGB ? formatInfo->srgbFormat : formatInfo->format;
+    layout.width = header.width;
+    layout.height = header.height;
+    layout.mipLevels = std::max(header.mipMapCount, 1u);
+    layout.blockSize = formatInfo->blockSize;
+    layout.bytesPerBlock = formatInfo->bytesPerBlock;
+    layout.dataOffset = dataOffset;
+
+    // The chain can not be longer than the one that ends at 1x1
+    uint32_t fullMipLevels = 1;
+    while ((std::max(layout.width, layout.height) >> fullMipLevels) != 0)
+        fullMipLevels++;
+    layout.mipLevels = std::min(layout.mipLevels, fullMipLevels);
+
+    uint64_t dataSize = 0;
+    for (uint32_t mip = 0; mip < layout.mipLevels; mip++)
+        dataSize += GetMipSize(layout, mip);
+
+    return size >= dataOffset + dataSize;
+}
+
+uint64_t TextureStreamer::GetMipSize(const DdsLayout& layout, uint32_t mip, uint64_t* rowPitch)
+{
+    const uint32_t width = std::max(layout.width >> mip, 1u);
+    const uint32_t height = std::max(layout.height >> mip, 1u);
+    const uint64_t blocksX = (width + layout.blockSize - 1) / layout.blockSize;
+    const uint64_t blocksY = (height + layout.blockSize - 1) / layout.blockSize;
+
+    if (rowPitch)
+        *rowPitch = blocksX * layout.bytesPerBlock;
+
+    return blocksX * blocksY * layout.bytesPerBlock;
+}
+
+bool TextureStreamer::CanStartAt(const DdsLayout& layout, uint32_t mip)
+{
+    // The top mip of a block compressed texture must be a whole number of blocks.
+    // The full chain is created the way the file has it, like the texture cache would do.
+    if (mip == 0 || layout.blockSize == 1)
+        return true;
+
+    const uint32_t width = layout.width >> mip;
+    const uint32_t height = layout.height >> mip;
+    return width != 0 && height != 0 && width % layout.blockSize == 0 && height % layout.blockSize == 0;
+}
+
+TextureStreamer::TextureStreamer(nvrhi::IDevice* device, std::shared_ptr<vfs::IFileSystem> fs, std::shared_ptr<TextureCache> textureCache)
+    : m_Device(device)
+    , m_FileSystem(std::move(fs))
+    , m_TextureCache(std::move(textureCache))
+{
+}
+
+void TextureStreamer::Init(const SceneGraph& sceneGraph, const std::vector<CachedScene::DeferredTexture>& textures,
+    nvrhi::ICommandList* commandList, tf::Executor* executor)
+{
+    Clear();
+    m_Executor = executor;
+
+    std::unordered_map<const LoadedTexture*, uint32_t> entryIndices;
+    for (const CachedScene::DeferredTexture& deferred : textures)
+    {
+        entryIndices[deferred.texture.get()] = uint32_t(m_Entries.size());
+
+        Entry entry;
+        entry.texture = deferred.texture;
+        entry.sRGB = deferred.sRGB;
+        m_Entries.push_back(std::move(entry));
+    }
+
+    const std::shared_ptr<LoadedTexture> Material::* slots[] = {
+        &Material::baseOrDiffuseTexture,
+        &Material::metalRoughOrSpecularTexture,
+        &Material::normalTexture,
+        &Material::emissiveTexture,
+        &Material::occlusionTexture,
+        &Material::transmissionTexture
+    };
+
+    std::unordered_map<const Material*, std::vector<uint32_t>> materialEntries;
+    for (const auto& material : sceneGraph.GetMaterials())
+    {
+        std::vector<uint32_t>& entries = materialEntries[material.get()];
+        for (auto slot : slots)
+        {
+            auto it = entryIndices.find((material.get()->*slot).get());
+            if (it == entryIndices.end())
+                continue;
+
+            entries.push_back(it->second);
+            m_Entries[it->second].materials.push_back(material.get());
+        }
+    }
+
+    for (const auto& instance : sceneGraph.GetMeshInstances())
+    {
+        InstanceTextures instanceTextures;
+        instanceTextures.instance = instance;
+
+        for (const auto& geometry : instance->GetMesh()->geometries)
+        {
+            auto it = materialEntries.find(geometry->material.get());
+            if (it != materialEntries.end())
+                instanceTextures.entries.insert(instanceTextures.entries.end(), it->second.begin(), it->second.end());
+        }
+
+        std::sort(instanceTextures.entries.begin(), instanceTextures.entries.end());
+        instanceTextures.entries.erase(std::unique(instanceTextures.entries.begin(), instanceTextures.entries.end()), instanceTextures.entries.end());
+
+        if (!instanceTextures.entries.empty())
+            m_Instances.push_back(std::move(instanceTextures));
+    }
+
+    m_Statistics.numTextures = uint32_t(m_Entries.size());
+
+    for (uint32_t index = 0; index < uint32_t(m_Entries.size()); index++)
+    {
+        Entry& entry = m_Entries[index];
+        m_Pending.push_back(index);
+
+        if (!IsDdsFile(entry.texture->path))
+            continue;
+
+        // With a mapped file system, the file stays mapped and the mips are written straight from it
+        std::shared_ptr<vfs::IBlob> fileData = m_FileSystem->readFile(entry.texture->path);
+        if (!fileData || !ParseDds(fileData->data(), fileData->size(), entry.sRGB, entry.layout))
+            continue;
+
+        entry.streamed = true;
+        entry.fileData = fileData;
+        entry.residentMip = entry.layout.mipLevels;
+        m_Statistics.numStreamed++;
+
+        uint32_t tailMip = entry.layout.mipLevels;
+        for (uint32_t mip = 0; mip < entry.layout.mipLevels; mip++)
+        {
+            if (std::max(entry.layout.width >> mip, entry.layout.height >> mip) <= c_MipTailSize && CanStartAt(entry.layout, mip))
+            {
+                tailMip = mip;
+                break;
+            }
+        }
+
+        if (tailMip < entry.layout.mipLevels)
+            MakeResident(entry, tailMip, commandList);
+    }
+
+    // Textures whose whole chain fits into the tail are done already
+    m_Pending.erase(std::remove_if(m_Pending.begin(), m_Pending.end(), [this](uint32_t index)
+    {
+        return m_Entries[index].complete;
+    }), m_Pending.end());
+
+    log::info("Streaming %d textures, %d of them mip by mip, %.1f MB of mip tails uploaded", int(m_Statistics.numTextures),
+        int(m_Statistics.numStreamed), double(m_Statistics.uploadedBytes) / double(1 << 20));
+}
+
+void TextureStreamer::Clear()
+{
+    m_Entries.clear();
+    m_Instances.clear();
+    m_Pending.clear();
+    m_Statistics = Statistics();
+    m_Executor = nullptr;
+}
+
+uint64_t TextureStreamer::MakeResident(Entry& entry, uint32_t firstMip, nvrhi::ICommandList* commandList)
+{
+    const DdsLayout& layout = entry.layout;
+
+    nvrhi::TextureDesc desc;
+    desc.width = std::max(layout.width >> firstMip, 1u);
+    desc.height = std::max(layout.height >> firstMip, 1u);
+    desc.mipLevels = layout.mipLevels - firstMip;
+    desc.format = layout.format;
+    desc.debugName = entry.texture->path;
+    desc.initialState = nvrhi::ResourceStates::ShaderResource;
+    desc.keepInitialState = true;
+
+    nvrhi::TextureHandle texture = m_Device->createTexture(desc);
+
+    // The mips that are already resident move to the end of the new chain
+    if (entry.texture->texture)
+    {
+        for (uint32_t mip = entry.residentMip; mip < layout.mipLevels; mip++)
+        {
+            commandList->copyTexture(texture, nvrhi::TextureSlice().setMipLevel(mip - firstMip),
+                entry.texture->texture, nvrhi::TextureSlice().setMipLevel(mip - entry.residentMip));
+        }
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(entry.fileData->data()) + layout.dataOffset;
+    uint64_t uploadedBytes = 0;
+    for (uint32_t mip = 0; mip < entry.residentMip; mip++)
+    {
+        uint64_t rowPitch = 0;
+        const uint64_t mipSize = GetMipSize(layout, mip, &rowPitch);
+
+        if (mip >= firstMip)
+        {
+            commandList->writeTexture(texture, 0, mip - firstMip, data, size_t(rowPitch));
+            uploadedBytes += mipSize;
+        }
+
+        data += mipSize;
+    }
+
+    entry.texture->texture = texture;
+    entry.residentMip = firstMip;
+
+    m_Statistics.uploadedBytes += uploadedBytes;
+    m_Statistics.residentBytes += uploadedBytes;
+
+    if (firstMip == 0)
+        MarkComplete(entry);
+
+    return uploadedBytes;
+}
+
+void TextureStreamer::RequestFromCache(Entry& entry)
+{
+    auto request = std::make_shared<CacheRequest>();
+    entry.cacheRequest = request;
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (m_Executor)
+    {
+        // The deferred load decodes the file on the worker and returns whether it succeeds or not
+        std::shared_ptr<TextureCache> textureCache = m_TextureCache;
+        std::string path = entry.texture->path;
+        bool sRGB = entry.sRGB;
+        m_Executor->async([textureCache, request, path, sRGB]()
+        {
+            request->texture = textureCache->LoadTextureFromFileDeferred(path, sRGB);
+            request->done = true;
+        });
+        return;
+    }
+#endif
+    request->texture = m_TextureCache->LoadTextureFromFileDeferred(entry.texture->path, entry.sRGB);
+    request->done = true;
+}
+
+void TextureStreamer::MarkComplete(Entry& entry)
+{
+    entry.complete = true;
+    entry.fileData.reset();
+    m_Statistics.numComplete++;
+}
+
+bool TextureStreamer::Update(const IView& view, float pixelsPerRadian, nvrhi::ICommandList* commandList, uint64_t byteBudget)
+{
+    m_Statistics.stepsLastFrame = 0;
+    m_Statistics.uploadedBytesLastFrame = 0;
+
+    if (m_Pending.empty())
+        return false;
+
+    bool texturesChanged = false;
+
+    // Placeholders of requested files take the texture once the cache has finalized it. The cache finalizes the loaded
+    // textures on this thread, so a done request that has no texture when all loaded textures are finalized has failed.
+    for (uint32_t index : m_Pending)
+    {
+        Entry& entry = m_Entries[index];
+        if (!entry.cacheRequest || !entry.cacheRequest->done)
+            continue;
+
+        const std::shared_ptr<LoadedTexture>& cacheTexture = entry.cacheRequest->texture;
+        if (cacheTexture && cacheTexture->texture)
+        {
+            entry.texture->texture = cacheTexture->texture;
+            MarkComplete(entry);
+            for (Material* material : entry.materials)
+                material->dirty = true;
+            texturesChanged = true;
+        }
+        else if (m_TextureCache->GetNumberOfFinalizedTextures() >= m_TextureCache->GetNumberOfLoadedTextures())
+        {
+            log::warning("Cannot load the texture '%s', its materials keep the placeholder", entry.texture->path.c_str());
+            m_Statistics.numFailed++;
+            MarkComplete(entry);
+        }
+    }
+
+    for (uint32_t index : m_Pending)
+        m_Entries[index].screenSize = 0.f;
+
+    const frustum viewFrustum = view.GetViewFrustum();
+    const float3 viewOrigin = view.GetViewOrigin();
+
+    for (const InstanceTextures& instanceTextures : m_Instances)
+    {
+        const box3 bounds = instanceTextures.instance->GetNode()->GetGlobalBoundingBox();
+        if (!viewFrustum.intersectsWith(bounds))
+            continue;
+
+        const float radius = length(bounds.diagonal()) * 0.5f;
+        const float distance = std::max(length(bounds.center() - viewOrigin), std::max(radius, 1e-3f));
+        const float screenSize = 2.f * radius / distance * pixelsPerRadian;
+
+        for (uint32_t index : instanceTextures.entries)
+            m_Entries[index].screenSize = std::max(m_Entries[index].screenSize, screenSize);
+    }
+
+    // Steps go first to the textures that cover the most pixels per resident texel.
+    // Textures of invisible instances keep a priority of zero and are loaded after all visible ones.
+    for (uint32_t index : m_Pending)
+    {
+        Entry& entry = m_Entries[index];
+        float residentSize = 1.f;
+        if (entry.streamed && entry.residentMip < entry.layout.mipLevels)
+            residentSize = float(std::max(entry.layout.width >> entry.residentMip, entry.layout.height >> entry.residentMip));
+        entry.priority = entry.screenSize / residentSize;
+    }
+
+    m_Pending.erase(std::remove_if(m_Pending.begin(), m_Pending.end(), [this](uint32_t index)
+    {
+        return m_Entries[index].complete;
+    }), m_Pending.end());
+
+    std::stable_sort(m_Pending.begin(), m_Pending.end(), [this](uint32_t a, uint32_t b)
+    {
+        return m_Entries[a].priority > m_Entries[b].priority;
+    });
+
+    uint32_t cacheRequests = 0;
+    for (uint32_t index : m_Pending)
+    {
+        Entry& entry = m_Entries[index];
+
+        if (!entry.streamed)
+        {
+            if (!entry.cacheRequest && cacheRequests < c_MaxCacheRequestsPerFrame)
+            {
+                RequestFromCache(entry);
+                cacheRequests++;
+                m_Statistics.stepsLastFrame++;
+            }
+            continue;
+        }
+
+        // One step per texture and frame, to the next larger mip that the texture can start at
+        uint32_t firstMip = entry.residentMip - 1;
+        while (!CanStartAt(entry.layout, firstMip))
+            firstMip--;
+
+        uint64_t stepBytes = 0;
+        for (uint32_t mip = firstMip; mip < entry.residentMip; mip++)
+            stepBytes += GetMipSize(entry.layout, mip);
+
+        if (m_Statistics.uploadedBytesLastFrame > 0 && m_Statistics.uploadedBytesLastFrame + stepBytes > byteBudget)
+            break;
+
+        // The old texture is released by the device once the GPU is done with it
+        m_Statistics.uploadedBytesLastFrame += MakeResident(entry, firstMip, commandList);
+        m_Statistics.stepsLastFrame++;
+
+        for (Material* material : entry.materials)
+            material->dirty = true;
+        texturesChanged = true;
+    }
+
+    m_Pending.erase(std::remove_if(m_Pending.begin(), m_Pending.end(), [this](uint32_t index)
+    {
+        return m_Entries[index].complete;
+    }), m_Pending.end());
+
+    return texturesChanged;
+}
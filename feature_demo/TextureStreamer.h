@@ -0,0 +1,157 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "SceneCache.h"
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <nvrhi/nvrhi.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace donut::vfs
+{
+    class IBlob;
+    class IFileSystem;
+}
+
+namespace donut::engine
+{
+    class TextureCache;
+}
+
+namespace tf
+{
+    class Executor;
+}
+
+// Largest mip, in texels, that is made resident when the scene is loaded
+constexpr uint32_t c_MipTailSize = 128;
+
+// Loads the material textures of a scene while the scene is already being rendered, so that the first frame
+// does not wait for them. DDS files with a mip chain are streamed: the mips up to c_MipTailSize are uploaded
+// when the scene is loaded, and each later step creates the texture again with the next larger mip, copies
+// the resident mips into it on the GPU and writes the new mip from the file. Other files are requested from
+// the texture cache, and their texture is copied into the placeholder once the cache has uploaded it.
+// Textures are stepped in the order of the on-screen size of the visible instances that use them,
+// relative to the resolution that is already resident, until the upload budget of the frame is used up.
+// Files that fail to load count as complete, and their materials keep the placeholder.
+// Only scenes loaded from a scene cache are streamed: the glTF loader requests every texture from the texture cache
+// while it loads the scene, so there are no placeholders to take over. Those scenes wait for their textures as before.
+class TextureStreamer
+{
+public:
+    struct Statistics
+    {
+        uint32_t numTextures = 0;
+        uint32_t numStreamed = 0;       // DDS textures that are loaded mip by mip
+        uint32_t numComplete = 0;
+        uint32_t numFailed = 0;         // counted as complete
+        uint32_t stepsLastFrame = 0;
+        uint64_t uploadedBytes = 0;
+        uint64_t uploadedBytesLastFrame = 0;
+        uint64_t residentBytes = 0;     // of the streamed textures
+    };
+
+    TextureStreamer(nvrhi::IDevice* device, std::shared_ptr<donut::vfs::IFileSystem> fs, std::shared_ptr<donut::engine::TextureCache> textureCache);
+
+    // Takes over the placeholder textures of the scene and uploads the mip tails of the streamed ones.
+    // The executor decodes the textures that are requested from the texture cache, it may be null.
+    void Init(const donut::engine::SceneGraph& sceneGraph, const std::vector<CachedScene::DeferredTexture>& textures,
+        nvrhi::ICommandList* commandList, tf::Executor* executor);
+    void Clear();
+
+    // Ranks the textures for the view and takes streaming steps until the byte budget is used up, at least one.
+    // pixelsPerRadian converts the angle covered by an object into its size on screen. Marks the materials that
+    // use changed textures as dirty and returns true in that case, the material binding sets must be created again.
+    bool Update(const donut::engine::IView& view, float pixelsPerRadian, nvrhi::ICommandList* commandList, uint64_t byteBudget);
+
+    bool IsActive() const { return !m_Entries.empty(); }
+    bool IsComplete() const { return m_Statistics.numComplete == m_Statistics.numTextures; }
+    const Statistics& GetStatistics() const { return m_Statistics; }
+
+private:
+    // Layout of a DDS file, the mips of the first array slice follow each other from dataOffset
+    struct DdsLayout
+    {
+        nvrhi::Format format = nvrhi::Format::UNKNOWN;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipLevels = 0;
+        uint32_t blockSize = 1;     // texels per block side, 4 for BC formats
+        uint32_t bytesPerBlock = 0;
+        uint64_t dataOffset = 0;
+    };
+
+    // The texture cache has loaded the file, or failed to, once done is set
+    struct CacheRequest
+    {
+        std::shared_ptr<donut::engine::LoadedTexture> texture;
+        std::atomic<bool> done = false;
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<donut::engine::LoadedTexture> texture;
+        bool sRGB = false;
+        std::vector<donut::engine::Material*> materials;
+        bool complete = false;
+        float screenSize = 0.f;
+        float priority = 0.f;
+
+        // Streamed textures
+        bool streamed = false;
+        std::shared_ptr<donut::vfs::IBlob> fileData; // released when all mips are resident
+        DdsLayout layout;
+        uint32_t residentMip = 0; // largest resident mip, layout.mipLevels when nothing is resident
+
+        // Textures requested from the texture cache
+        std::shared_ptr<CacheRequest> cacheRequest;
+    };
+
+    struct InstanceTextures
+    {
+        std::shared_ptr<donut::engine::MeshInstance> instance;
+        std::vector<uint32_t> entries;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    std::shared_ptr<donut::vfs::IFileSystem> m_FileSystem;
+    std::shared_ptr<donut::engine::TextureCache> m_TextureCache;
+    tf::Executor* m_Executor = nullptr;
+
+    std::vector<Entry> m_Entries;
+    std::vector<InstanceTextures> m_Instances;
+    std::vector<uint32_t> m_Pending;
+    Statistics m_Statistics;
+
+    static bool ParseDds(const void* data, size_t size, bool sRGB, DdsLayout& layout);
+    static uint64_t GetMipSize(const DdsLayout& layout, uint32_t mip, uint64_t* rowPitch = nullptr);
+    static bool CanStartAt(const DdsLayout& layout, uint32_t mip);
+
+    // Creates the texture with the mips from firstMip and fills it from the resident mips and the file
+    uint64_t MakeResident(Entry& entry, uint32_t firstMip, nvrhi::ICommandList* commandList);
+    void RequestFromCache(Entry& entry);
+    void MarkComplete(Entry& entry);
+};
@@ -0,0 +1,406 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TextureTranscoder.h"
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+
+// Increment when the encoders or the mip filters change, which gives the cached files new names
+constexpr uint32_t c_TranscoderVersion = 1;
+
+static const char* const c_TranscodedExtensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+
+// 64-bit hash of the file content, processed in 8-byte words
+static uint64_t HashContent(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ uint64_t(size);
+
+    auto mix = [&hash](uint64_t word)
+    {
+        hash ^= word * 0xBF58476D1CE4E5B9ull;
+        hash = ((hash << 31) | (hash >> 33)) * 0x94D049BB133111EBull;
+    };
+
+    size_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + offset, sizeof(word));
+        mix(word);
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + offset, size - offset);
+    mix(tail);
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static bool HasTranscodedExtension(const std::string& path)
+{
+    std::string extension = std::filesystem::path(path).extension().generic_string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(tolower(c)); });
+
+    for (const char* candidate : c_TranscodedExtensions)
+    {
+        if (extension == candidate)
+            return true;
+    }
+    return false;
+}
+
+static float SrgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSrgb(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+}
+
+static uint8_t ToUnorm8(float value)
+{
+    return uint8_t(std::clamp(lroundf(value * 255.f), 0l, 255l));
+}
+
+// Averages 2x2 pixels of the source, or 2x1 and 1x2 along the axes that are already 1 pixel long
+static void GenerateMip(const uint8_t* source, uint32_t width, uint32_t height, TextureUsage usage, uint8_t* destination)
+{
+    static float srgbToLinear[256];
+    static bool tableInitialized = [] { for (int value = 0; value < 256; value++) srgbToLinear[value] = SrgbToLinear(float(value) / 255.f); return true; }();
+    (void)tableInitialized;
+
+    const uint32_t mipWidth = std::max(width / 2, 1u);
+    const uint32_t mipHeight = std::max(height / 2, 1u);
+
+    for (uint32_t y = 0; y < mipHeight; y++)
+    {
+        for (uint32_t x = 0; x < mipWidth; x++)
+        {
+            const uint32_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+            const uint32_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            const uint8_t* pixels[4] = {
+                source + (size_t(y0) * width + x0) * 4,
+                source + (size_t(y0) * width + x1) * 4,
+                source + (size_t(y1) * width + x0) * 4,
+                source + (size_t(y1) * width + x1) * 4
+            };
+
+            float sum[4] = {};
+            for (const uint8_t* pixel : pixels)
+            {
+                for (int channel = 0; channel < 4; channel++)
+                {
+                    const bool linearize = usage == TextureUsage::Color && channel < 3;
+                    const float value = linearize ? srgbToLinear[pixel[channel]] : float(pixel[channel]) / 255.f;
+                    sum[channel] += usage == TextureUsage::Normal && channel < 3 ? value * 2.f - 1.f : value;
+                }
+            }
+
+            uint8_t* output = destination + (size_t(y) * mipWidth + x) * 4;
+            if (usage == TextureUsage::Normal)
+            {
+                const float length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                const float scale = length > 0.f ? 1.f / length : 0.f;
+                for (int channel = 0; channel < 3; channel++)
+                    output[channel] = ToUnorm8(sum[channel] * scale * 0.5f + 0.5f);
+            }
+            else
+            {
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    const float average = sum[channel] * 0.25f;
+                    output[channel] = ToUnorm8(usage == TextureUsage::Color ? LinearToSrgb(average) : average);
+                }
+            }
+            output[3] = ToUnorm8(sum[3] * 0.25f);
+        }
+    }
+}
+
+static bool WriteDdsFile(const std::filesystem::path& fileName, BcFormat format, uint32_t width, uint32_t height,
+    const std::vector<std::vector<uint8_t>>& mips)
+{
+    uint32_t header[32] = {};
+    header[0] = 0x20534444;                 // "DDS "
+    header[1] = 124;                        // header size
+    header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+    header[3] = height;
+    header[4] = width;
+    header[5] = uint32_t(mips[0].size());
+    header[7] = uint32_t(mips.size());
+    header[19] = 32;                        // pixel format size
+    header[20] = 0x4;                       // four CC
+    header[21] = 0x30315844;                // "DX10"
+    header[27] = 0x1000 | 0x400000 | 0x8;   // texture, mipmap, complex
+
+    const uint32_t header10[5] = {
+        GetBcDxgiFormat(format),
+        3,                                  // 2D texture
+        0,
+        1,                                  // array size
+        0
+    };
+
+    // Written under a temporary name first, so that an interrupted write never leaves a broken cache file
+    std::filesystem::path temporaryFileName = fileName;
+    temporaryFileName += ".tmp";
+
+    {
+        std::ofstream file(temporaryFileName, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(header10), sizeof(header10));
+        for (const auto& mip : mips)
+            file.write(reinterpret_cast<const char*>(mip.data()), std::streamsize(mip.size()));
+
+        if (!file.good())
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryFileName, fileName, error);
+    return !error;
+}
+
+TextureTranscoder::TextureTranscoder(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& cacheFolder,
+    const std::string& mountPoint, tf::Executor* executor)
+    : m_FileSystem(std::move(fs))
+    , m_CacheFolder(cacheFolder)
+    , m_MountPoint(mountPoint)
+    , m_Executor(executor)
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_CacheFolder, error);
+}
+
+BcFormat TextureTranscoder::ChooseFormat(TextureUsage usage, bool hasAlpha)
+{
+    if (usage == TextureUsage::Normal)
+        return BcFormat::BC7;
+
+    return hasAlpha ? BcFormat::BC3 : BcFormat::BC1;
+}
+
+std::string TextureTranscoder::GetTranscodedPath(const std::string& sourcePath, TextureUsage usage)
+{
+    if (!HasTranscodedExtension(sourcePath))
+        return sourcePath;
+
+    std::shared_ptr<vfs::IBlob> sourceData = m_FileSystem->readFile(sourcePath);
+    if (!sourceData || sourceData->size() == 0)
+        return sourcePath;
+
+    const char usageNames[] = { 'c', 'n', 'd' };
+    char cacheName[64];
+    snprintf(cacheName, sizeof(cacheName), "%016llx-%c%u.dds", (unsigned long long)HashContent(sourceData->data(), sourceData->size()),
+        usageNames[int(usage)], c_TranscoderVersion);
+
+    const std::filesystem::path cacheFileName = m_CacheFolder / cacheName;
+    const std::string transcodedPath = m_MountPoint + "/" + cacheName;
+
+    if (std::filesystem::exists(cacheFileName))
+    {
+        m_Statistics.cacheHits++;
+        return transcodedPath;
+    }
+
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    const bool transcoded = Transcode(sourceData->data(), sourceData->size(), usage, cacheFileName);
+    m_Statistics.encodeSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    if (!transcoded)
+    {
+        log::warning("Failed to transcode the texture '%s', loading it uncompressed", sourcePath.c_str());
+        m_Statistics.failed++;
+        return sourcePath;
+    }
+
+    m_Statistics.transcoded++;
+    return transcodedPath;
+}
+
+bool TextureTranscoder::Transcode(const void* sourceData, size_t sourceSize, TextureUsage usage, const std::filesystem::path& cacheFileName)
+{
+    int width = 0, height = 0, components = 0;
+    stbi_uc* pixels = stbi_load_from_memory(static_cast<const stbi_uc*>(sourceData), int(sourceSize), &width, &height, &components, 4);
+    if (!pixels)
+        return false;
+
+    std::vector<uint8_t> level(pixels, pixels + size_t(width) * size_t(height) * 4);
+    stbi_image_free(pixels);
+
+    bool hasAlpha = false;
+    for (size_t offset = 3; offset < level.size(); offset += 4)
+    {
+        if (level[offset] != 255)
+        {
+            hasAlpha = true;
+            break;
+        }
+    }
+
+    const BcFormat format = ChooseFormat(usage, hasAlpha);
+
+    uint32_t mipWidth = uint32_t(width);
+    uint32_t mipHeight = uint32_t(height);
+    std::vector<std::vector<uint8_t>> mips;
+    std::vector<uint8_t> nextLevel;
+
+    while (true)
+    {
+        std::vector<uint8_t>& blocks = mips.emplace_back(GetBcImageSize(format, mipWidth, mipHeight));
+        EncodeBcImage(format, level.data(), mipWidth, mipHeight, blocks.data(), m_Executor);
+
+        if (mipWidth == 1 && mipHeight == 1)
+            break;
+
+        nextLevel.resize(size_t(std::max(mipWidth / 2, 1u)) * size_t(std::max(mipHeight / 2, 1u)) * 4);
+        GenerateMip(level.data(), mipWidth, mipHeight, usage, nextLevel.data());
+        level.swap(nextLevel);
+        mipWidth = std::max(mipWidth / 2, 1u);
+        mipHeight = std::max(mipHeight / 2, 1u);
+    }
+
+    return WriteDdsFile(cacheFileName, format, uint32_t(width), uint32_t(height), mips);
+}
+
+static double ComputePsnr(const uint8_t* reference, const uint8_t* decoded, size_t numPixels, int numChannels)
+{
+    double squaredError = 0.0;
+    for (size_t pixel = 0; pixel < numPixels; pixel++)
+    {
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            const double delta = double(reference[pixel * 4 + channel]) - double(decoded[pixel * 4 + channel]);
+            squaredError += delta * delta;
+        }
+    }
+
+    const double meanSquaredError = squaredError / double(numPixels * numChannels);
+    return meanSquaredError > 0.0 ? 10.0 * log10(255.0 * 255.0 / meanSquaredError) : 99.0;
+}
+
+void RunTextureTranscodingBenchmark(const std::filesystem::path& folder, tf::Executor* executor)
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    struct Image
+    {
+        std::vector<uint8_t> pixels;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    std::vector<Image> images;
+    size_t totalPixels = 0;
+
+    std::error_code error;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(folder, error))
+    {
+        if (!entry.is_regular_file() || !HasTranscodedExtension(entry.path().generic_string()))
+            continue;
+
+        int width = 0, height = 0, components = 0;
+        stbi_uc* pixels = stbi_load(entry.path().generic_string().c_str(), &width, &height, &components, 4);
+        if (!pixels)
+            continue;
+
+        Image& image = images.emplace_back();
+        image.width = uint32_t(width);
+        image.height = uint32_t(height);
+        image.pixels.assign(pixels, pixels + size_t(width) * size_t(height) * 4);
+        stbi_image_free(pixels);
+        totalPixels += size_t(width) * size_t(height);
+    }
+
+    if (images.empty())
+    {
+        log::error("No images found in '%s'", folder.generic_string().c_str());
+        return;
+    }
+
+#ifdef DONUT_WITH_TASKFLOW
+    const int numWorkers = executor ? int(executor->num_workers()) : 1;
+#else
+    const int numWorkers = 1;
+#endif
+
+    log::info("Encoding %d images, %.1f megapixels, with %s block encoders and %d worker threads", int(images.size()),
+        double(totalPixels) * 1e-6, GetBcEncoderInstructionSetName(), numWorkers);
+
+    for (BcFormat format : { BcFormat::BC1, BcFormat::BC3, BcFormat::BC5, BcFormat::BC7 })
+    {
+        const int numChannels = format == BcFormat::BC1 ? 3 : format == BcFormat::BC5 ? 2 : 4;
+        double serialSeconds = 0.0;
+        double parallelSeconds = 0.0;
+        double weightedPsnr = 0.0;
+        size_t compressedSize = 0;
+
+        std::vector<uint8_t> blocks;
+        std::vector<uint8_t> decoded;
+        for (const Image& image : images)
+        {
+            blocks.resize(GetBcImageSize(format, image.width, image.height));
+            decoded.resize(image.pixels.size());
+
+            auto start = clock::now();
+            EncodeBcImage(format, image.pixels.data(), image.width, image.height, blocks.data(), nullptr);
+            auto serialEnd = clock::now();
+            EncodeBcImage(format, image.pixels.data(), image.width, image.height, blocks.data(), executor);
+            auto parallelEnd = clock::now();
+
+            serialSeconds += std::chrono::duration<double>(serialEnd - start).count();
+            parallelSeconds += std::chrono::duration<double>(parallelEnd - serialEnd).count();
+
+            DecodeBcImage(format, blocks.data(), image.width, image.height, decoded.data());
+            const size_t numPixels = size_t(image.width) * size_t(image.height);
+            weightedPsnr += ComputePsnr(image.pixels.data(), decoded.data(), numPixels, numChannels) * double(numPixels);
+            compressedSize += blocks.size();
+        }
+
+        const double megapixels = double(totalPixels) * 1e-6;
+        log::info("%s: %6.1f MP/s on 1 thread, %7.1f MP/s on %d threads, %.2f dB PSNR, %.1f MB instead of %.1f MB",
+            GetBcFormatName(format), megapixels / serialSeconds, megapixels / parallelSeconds, numWorkers,
+            weightedPsnr / double(totalPixels), double(compressedSize) / double(1 << 20), double(totalPixels * 4) / double(1 << 20));
+    }
+}
@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "BcEncoder.h"
+#include <filesystem>
+#include <memory>
+#include <string>
+
+namespace donut::vfs
+{
+    class IFileSystem;
+}
+
+namespace tf
+{
+    class Executor;
+}
+
+// How a material uses a texture, which decides the block compressed format and the mip filter
+enum class TextureUsage
+{
+    Color,  // base color, diffuse, emissive: filtered in linear space
+    Normal, // tangent space normals: renormalized after filtering
+    Data    // metal-rough, specular, occlusion, transmission
+};
+
+// Converts PNG, JPEG, TGA and BMP textures into DDS files with a full chain of block compressed mips.
+// The files are stored in a cache folder under a hash of the source file content, so that later requests
+// for the same content only read and hash the source, and skip decoding and encoding.
+// Color and data textures are BC1, or BC3 when they have alpha. Normal maps are BC7: the material shaders
+// read the Z component from the texture, so the two channels of BC5 would disable the normal map.
+class TextureTranscoder
+{
+public:
+    struct Statistics
+    {
+        uint32_t transcoded = 0;
+        uint32_t cacheHits = 0;
+        uint32_t failed = 0;
+        double encodeSeconds = 0.0;
+    };
+
+    // The cache folder is on disk and is mounted in the root file system at mountPoint
+    TextureTranscoder(std::shared_ptr<donut::vfs::IFileSystem> fs, const std::filesystem::path& cacheFolder,
+        const std::string& mountPoint, tf::Executor* executor);
+
+    // Returns the path of the transcoded file in the root file system. Returns the source path for DDS files
+    // and for files that can not be transcoded, which are then loaded as they are.
+    std::string GetTranscodedPath(const std::string& sourcePath, TextureUsage usage);
+
+    const Statistics& GetStatistics() const { return m_Statistics; }
+    void ResetStatistics() { m_Statistics = Statistics(); }
+
+    static BcFormat ChooseFormat(TextureUsage usage, bool hasAlpha);
+
+private:
+    std::shared_ptr<donut::vfs::IFileSystem> m_FileSystem;
+    std::filesystem::path m_CacheFolder;
+    std::string m_MountPoint;
+    tf::Executor* m_Executor;
+    Statistics m_Statistics;
+
+    bool Transcode(const void* sourceData, size_t sourceSize, TextureUsage usage, const std::filesystem::path& cacheFileName);
+};
+
+// Encodes every image in a folder to each format, once on one thread and once with the executor,
+// and prints the throughput and the PSNR of the decoded blocks to the log
+void RunTextureTranscodingBenchmark(const std::filesystem::path& folder, tf::Executor* executor);
@@ -0,0 +1,257 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TransientResourcePool.h"
+#include <nvrhi/common/misc.h>
+#include <algorithm>
+#include <numeric>
+
+#ifdef DONUT_WITH_DX12
+#include <d3d12.h>
+#endif
+
+#ifdef DONUT_WITH_VULKAN
+// The dispatcher is the one that the device manager initializes
+#ifndef VULKAN_HPP_DISPATCH_LOADER_DYNAMIC
+#define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
+#endif
+#include <vulkan/vulkan.hpp>
+#endif
+
+static bool LifetimesOverlap(const TransientResource& a, const TransientResource& b)
+{
+    return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+}
+
+TransientPlacement PlaceTransientResources(const std::vector<TransientResource>& resources)
+{
+    TransientPlacement placement;
+    placement.offsets.resize(resources.size(), 0);
+
+    std::vector<uint64_t> unaliasedOffsets(resources.size(), 0);
+    for (size_t index = 0; index < resources.size(); index++)
+    {
+        placement.unaliasedSize = nvrhi::align(placement.unaliasedSize, resources[index].alignment);
+        unaliasedOffsets[index] = placement.unaliasedSize;
+        placement.unaliasedSize += resources[index].size;
+    }
+
+    // Largest first, then the longest lifetime, then the order of the resources
+    std::vector<size_t> order(resources.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&resources](size_t a, size_t b)
+    {
+        if (resources[a].size != resources[b].size)
+            return resources[a].size > resources[b].size;
+        return uint64_t(resources[a].lastPass) - resources[a].firstPass > uint64_t(resources[b].lastPass) - resources[b].firstPass;
+    });
+
+    struct Range
+    {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    std::vector<size_t> placed;
+    std::vector<Range> occupied;
+
+    for (size_t index : order)
+    {
+        const TransientResource& resource = resources[index];
+
+        // Memory of the placed resources that are alive at the same time as this one
+        occupied.clear();
+        for (size_t other : placed)
+        {
+            if (LifetimesOverlap(resource, resources[other]))
+                occupied.push_back({ placement.offsets[other], placement.offsets[other] + resources[other].size });
+        }
+
+        std::sort(occupied.begin(), occupied.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+
+        // First fit in the gaps between the occupied ranges
+        uint64_t offset = 0;
+        for (const Range& range : occupied)
+        {
+            offset = nvrhi::align(offset, resource.alignment);
+            if (offset + resource.size <= range.begin)
+                break;
+            offset = std::max(offset, range.end);
+        }
+        offset = nvrhi::align(offset, resource.alignment);
+
+        placement.offsets[index] = offset;
+        placement.heapSize = std::max(placement.heapSize, offset + resource.size);
+        placed.push_back(index);
+    }
+
+    // A large resource with a small alignment placed before a small one with a large alignment can leave
+    // a gap that the order of the resources does not have
+    if (placement.heapSize > placement.unaliasedSize)
+    {
+        placement.offsets = unaliasedOffsets;
+        placement.heapSize = placement.unaliasedSize;
+    }
+
+    return placement;
+}
+
+TransientTexturePool::TransientTexturePool(nvrhi::IDevice* device, bool enableAliasing)
+    : m_Device(device)
+    , m_VirtualResources(device->queryFeatureSupport(nvrhi::Feature::VirtualResources))
+    , m_EnableAliasing(enableAliasing)
+{
+}
+
+nvrhi::TextureHandle TransientTexturePool::CreateTexture(nvrhi::TextureDesc desc, uint32_t firstPass, uint32_t lastPass)
+{
+    desc.isVirtual = m_VirtualResources;
+
+    Entry entry;
+    entry.texture = m_Device->createTexture(desc);
+
+    if (m_VirtualResources)
+    {
+        nvrhi::MemoryRequirements memReq = m_Device->getTextureMemoryRequirements(entry.texture);
+        entry.resource.size = memReq.size;
+        entry.resource.alignment = std::max<uint64_t>(memReq.alignment, 1);
+        entry.resource.firstPass = m_EnableAliasing ? firstPass : 0;
+        entry.resource.lastPass = m_EnableAliasing ? lastPass : c_PersistentLastPass;
+    }
+
+    m_Entries.push_back(entry);
+    return entry.texture;
+}
+
+void TransientTexturePool::Allocate(const char* heapName)
+{
+    if (!m_VirtualResources || m_Entries.empty())
+        return;
+
+    std::vector<TransientResource> resources;
+    resources.reserve(m_Entries.size());
+    for (const Entry& entry : m_Entries)
+        resources.push_back(entry.resource);
+
+    m_Placement = PlaceTransientResources(resources);
+
+    nvrhi::HeapDesc heapDesc;
+    heapDesc.type = nvrhi::HeapType::DeviceLocal;
+    heapDesc.capacity = m_Placement.heapSize;
+    heapDesc.debugName = heapName;
+
+    m_Heap = m_Device->createHeap(heapDesc);
+
+    for (size_t index = 0; index < m_Entries.size(); index++)
+    {
+        Entry& entry = m_Entries[index];
+        m_Device->bindTextureMemory(entry.texture, m_Heap, m_Placement.offsets[index]);
+
+        const uint64_t begin = m_Placement.offsets[index];
+        const uint64_t end = begin + entry.resource.size;
+        for (size_t other = 0; other < m_Entries.size(); other++)
+        {
+            const uint64_t otherBegin = m_Placement.offsets[other];
+            if (other != index && begin < otherBegin + m_Entries[other].resource.size && otherBegin < end)
+                entry.aliased = true;
+        }
+    }
+}
+
+bool TransientTexturePool::IsAliased(nvrhi::ITexture* texture) const
+{
+    for (const Entry& entry : m_Entries)
+    {
+        if (entry.texture == texture)
+            return entry.aliased;
+    }
+    return false;
+}
+
+// Makes the work that follows wait for all earlier work on the queue, including the other command lists
+// of the frame, and makes the memory that it wrote visible. nvrhi only places barriers between uses of
+// the same resource, which do not order the last reads of a texture before the writes of the next
+// texture that shares its memory.
+static void AliasingBarrier(nvrhi::IDevice* device, nvrhi::ICommandList* commandList)
+{
+    commandList->commitBarriers();
+
+#ifdef DONUT_WITH_DX12
+    if (device->getGraphicsAPI() == nvrhi::GraphicsAPI::D3D12)
+    {
+        ID3D12GraphicsCommandList* d3dCommandList = commandList->getNativeObject(nvrhi::ObjectTypes::D3D12_GraphicsCommandList);
+
+        // Without the resources, the barrier covers every placed resource
+        D3D12_RESOURCE_BARRIER barrier = {};
+        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+        d3dCommandList->ResourceBarrier(1, &barrier);
+    }
+#endif
+
+#ifdef DONUT_WITH_VULKAN
+    if (device->getGraphicsAPI() == nvrhi::GraphicsAPI::VULKAN)
+    {
+        vk::CommandBuffer vkCommandBuffer = static_cast<VkCommandBuffer>(commandList->getNativeObject(nvrhi::ObjectTypes::VK_CommandBuffer));
+
+        auto barrier = vk::MemoryBarrier()
+            .setSrcAccessMask(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite);
+        vkCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands,
+            vk::DependencyFlags(), { barrier }, {}, {});
+    }
+#endif
+
+    (void)device;
+}
+
+void TransientTexturePool::BeginPass(nvrhi::ICommandList* commandList, uint32_t pass) const
+{
+    bool barrierPlaced = false;
+
+    for (const Entry& entry : m_Entries)
+    {
+        if (!entry.aliased || entry.resource.firstPass != pass)
+            continue;
+
+        if (!barrierPlaced)
+        {
+            AliasingBarrier(m_Device, commandList);
+            barrierPlaced = true;
+        }
+
+        // Vulkan images keep their layout when the memory is reused. Starting from an unknown state makes
+        // the first transition go from the undefined layout, which discards what the other textures left.
+        // D3D12 tracks the state of placed resources, so they stay in their initial state there.
+        if (m_Device->getGraphicsAPI() == nvrhi::GraphicsAPI::VULKAN)
+            commandList->beginTrackingTextureState(entry.texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Unknown);
+
+        const nvrhi::TextureDesc& desc = entry.texture->getDesc();
+        const nvrhi::FormatInfo& formatInfo = nvrhi::getFormatInfo(desc.format);
+
+        if (formatInfo.hasDepth || formatInfo.hasStencil)
+            commandList->clearDepthStencilTexture(entry.texture, nvrhi::AllSubresources, formatInfo.hasDepth, desc.clearValue.r, formatInfo.hasStencil, uint8_t(desc.clearValue.g));
+        else if (formatInfo.kind == nvrhi::FormatKind::Integer)
+            commandList->clearTextureUInt(entry.texture, nvrhi::AllSubresources, uint32_t(desc.clearValue.r));
+        else
+            commandList->clearTextureFloat(entry.texture, nvrhi::AllSubresources, desc.clearValue);
+    }
+}
@@ -0,0 +1,90 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <cstdint>
+#include <vector>
+
+// Lifetime that covers the whole frame and the frames after it, for resources that keep their content
+constexpr uint32_t c_PersistentLastPass = ~0u;
+
+// A resource that lives from the pass firstPass to the pass lastPass of a frame, both included
+struct TransientResource
+{
+    uint64_t size = 0;
+    uint64_t alignment = 1;
+    uint32_t firstPass = 0;
+    uint32_t lastPass = c_PersistentLastPass;
+};
+
+struct TransientPlacement
+{
+    std::vector<uint64_t> offsets; // in the order of the resources
+    uint64_t heapSize = 0;
+    uint64_t unaliasedSize = 0;    // of the resources placed back to back
+};
+
+// Places the resources in one heap so that resources with overlapping lifetimes never overlap in memory.
+// The resources are placed largest first, each at the lowest aligned offset that is free over its lifetime.
+// When that wastes more on alignment than aliasing saves, they are placed back to back, so the heap is never
+// larger than unaliasedSize. Only depends on the sizes and lifetimes, so the placement is the same on every run.
+TransientPlacement PlaceTransientResources(const std::vector<TransientResource>& resources);
+
+// Creates virtual textures with their lifetimes in the frame, and binds them to one heap where textures
+// that are never used at the same time share memory. The textures must be bound with Allocate before use.
+// Textures that share memory have undefined content at the start of their lifetime: BeginPass places an aliasing
+// barrier and clears them at the start of the pass that their lifetime starts with, which must be called on the
+// command list that records the pass. Without virtual resources, the textures are committed.
+class TransientTexturePool
+{
+public:
+    TransientTexturePool(nvrhi::IDevice* device, bool enableAliasing);
+
+    nvrhi::TextureHandle CreateTexture(nvrhi::TextureDesc desc, uint32_t firstPass, uint32_t lastPass = c_PersistentLastPass);
+    void Allocate(const char* heapName);
+
+    // True if the texture shares memory with another one
+    bool IsAliased(nvrhi::ITexture* texture) const;
+
+    // Waits for the earlier users of the memory and clears every aliased texture whose lifetime starts with the pass, to its clear value
+    void BeginPass(nvrhi::ICommandList* commandList, uint32_t pass) const;
+
+    uint64_t GetHeapSize() const { return m_Placement.heapSize; }
+    uint64_t GetUnaliasedSize() const { return m_Placement.unaliasedSize; }
+
+private:
+    struct Entry
+    {
+        nvrhi::TextureHandle texture;
+        TransientResource resource;
+        bool aliased = false;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    bool m_VirtualResources = false;
+    bool m_EnableAliasing = true;
+    std::vector<Entry> m_Entries;
+    TransientPlacement m_Placement;
+    nvrhi::HeapHandle m_Heap;
+};
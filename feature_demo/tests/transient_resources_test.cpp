@@ -0,0 +1,170 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// CPU-only test of the placement of the transient render targets in one heap. Resources with overlapping
+// lifetimes must never overlap in memory, every offset must be aligned, and the heap must never be
+// larger than the resources placed back to back.
+
+#include "TransientResourcePool.h"
+#include "TestHarness.h"
+#include <iterator>
+#include <random>
+
+static TransientResource MakeResource(uint64_t size, uint64_t alignment, uint32_t firstPass, uint32_t lastPass)
+{
+    TransientResource resource;
+    resource.size = size;
+    resource.alignment = alignment;
+    resource.firstPass = firstPass;
+    resource.lastPass = lastPass;
+    return resource;
+}
+
+// Checks the properties that every placement must have, returns false when one is missing
+static bool CheckPlacement(const char* name, const std::vector<TransientResource>& resources, const TransientPlacement& placement)
+{
+    const int failures = g_Failures;
+
+    CHECK(placement.offsets.size() == resources.size(), "%s: %d offsets for %d resources", name, int(placement.offsets.size()), int(resources.size()));
+    if (placement.offsets.size() != resources.size())
+        return false;
+
+    CHECK(placement.heapSize <= placement.unaliasedSize, "%s: the heap is %llu bytes, more than the %llu bytes of the resources back to back",
+        name, (unsigned long long)placement.heapSize, (unsigned long long)placement.unaliasedSize);
+
+    for (size_t index = 0; index < resources.size(); index++)
+    {
+        const TransientResource& resource = resources[index];
+        const uint64_t offset = placement.offsets[index];
+
+        CHECK(offset % resource.alignment == 0, "%s: resource %d is at %llu, which is not aligned to %llu",
+            name, int(index), (unsigned long long)offset, (unsigned long long)resource.alignment);
+        CHECK(offset + resource.size <= placement.heapSize, "%s: resource %d ends at %llu, after the end of the %llu byte heap",
+            name, int(index), (unsigned long long)(offset + resource.size), (unsigned long long)placement.heapSize);
+
+        for (size_t other = index + 1; other < resources.size(); other++)
+        {
+            const TransientResource& otherResource = resources[other];
+            const bool lifetimesOverlap = resource.firstPass <= otherResource.lastPass && otherResource.firstPass <= resource.lastPass;
+            const bool memoryOverlaps = offset < placement.offsets[other] + otherResource.size && placement.offsets[other] < offset + resource.size;
+
+            CHECK(!lifetimesOverlap || !memoryOverlaps, "%s: resources %d and %d are alive at the same time and overlap in memory",
+                name, int(index), int(other));
+        }
+    }
+
+    return g_Failures == failures;
+}
+
+static void TestDisjointLifetimes()
+{
+    // A and B are never alive at the same time and share memory, C is alive during both
+    const std::vector<TransientResource> resources = {
+        MakeResource(1000, 1, 0, 1),
+        MakeResource(1000, 1, 2, 3),
+        MakeResource(500, 1, 0, 3) };
+
+    const TransientPlacement placement = PlaceTransientResources(resources);
+    CheckPlacement("disjoint lifetimes", resources, placement);
+
+    CHECK(placement.offsets[0] == placement.offsets[1], "A and B are at %llu and %llu, they should share memory",
+        (unsigned long long)placement.offsets[0], (unsigned long long)placement.offsets[1]);
+    CHECK(placement.heapSize == 1500, "the heap is %llu bytes, expected 1500", (unsigned long long)placement.heapSize);
+    CHECK(placement.unaliasedSize == 2500, "the resources take %llu bytes back to back, expected 2500", (unsigned long long)placement.unaliasedSize);
+}
+
+static void TestPersistentResources()
+{
+    // Persistent resources are alive during every pass and never share memory
+    const std::vector<TransientResource> resources = {
+        MakeResource(300, 1, 0, c_PersistentLastPass),
+        MakeResource(700, 1, 5, c_PersistentLastPass),
+        MakeResource(200, 1, 9, 9) };
+
+    const TransientPlacement placement = PlaceTransientResources(resources);
+    CheckPlacement("persistent resources", resources, placement);
+
+    CHECK(placement.heapSize == placement.unaliasedSize, "the heap is %llu bytes, expected all %llu bytes of the resources",
+        (unsigned long long)placement.heapSize, (unsigned long long)placement.unaliasedSize);
+}
+
+static void TestAlignmentGap()
+{
+    // Placing the larger resource first leaves a gap before the aligned one, back to back in this order is smaller
+    const std::vector<TransientResource> resources = {
+        MakeResource(4096, 4096, 0, 1),
+        MakeResource(5000, 1, 0, 1) };
+
+    const TransientPlacement placement = PlaceTransientResources(resources);
+    CheckPlacement("alignment gap", resources, placement);
+
+    CHECK(placement.heapSize == 9096, "the heap is %llu bytes, expected 9096", (unsigned long long)placement.heapSize);
+}
+
+static void TestRandomResources()
+{
+    std::mt19937 random(4321);
+    const uint64_t alignments[] = { 1, 256, 4096, 65536 };
+
+    int numAliasing = 0;
+    for (int test = 0; test < 2000; test++)
+    {
+        const uint32_t numPasses = 1 + random() % 12;
+        const size_t numResources = 1 + random() % 24;
+
+        std::vector<TransientResource> resources;
+        for (size_t index = 0; index < numResources; index++)
+        {
+            const uint64_t alignment = alignments[random() % std::size(alignments)];
+            const uint64_t size = 1 + random() % (1 << 20);
+            const uint32_t firstPass = random() % numPasses;
+            const uint32_t lastPass = (random() % 8 == 0) ? c_PersistentLastPass : firstPass + random() % (numPasses - firstPass);
+            resources.push_back(MakeResource(size, alignment, firstPass, lastPass));
+        }
+
+        const TransientPlacement placement = PlaceTransientResources(resources);
+
+        char name[32];
+        snprintf(name, sizeof(name), "random set %d", test);
+        if (!CheckPlacement(name, resources, placement))
+            break;
+
+        // The same resources give the same placement
+        const TransientPlacement again = PlaceTransientResources(resources);
+        CHECK(again.offsets == placement.offsets && again.heapSize == placement.heapSize, "%s: the placement changes between runs", name);
+
+        if (placement.heapSize < placement.unaliasedSize)
+            numAliasing++;
+    }
+
+    CHECK(numAliasing > 1000, "only %d of 2000 random sets save memory by aliasing", numAliasing);
+}
+
+int main()
+{
+    TestDisjointLifetimes();
+    TestPersistentResources();
+    TestAlignmentGap();
+    TestRandomResources();
+
+    return ReportTestResults("All transient resource placement checks passed");
+}